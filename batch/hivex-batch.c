@@ -0,0 +1,938 @@
+/* hivex-batch - Run one operation over many Windows Registry "hive" files.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <locale.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_FORK
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_LIBINTL_H
+#include <libintl.h>
+#endif
+
+#include <getopt.h>
+
+#include "full-read.h"
+#include "full-write.h"
+#include "ignore-value.h"
+#include "xstrtol.h"
+
+#include "hivex.h"
+#include "timeline-common.h"
+
+#ifdef HAVE_GETTEXT
+#include "gettext.h"
+#define _(str) dgettext(PACKAGE, (str))
+//#define N_(str) dgettext(PACKAGE, (str))
+#else
+#define _(str) str
+//#define N_(str) str
+#endif
+
+#define STREQ(a,b) (strcmp((a),(b)) == 0)
+
+static int op_json (hive_h *h, const char *filename, FILE *fp);
+static int op_timeline (hive_h *h, const char *filename, FILE *fp);
+static int op_get (hive_h *h, const char *filename, FILE *fp);
+
+static const struct operation {
+  const char *name;
+  int nr_args;                  /* Arguments following the name. */
+  int (*run) (hive_h *h, const char *filename, FILE *fp);
+} operations[] = {
+  { "json", 0, op_json },
+  { "timeline", 0, op_timeline },
+  { "get", 1, op_get },
+  { "getval", 2, op_get },
+  { NULL }
+};
+
+static const struct operation *operation;
+static const char *get_key, *get_value;
+static int open_flags = 0;
+static int skip_bad = 0;
+static size_t memory_limit = 0; /* Per handle, 0 = no limit. */
+
+static char **files;
+static size_t nr_files;
+
+/* Each process opens its hives one after another on this context. */
+static hive_context *ctx;
+
+static int run_task (const char *filename, FILE *fp);
+static void read_list (const char *listfile);
+#ifdef HAVE_FORK
+static int run_pool (int jobs);
+#endif
+
+static void
+usage (int status)
+{
+  fprintf (stderr,
+           _("hivex-batch [-dk] [-j jobs] [-m bytes] [-f listfile] json|timeline [hivefile ...]\n"
+             "hivex-batch [-dk] [-j jobs] [-m bytes] [-f listfile] get key [hivefile ...]\n"
+             "hivex-batch [-dk] [-j jobs] [-m bytes] [-f listfile] getval key value [hivefile ...]\n"));
+  exit (status);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+#ifdef HAVE_BINDTEXTDOMAIN
+  bindtextdomain (PACKAGE, LOCALEBASEDIR);
+  textdomain (PACKAGE);
+#endif
+
+  int c, i;
+  int jobs = 1;
+  const char *listfile = NULL;
+  unsigned long long budget = 0;
+  strtol_error xerr;
+  int status = EXIT_SUCCESS;
+
+  while ((c = getopt (argc, argv, "df:j:km:")) != EOF) {
+    switch (c) {
+    case 'd':
+      open_flags |= HIVEX_OPEN_DEBUG;
+      break;
+    case 'f':
+      listfile = optarg;
+      break;
+    case 'j':
+      jobs = atoi (optarg);
+      if (jobs < 1) {
+        fprintf (stderr, _("hivex-batch: -j must be at least 1\n"));
+        usage (EXIT_FAILURE);
+      }
+      break;
+    case 'k':
+      skip_bad = 1;
+      break;
+    case 'm':
+      xerr = xstrtoull (optarg, NULL, 0, &budget, "kKMG");
+      if (xerr != LONGINT_OK || budget == 0) {
+        fprintf (stderr, _("hivex-batch: -m: invalid memory budget: %s\n"),
+                 optarg);
+        usage (EXIT_FAILURE);
+      }
+      break;
+    default:
+      usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf (stderr, _("hivex-batch: expecting an operation\n"));
+    usage (EXIT_FAILURE);
+  }
+  for (operation = operations; operation->name != NULL; ++operation)
+    if (STREQ (operation->name, argv[optind]))
+      break;
+  if (operation->name == NULL) {
+    fprintf (stderr, _("hivex-batch: unknown operation: %s\n"), argv[optind]);
+    usage (EXIT_FAILURE);
+  }
+  optind++;
+  if (argc - optind < operation->nr_args) {
+    fprintf (stderr, _("hivex-batch: %s: missing arguments\n"),
+             operation->name);
+    usage (EXIT_FAILURE);
+  }
+  if (operation->nr_args >= 1)
+    get_key = argv[optind++];
+  if (operation->nr_args >= 2)
+    get_value = argv[optind++];
+
+  if (listfile)
+    read_list (listfile);
+  for (i = optind; i < argc; ++i) {
+    char **p = realloc (files, (nr_files+1) * sizeof (char *));
+    if (p == NULL) {
+      perror ("realloc");
+      exit (EXIT_FAILURE);
+    }
+    files = p;
+    files[nr_files++] = argv[i];
+  }
+  if (nr_files == 0) {
+    fprintf (stderr, _("hivex-batch: expecting the names of hive files\n"));
+    usage (EXIT_FAILURE);
+  }
+
+  if ((size_t) jobs > nr_files)
+    jobs = nr_files;
+
+  /* The memory budget is shared between the workers, each of which
+   * has one hive open at a time.
+   */
+  if (budget > 0) {
+    memory_limit = budget / jobs;
+    if (memory_limit == 0)
+      memory_limit = 1;
+  }
+
+  if (jobs == 1) {
+    size_t n;
+
+    for (n = 0; n < nr_files; ++n) {
+      printf ("==> %s <==\n", files[n]);
+      if (run_task (files[n], stdout) == -1)
+        status = EXIT_FAILURE;
+    }
+  }
+  else {
+#ifdef HAVE_FORK
+    if (run_pool (jobs) == -1)
+      status = EXIT_FAILURE;
+#else
+    fprintf (stderr, _("hivex-batch: -j is not supported on this platform\n"));
+    exit (EXIT_FAILURE);
+#endif
+  }
+
+  if (ctx != NULL)
+    ignore_value (hivex_context_free (ctx));
+
+  if (fflush (stdout) == EOF) {
+    perror ("stdout");
+    exit (EXIT_FAILURE);
+  }
+
+  exit (status);
+}
+
+/* Read the list of hive files, one per line.  "-" means stdin. */
+static void
+read_list (const char *listfile)
+{
+  FILE *fp;
+  char *line = NULL;
+  size_t alloc = 0;
+  ssize_t len;
+
+  fp = STREQ (listfile, "-") ? stdin : fopen (listfile, "r");
+  if (fp == NULL) {
+    fprintf (stderr, "hivex-batch: %s: %m\n", listfile);
+    exit (EXIT_FAILURE);
+  }
+
+  while ((len = getline (&line, &alloc, fp)) != -1) {
+    char **p;
+
+    if (len > 0 && line[len-1] == '\n')
+      line[--len] = '\0';
+    if (len == 0)
+      continue;
+
+    p = realloc (files, (nr_files+1) * sizeof (char *));
+    if (p == NULL) {
+      perror ("realloc");
+      exit (EXIT_FAILURE);
+    }
+    files = p;
+    files[nr_files] = strdup (line);
+    if (files[nr_files] == NULL) {
+      perror ("strdup");
+      exit (EXIT_FAILURE);
+    }
+    nr_files++;
+  }
+
+  free (line);
+  if (fp != stdin)
+    fclose (fp);
+}
+
+/* Open one hive, run the operation on it, and close it. */
+static int
+run_task (const char *filename, FILE *fp)
+{
+  hive_h *h;
+  int r;
+
+  /* hivex_open allocates about 1 byte for every 32 bytes of hive,
+   * before the limit can be set.  Refuse hives which would go over
+   * the budget just by being opened.
+   */
+  if (memory_limit > 0) {
+    struct stat statbuf;
+
+    if (stat (filename, &statbuf) == -1) {
+      fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+      return -1;
+    }
+    if ((uintmax_t) statbuf.st_size / 32 > memory_limit) {
+      fprintf (stderr, _("hivex-batch: %s: hive is too large for the memory budget\n"),
+               filename);
+      return -1;
+    }
+  }
+
+  if (ctx == NULL) {
+    ctx = hivex_context_new (0);
+    if (ctx == NULL) {
+      perror ("hivex_context_new");
+      exit (EXIT_FAILURE);
+    }
+  }
+
+  h = hivex_open_ctx (ctx, filename, open_flags);
+  if (h == NULL) {
+    fprintf (stderr, "hivex_open: %s: %m\n", filename);
+    return -1;
+  }
+
+  if (memory_limit > 0 && hivex_set_memory_limit (h, memory_limit) == -1) {
+    fprintf (stderr, _("hivex-batch: %s: hive is too large for the memory budget\n"),
+             filename);
+    hivex_close (h);
+    return -1;
+  }
+
+  r = operation->run (h, filename, fp);
+
+  hivex_close (h);
+  return r;
+}
+
+#ifdef HAVE_FORK
+
+/* The worker pool.
+ *
+ * Each worker is a child process which reads the index of a hive
+ * from its 'to' pipe, runs the operation with the output going to a
+ * temporary file, and then writes a reply followed by the output to
+ * its 'from' pipe.  The parent copies each output to stdout as soon
+ * as it is complete, so outputs appear in the order that the hives
+ * are finished, each after its own header.
+ *
+ * If a worker dies (for example because a hive made it crash) the
+ * hive it was working on is reported as failed and a new worker is
+ * started in its place.
+ */
+
+struct worker {
+  pid_t pid;
+  int to, from;                 /* Pipes, or -1 if not running. */
+  ssize_t task;                 /* Index of the current hive, or -1. */
+};
+
+struct reply {
+  size_t task;
+  int status;
+  uint64_t len;
+};
+
+static struct worker *workers;
+static int nr_workers;
+
+static void
+worker_main (int to, int from)
+{
+  FILE *fp;
+  size_t task;
+  char buf[BUFSIZ];
+
+  fp = tmpfile ();
+  if (fp == NULL) {
+    perror ("tmpfile");
+    _exit (EXIT_FAILURE);
+  }
+
+  while (full_read (to, &task, sizeof task) == sizeof task) {
+    struct reply reply;
+    size_t n;
+    long len;
+
+    rewind (fp);
+    if (ftruncate (fileno (fp), 0) == -1) {
+      perror ("ftruncate");
+      _exit (EXIT_FAILURE);
+    }
+
+    reply.task = task;
+    reply.status = run_task (files[task], fp);
+    if (fflush (fp) == EOF || (len = ftell (fp)) == -1) {
+      perror ("hivex-batch: temporary file");
+      _exit (EXIT_FAILURE);
+    }
+    reply.len = len;
+
+    if (full_write (from, &reply, sizeof reply) != sizeof reply)
+      _exit (EXIT_FAILURE);
+    rewind (fp);
+    while ((n = fread (buf, 1, sizeof buf, fp)) > 0) {
+      if (full_write (from, buf, n) != n)
+        _exit (EXIT_FAILURE);
+    }
+  }
+
+  /* Every handle was closed by run_task. */
+  if (ctx != NULL)
+    ignore_value (hivex_context_free (ctx));
+  _exit (EXIT_SUCCESS);
+}
+
+static void
+start_worker (struct worker *w)
+{
+  int to[2], from[2];
+  int i;
+
+  if (pipe (to) == -1 || pipe (from) == -1) {
+    perror ("pipe");
+    exit (EXIT_FAILURE);
+  }
+
+  fflush (stdout);
+  w->pid = fork ();
+  if (w->pid == -1) {
+    perror ("fork");
+    exit (EXIT_FAILURE);
+  }
+
+  if (w->pid == 0) {
+    /* Close the ends belonging to the parent and to the other
+     * workers, otherwise the other workers won't see end of file.
+     */
+    for (i = 0; i < nr_workers; ++i) {
+      if (&workers[i] != w && workers[i].to >= 0) {
+        close (workers[i].to);
+        close (workers[i].from);
+      }
+    }
+    close (to[1]);
+    close (from[0]);
+    worker_main (to[0], from[1]);
+  }
+
+  close (to[0]);
+  close (from[1]);
+  w->to = to[1];
+  w->from = from[0];
+  w->task = -1;
+}
+
+static void
+stop_worker (struct worker *w)
+{
+  int wstatus;
+
+  close (w->to);
+  close (w->from);
+  w->to = w->from = -1;
+  if (waitpid (w->pid, &wstatus, 0) == -1)
+    perror ("waitpid");
+}
+
+/* Copy the output of a finished hive from a worker to stdout.
+ * Returns -1 if the worker has died.
+ */
+static int
+collect (struct worker *w, int *status)
+{
+  struct reply reply;
+  char buf[BUFSIZ];
+
+  if (full_read (w->from, &reply, sizeof reply) != sizeof reply)
+    return -1;
+
+  printf ("==> %s <==\n", files[reply.task]);
+  while (reply.len > 0) {
+    size_t n = reply.len < sizeof buf ? reply.len : sizeof buf;
+
+    if (full_read (w->from, buf, n) != n)
+      return -1;
+    fwrite (buf, 1, n, stdout);
+    reply.len -= n;
+  }
+  if (reply.status == -1)
+    *status = -1;
+  w->task = -1;
+  return 0;
+}
+
+static int
+run_pool (int jobs)
+{
+  struct pollfd *fds;
+  size_t next = 0, done = 0;
+  int status = 0;
+  int i;
+
+  /* A worker which has died is noticed when reading from it, not by
+   * getting SIGPIPE when writing to it.
+   */
+  signal (SIGPIPE, SIG_IGN);
+
+  nr_workers = jobs;
+  workers = calloc (nr_workers, sizeof (struct worker));
+  fds = calloc (nr_workers, sizeof (struct pollfd));
+  if (workers == NULL || fds == NULL) {
+    perror ("calloc");
+    exit (EXIT_FAILURE);
+  }
+  for (i = 0; i < nr_workers; ++i)
+    workers[i].to = workers[i].from = -1;
+  for (i = 0; i < nr_workers; ++i)
+    start_worker (&workers[i]);
+
+  while (done < nr_files) {
+    /* Give every idle worker a hive. */
+    for (i = 0; i < nr_workers && next < nr_files; ++i) {
+      if (workers[i].task == -1) {
+        /* If the worker has died, writing fails, and this is noticed
+         * when reading the reply below.
+         */
+        workers[i].task = next;
+        ignore_value (full_write (workers[i].to, &next, sizeof next));
+        next++;
+      }
+    }
+
+    for (i = 0; i < nr_workers; ++i) {
+      fds[i].fd = workers[i].task >= 0 ? workers[i].from : -1;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    if (poll (fds, nr_workers, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror ("poll");
+      exit (EXIT_FAILURE);
+    }
+
+    for (i = 0; i < nr_workers; ++i) {
+      if (fds[i].revents == 0)
+        continue;
+
+      if (collect (&workers[i], &status) == -1) {
+        fprintf (stderr, _("hivex-batch: %s: worker process died\n"),
+                 files[workers[i].task]);
+        status = -1;
+        stop_worker (&workers[i]);
+        start_worker (&workers[i]);
+      }
+      done++;
+    }
+  }
+
+  for (i = 0; i < nr_workers; ++i)
+    stop_worker (&workers[i]);
+
+  free (fds);
+  free (workers);
+  return status;
+}
+
+#endif /* HAVE_FORK */
+
+/* Write a JSON string. */
+static void
+print_json_string (FILE *fp, const char *str)
+{
+  const unsigned char *p;
+
+  putc ('"', fp);
+  for (p = (const unsigned char *) str; *p; ++p) {
+    if (*p == '"' || *p == '\\')
+      fprintf (fp, "\\%c", *p);
+    else if (*p < 0x20)
+      fprintf (fp, "\\u%04x", *p);
+    else
+      putc (*p, fp);
+  }
+  putc ('"', fp);
+}
+
+static void
+print_hex (FILE *fp, const char *data, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    fprintf (fp, "%02x", (unsigned char) data[i]);
+}
+
+/* Write the value of a key as a JSON value.  Strings and numbers are
+ * written as such, and anything else as a string of hex digits.
+ */
+static int
+print_json_value (hive_h *h, hive_value_h value, FILE *fp)
+{
+  hive_type t;
+  size_t len;
+  char *data;
+
+  if (hivex_value_type (h, value, &t, &len) == -1)
+    return -1;
+
+  switch (t) {
+  case hive_t_string:
+  case hive_t_expand_string:
+  case hive_t_link: {
+    char *str = hivex_value_string (h, value);
+    if (str == NULL)
+      break;                    /* eg. invalid UTF-16, write as hex */
+    print_json_string (fp, str);
+    free (str);
+    return 0;
+  }
+
+  case hive_t_multiple_strings: {
+    char **strs = hivex_value_multiple_strings (h, value);
+    size_t i;
+    if (strs == NULL)
+      break;
+    putc ('[', fp);
+    for (i = 0; strs[i] != NULL; ++i) {
+      if (i > 0)
+        putc (',', fp);
+      print_json_string (fp, strs[i]);
+      free (strs[i]);
+    }
+    putc (']', fp);
+    free (strs);
+    return 0;
+  }
+
+  case hive_t_dword:
+  case hive_t_dword_be:
+    errno = 0;
+    if (len == 4) {
+      int32_t i = hivex_value_dword (h, value);
+      if (i != -1 || errno == 0) {
+        fprintf (fp, "%" PRIi32, i);
+        return 0;
+      }
+    }
+    break;
+
+  case hive_t_qword:
+    errno = 0;
+    if (len == 8) {
+      int64_t i = hivex_value_qword (h, value);
+      if (i != -1 || errno == 0) {
+        fprintf (fp, "%" PRIi64, i);
+        return 0;
+      }
+    }
+    break;
+
+  default: ;
+  }
+
+  data = hivex_value_value (h, value, &t, &len);
+  if (data == NULL)
+    return -1;
+  putc ('"', fp);
+  print_hex (fp, data, len);
+  putc ('"', fp);
+  free (data);
+  return 0;
+}
+
+static int
+json_node (hive_h *h, void *opaque, hive_node_h node, const char *name)
+{
+  FILE *fp = opaque;
+  char *path;
+  int64_t timestamp;
+  hive_value_h *values;
+  size_t i, n;
+
+  path = hivex_node_path (h, node);
+  if (path == NULL)
+    return skip_bad ? 0 : -1;
+  values = hivex_node_values (h, node);
+  if (values == NULL) {
+    free (path);
+    return skip_bad ? 0 : -1;
+  }
+
+  fprintf (fp, "{\"path\":");
+  print_json_string (fp, path);
+  free (path);
+  errno = 0;
+  timestamp = hivex_node_timestamp (h, node);
+  if (timestamp != -1 || errno == 0)
+    fprintf (fp, ",\"last_write\":%" PRIi64, timestamp);
+  fprintf (fp, ",\"values\":[");
+
+  for (i = n = 0; values[i] != 0; ++i) {
+    char *key;
+    hive_type t;
+    size_t len;
+
+    key = hivex_value_key (h, values[i]);
+    if (key == NULL || hivex_value_type (h, values[i], &t, &len) == -1) {
+      free (key);
+      if (skip_bad)
+        continue;
+      free (values);
+      return -1;
+    }
+
+    if (n++ > 0)
+      putc (',', fp);
+    fprintf (fp, "{\"name\":");
+    print_json_string (fp, key);
+    free (key);
+    fprintf (fp, ",\"type\":%d,\"value\":", (int) t);
+    if (print_json_value (h, values[i], fp) == -1) {
+      /* Keep the line valid JSON. */
+      fprintf (fp, "null}");
+      if (skip_bad)
+        continue;
+      fprintf (fp, "]}\n");
+      free (values);
+      return -1;
+    }
+    putc ('}', fp);
+  }
+
+  fprintf (fp, "]}\n");
+  free (values);
+  return 0;
+}
+
+/* Write one JSON object per line for each key. */
+static int
+op_json (hive_h *h, const char *filename, FILE *fp)
+{
+  struct hivex_visitor visitor = { .node_start = json_node };
+
+  if (hivex_build_path_index (h, 0) == -1 ||
+      hivex_visit (h, &visitor, sizeof visitor, fp,
+                   skip_bad ? HIVEX_VISIT_SKIP_BAD : 0) == -1) {
+    fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/* Write the header and a line for each key, oldest first, as for
+ * hivextimeline -f tsv.
+ */
+static int
+op_timeline (hive_h *h, const char *filename, FILE *fp)
+{
+  hive_node_h *nodes;
+  size_t i;
+  int r = 0;
+
+  if (hivex_build_path_index (h, 0) == -1 ||
+      (nodes = hivex_nodes_modified_between (h, INT64_MIN, INT64_MAX)) == NULL) {
+    fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+    return -1;
+  }
+
+  timeline_print_header (fp, TIMELINE_TSV);
+  for (i = 0; nodes[i] != 0; ++i) {
+    if (timeline_print_key (fp, TIMELINE_TSV, h, nodes[i], NULL, "") == -1) {
+      fprintf (stderr, "hivex-batch: %s: key at 0x%zx: %m\n",
+               filename, nodes[i]);
+      r = -1;
+    }
+  }
+
+  free (nodes);
+  return skip_bad ? 0 : r;
+}
+
+/* Print a value as for hivexget. */
+static int
+print_value (hive_h *h, hive_value_h value, int with_name, FILE *fp)
+{
+  hive_type t;
+  size_t len, i;
+
+  if (with_name) {
+    char *key = hivex_value_key (h, value);
+    if (key == NULL)
+      return -1;
+    if (*key) {
+      putc ('"', fp);
+      for (i = 0; key[i] != 0; ++i) {
+        if (key[i] == '"' || key[i] == '\\')
+          putc ('\\', fp);
+        putc (key[i], fp);
+      }
+      putc ('"', fp);
+    } else
+      fprintf (fp, "\"@\"");    /* default key in regedit files */
+    putc ('=', fp);
+    free (key);
+  }
+
+  if (hivex_value_type (h, value, &t, &len) == -1)
+    return -1;
+
+  switch (t) {
+  case hive_t_string:
+  case hive_t_expand_string:
+  case hive_t_link: {
+    char *str = hivex_value_string (h, value);
+    if (str == NULL)
+      return -1;
+    if (with_name) {
+      if (t != hive_t_string)
+        fprintf (fp, "str(%d):", t);
+      putc ('"', fp);
+      for (i = 0; str[i] != 0; ++i) {
+        if (str[i] == '"' || str[i] == '\\')
+          putc ('\\', fp);
+        putc (str[i], fp);
+      }
+      putc ('"', fp);
+    }
+    else
+      fputs (str, fp);
+    free (str);
+    break;
+  }
+
+  case hive_t_dword:
+  case hive_t_dword_be: {
+    int32_t j = hivex_value_dword (h, value);
+    if (with_name)
+      fprintf (fp, "dword:%08" PRIx32, j);
+    else
+      fprintf (fp, "%" PRIi32, j);
+    break;
+  }
+
+  case hive_t_qword:
+    if (!with_name) {
+      int64_t j = hivex_value_qword (h, value);
+      fprintf (fp, "%" PRIi64, j);
+      break;
+    }
+    /*FALLTHROUGH*/
+
+  default: {
+    unsigned char *data =
+      (unsigned char *) hivex_value_value (h, value, &t, &len);
+    if (data == NULL)
+      return -1;
+    fprintf (fp, "hex(%d):", t);
+    for (i = 0; i < len; ++i) {
+      if (i > 0)
+        putc (',', fp);
+      fprintf (fp, "%02x", data[i]);
+    }
+    free (data);
+    break;
+  }
+  }
+
+  putc ('\n', fp);
+  return 0;
+}
+
+/* Print all the values of a key, or one value. */
+static int
+op_get (hive_h *h, const char *filename, FILE *fp)
+{
+  hive_node_h node;
+  const char *p, *q;
+  size_t i;
+
+  /* Look up the key one component at a time.  Empty components (eg.
+   * a leading backslash) are ignored.
+   */
+  node = hivex_root (h);
+  for (p = get_key; node != 0 && *p; p = *q ? q+1 : q) {
+    char *name;
+
+    q = strchr (p, '\\');
+    if (q == NULL)
+      q = p + strlen (p);
+    if (q == p)
+      continue;
+    name = strndup (p, q - p);
+    if (name == NULL) {
+      perror ("strndup");
+      exit (EXIT_FAILURE);
+    }
+    errno = 0;
+    node = hivex_node_get_child (h, node, name);
+    free (name);
+  }
+  if (node == 0) {
+    if (errno)
+      fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+    else
+      fprintf (stderr, _("hivex-batch: %s: %s: key not found\n"),
+               filename, get_key);
+    return -1;
+  }
+
+  if (get_value) {
+    hive_value_h value;
+
+    errno = 0;
+    value = hivex_node_get_value (h, node,
+                                  STREQ (get_value, "@") ? "" : get_value);
+    if (value == 0) {
+      if (errno)
+        fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+      else
+        fprintf (stderr, _("hivex-batch: %s: %s: value not found\n"),
+                 filename, get_value);
+      return -1;
+    }
+    if (print_value (h, value, 0, fp) == -1) {
+      fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+      return -1;
+    }
+  }
+  else {
+    hive_value_h *values = hivex_node_values (h, node);
+
+    if (values == NULL) {
+      fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+      return -1;
+    }
+    for (i = 0; values[i] != 0; ++i) {
+      if (print_value (h, values[i], 1, fp) == -1 && !skip_bad) {
+        fprintf (stderr, "hivex-batch: %s: %m\n", filename);
+        free (values);
+        return -1;
+      }
+    }
+    free (values);
+  }
+
+  return 0;
+}
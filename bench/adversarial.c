@@ -0,0 +1,803 @@
+/* hivex-adversarial - Check the cost of reading pathological hives.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* This builds hives which are valid as far as hivex is concerned but
+ * are shaped to make the library do as much work as possible: very
+ * deep ri-record chains, ri-records which point back to themselves,
+ * HIVEX_MAX_SUBKEYS fan-outs with long names, HIVEX_MAX_VALUES values
+ * on one key, db-records split into many tiny sub-blocks and deeply
+ * nested keys.  Each hive is opened, visited and searched in a child
+ * process, and the time taken by each phase and the peak memory used
+ * are checked against a budget.  A quadratic algorithm or a missing
+ * limit shows up as a blown budget (or a crash) here rather than in
+ * the field.
+ *
+ * The hives are written by hand rather than with the hivex write
+ * API, because the write API cannot produce most of these shapes.
+ * With -w the hives are only written out, so they can be used with
+ * hivexsh, hivex-bench or other tools.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <hivex.h>
+
+/* These mirror the limits in lib/hivex-internal.h. */
+#define MAX_SUBKEYS     25000
+#define MAX_VALUES      10000
+
+static double time_scale = 1;
+static int verbose = 0;
+
+static void
+die (const char *what)
+{
+  perror (what);
+  exit (EXIT_FAILURE);
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*----------------------------------------------------------------------*/
+/* Hive image builder.  The image is a header followed by a single
+ * hbin page which grows as cells are added.  Offsets returned and
+ * taken by these functions are relative to the start of the page, as
+ * they are stored in the hive.
+ */
+
+struct image {
+  unsigned char *data;
+  size_t len, alloc;
+};
+
+static void
+put_le16 (unsigned char *p, uint16_t v)
+{
+  p[0] = v; p[1] = v >> 8;
+}
+
+static void
+put_le32 (unsigned char *p, uint32_t v)
+{
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void
+put16 (struct image *im, uint32_t off, uint16_t v)
+{
+  put_le16 (im->data + 0x1000 + off, v);
+}
+
+static void
+put32 (struct image *im, uint32_t off, uint32_t v)
+{
+  put_le32 (im->data + 0x1000 + off, v);
+}
+
+static void
+init_image (struct image *im)
+{
+  im->alloc = 1024 * 1024;
+  im->data = calloc (im->alloc, 1);
+  if (im->data == NULL) die ("calloc");
+  im->len = 0x1020;             /* header + hbin page header */
+}
+
+/* Allocate a used cell of at least 'size' bytes, including the
+ * 4 byte length field.
+ */
+static uint32_t
+new_cell (struct image *im, size_t size)
+{
+  uint32_t off;
+
+  size = (size + 7) & ~7;
+  while (im->len + size + 8 > im->alloc) {
+    im->data = realloc (im->data, im->alloc * 2);
+    if (im->data == NULL) die ("realloc");
+    memset (im->data + im->alloc, 0, im->alloc);
+    im->alloc *= 2;
+  }
+  off = im->len - 0x1000;
+  im->len += size;
+  put32 (im, off, - (int32_t) size);
+  return off;
+}
+
+/* Names are ASCII.  If utf16 is set, the name is stored as UTF-16LE
+ * with a Greek letter in front (so it is not representable in
+ * Latin-1) and must be looked up as "\xce\xba" + name.
+ */
+static size_t
+name_len (const char *name, int utf16)
+{
+  return utf16 ? 2 * (strlen (name) + 1) : strlen (name);
+}
+
+static void
+put_name (struct image *im, uint32_t off, const char *name, int utf16)
+{
+  size_t i;
+
+  if (!utf16) {
+    memcpy (im->data + 0x1000 + off, name, strlen (name));
+    return;
+  }
+  put16 (im, off, 0x3ba);
+  for (i = 0; name[i]; ++i)
+    put16 (im, off + 2 + 2*i, (unsigned char) name[i]);
+}
+
+static uint32_t
+new_nk (struct image *im, uint32_t parent, const char *name, int utf16)
+{
+  size_t len = name_len (name, utf16);
+  uint32_t nk = new_cell (im, 0x50 + len);
+
+  memcpy (im->data + 0x1000 + nk + 4, "nk", 2);
+  put16 (im, nk + 0x06, utf16 ? 0 : 0x20);
+  put32 (im, nk + 0x14, parent);
+  put32 (im, nk + 0x20, 0xffffffff); /* subkey_lf */
+  put32 (im, nk + 0x24, 0xffffffff); /* subkey_lf_volatile */
+  put32 (im, nk + 0x2c, 0xffffffff); /* vallist */
+  put32 (im, nk + 0x30, 0xffffffff); /* sk */
+  put32 (im, nk + 0x34, 0xffffffff); /* classname */
+  put16 (im, nk + 0x4c, len);
+  put_name (im, nk + 0x50, name, utf16);
+  return nk;
+}
+
+static void
+set_subkeys (struct image *im, uint32_t nk, uint32_t list, size_t n)
+{
+  put32 (im, nk + 0x18, n);
+  put32 (im, nk + 0x20, list);
+}
+
+static void
+set_values (struct image *im, uint32_t nk, uint32_t list, size_t n)
+{
+  put32 (im, nk + 0x28, n);
+  put32 (im, nk + 0x2c, list);
+}
+
+/* An ri- or li-record. */
+static uint32_t
+new_ri (struct image *im, const char *id, const uint32_t *offsets, size_t n)
+{
+  uint32_t ri = new_cell (im, 8 + 4*n);
+  size_t i;
+
+  memcpy (im->data + 0x1000 + ri + 4, id, 2);
+  put16 (im, ri + 6, n);
+  for (i = 0; i < n; ++i)
+    put32 (im, ri + 8 + 4*i, offsets[i]);
+  return ri;
+}
+
+/* Link children[0..n-1] under nk using lh-records of at most per_lh
+ * entries, and an ri-record above them if more than one is needed.
+ * The hashes are not checked by hivex, so they are left as zero.
+ */
+static void
+link_children (struct image *im, uint32_t nk,
+               const uint32_t *children, size_t n, size_t per_lh)
+{
+  size_t nr_lh = (n + per_lh - 1) / per_lh;
+  uint32_t *lhs = malloc (nr_lh * sizeof (uint32_t));
+  size_t i, j;
+
+  if (lhs == NULL) die ("malloc");
+  for (i = 0; i < nr_lh; ++i) {
+    size_t m = n - i*per_lh < per_lh ? n - i*per_lh : per_lh;
+
+    lhs[i] = new_cell (im, 8 + 8*m);
+    memcpy (im->data + 0x1000 + lhs[i] + 4, "lh", 2);
+    put16 (im, lhs[i] + 6, m);
+    for (j = 0; j < m; ++j)
+      put32 (im, lhs[i] + 8 + 8*j, children[i*per_lh + j]);
+  }
+  set_subkeys (im, nk, nr_lh == 1 ? lhs[0] : new_ri (im, "ri", lhs, nr_lh),
+               n);
+  free (lhs);
+}
+
+static uint32_t
+new_vk (struct image *im, const char *name, hive_type t,
+        uint32_t data_len, uint32_t data_offset)
+{
+  size_t len = strlen (name);
+  uint32_t vk = new_cell (im, 0x18 + len);
+
+  memcpy (im->data + 0x1000 + vk + 4, "vk", 2);
+  put16 (im, vk + 0x06, len);
+  put32 (im, vk + 0x08, data_len);
+  put32 (im, vk + 0x0c, data_offset);
+  put32 (im, vk + 0x10, t);
+  put16 (im, vk + 0x14, 1);     /* ASCII name */
+  memcpy (im->data + 0x1000 + vk + 0x18, name, len);
+  return vk;
+}
+
+static uint32_t
+new_value_list (struct image *im, const uint32_t *values, size_t n)
+{
+  uint32_t list = new_cell (im, 4 + 4*n);
+  size_t i;
+
+  for (i = 0; i < n; ++i)
+    put32 (im, list + 4 + 4*i, values[i]);
+  return list;
+}
+
+/* Pad the page to a multiple of 4K with a free cell, fill in the
+ * page and file headers and write the image out.
+ */
+static void
+write_image (struct image *im, uint32_t root, const char *filename)
+{
+  size_t page_size = (im->len - 0x1000 + 0xfff) & ~0xfff;
+  size_t pad = 0x1000 + page_size - im->len;
+  uint32_t sum = 0;
+  size_t i;
+  FILE *fp;
+
+  if (pad > 0) {
+    uint32_t free_cell = new_cell (im, pad);
+    put32 (im, free_cell, pad);
+  }
+
+  memcpy (im->data + 0x1000, "hbin", 4);
+  put32 (im, 8, page_size);
+
+  memcpy (im->data, "regf", 4);
+  put_le32 (im->data + 0x04, 1);   /* sequence1 */
+  put_le32 (im->data + 0x08, 1);   /* sequence2 */
+  put_le32 (im->data + 0x14, 1);   /* major_ver */
+  put_le32 (im->data + 0x18, 3);   /* minor_ver */
+  put_le32 (im->data + 0x20, 1);   /* unknown6 */
+  put_le32 (im->data + 0x24, root);
+  put_le32 (im->data + 0x28, page_size);
+  put_le32 (im->data + 0x2c, 1);   /* unknown7 */
+  for (i = 0; i < 0x1fc; i += 4) {
+    unsigned char *p = im->data + i;
+    sum ^= p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+  }
+  put_le32 (im->data + 0x1fc, sum);
+
+  fp = fopen (filename, "w");
+  if (fp == NULL) die (filename);
+  if (fwrite (im->data, 1, im->len, fp) != im->len || fclose (fp) == EOF)
+    die (filename);
+}
+
+static uint32_t
+new_root (struct image *im, const char *name)
+{
+  uint32_t root = new_nk (im, 0, name, 0);
+
+  put16 (im, root + 0x06, 0x2c); /* HiveEntry | NoDelete | CompressedName */
+  put32 (im, root + 0x14, root);
+  return root;
+}
+
+/*----------------------------------------------------------------------*/
+/* The test cases.  Each builds a hive and provides a lookup function
+ * which returns -1 if the library did not give the expected answer.
+ */
+
+#define RI_CHAIN_DEPTH (MAX_SUBKEYS - 2)
+#define LONG_NAME_LEN  240
+#define DB_BLOCKS      65535
+#define DB_ALIASES     64
+#define NEST_DEPTH     10000
+
+static const char *
+long_name (size_t i)
+{
+  static char buf[LONG_NAME_LEN + 16];
+
+  memset (buf, 'x', LONG_NAME_LEN);
+  snprintf (buf + LONG_NAME_LEN, 16, "%05zu", i);
+  return buf;
+}
+
+/* A chain of single-entry ri-records, just inside the limit on the
+ * number of intermediate blocks.
+ */
+static uint32_t
+build_ri_chain (struct image *im)
+{
+  uint32_t root = new_root (im, "ri-chain");
+  uint32_t leaf = new_nk (im, root, "leaf", 0);
+  uint32_t list = new_ri (im, "li", &leaf, 1);
+  size_t i;
+
+  for (i = 0; i < RI_CHAIN_DEPTH; ++i)
+    list = new_ri (im, "ri", &list, 1);
+  set_subkeys (im, root, list, 1);
+  return root;
+}
+
+static int
+lookup_ri_chain (hive_h *h)
+{
+  return hivex_node_get_child (h, hivex_root (h), "leaf") ? 0 : -1;
+}
+
+/* An ri-record whose entries all point back to itself. */
+static uint32_t
+build_ri_cycle (struct image *im)
+{
+  uint32_t root = new_root (im, "ri-cycle");
+  uint32_t offsets[1000];
+  uint32_t ri;
+  size_t i;
+
+  ri = new_ri (im, "ri", offsets, 1000);
+  for (i = 0; i < 1000; ++i)
+    put32 (im, ri + 8 + 4*i, ri);
+  set_subkeys (im, root, ri, 1);
+  return root;
+}
+
+static int
+lookup_ri_cycle (hive_h *h)
+{
+  errno = 0;
+  if (hivex_node_get_child (h, hivex_root (h), "leaf") != 0 || errno == 0)
+    return -1;
+  return 0;
+}
+
+/* HIVEX_MAX_SUBKEYS subkeys with long names which differ only at the
+ * end, so every lookup has to decode and compare all of them.
+ */
+static uint32_t
+build_wide_1 (struct image *im, const char *root_name, int utf16)
+{
+  uint32_t root = new_root (im, root_name);
+  uint32_t *children = malloc (MAX_SUBKEYS * sizeof (uint32_t));
+  size_t i;
+
+  if (children == NULL) die ("malloc");
+  for (i = 0; i < MAX_SUBKEYS; ++i)
+    children[i] = new_nk (im, root, long_name (i), utf16);
+  link_children (im, root, children, MAX_SUBKEYS, 500);
+  free (children);
+  return root;
+}
+
+static uint32_t
+build_wide (struct image *im)
+{
+  return build_wide_1 (im, "wide", 0);
+}
+
+static uint32_t
+build_wide_utf16 (struct image *im)
+{
+  return build_wide_1 (im, "wide-utf16", 1);
+}
+
+static int
+lookup_wide_1 (hive_h *h, const char *prefix)
+{
+  char name[LONG_NAME_LEN + 32];
+
+  snprintf (name, sizeof name, "%s%s", prefix, long_name (MAX_SUBKEYS - 1));
+  if (hivex_node_get_child (h, hivex_root (h), name) == 0)
+    return -1;
+  snprintf (name, sizeof name, "%s%s", prefix, long_name (MAX_SUBKEYS));
+  errno = 0;
+  if (hivex_node_get_child (h, hivex_root (h), name) != 0 || errno != 0)
+    return -1;
+  return 0;
+}
+
+static int
+lookup_wide (hive_h *h)
+{
+  return lookup_wide_1 (h, "");
+}
+
+static int
+lookup_wide_utf16 (hive_h *h)
+{
+  return lookup_wide_1 (h, "\xce\xba");
+}
+
+/* HIVEX_MAX_VALUES values with long names on the root key. */
+static uint32_t
+build_values (struct image *im)
+{
+  uint32_t root = new_root (im, "values");
+  uint32_t *values = malloc (MAX_VALUES * sizeof (uint32_t));
+  size_t i;
+
+  if (values == NULL) die ("malloc");
+  for (i = 0; i < MAX_VALUES; ++i)
+    values[i] = new_vk (im, long_name (i), hive_t_REG_DWORD,
+                        0x80000004, i);
+  set_values (im, root, new_value_list (im, values, MAX_VALUES), MAX_VALUES);
+  free (values);
+  return root;
+}
+
+static int
+lookup_values (hive_h *h)
+{
+  if (hivex_node_get_value (h, hivex_root (h),
+                            long_name (MAX_VALUES - 1)) == 0)
+    return -1;
+  errno = 0;
+  if (hivex_node_get_value (h, hivex_root (h), long_name (MAX_VALUES)) != 0 ||
+      errno != 0)
+    return -1;
+  return 0;
+}
+
+/* A db-record split into the largest possible number of sub-blocks,
+ * each holding 8 bytes of data, shared by several values.
+ */
+static uint32_t
+build_db (struct image *im)
+{
+  uint32_t root = new_root (im, "db");
+  uint32_t *blocks = malloc (DB_BLOCKS * sizeof (uint32_t));
+  uint32_t values[DB_ALIASES];
+  uint32_t db;
+  size_t i;
+  char name[16];
+
+  if (blocks == NULL) die ("malloc");
+  for (i = 0; i < DB_BLOCKS; ++i)
+    blocks[i] = new_cell (im, 16);
+  db = new_cell (im, 16);
+  memcpy (im->data + 0x1000 + db + 4, "db", 2);
+  put16 (im, db + 6, DB_BLOCKS);
+  put32 (im, db + 8, new_value_list (im, blocks, DB_BLOCKS));
+  free (blocks);
+
+  for (i = 0; i < DB_ALIASES; ++i) {
+    snprintf (name, sizeof name, "v%zu", i);
+    values[i] = new_vk (im, name, hive_t_REG_BINARY, DB_BLOCKS * 8, db);
+  }
+  set_values (im, root, new_value_list (im, values, DB_ALIASES), DB_ALIASES);
+  return root;
+}
+
+static int
+lookup_db (hive_h *h)
+{
+  hive_value_h v = hivex_node_get_value (h, hivex_root (h), "v0");
+  hive_type t;
+  size_t len;
+  char *data;
+
+  if (v == 0)
+    return -1;
+  data = hivex_value_value (h, v, &t, &len);
+  if (data == NULL || len != DB_BLOCKS * 8) {
+    free (data);
+    return -1;
+  }
+  free (data);
+  return 0;
+}
+
+/* Keys nested NEST_DEPTH deep. */
+static uint32_t
+build_deep (struct image *im)
+{
+  uint32_t root = new_root (im, "deep");
+  uint32_t parent = root, child;
+  size_t i;
+
+  for (i = 0; i < NEST_DEPTH; ++i) {
+    child = new_nk (im, parent, "k", 0);
+    set_subkeys (im, parent, new_ri (im, "li", &child, 1), 1);
+    parent = child;
+  }
+  return root;
+}
+
+static int
+lookup_deep (hive_h *h)
+{
+  hive_node_h node = hivex_root (h);
+  size_t i;
+
+  for (i = 0; i < NEST_DEPTH; ++i) {
+    node = hivex_node_get_child (h, node, "k");
+    if (node == 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* Budgets are in milliseconds and kilobytes.  They are deliberately
+ * generous (roughly 10 times what an optimized build needs on a
+ * current machine) so that they only trip on an algorithmic
+ * regression.  Use -s on slow machines or under valgrind.
+ */
+struct test {
+  const char *name;
+  uint32_t (*build) (struct image *im);
+  int (*lookup) (hive_h *h);
+  int lookups;                  /* number of calls to lookup */
+  double open_ms, visit_ms, lookup_ms;
+  long maxrss_kb;
+};
+
+static const struct test tests[] = {
+  { "ri-chain", build_ri_chain, lookup_ri_chain, 10,
+    250, 250, 250, 16*1024 },
+  { "ri-cycle", build_ri_cycle, lookup_ri_cycle, 10,
+    250, 250, 250, 16*1024 },
+  { "wide", build_wide, lookup_wide, 2,
+    250, 1000, 2500, 32*1024 },
+  { "wide-utf16", build_wide_utf16, lookup_wide_utf16, 2,
+    250, 1000, 3000, 48*1024 },
+  { "values", build_values, lookup_values, 2,
+    250, 500, 1000, 16*1024 },
+  { "db", build_db, lookup_db, 10,
+    250, 500, 250, 16*1024 },
+  { "deep", build_deep, lookup_deep, 1,
+    250, 250, 250, 16*1024 },
+};
+#define NR_TESTS (sizeof tests / sizeof tests[0])
+
+static void
+build (const struct test *t, const char *filename)
+{
+  struct image im;
+  uint32_t root;
+
+  init_image (&im);
+  root = t->build (&im);
+  write_image (&im, root, filename);
+  free (im.data);
+}
+
+static int
+value_any (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+           hive_type t, size_t len, const char *key, const char *str)
+{
+  size_t *n = opaque;
+
+  (*n)++;
+  return 0;
+}
+
+static int
+check_time (const struct test *t, const char *phase, double secs,
+            double budget_ms)
+{
+  if (verbose)
+    printf ("%s: %s %.1f ms\n", t->name, phase, secs * 1000);
+  if (secs * 1000 > budget_ms * time_scale) {
+    fprintf (stderr, "%s: %s took %.1f ms (budget %.0f ms)\n",
+             t->name, phase, secs * 1000, budget_ms * time_scale);
+    return -1;
+  }
+  return 0;
+}
+
+/* Runs in the child process.  Returns the exit status. */
+static int
+run (const struct test *t, const char *filename)
+{
+  struct hivex_visitor visitor = { .value_any = value_any };
+  size_t nr_values = 0;
+  hive_h *h;
+  double start;
+  int i, ret = EXIT_SUCCESS;
+
+  /* Give up on a hang rather than blocking 'make check-adversarial'. */
+  alarm (60 * time_scale);
+
+  start = now ();
+  h = hivex_open (filename, 0);
+  if (h == NULL) {
+    fprintf (stderr, "%s: hivex_open: %s\n", t->name, strerror (errno));
+    return EXIT_FAILURE;
+  }
+  if (check_time (t, "open", now () - start, t->open_ms) == -1)
+    ret = EXIT_FAILURE;
+
+  /* Errors are expected on some of these hives, only the time taken
+   * matters.
+   */
+  start = now ();
+  hivex_visit (h, &visitor, sizeof visitor, &nr_values,
+               HIVEX_VISIT_SKIP_BAD);
+  if (check_time (t, "visit", now () - start, t->visit_ms) == -1)
+    ret = EXIT_FAILURE;
+
+  start = now ();
+  for (i = 0; i < t->lookups; ++i) {
+    if (t->lookup (h) == -1) {
+      fprintf (stderr, "%s: lookup gave an unexpected result\n", t->name);
+      ret = EXIT_FAILURE;
+      break;
+    }
+  }
+  if (check_time (t, "lookup", now () - start, t->lookup_ms) == -1)
+    ret = EXIT_FAILURE;
+
+  hivex_close (h);
+  return ret;
+}
+
+static int
+run_test (const struct test *t, const char *dir)
+{
+  char filename[4096];
+  struct rusage ru;
+  pid_t pid;
+  int status, ret = 0;
+
+  snprintf (filename, sizeof filename, "%s/hivex-adversarial-%d-%s.hive",
+            dir, (int) getpid (), t->name);
+
+  /* The peak memory of a child includes the peak of its parent at
+   * the time of the fork, so the (large) image is built in a separate
+   * process to keep it out of the measurement.
+   */
+  fflush (stdout);
+  pid = fork ();
+  if (pid == -1) die ("fork");
+  if (pid == 0) {
+    build (t, filename);
+    _exit (EXIT_SUCCESS);
+  }
+  if (waitpid (pid, &status, 0) == -1) die ("waitpid");
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+    fprintf (stderr, "%s: could not build the hive\n", t->name);
+    unlink (filename);
+    return -1;
+  }
+
+  pid = fork ();
+  if (pid == -1) die ("fork");
+  if (pid == 0) {
+    status = run (t, filename);
+    fflush (stdout);
+    _exit (status);
+  }
+
+  if (wait4 (pid, &status, 0, &ru) == -1) die ("wait4");
+  unlink (filename);
+
+  if (WIFSIGNALED (status)) {
+    fprintf (stderr, "%s: killed by signal %d%s\n", t->name,
+             WTERMSIG (status),
+             WTERMSIG (status) == SIGALRM ? " (timed out)" : "");
+    ret = -1;
+  }
+  else if (WEXITSTATUS (status) != 0)
+    ret = -1;
+
+  if (verbose)
+    printf ("%s: maxrss %ld KB\n", t->name, ru.ru_maxrss);
+  if (ru.ru_maxrss > t->maxrss_kb) {
+    fprintf (stderr, "%s: peak memory %ld KB (budget %ld KB)\n",
+             t->name, ru.ru_maxrss, t->maxrss_kb);
+    ret = -1;
+  }
+
+  printf ("%s: %s\n", t->name, ret == 0 ? "ok" : "FAILED");
+  return ret;
+}
+
+static void usage (int status) __attribute__((noreturn));
+
+static void
+usage (int status)
+{
+  size_t i;
+
+  fprintf (stderr,
+           "usage: hivex-adversarial [options] [test ...]\n"
+           "Options:\n"
+           "  -s scale       multiply the time budgets by scale (default 1)\n"
+           "  -v             print the time and memory used by each phase\n"
+           "  -w dir         only write the hives to dir\n"
+           "Tests:\n");
+  for (i = 0; i < NR_TESTS; ++i)
+    fprintf (stderr, "  %s\n", tests[i].name);
+  exit (status);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *tmpdir, *write_dir = NULL;
+  char filename[4096];
+  size_t i;
+  int c, j, failed = 0;
+
+  while ((c = getopt (argc, argv, "s:vw:h")) != -1) {
+    switch (c) {
+    case 's': time_scale = atof (optarg); break;
+    case 'v': verbose = 1; break;
+    case 'w': write_dir = optarg; break;
+    case 'h': usage (EXIT_SUCCESS);
+    default: usage (EXIT_FAILURE);
+    }
+  }
+  if (time_scale <= 0)
+    usage (EXIT_FAILURE);
+
+  for (j = optind; j < argc; ++j) {
+    for (i = 0; i < NR_TESTS; ++i)
+      if (strcmp (argv[j], tests[i].name) == 0)
+        break;
+    if (i == NR_TESTS) {
+      fprintf (stderr, "hivex-adversarial: unknown test: %s\n", argv[j]);
+      usage (EXIT_FAILURE);
+    }
+  }
+
+  tmpdir = getenv ("TMPDIR");
+  if (tmpdir == NULL)
+    tmpdir = "/tmp";
+
+  for (i = 0; i < NR_TESTS; ++i) {
+    if (optind < argc) {
+      for (j = optind; j < argc; ++j)
+        if (strcmp (argv[j], tests[i].name) == 0)
+          break;
+      if (j == argc)
+        continue;
+    }
+
+    if (write_dir) {
+      snprintf (filename, sizeof filename, "%s/%s.hive",
+                write_dir, tests[i].name);
+      build (&tests[i], filename);
+      printf ("%s\n", filename);
+    }
+    else if (run_test (&tests[i], tmpdir) == -1)
+      failed++;
+  }
+
+  exit (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
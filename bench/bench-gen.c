@@ -0,0 +1,280 @@
+/* hivex-bench-gen - Generate hives of a configurable shape for benchmarking.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <hivex.h>
+
+/* Shape of the generated hive.  Every node at depth < depth gets
+ * exactly fanout children, so the hive has roughly fanout^depth
+ * nodes.
+ */
+static int fanout = 8;
+static int depth = 4;
+static int min_values = 0, max_values = 8;
+static int min_size = 4, max_size = 256;
+static double utf16_ratio = 0.1;
+static double db_ratio = 0.01;
+static int db_size = 20000;
+static uint64_t seed = 1;
+
+static size_t nr_nodes, nr_values, nr_bytes;
+
+/* A small private PRNG so that the same seed produces the same hive
+ * on every platform.
+ */
+static uint64_t
+rnd (void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static int
+rnd_range (int min, int max)
+{
+  if (max <= min)
+    return min;
+  return min + (int) (rnd () % (uint64_t) (max - min + 1));
+}
+
+static int
+rnd_chance (double p)
+{
+  return (double) (rnd () >> 11) / (double) (UINT64_C(1) << 53) < p;
+}
+
+/* Names which cannot be represented in Latin-1 are stored as UTF-16
+ * by the library, so the ratio of those is controlled here.
+ */
+static void
+make_name (char *buf, size_t len, const char *prefix, int i)
+{
+  if (rnd_chance (utf16_ratio))
+    snprintf (buf, len, "%s\xce\xba\xce\xbb\xce\xb5\xce\xb9\xce\xb4\xce\xaf %d",
+              prefix, i);
+  else
+    snprintf (buf, len, "%s%d", prefix, i);
+}
+
+static void
+make_value (hive_set_value *val, int i)
+{
+  char name[64];
+  size_t j, len;
+
+  make_name (name, sizeof name, "v", i);
+  val->key = strdup (name);
+  if (val->key == NULL) {
+    perror ("strdup");
+    exit (EXIT_FAILURE);
+  }
+
+  switch (rnd () % 4) {
+  case 0:
+    val->t = hive_t_REG_DWORD;
+    len = 4;
+    break;
+  case 1:
+    val->t = hive_t_REG_QWORD;
+    len = 8;
+    break;
+  case 2:
+    val->t = hive_t_REG_SZ;
+    len = rnd_range (min_size, max_size) & ~1;
+    break;
+  default:
+    val->t = hive_t_REG_BINARY;
+    len = rnd_range (min_size, max_size);
+  }
+
+  /* Values larger than a single cell would normally be stored in a
+   * db record by Windows.
+   */
+  if (val->t != hive_t_REG_DWORD && val->t != hive_t_REG_QWORD &&
+      rnd_chance (db_ratio))
+    len = db_size;
+
+  val->len = len;
+  val->value = malloc (len);
+  if (val->value == NULL) {
+    perror ("malloc");
+    exit (EXIT_FAILURE);
+  }
+
+  if (val->t == hive_t_REG_SZ) {
+    /* UTF-16LE string of printable ASCII, NUL-terminated. */
+    for (j = 0; j + 1 < len; j += 2) {
+      val->value[j] = 'a' + (char) (rnd () % 26);
+      val->value[j+1] = '\0';
+    }
+    if (len >= 2)
+      val->value[len-2] = val->value[len-1] = '\0';
+  }
+  else {
+    for (j = 0; j < len; ++j)
+      val->value[j] = (char) rnd ();
+  }
+
+  nr_bytes += len;
+}
+
+static void
+iter (hive_h *h, int level, hive_node_h parent)
+{
+  int i, n;
+  char name[64];
+  hive_node_h node;
+  hive_set_value *values;
+
+  nr_nodes++;
+
+  if (level < depth) {
+    for (i = 0; i < fanout; ++i) {
+      make_name (name, sizeof name, "k", i);
+      node = hivex_node_add_child (h, parent, name);
+      if (node == 0) {
+        perror ("hivex-bench-gen: hivex_node_add_child");
+        exit (EXIT_FAILURE);
+      }
+      iter (h, level+1, node);
+    }
+  }
+
+  n = rnd_range (min_values, max_values);
+  if (n == 0)
+    return;
+
+  values = malloc (n * sizeof (hive_set_value));
+  if (values == NULL) {
+    perror ("malloc");
+    exit (EXIT_FAILURE);
+  }
+  for (i = 0; i < n; ++i)
+    make_value (&values[i], i);
+
+  if (hivex_node_set_values (h, parent, n, values, 0) == -1) {
+    perror ("hivex-bench-gen: hivex_node_set_values");
+    exit (EXIT_FAILURE);
+  }
+  nr_values += n;
+
+  for (i = 0; i < n; ++i) {
+    free (values[i].key);
+    free (values[i].value);
+  }
+  free (values);
+}
+
+static int
+parse_range (const char *arg, int *min, int *max)
+{
+  if (sscanf (arg, "%d:%d", min, max) == 2)
+    return *min >= 0 && *max >= *min ? 0 : -1;
+  if (sscanf (arg, "%d", min) == 1 && *min >= 0) {
+    *max = *min;
+    return 0;
+  }
+  return -1;
+}
+
+static void usage (int status) __attribute__((noreturn));
+
+static void
+usage (int status)
+{
+  fprintf (stderr,
+           "usage: hivex-bench-gen [options] minimal output\n"
+           "Options:\n"
+           "  -f fanout      children per node (default %d)\n"
+           "  -d depth       depth of the tree (default %d)\n"
+           "  -v min[:max]   values per node (default %d:%d)\n"
+           "  -s min[:max]   size of string and binary values (default %d:%d)\n"
+           "  -u ratio       share of UTF-16 key and value names (default %g)\n"
+           "  -b ratio       share of large values (default %g)\n"
+           "  -B bytes       size of large values (default %d)\n"
+           "  -S seed        random seed (default %" PRIu64 ")\n",
+           fanout, depth, min_values, max_values, min_size, max_size,
+           utf16_ratio, db_ratio, db_size, seed);
+  exit (status);
+}
+
+int
+main (int argc, char *argv[])
+{
+  hive_h *h;
+  int c;
+
+  while ((c = getopt (argc, argv, "f:d:v:s:u:b:B:S:h")) != -1) {
+    switch (c) {
+    case 'f': fanout = atoi (optarg); break;
+    case 'd': depth = atoi (optarg); break;
+    case 'v':
+      if (parse_range (optarg, &min_values, &max_values) == -1)
+        usage (EXIT_FAILURE);
+      break;
+    case 's':
+      if (parse_range (optarg, &min_size, &max_size) == -1)
+        usage (EXIT_FAILURE);
+      break;
+    case 'u': utf16_ratio = atof (optarg); break;
+    case 'b': db_ratio = atof (optarg); break;
+    case 'B': db_size = atoi (optarg); break;
+    case 'S': seed = strtoull (optarg, NULL, 0); break;
+    case 'h': usage (EXIT_SUCCESS);
+    default: usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind + 2 != argc || fanout < 0 || depth < 0 || db_size < 0)
+    usage (EXIT_FAILURE);
+  if (seed == 0)
+    seed = 1;
+
+  h = hivex_open (argv[optind], HIVEX_OPEN_WRITE);
+  if (h == NULL) {
+    perror (argv[optind]);
+    exit (EXIT_FAILURE);
+  }
+
+  iter (h, 0, hivex_root (h));
+
+  if (hivex_commit (h, argv[optind+1], 0) == -1) {
+    perror (argv[optind+1]);
+    exit (EXIT_FAILURE);
+  }
+
+  if (hivex_close (h) == -1) {
+    perror ("hivex-bench-gen: close");
+    exit (EXIT_FAILURE);
+  }
+
+  printf ("%zu nodes, %zu values, %zu bytes of value data\n",
+          nr_nodes, nr_values, nr_bytes);
+
+  exit (EXIT_SUCCESS);
+}
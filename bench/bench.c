@@ -0,0 +1,460 @@
+/* hivex-bench - Time the hot paths of the library against a hive.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <hivex.h>
+
+static int iterations = 5;
+static size_t nr_lookups = 10000;
+static size_t nr_inserts = 1000;
+static uint64_t seed = 1;
+
+static uint64_t
+rnd (void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+die (const char *what)
+{
+  perror (what);
+  exit (EXIT_FAILURE);
+}
+
+/* Every benchmark is run 'iterations' times and the fastest run is
+ * reported, which is the least noisy figure on a busy machine.
+ */
+struct result {
+  const char *name;
+  size_t ops;                   /* operations per iteration */
+  double best, total;           /* seconds */
+};
+
+#define NR_RESULTS 6
+static struct result results[NR_RESULTS];
+static int nr_results;
+
+static struct result *
+new_result (const char *name)
+{
+  struct result *r = &results[nr_results++];
+
+  r->name = name;
+  r->ops = 0;
+  r->best = 0;
+  r->total = 0;
+  return r;
+}
+
+static void
+add_time (struct result *r, double t)
+{
+  if (r->total == 0 || t < r->best)
+    r->best = t;
+  r->total += t;
+}
+
+/* Paths of all nodes, collected once so the lookup benchmark only
+ * measures hivex_node_get_child.
+ */
+static char **paths;
+static size_t nr_paths, paths_alloc;
+
+/* All value handles, for the decoding benchmark. */
+static hive_value_h *all_values;
+static size_t nr_all_values, all_values_alloc;
+
+static void
+collect (hive_h *h, hive_node_h node, const char *path)
+{
+  hive_node_h *children;
+  hive_value_h *values;
+  size_t i;
+
+  if (nr_paths == paths_alloc) {
+    paths_alloc = paths_alloc ? paths_alloc * 2 : 1024;
+    paths = realloc (paths, paths_alloc * sizeof (char *));
+    if (paths == NULL) die ("realloc");
+  }
+  paths[nr_paths] = strdup (path);
+  if (paths[nr_paths] == NULL) die ("strdup");
+  nr_paths++;
+
+  values = hivex_node_values (h, node);
+  if (values == NULL) die ("hivex_node_values");
+  for (i = 0; values[i] != 0; ++i) {
+    if (nr_all_values == all_values_alloc) {
+      all_values_alloc = all_values_alloc ? all_values_alloc * 2 : 1024;
+      all_values = realloc (all_values,
+                            all_values_alloc * sizeof (hive_value_h));
+      if (all_values == NULL) die ("realloc");
+    }
+    all_values[nr_all_values++] = values[i];
+  }
+  free (values);
+
+  children = hivex_node_children (h, node);
+  if (children == NULL) die ("hivex_node_children");
+  for (i = 0; children[i] != 0; ++i) {
+    char *name = hivex_node_name (h, children[i]);
+    char *child_path;
+    if (name == NULL) die ("hivex_node_name");
+    if (asprintf (&child_path, "%s%s%s",
+                  path, path[0] ? "\\" : "", name) == -1)
+      die ("asprintf");
+    free (name);
+    collect (h, children[i], child_path);
+    free (child_path);
+  }
+  free (children);
+}
+
+static hive_node_h
+lookup (hive_h *h, const char *path)
+{
+  hive_node_h node = hivex_root (h);
+  char buf[4096];
+  char *p, *sep;
+
+  if (strlen (path) >= sizeof buf)
+    return 0;
+  strcpy (buf, path);
+
+  for (p = buf; node != 0 && *p; p = sep + 1) {
+    sep = strchr (p, '\\');
+    if (sep)
+      *sep = '\0';
+    node = hivex_node_get_child (h, node, p);
+    if (!sep)
+      break;
+  }
+  return node;
+}
+
+struct visit_counts {
+  size_t nodes, values;
+};
+
+static int
+visit_node (hive_h *h, void *opaque, hive_node_h node, const char *name)
+{
+  struct visit_counts *c = opaque;
+  c->nodes++;
+  return 0;
+}
+
+static int
+visit_string (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+              hive_type t, size_t len, const char *key, const char *str)
+{
+  struct visit_counts *c = opaque;
+  c->values++;
+  return 0;
+}
+
+static int
+visit_multiple_strings (hive_h *h, void *opaque, hive_node_h node,
+                        hive_value_h value, hive_type t, size_t len,
+                        const char *key, char **argv)
+{
+  struct visit_counts *c = opaque;
+  c->values++;
+  return 0;
+}
+
+static int
+visit_dword (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+             hive_type t, size_t len, const char *key, int32_t v)
+{
+  struct visit_counts *c = opaque;
+  c->values++;
+  return 0;
+}
+
+static int
+visit_qword (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+             hive_type t, size_t len, const char *key, int64_t v)
+{
+  struct visit_counts *c = opaque;
+  c->values++;
+  return 0;
+}
+
+static const struct hivex_visitor visitor = {
+  .node_start = visit_node,
+  .value_string = visit_string,
+  .value_multiple_strings = visit_multiple_strings,
+  .value_string_invalid_utf16 = visit_string,
+  .value_dword = visit_dword,
+  .value_qword = visit_qword,
+  .value_binary = visit_string,
+  .value_none = visit_string,
+  .value_other = visit_string,
+};
+
+/* Decode a value the way a typical consumer would. */
+static void
+decode (hive_h *h, hive_value_h value)
+{
+  hive_type t;
+  size_t len;
+  char *s, **ss, *data;
+  size_t i;
+
+  if (hivex_value_type (h, value, &t, &len) == -1)
+    die ("hivex_value_type");
+
+  switch (t) {
+  case hive_t_REG_SZ:
+  case hive_t_REG_EXPAND_SZ:
+  case hive_t_REG_LINK:
+    s = hivex_value_string (h, value);
+    if (s == NULL) die ("hivex_value_string");
+    free (s);
+    break;
+  case hive_t_REG_MULTI_SZ:
+    ss = hivex_value_multiple_strings (h, value);
+    if (ss == NULL) die ("hivex_value_multiple_strings");
+    for (i = 0; ss[i] != NULL; ++i)
+      free (ss[i]);
+    free (ss);
+    break;
+  case hive_t_REG_DWORD:
+  case hive_t_REG_DWORD_BIG_ENDIAN:
+    hivex_value_dword (h, value);
+    break;
+  case hive_t_REG_QWORD:
+    hivex_value_qword (h, value);
+    break;
+  default:
+    data = hivex_value_value (h, value, &t, &len);
+    if (data == NULL) die ("hivex_value_value");
+    free (data);
+  }
+}
+
+static void
+run (const char *filename, const char *tmpdir)
+{
+  struct result *r_open = new_result ("open");
+  struct result *r_visit = new_result ("visit");
+  struct result *r_lookup = new_result ("lookup");
+  struct result *r_decode = new_result ("decode");
+  struct result *r_insert = new_result ("insert");
+  struct result *r_commit = new_result ("commit");
+  hive_h *h;
+  int it;
+  size_t i;
+  double t;
+  char *commit_file;
+  char dword[4] = { 1, 2, 3, 4 };
+  hive_set_value insert_value = {
+    (char *) "Value", hive_t_REG_DWORD, 4, dword
+  };
+
+  if (asprintf (&commit_file, "%s/hivex-bench-%d", tmpdir, (int) getpid ())
+      == -1)
+    die ("asprintf");
+
+  h = hivex_open (filename, 0);
+  if (h == NULL) die (filename);
+  collect (h, hivex_root (h), "");
+  hivex_close (h);
+
+  r_open->ops = 1;
+  r_visit->ops = nr_paths;
+  r_lookup->ops = nr_lookups;
+  r_decode->ops = nr_all_values;
+  r_insert->ops = nr_inserts;
+  r_commit->ops = 1;
+
+  for (it = 0; it < iterations; ++it) {
+    /* Read-only benchmarks. */
+    t = now ();
+    h = hivex_open (filename, 0);
+    if (h == NULL) die (filename);
+    add_time (r_open, now () - t);
+
+    struct visit_counts counts = { 0, 0 };
+    t = now ();
+    if (hivex_visit (h, &visitor, sizeof visitor, &counts, 0) == -1)
+      die ("hivex_visit");
+    add_time (r_visit, now () - t);
+    if (counts.nodes != nr_paths || counts.values != nr_all_values) {
+      fprintf (stderr, "hivex-bench: visit found %zu nodes and %zu values, "
+               "expected %zu and %zu\n",
+               counts.nodes, counts.values, nr_paths, nr_all_values);
+      exit (EXIT_FAILURE);
+    }
+
+    t = now ();
+    for (i = 0; i < nr_lookups; ++i) {
+      const char *path = paths[rnd () % nr_paths];
+
+      /* A key which is not found is 0 without errno set. */
+      errno = 0;
+      if (lookup (h, path) == 0) {
+        if (errno != 0)
+          die ("hivex_node_get_child");
+        fprintf (stderr, "hivex-bench: lookup did not find %s\n", path);
+        exit (EXIT_FAILURE);
+      }
+    }
+    add_time (r_lookup, now () - t);
+
+    t = now ();
+    for (i = 0; i < nr_all_values; ++i)
+      decode (h, all_values[i]);
+    add_time (r_decode, now () - t);
+
+    if (hivex_close (h) == -1) die ("hivex_close");
+
+    /* Write benchmarks. */
+    h = hivex_open (filename, HIVEX_OPEN_WRITE);
+    if (h == NULL) die (filename);
+
+    t = now ();
+    for (i = 0; i < nr_inserts; ++i) {
+      char name[64];
+      hive_node_h node;
+
+      snprintf (name, sizeof name, "hivex-bench %zu", i);
+      node = hivex_node_add_child (h, hivex_root (h), name);
+      if (node == 0) die ("hivex_node_add_child");
+      if (hivex_node_set_values (h, node, 1, &insert_value, 0) == -1)
+        die ("hivex_node_set_values");
+    }
+    add_time (r_insert, now () - t);
+
+    t = now ();
+    if (hivex_commit (h, commit_file, 0) == -1) die (commit_file);
+    add_time (r_commit, now () - t);
+
+    if (hivex_close (h) == -1) die ("hivex_close");
+    unlink (commit_file);
+  }
+
+  free (commit_file);
+}
+
+static void
+print_json (const char *filename)
+{
+  struct stat st;
+  int i;
+
+  if (stat (filename, &st) == -1) die (filename);
+
+  printf ("{\n");
+  printf ("  \"hive\": \"");
+  for (; *filename; ++filename) {
+    if (*filename == '"' || *filename == '\\')
+      putchar ('\\');
+    putchar (*filename);
+  }
+  printf ("\",\n");
+  printf ("  \"size\": %" PRIu64 ",\n", (uint64_t) st.st_size);
+  printf ("  \"nodes\": %zu,\n", nr_paths);
+  printf ("  \"values\": %zu,\n", nr_all_values);
+  printf ("  \"iterations\": %d,\n", iterations);
+  printf ("  \"results\": {\n");
+  for (i = 0; i < nr_results; ++i) {
+    const struct result *r = &results[i];
+    printf ("    \"%s\": { \"ops\": %zu, \"best_s\": %.9f, \"mean_s\": %.9f, "
+            "\"best_ns_per_op\": %.1f }%s\n",
+            r->name, r->ops, r->best, r->total / iterations,
+            r->ops ? r->best * 1e9 / r->ops : 0.0,
+            i < nr_results-1 ? "," : "");
+  }
+  printf ("  }\n");
+  printf ("}\n");
+}
+
+static void usage (int status) __attribute__((noreturn));
+
+static void
+usage (int status)
+{
+  fprintf (stderr,
+           "usage: hivex-bench [options] hive\n"
+           "Options:\n"
+           "  -i iterations  number of runs of each benchmark (default %d)\n"
+           "  -l lookups     random path lookups per run (default %zu)\n"
+           "  -n inserts     nodes inserted per run (default %zu)\n"
+           "  -S seed        random seed for lookups (default %" PRIu64 ")\n"
+           "  -t tmpdir      directory for committed hives (default $TMPDIR)\n",
+           iterations, nr_lookups, nr_inserts, seed);
+  exit (status);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *tmpdir;
+  int c;
+
+  tmpdir = getenv ("TMPDIR");
+  if (tmpdir == NULL)
+    tmpdir = "/tmp";
+
+  while ((c = getopt (argc, argv, "i:l:n:S:t:h")) != -1) {
+    switch (c) {
+    case 'i': iterations = atoi (optarg); break;
+    case 'l': nr_lookups = strtoul (optarg, NULL, 0); break;
+    case 'n': nr_inserts = strtoul (optarg, NULL, 0); break;
+    case 'S': seed = strtoull (optarg, NULL, 0); break;
+    case 't': tmpdir = optarg; break;
+    case 'h': usage (EXIT_SUCCESS);
+    default: usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind + 1 != argc || iterations < 1)
+    usage (EXIT_FAILURE);
+  if (seed == 0)
+    seed = 1;
+
+  run (argv[optind], tmpdir);
+  print_json (argv[optind]);
+
+  exit (EXIT_SUCCESS);
+}
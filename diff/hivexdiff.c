@@ -0,0 +1,304 @@
+/* hivexdiff - Compare two Windows Registry "hive" files.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <locale.h>
+
+#ifdef HAVE_LIBINTL_H
+#include <libintl.h>
+#endif
+
+#include <getopt.h>
+
+#include "hivex.h"
+
+#ifdef HAVE_GETTEXT
+#include "gettext.h"
+#define _(str) dgettext(PACKAGE, (str))
+//#define N_(str) dgettext(PACKAGE, (str))
+#else
+#define _(str) str
+//#define N_(str) str
+#endif
+
+#define STREQ(a,b) (strcmp((a),(b)) == 0)
+
+static const char *prefix = "";
+static size_t nr_changes = 0;
+
+/* The key whose values are being printed, so that all the changes
+ * to one key are printed under a single [key] line.
+ */
+static hive_node_h current = 0;
+
+static int diff_callback (hive_h *h1, hive_h *h2, void *opaque, int change, hive_node_h node1, hive_node_h node2, hive_value_h value1, hive_value_h value2);
+static int print_key (hive_h *h, hive_node_h node, const char *deleted);
+static int print_value (hive_h *h, hive_value_h value, int deleted);
+static void print_data (hive_type t, size_t len, const char *data);
+static void end_key (void);
+
+/* Used to print all the keys and values under an added key. */
+static int added_node_start (hive_h *, void *, hive_node_h, const char *name);
+static int added_value (hive_h *, void *, hive_node_h, hive_value_h, hive_type t, size_t len, const char *key, const char *value);
+
+static struct hivex_visitor added_visitor = {
+  .node_start = added_node_start,
+  .value_any = added_value,
+};
+
+static void
+usage (int status)
+{
+  fprintf (stderr, _("hivexdiff [-dt] [-p prefix] old-hive new-hive > patch.reg\n"));
+  exit (status);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+#ifdef HAVE_BINDTEXTDOMAIN
+  bindtextdomain (PACKAGE, LOCALEBASEDIR);
+  textdomain (PACKAGE);
+#endif
+
+  int c;
+  int open_flags = 0;
+  int diff_flags = 0;
+  hive_h *h1, *h2;
+
+  while ((c = getopt (argc, argv, "dp:t")) != EOF) {
+    switch (c) {
+    case 'd':
+      open_flags |= HIVEX_OPEN_DEBUG;
+      break;
+    case 'p':
+      prefix = optarg;
+      break;
+    case 't':
+      diff_flags |= HIVEX_DIFF_TRUST_TIMESTAMPS;
+      break;
+    default:
+      usage (2);
+    }
+  }
+
+  if (optind + 2 != argc) {
+    fprintf (stderr, _("hivexdiff: expecting the names of two hive files\n"));
+    usage (2);
+  }
+
+  /* As in hivexregedit, the prefix is given without a final backslash. */
+  if (*prefix && prefix[strlen (prefix) - 1] == '\\') {
+    char *p = strdup (prefix);
+    if (p == NULL) {
+      perror ("strdup");
+      exit (2);
+    }
+    p[strlen (p) - 1] = '\0';
+    prefix = p;
+  }
+
+  h1 = hivex_open (argv[optind], open_flags);
+  if (h1 == NULL) {
+    fprintf (stderr, "hivex_open: %s: %m\n", argv[optind]);
+    exit (2);
+  }
+  h2 = hivex_open (argv[optind+1], open_flags);
+  if (h2 == NULL) {
+    fprintf (stderr, "hivex_open: %s: %m\n", argv[optind+1]);
+    exit (2);
+  }
+
+  printf ("Windows Registry Editor Version 5.00\n\n");
+
+  if (hivex_diff (h1, hivex_root (h1), h2, hivex_root (h2),
+                  diff_callback, NULL, diff_flags) == -1) {
+    fprintf (stderr, "hivexdiff: %s: %s: %m\n", argv[optind], argv[optind+1]);
+    exit (2);
+  }
+  end_key ();
+
+  if (fflush (stdout) == EOF) {
+    perror ("stdout");
+    exit (2);
+  }
+
+  hivex_close (h1);
+  hivex_close (h2);
+
+  /* Like diff(1), exit with 1 if the hives differ. */
+  exit (nr_changes > 0 ? 1 : 0);
+}
+
+static int
+diff_callback (hive_h *h1, hive_h *h2, void *opaque, int change,
+               hive_node_h node1, hive_node_h node2,
+               hive_value_h value1, hive_value_h value2)
+{
+  nr_changes++;
+
+  switch (change) {
+  case hivex_diff_node_added:
+    end_key ();
+    if (hivex_visit_node (h2, node2, &added_visitor, sizeof added_visitor,
+                          NULL, 0) == -1)
+      return -1;
+    end_key ();
+    return 0;
+
+  case hivex_diff_node_deleted:
+    end_key ();
+    if (print_key (h1, node1, "-") == -1)
+      return -1;
+    printf ("\n");
+    return 0;
+
+  case hivex_diff_value_added:
+  case hivex_diff_value_changed:
+  case hivex_diff_value_deleted:
+    if (current != node2) {
+      end_key ();
+      if (print_key (h2, node2, "") == -1)
+        return -1;
+      current = node2;
+    }
+    if (change == hivex_diff_value_deleted)
+      return print_value (h1, value1, 1);
+    else
+      return print_value (h2, value2, 0);
+  }
+
+  return 0;
+}
+
+static void
+end_key (void)
+{
+  if (current) {
+    printf ("\n");
+    current = 0;
+  }
+}
+
+static int
+print_key (hive_h *h, hive_node_h node, const char *deleted)
+{
+  char *path = hivex_node_path (h, node);
+
+  if (path == NULL)
+    return -1;
+  /* The root is "\" on its own. */
+  printf ("[%s%s%s]\n", deleted, prefix,
+          *prefix && STREQ (path, "\\") ? "" : path);
+  free (path);
+  return 0;
+}
+
+/* Print the name of a value, as in hivexregedit --export. */
+static void
+print_value_name (const char *key)
+{
+  const char *p;
+
+  if (*key == '\0')
+    printf ("@=");              /* default key */
+  else {
+    putchar ('"');
+    for (p = key; *p; ++p) {
+      if (*p == '\\' || *p == '"')
+        putchar ('\\');
+      putchar (*p);
+    }
+    printf ("\"=");
+  }
+}
+
+static int
+print_value (hive_h *h, hive_value_h value, int deleted)
+{
+  hive_type t;
+  size_t len;
+  char *key, *data;
+
+  key = hivex_value_key (h, value);
+  if (key == NULL)
+    return -1;
+  print_value_name (key);
+  free (key);
+
+  if (deleted) {
+    printf ("-\n");
+    return 0;
+  }
+
+  data = hivex_value_value (h, value, &t, &len);
+  if (data == NULL)
+    return -1;
+  print_data (t, len, data);
+  free (data);
+  return 0;
+}
+
+/* Print value data, as in hivexregedit --export. */
+static void
+print_data (hive_type t, size_t len, const char *data)
+{
+  size_t i;
+
+  if (t == hive_t_REG_DWORD && len == 4) {
+    uint32_t dword = (unsigned char) data[0] |
+      (unsigned char) data[1] << 8 |
+      (unsigned char) data[2] << 16 |
+      (uint32_t) (unsigned char) data[3] << 24;
+    printf ("dword:%08x\n", dword);
+  }
+  else {
+    printf ("hex(%x):", (unsigned) t);
+    for (i = 0; i < len; ++i)
+      printf ("%s%02x", i > 0 ? "," : "", (unsigned char) data[i]);
+    printf ("\n");
+  }
+}
+
+static int
+added_node_start (hive_h *h, void *opaque, hive_node_h node,
+                  const char *name)
+{
+  end_key ();
+  if (print_key (h, node, "") == -1)
+    return -1;
+  current = node;
+  return 0;
+}
+
+static int
+added_value (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+             hive_type t, size_t len, const char *key, const char *data)
+{
+  print_value_name (key);
+  print_data (t, len, data);
+  return 0;
+}
@@ -51,11 +51,14 @@ and ret =
   | RNodeList                           (* Returns hive_node_h* or NULL. *)
   | RValue                              (* Returns hive_value_h or 0. *)
   | RValueList                          (* Returns hive_value_h* or NULL. *)
+  | RNodeNamedList                      (* Returns hive_node_named* or NULL. *)
+  | RValueFullList                      (* Returns hive_value_full* or NULL. *)
   | RLenValue                           (* Returns offset and length of value. *)
   | RString                             (* Returns char* or NULL. *)
   | RStringList                         (* Returns char** or NULL. *)
   | RLenType                            (* See hivex_value_type. *)
   | RLenTypeVal                         (* See hivex_value_value. *)
+  | RStats                              (* See hivex_get_stats. *)
   | RInt32                              (* Returns int32. *)
   | RInt64                              (* Returns int64. *)
 
@@ -210,6 +213,16 @@ Return the child of node with the name C<name>, if it exists.
 
 The name is matched case insensitively.";
 
+  "node_children_named", (RNodeNamedList, [AHive; ANode "node"]),
+    "return children of node with their names",
+    "\
+Return an array of (name, node) pairs for the subkeys (children)
+of C<node>.
+
+This returns the same information as calling C<hivex_node_children>
+followed by C<hivex_node_name> on each child, but language bindings
+can fetch it in a single call.";
+
   "node_parent", (RNode, [AHive; ANode "node"]),
     "return the parent of node",
     "\
@@ -224,6 +237,17 @@ return an error if called on the root node.";
     "\
 Return the array of (key, value) pairs attached to this node.";
 
+  "node_values_full", (RValueFullList, [AHive; ANode "node"]),
+    "return keys, types and data of all values attached to a node",
+    "\
+Return an array of (key, type, data) entries for every value
+attached to this node.
+
+This returns the same information as calling C<hivex_node_values>
+followed by C<hivex_value_key> and C<hivex_value_value> on each
+value, but language bindings can fetch it in a single call.
+If any value cannot be read then the whole call fails.";
+
   "node_get_value", (RValue, [AHive; ANode "node"; AString "key"]),
     "return named key at node",
     "\
@@ -378,6 +402,114 @@ stored in C<node>.  If the key does not already exist, then a
 new key is added.  Key matching is case insensitive.
 
 C<node> is the node to modify.";
+
+  "get_stats", (RStats, [AHive]),
+    "return performance counters for the handle",
+    "\
+Return statistics and performance counters collected by the
+hive handle since it was opened.  This can be used to understand
+why a particular hive is slow to process.
+
+The open scan figures describe the pages and blocks found when the
+hive was opened.  The other counters are cumulative.  See
+L<hivex(3)/STATISTICS> for the meaning of each counter.";
+
+  "build_path_index", (RErr, [AHive; AUnusedFlags]),
+    "build the offset to path index",
+    "\
+Walk the whole hive once and build an index mapping the offset
+of every cell belonging to a key (the key itself, its class name,
+subkey lists, value list, values and value data) to the key which
+owns it, and every key to its parent and name.
+
+The index makes C<hivex_cell_owner> and C<hivex_node_path> fast
+when they are called many times, for example when mapping the
+cell offsets found by a forensic scan back to registry paths.
+Names are stored once each, already converted to UTF-8, so
+looking up a path only costs one step per level of the tree.
+
+Building the index is optional.  It uses memory in proportion
+to the number of cells in the hive (counted against any limit set
+with C<hivex_set_memory_limit>) and is kept until the handle is
+closed or the hive is modified.  Calling this again while the
+index exists does nothing.";
+
+  "node_path", (RString, [AHive; ANode "node"]),
+    "return the full path of a node",
+    "\
+Return the full path of C<node> from the root, as a string with
+components separated by backslashes, for example
+C<\\Microsoft\\Windows>.  The path of the root node is C<\\>.
+The name of the root key itself is not included.
+
+If the index has been built with C<hivex_build_path_index> then
+it is used, otherwise the parent pointers stored in the hive are
+followed.  With the index, a node which is not reachable from the
+root is an error (C<ENOENT>).";
+
+  "cell_owner", (RNode, [AHive; ANode "offset"]),
+    "return the node which owns a cell",
+    "\
+Return the node (key) which owns the cell at C<offset>.  The
+offset may be that of any cell belonging to a key: the key itself,
+its class name, a subkey list, its value list, a value or a value
+data cell.
+
+This builds the index (see C<hivex_build_path_index>) if it
+has not been built already.  If the cell does not belong to any
+key reachable from the root, for example because it is free or
+was used by a deleted key, this returns C<0> and sets errno to
+C<ENOENT>.";
+
+  "node_hash", (RString, [AHive; ANode "node"]),
+    "return a content hash of the subtree below a node",
+    "\
+Return a hash of the contents of C<node> and everything below it,
+as a string of 64 lowercase hexadecimal digits.  Two subtrees have
+the same hash if the keys have the same names, the values have the
+same names, types and data, and the subkeys have the same hashes.
+The order in which subkeys and values are stored, and the
+timestamps, class names and security descriptors of keys, do not
+affect the hash.  See L<hivex(3)/SUBTREE HASHES> for the exact
+definition.
+
+Comparing hashes is a quick way to find which parts of two hives
+differ, or to find copies of the same tree in many hives.
+
+Computing the hash of a key computes the hash of every key below
+it, and these are all kept by the handle until it is closed or the
+hive is modified, so asking for the hash of a subkey afterwards is
+fast.";
+]
+
+(* Fields of struct hive_stats, in order.  All fields are uint64_t.
+ * New fields must only ever be added to the end, since callers pass
+ * the size of the structure they were compiled against.
+ *)
+let stats_fields = [
+  "open_scan_ns",
+    "time taken by hivex_open to scan the pages and blocks (nanoseconds)";
+  "pages", "number of hbin pages found by hivex_open";
+  "smallest_page", "size of the smallest page";
+  "largest_page", "size of the largest page";
+  "blocks", "number of blocks (used and free) found by hivex_open";
+  "smallest_block", "size of the smallest block";
+  "largest_block", "size of the largest block";
+  "blocks_bytes", "total size of all blocks";
+  "used_blocks", "number of used blocks found by hivex_open";
+  "used_bytes", "total size of the used blocks";
+  "recode_calls", "number of character set conversions";
+  "recode_bytes", "bytes of input passed to the character set conversions";
+  "allocations",
+    "number of heap allocations made by the library for this handle";
+  "children_lists", "number of lists of subkeys constructed";
+  "values_lists", "number of lists of values constructed";
+  "allocate_page_calls", "number of hbin pages added when writing";
+  "allocate_page_bytes", "total size of the pages added";
+  "allocate_block_calls", "number of blocks allocated when writing";
+  "allocate_block_bytes", "total size of the blocks allocated";
+  "iconv_opens",
+    "number of character set converters opened (see hivex_open_ctx)";
 ]
 
 let f_len_exists n =
@@ -385,6 +517,25 @@ let f_len_exists n =
     (function (cand, _, _, _) -> cand = (String.concat "" [n; "_len"]))
     functions
 
+(* Functions which may take a long time, for which the Ruby bindings
+ * release the global VM lock.  These must not take set values, since
+ * those are not copied out of the Ruby objects.
+ *)
+let ruby_without_gvl = [
+  "open"; "commit";
+  "node_children"; "node_values";
+  "node_children_named"; "node_values_full";
+  "value_value"; "value_string"; "value_multiple_strings"
+]
+
+(* Functions which modify the hive.  The C++ wrappers for these are
+ * not const.
+ *)
+let write_functions = [
+  "commit"; "node_add_child"; "node_delete_child";
+  "node_set_values"; "node_set_value"
+]
+
 (* Useful functions.
  * Note we don't want to use any external OCaml libraries which
  * makes this a bit harder than it should be.
@@ -855,6 +1006,39 @@ struct hive_set_value {
 };
 typedef struct hive_set_value hive_set_value;
 
+/* Array of (name, node) pairs returned by hivex_node_children_named.
+ * The array is terminated by an entry with name == NULL.
+ */
+struct hive_node_named {
+  char *name;
+  hive_node_h node;
+};
+typedef struct hive_node_named hive_node_named;
+
+/* Array of values returned by hivex_node_values_full.  The array
+ * is terminated by an entry with key == NULL.
+ */
+struct hive_value_full {
+  char *key;
+  hive_type t;
+  size_t len;
+  char *value;
+  hive_value_h val;
+};
+typedef struct hive_value_full hive_value_full;
+
+/* Statistics returned by hivex_get_stats. */
+struct hive_stats {
+";
+  List.iter (
+    fun (name, description) ->
+      pr "  uint64_t %s;%s/* %s */\n"
+        name (String.make (max 1 (24 - String.length name)) ' ') description
+  ) stats_fields;
+  pr "\
+};
+typedef struct hive_stats hive_stats;
+
 ";
 
   pr "/* Functions. */\n";
@@ -892,6 +1076,92 @@ struct hivex_visitor {
 extern int hivex_visit (hive_h *h, const struct hivex_visitor *visitor, size_t len, void *opaque, int flags);
 extern int hivex_visit_node (hive_h *h, hive_node_h node, const struct hivex_visitor *visitor, size_t len, void *opaque, int flags);
 
+/* Return a pointer to value data without copying it.  This is
+ * specific to the C API, although some language bindings use it to
+ * avoid copies.
+ */
+extern const char *hivex_value_value_ptr (hive_h *h, hive_value_h val, hive_type *t, size_t *len);
+
+/* Memory accounting and limits.  These are specific to the C API. */
+extern int hivex_set_memory_limit (hive_h *h, size_t limit);
+extern size_t hivex_memory_usage (hive_h *h);
+
+/* Last-write timestamp index.  These are specific to the C API. */
+extern int hivex_build_timestamp_index (hive_h *h, int flags);
+extern hive_node_h *hivex_nodes_modified_between (hive_h *h, int64_t from, int64_t to);
+extern hive_node_h *hivex_nodes_most_recent (hive_h *h, size_t n);
+extern int hivex_save_timestamp_index (hive_h *h, const char *filename);
+extern int hivex_load_timestamp_index (hive_h *h, const char *filename);
+
+/* Structural diff.  This is specific to the C API. */
+enum hivex_diff_change {
+  hivex_diff_node_added = 1,
+  hivex_diff_node_deleted = 2,
+  hivex_diff_value_added = 3,
+  hivex_diff_value_deleted = 4,
+  hivex_diff_value_changed = 5,
+};
+
+typedef int (*hivex_diff_callback) (hive_h *h1, hive_h *h2, void *opaque, int change, hive_node_h node1, hive_node_h node2, hive_value_h value1, hive_value_h value2);
+
+#define HIVEX_DIFF_TRUST_TIMESTAMPS 1
+
+extern int hivex_diff (hive_h *h1, hive_node_h node1, hive_h *h2, hive_node_h node2, hivex_diff_callback callback, void *opaque, int flags);
+
+/* Saving subtree hashes.  These are specific to the C API. */
+extern int hivex_save_node_hashes (hive_h *h, const char *filename);
+extern int hivex_load_node_hashes (hive_h *h, const char *filename);
+
+/* Substring search.  These are specific to the C API. */
+struct hive_search_match {
+  hive_node_h node;
+  hive_value_h value;
+};
+typedef struct hive_search_match hive_search_match;
+
+#define HIVEX_SEARCH_NAMES 1
+#define HIVEX_SEARCH_DATA 2
+
+extern int hivex_build_search_index (hive_h *h, int flags);
+extern hive_search_match *hivex_search (hive_h *h, const char *str, int flags);
+extern int hivex_save_search_index (hive_h *h, const char *filename);
+extern int hivex_load_search_index (hive_h *h, const char *filename);
+
+/* Recovering deleted records.  This is specific to the C API. */
+enum hivex_recovered_kind {
+  hivex_recovered_node = 1,
+  hivex_recovered_value = 2,
+  hivex_recovered_subkey_list = 3,
+  hivex_recovered_big_data = 4,
+};
+
+struct hive_recovered {
+  int kind;                     /* hivex_recovered_*, 0 ends the list */
+  int flags;                    /* HIVEX_RECOVERED_* */
+  size_t offset;                /* offset of the record */
+  char *name;                   /* node, value: name as UTF-8 */
+  int64_t timestamp;            /* node: last modified time */
+  size_t parent;                /* node: offset of the parent key */
+  hive_type t;                  /* value: type */
+  size_t len;                   /* value: length of data, else entries */
+  char *value;                  /* value: data, or NULL */
+};
+typedef struct hive_recovered hive_recovered;
+
+#define HIVEX_RECOVERED_IN_SLACK 1
+#define HIVEX_RECOVERED_PARENT_LIVE 2
+#define HIVEX_RECOVERED_DATA 4
+#define HIVEX_RECOVERED_LINKS_VALID 8
+
+extern hive_recovered *hivex_recover (hive_h *h, size_t from, size_t to, int flags);
+
+/* Contexts shared between handles.  These are specific to the C API. */
+typedef struct hive_context hive_context;
+
+extern hive_context *hivex_context_new (int flags);
+extern int hivex_context_free (hive_context *ctx);
+extern hive_h *hivex_open_ctx (hive_context *ctx, const char *filename, int flags);
+
 ";
 
   (* Finish the header file. *)
@@ -915,11 +1185,14 @@ and generate_c_prototype ?(extern = false) name style =
    | RNodeList -> pr "hive_node_h *"
    | RValue -> pr "hive_value_h "
    | RValueList -> pr "hive_value_h *"
+   | RNodeNamedList -> pr "hive_node_named *"
+   | RValueFullList -> pr "hive_value_full *"
    | RString -> pr "char *"
    | RStringList -> pr "char **"
    | RLenValue -> pr "hive_value_h "
    | RLenType -> pr "int "
    | RLenTypeVal -> pr "char *"
+   | RStats -> pr "int "
    | RInt32 -> pr "int32_t "
    | RInt64 -> pr "int64_t "
   );
@@ -940,10 +1213,29 @@ and generate_c_prototype ?(extern = false) name style =
   (match fst style with
    | RLenType | RLenTypeVal -> pr ", hive_type *t, size_t *len"
    | RLenValue -> pr ", size_t *len"
+   | RStats -> pr ", hive_stats *stats, size_t len"
    | _ -> ()
   );
   pr ");\n"
 
+(* Table of the fields of hive_stats, used by the bindings to turn
+ * the structure into a list or hash without knowing its layout.
+ *)
+and generate_c_stats_table () =
+  pr "static const struct {\n";
+  pr "  const char *name;\n";
+  pr "  size_t offset;\n";
+  pr "} stats_fields[] = {\n";
+  List.iter (
+    fun (name, _) ->
+      pr "  { \"%s\", offsetof (hive_stats, %s) },\n" name name
+  ) stats_fields;
+  pr "};\n";
+  pr "#define nr_stats_fields (sizeof stats_fields / sizeof stats_fields[0])\n";
+  pr "#define stats_field(stats, i) \\\n";
+  pr "  (*(const uint64_t *) ((const char *) (stats) + stats_fields[i].offset))\n";
+  pr "\n"
+
 and generate_c_pod () =
   generate_header PODCommentStyle GPLv2;
 
@@ -1126,6 +1418,22 @@ On error this returns 0 and sets errno.\n\n"
            pr "\
 Returns a 0-terminated array of values.
 The array must be freed by the caller when it is no longer needed.
+On error this returns NULL and sets errno.\n\n"
+       | RNodeNamedList ->
+           pr "\
+Returns an array of C<hive_node_named> structures, terminated by
+an entry where C<name> is NULL.
+The names and the array must all be freed by the caller when
+they are no longer needed.
+On error this returns NULL and sets errno.\n\n"
+       | RValueFullList ->
+           pr "\
+Returns an array of C<hive_value_full> structures, terminated by
+an entry where C<key> is NULL.  The C<val> field is the value
+handle.  The C<value> field points to C<len> bytes of data which
+should be interpreted according to C<t>.
+The C<key> and C<value> fields of every entry and the array
+must all be freed by the caller when they are no longer needed.
 On error this returns NULL and sets errno.\n\n"
        | RString ->
            pr "\
@@ -1151,6 +1459,13 @@ On error this returns 0 and sets errno.\n\n"
 The value is returned as an array of bytes (of length C<len>).
 The value must be freed by the caller when it is no longer needed.
 On error this returns NULL and sets errno.\n\n"
+       | RStats ->
+           pr "\
+C<len> must be set to C<sizeof (hive_stats)>.  Fields beyond C<len>
+are not filled in, so programs compiled against an older version of
+this header continue to work.
+Returns 0 on success.
+On error this returns -1 and sets errno.\n\n"
        | RInt32 | RInt64 -> ()
       );
   ) functions;
@@ -1220,253 +1535,872 @@ are well-understood and we could add support if it was required
 
 =back
 
-=head1 VISITING ALL NODES
+=head1 READING VALUES WITHOUT COPYING
 
-The visitor pattern is useful if you want to visit all nodes
-in the tree or all nodes below a certain point in the tree.
+C<hivex_value_value> always returns a newly allocated copy of the
+value data.  For large values, or when processing many values, it may
+be preferable to read the data directly from the hive.
 
-First you set up your own C<struct hivex_visitor> with your
-callback functions.
+=over 4
 
-Each of these callback functions should return 0 on success or -1
-on error.  If any callback returns -1, then the entire visit
-terminates immediately.  If you don't need a callback function at
-all, set the function pointer to NULL.
+=item hivex_value_value_ptr
 
- struct hivex_visitor {
-   int (*node_start) (hive_h *, void *opaque, hive_node_h, const char *name);
-   int (*node_end) (hive_h *, void *opaque, hive_node_h, const char *name);
-   int (*value_string) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, const char *str);
-   int (*value_multiple_strings) (hive_h *, void *opaque, hive_node_h,
-         hive_value_h, hive_type t, size_t len, const char *key, char **argv);
-   int (*value_string_invalid_utf16) (hive_h *, void *opaque, hive_node_h,
-         hive_value_h, hive_type t, size_t len, const char *key,
-         const char *str);
-   int (*value_dword) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, int32_t);
-   int (*value_qword) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, int64_t);
-   int (*value_binary) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, const char *value);
-   int (*value_none) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, const char *value);
-   int (*value_other) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, const char *value);
-   /* If value_any callback is not NULL, then the other value_*
-    * callbacks are not used, and value_any is called on all values.
-    */
-   int (*value_any) (hive_h *, void *opaque, hive_node_h, hive_value_h,
-         hive_type t, size_t len, const char *key, const char *value);
- };
+ const char *hivex_value_value_ptr (hive_h *h, hive_value_h val, hive_type *t, size_t *len);
 
-=over 4
+This is the same as C<hivex_value_value>, except that instead of
+returning a copy of the data, it returns a pointer into the hive
+itself.  The caller must B<not> free the returned pointer.  The
+pointer remains valid until the handle is closed.
 
-=item hivex_visit
+This only works for hives opened without C<HIVEX_OPEN_WRITE>, and for
+values whose data is stored inline or in a single cell.  Large values
+stored in C<db> records are split across several cells.  In these
+cases this returns NULL with errno set to C<ENOTSUP>, and the caller
+should fall back to C<hivex_value_value>.  On other errors this
+returns NULL and sets errno as for C<hivex_value_value>.
 
- int hivex_visit (hive_h *h, const struct hivex_visitor *visitor, size_t len, void *opaque, int flags);
+=back
 
-Visit all the nodes recursively in the hive C<h>.
+=head1 MEMORY LIMITS
 
-C<visitor> should be a C<hivex_visitor> structure with callback
-fields filled in as required (unwanted callbacks can be set to
-NULL).  C<len> must be the length of the 'visitor' struct (you
-should pass C<sizeof (struct hivex_visitor)> for this).
+Each handle keeps count of the memory that the library has allocated
+for it, and can be given a limit.  This lets a program which opens
+hives from untrusted sources bound the memory that each one can use.
 
-This returns 0 if the whole recursive visit was completed
-successfully.  On error this returns -1.  If one of the callback
-functions returned an error than we don't touch errno.  If the
-error was generated internally then we set errno.
+=over 4
 
-You can skip bad registry entries by setting C<flag> to
-C<HIVEX_VISIT_SKIP_BAD>.  If this flag is not set, then a bad registry
-causes the function to return an error immediately.
+=item hivex_set_memory_limit
 
-This function is robust if the registry contains cycles or
-pointers which are invalid or outside the registry.  It detects
-these cases and returns an error.
+ int hivex_set_memory_limit (hive_h *h, size_t limit);
 
-=item hivex_visit_node
+Set the maximum number of bytes that the library may allocate for
+this handle.  C<0> (the default) means no limit.  Once a limit is set,
+any call which would need to allocate more than the limit fails with
+errno set to C<ENOMEM>, and the handle can still be used afterwards.
 
- int hivex_visit_node (hive_h *h, hive_node_h node, const struct hivex_visitor *visitor, size_t len, void *opaque);
+This returns C<0> on success.  If the handle is already using more
+than C<limit>, it returns C<-1> with errno set to C<ENOMEM> and the
+limit is not changed.
 
-Same as C<hivex_visit> but instead of starting out at the root, this
-starts at C<node>.
+=item hivex_memory_usage
+
+ size_t hivex_memory_usage (hive_h *h);
+
+Return the number of bytes currently charged to the handle.
 
 =back
 
-=head1 THE STRUCTURE OF THE WINDOWS REGISTRY
+The following are counted: the handle itself, the bitmap of valid
+blocks (1 byte for every 32 bytes of hive), the copy of the hive held
+in memory when it is opened with C<HIVEX_OPEN_WRITE> (including its
+growth as keys and values are added), and the temporary lists and
+buffers used internally by each call.  The hive file mapped in
+read-only mode is not counted, since it is backed by the file.
 
-Note: To understand the relationship between hives and the common
-Windows Registry keys (like C<HKEY_LOCAL_MACHINE>) please see the
-Wikipedia page on the Windows Registry.
+Strings, lists and value data returned to the caller are counted
+while they are being built and are subject to the limit, but they
+stop being counted once returned, since they belong to the caller.
 
-The Windows Registry is split across various binary files, each
-file being known as a \"hive\".  This library only handles a single
-hive file at a time.
+The limit can only be set after C<hivex_open> has returned, so it does
+not cover the memory used by C<hivex_open> itself.  That is about
+S<C<size / 32>> bytes for a hive of C<size> bytes, plus C<size> bytes
+if C<HIVEX_OPEN_WRITE> is used.  To bound this, check the size of the
+file before opening it.
 
-Hives are n-ary trees with a single root.  Each node in the tree
-has a name.
+=head1 TIMESTAMP INDEX
 
-Each node in the tree (including non-leaf nodes) may have an
-arbitrary list of (key, value) pairs attached to it.  It may
-be the case that one of these pairs has an empty key.  This
-is referred to as the default key for the node.
+To find which keys were modified in a period of time, build an index
+of the last-write timestamps of all keys.  The index is held by the
+handle, and can be saved to a file so that later runs over the same
+hive do not have to walk it again.  These calls are specific to the
+C API.
 
-The (key, value) pairs are the place where the useful data is
-stored in the registry.  The key is always a string (possibly the
-empty string for the default key).  The value is a typed object
-(eg. string, int32, binary, etc.).
+=over 4
 
-=head2 RELATIONSHIP TO .REG FILES
+=item hivex_build_timestamp_index
 
-The hivex C library does not care about or deal with Windows .REG
-files.  Instead we push this complexity up to the Perl
-L<Win::Hivex(3)> library and the Perl programs
-L<hivexregedit(1)> and L<virt-win-reg(1)>.
-Nevertheless it is useful to look at the relationship between the
-Registry and .REG files because they are so common.
+ int hivex_build_timestamp_index (hive_h *h, int flags);
 
-A .REG file is a textual representation of the registry, or part of the
-registry.  The actual registry hives that Windows uses are binary
-files.  There are a number of Windows and Linux tools that let you
-generate .REG files, or merge .REG files back into the registry hives.
-Notable amongst them is Microsoft's REGEDIT program (formerly known as
-REGEDT32).
+Walk all the keys reachable from the root once and build the index.
+C<flags> must be C<0>.  The other calls below build the index
+if necessary, so calling this first is only needed to control when
+the work is done.  Calling it while the index exists does nothing.
 
-A typical .REG file will contain many sections looking like this:
+The index uses 16 bytes per key, counted against any limit set with
+C<hivex_set_memory_limit>.  It is kept until the handle is closed or
+the hive is modified.
 
- [HKEY_LOCAL_MACHINE\\SOFTWARE\\Classes\\Stack]
- \"@\"=\"Generic Stack\"
- \"TileInfo\"=\"prop:System.FileCount\"
- \"TilePath\"=str(2):\"%%systemroot%%\\\\system32\"
- \"ThumbnailCutoff\"=dword:00000000
- \"FriendlyTypeName\"=hex(2):40,00,25,00,53,00,79,00,73,00,74,00,65,00,6d,00,52,00,6f,00,\\
-  6f,00,74,00,25,00,5c,00,53,00,79,00,73,00,74,00,65,00,6d,00,\\
-  33,00,32,00,5c,00,73,00,65,00,61,00,72,00,63,00,68,00,66,00,\\
-  6f,00,6c,00,64,00,65,00,72,00,2e,00,64,00,6c,00,6c,00,2c,00,\\
-  2d,00,39,00,30,00,32,00,38,00,00,00,d8
+=item hivex_nodes_modified_between
 
-Taking this one piece at a time:
+ hive_node_h *hivex_nodes_modified_between (hive_h *h,
+                                            int64_t from, int64_t to);
 
- [HKEY_LOCAL_MACHINE\\SOFTWARE\\Classes\\Stack]
+Return a 0-terminated list of the keys whose timestamp (see
+C<hivex_node_timestamp>) is between C<from> and C<to> inclusive,
+oldest first.  The caller must free the list.
 
-This is the path to this node in the registry tree.  The first part,
-C<HKEY_LOCAL_MACHINE\\SOFTWARE> means that this comes from a hive
-file called C<C:\\WINDOWS\\SYSTEM32\\CONFIG\\SOFTWARE>.
-C<\\Classes\\Stack> is the real path part,
-starting at the root node of the C<SOFTWARE> hive.
+=item hivex_nodes_most_recent
 
-Below the node name is a list of zero or more key-value pairs.  Any
-interior or leaf node in the registry may have key-value pairs
-attached.
+ hive_node_h *hivex_nodes_most_recent (hive_h *h, size_t n);
 
- \"@\"=\"Generic Stack\"
+Return a 0-terminated list of the C<n> most recently modified keys,
+newest first.  The caller must free the list.
 
-This is the \"default key\".  In reality (ie. inside the binary hive)
-the key string is the empty string.  In .REG files this is written as
-C<@> but this has no meaning either in the hives themselves or in this
-library.  The value is a string (type 1 - see C<enum hive_type>
-above).
+=item hivex_save_timestamp_index
 
- \"TileInfo\"=\"prop:System.FileCount\"
+ int hivex_save_timestamp_index (hive_h *h, const char *filename);
 
-This is a regular (key, value) pair, with the value being a type 1
-string.  Note that inside the binary file the string is likely to be
-UTF-16LE encoded.  This library converts to and from UTF-8 strings
-transparently in some cases.
+Save the index to C<filename>, building it first if necessary.
 
- \"TilePath\"=str(2):\"%%systemroot%%\\\\system32\"
+=item hivex_load_timestamp_index
 
-The value in this case has type 2 (expanded string) meaning that some
-%%...%% variables get expanded by Windows.  (This library doesn't know
-or care about variable expansion).
+ int hivex_load_timestamp_index (hive_h *h, const char *filename);
 
- \"ThumbnailCutoff\"=dword:00000000
+Load an index saved by C<hivex_save_timestamp_index>.  The file
+records the size, sequence numbers, checksum and last modified time
+of the hive it was built from, and if these do not match the hive
+open in C<h> this fails with errno set to C<EINVAL>.  A program
+using the file as a cache should then call
+C<hivex_save_timestamp_index> again.
 
-The value in this case is a dword (type 4).
+The header is only updated by C<hivex_commit>, so while a handle has
+changes which have not been committed both functions fail with errno
+set to C<EBUSY>.
 
- \"FriendlyTypeName\"=hex(2):40,00,....
+=back
 
-This value is an expanded string (type 2) represented in the .REG file
-as a series of hex bytes.  In this case the string appears to be a
-UTF-16LE string.
+=head1 COMPARING HIVES
 
-=head1 NOTE ON THE USE OF ERRNO
+ typedef int (*hivex_diff_callback) (hive_h *h1, hive_h *h2,
+                                     void *opaque, int change,
+                                     hive_node_h node1, hive_node_h node2,
+                                     hive_value_h value1,
+                                     hive_value_h value2);
 
-Many functions in this library set errno to indicate errors.  These
-are the values of errno you may encounter (this list is not
-exhaustive):
+ int hivex_diff (hive_h *h1, hive_node_h node1,
+                 hive_h *h2, hive_node_h node2,
+                 hivex_diff_callback callback, void *opaque, int flags);
 
-=over 4
+Compare the tree of keys under C<node1> in hive C<h1> with the tree
+under C<node2> in hive C<h2> (usually the two root nodes of two
+copies of the same hive taken at different times), calling
+C<callback> for each difference.  This is specific to the C API.
+The C<hivexdiff(1)> program uses it to produce a C<.reg> file which
+turns one hive into the other.
 
-=item ENOTSUP
+Keys and values are matched by name.  Names are compared as they
+are stored in the hive, ignoring case in ASCII letters only, and
+value data is compared byte for byte, so this is much faster than
+exporting both hives and comparing the text.
 
-Corrupt or unsupported Registry file format.
+This has two consequences.  A key or value which was only renamed
+to change the case of ASCII letters (C<Foo> to C<FOO>) matches its
+old name, so the rename is not reported.  A name which differs only
+in the case of other letters (C<E<Auml>> to C<E<auml>>) does not
+match, so it is reported as deleted and added.  C<hivex_node_get_child>
+also ignores case in ASCII letters only.
 
-=item HIVEX_NO_KEY
+C<change> is one of:
 
-Missing root key.
+=over 4
 
-=item EINVAL
+=item C<hivex_diff_node_added>
 
-Passed an invalid argument to the function.
+The key C<node2> exists only in the second tree.  The keys below it
+are not reported separately.  C<node1> is C<0>.
 
-=item EFAULT
+=item C<hivex_diff_node_deleted>
 
-Followed a Registry pointer which goes outside
-the registry or outside a registry block.
+The key C<node1> exists only in the first tree.  The keys below it
+are not reported separately.  C<node2> is C<0>.
 
-=item ELOOP
+=item C<hivex_diff_value_added>
 
-Registry contains cycles.
+=item C<hivex_diff_value_deleted>
 
-=item ERANGE
+=item C<hivex_diff_value_changed>
 
-Field in the registry out of range.
+The value C<value2> exists only in the second key, C<value1>
+exists only in the first key, or the type or data of the value
+differs.  C<node1> and C<node2> are the matching keys, and the
+value which does not exist is C<0>.
 
-=item EEXIST
+=back
 
-Registry key already exists.
+If the callback returns C<-1> then the comparison stops and
+C<hivex_diff> returns C<-1>.  It also returns C<-1> (with errno
+set) if either hive is corrupt.
 
-=item EROFS
+C<flags> may be C<0> or:
 
-Tried to write to a registry which is not opened for writing.
+=over 4
+
+=item C<HIVEX_DIFF_TRUST_TIMESTAMPS>
+
+Don't compare the values of two keys which have the same last
+modified time (see C<hivex_node_timestamp>).  Windows updates the
+time of a key when its values are changed, so this is safe when
+comparing copies of the same hive, and it is faster when most keys
+are unchanged.  Subkeys are still compared, because changes to a
+subkey do not update the time of its parent.
 
 =back
 
-=head1 ENVIRONMENT VARIABLES
+=head1 SUBTREE HASHES
+
+C<hivex_node_hash> returns the SHA-256 hash of the following, where
+all integers are 32 bit little endian and names are UTF-16LE (names
+which are stored in the hive as Latin-1 are converted):
 
 =over 4
 
-=item HIVEX_DEBUG
+=item *
 
-Setting HIVEX_DEBUG=1 will enable very verbose messages.  This is
-useful for debugging problems with the library itself.
+The length of the name of the key in UTF-16 code units, then the
+name.
 
-=back
+=item *
 
-=head1 SEE ALSO
+The number of values.  Then for each value, in order of the
+UTF-16 code units of their names: the length of the name in code
+units, the name, the type, the length of the data in bytes, and the
+data.
 
-L<hivexget(1)>,
-L<hivexml(1)>,
-L<hivexsh(1)>,
-L<hivexregedit(1)>,
-L<virt-win-reg(1)>,
-L<Win::Hivex(3)>,
-L<guestfs(3)>,
-L<http://libguestfs.org/>,
-L<virt-cat(1)>,
-L<virt-edit(1)>,
-L<http://en.wikipedia.org/wiki/Windows_Registry>.
+=item *
 
-=head1 AUTHORS
+The number of subkeys.  Then the hashes of the subkeys (32 bytes
+each), sorted bytewise.
 
-Richard W.M. Jones (C<rjones at redhat dot com>)
+=back
 
-=head1 COPYRIGHT
+Because the hash of a key is built from the hashes of its subkeys,
+two trees can be compared by comparing the hashes of their roots,
+then only descending into subkeys whose hashes differ.
 
-Copyright (C) 2009-2010 Red Hat Inc.
+The hashes computed by a handle can be saved to a file, so that
+later runs over the same hive do not have to read all of it again.
+These calls are specific to the C API.
+
+=over 4
+
+=item hivex_save_node_hashes
+
+ int hivex_save_node_hashes (hive_h *h, const char *filename);
+
+Compute the hashes of all the keys reachable from the root (if
+they have not been computed already), and save them to
+C<filename>.
+
+=item hivex_load_node_hashes
+
+ int hivex_load_node_hashes (hive_h *h, const char *filename);
+
+Load hashes saved by C<hivex_save_node_hashes>.  As with
+C<hivex_load_timestamp_index>, if the file was saved from a
+different hive, or a different version of the same hive, this fails
+with errno set to C<EINVAL>, and both functions fail with errno set
+to C<EBUSY> while the handle has uncommitted changes.
+
+=back
+
+=head1 SEARCHING VALUES
+
+To find the values whose names or string data contain a string,
+such as a file path, GUID or URL, build an index of the hive.  The
+index is held by the handle, and can be saved to a file so that
+later searches of the same hive do not have to decode every value
+again.  These calls are specific to the C API.
+
+=over 4
+
+=item hivex_build_search_index
+
+ int hivex_build_search_index (hive_h *h, int flags);
+
+Walk all the keys reachable from the root once and build the index.
+C<flags> must be C<0>.  C<hivex_search> builds the index if
+necessary, so calling this first is only needed to control when the
+work is done.  Calling it while the index exists does nothing.
+
+The names of all values are indexed, and so is the data of values
+of type C<hive_t_REG_SZ>, C<hive_t_REG_EXPAND_SZ>, C<hive_t_REG_LINK>
+and C<hive_t_REG_MULTI_SZ>, after conversion to UTF-8.  Values which
+cannot be read are skipped.  The index records every sequence of 3
+bytes in each string (ignoring the case of ASCII letters) and the
+values it occurs in.  It is counted against any limit set with
+C<hivex_set_memory_limit>, and kept until the handle is closed or
+the hive is modified.
+
+=item hivex_search
+
+ struct hive_search_match {
+   hive_node_h node;
+   hive_value_h value;
+ };
+
+ hive_search_match *hivex_search (hive_h *h, const char *str,
+                                  int flags);
+
+Return the values whose name or data contains the UTF-8 string
+C<str>, ignoring the case of ASCII letters.  C<flags> may be
+C<HIVEX_SEARCH_NAMES> to search only the names of values,
+C<HIVEX_SEARCH_DATA> to search only their data, or C<0> to search
+both.
+
+The result is an array of (key, value) pairs, terminated by an
+entry where C<node> is C<0>, in the order the values were found
+when walking the hive.  The caller must free the array.
+
+Only the values which contain every 3 byte sequence in C<str> are
+decoded to check for a match, so a search usually takes a small
+fraction of the time needed to decode the whole hive.  Strings
+shorter than 3 bytes cannot use the index, and every value is
+checked.
+
+=item hivex_save_search_index
+
+ int hivex_save_search_index (hive_h *h, const char *filename);
+
+Save the index to C<filename>, building it first if necessary.  The
+file is compact (each value is listed once per distinct 3 byte
+sequence, as a variable length number), and is usually smaller than
+the hive.
+
+=item hivex_load_search_index
+
+ int hivex_load_search_index (hive_h *h, const char *filename);
+
+Load an index saved by C<hivex_save_search_index>.  As with
+C<hivex_load_timestamp_index>, if the file was saved from a
+different hive, or a different version of the same hive, this fails
+with errno set to C<EINVAL>, and both functions fail with errno set
+to C<EBUSY> while the handle has uncommitted changes.
+
+=back
+
+=head1 RECOVERING DELETED KEYS AND VALUES
+
+ hive_recovered *hivex_recover (hive_h *h, size_t from, size_t to,
+                                int flags);
+
+When Windows deletes a key or value, it marks the space used by the
+records as free but does not clear it.  This function looks for
+records in the free space of the hive and in the slack space after
+the last hbin page, and returns what it finds.  It is specific to
+the C API.
+
+Only records at offsets between C<from> and C<to> (exclusive) are
+returned.  To search the whole hive, use C<0> and C<SIZE_MAX>.
+hivex does not use threads, so to search a large hive using several
+threads, open a handle in each thread and give each one a different
+range of offsets.  Records are assigned to a range by the offset
+where they start, so each record is found exactly once.
+
+C<flags> must be C<0>.
+
+The result is an array of structures, terminated by an entry where
+C<kind> is C<0>:
+
+ struct hive_recovered {
+   int kind;
+   int flags;
+   size_t offset;
+   char *name;
+   int64_t timestamp;
+   size_t parent;
+   hive_type t;
+   size_t len;
+   char *value;
+ };
+
+C<offset> is the offset of the record in the hive.  The caller must
+free the C<name> and C<value> fields of every entry and the array.
+C<kind> is one of:
+
+=over 4
+
+=item C<hivex_recovered_node>
+
+A key.  C<name> is its name, C<timestamp> is its last modified time
+(see C<hivex_node_timestamp>) and C<parent> is the offset of its
+parent key.
+
+=item C<hivex_recovered_value>
+
+A value.  C<name> is its name (C<""> for the default value), C<t> is
+its type and C<len> is the length of its data.  C<value> is the data
+if it could be recovered (see C<HIVEX_RECOVERED_DATA> below),
+otherwise C<NULL>.
+
+=item C<hivex_recovered_subkey_list>
+
+A list of subkeys.  C<len> is the number of entries.
+
+=item C<hivex_recovered_big_data>
+
+The header of value data split over several cells.  C<len> is the
+number of cells.
+
+=back
+
+Because free space may have been partly reused, records found this
+way are only guesses.  Names must be valid and records must fit in
+the free space, and the C<flags> field says how well a record fits
+in with the rest of the hive:
+
+=over 4
+
+=item C<HIVEX_RECOVERED_IN_SLACK>
+
+The record was found after the last hbin page, rather than in a free
+cell.
+
+=item C<HIVEX_RECOVERED_PARENT_LIVE>
+
+The parent of this key is a key which has not been deleted.  The key
+was probably deleted directly, rather than as part of a subtree.
+
+=item C<HIVEX_RECOVERED_DATA>
+
+The data of this value was stored in the record, or in space which
+is still free, so it cannot have been overwritten by a later record,
+and it is returned in C<value>.
+
+=item C<HIVEX_RECOVERED_LINKS_VALID>
+
+Every entry of this subkey list points at a key record (deleted or
+not), or the list of cells of this big data record lies within the
+hive.
+
+=back
+
+=head1 SHARING SETUP BETWEEN HANDLES
+
+Programs which open many hives, one after another, can open them
+against a shared context.  The context keeps the character set
+converters used to decode names and strings, so that they are only
+created once, and the block bitmap of the last handle closed, so
+that the next handle can reuse it instead of allocating a new one.
+These are specific to the C API.
+
+Handles opened with C<hivex_open> have a private context, so the
+converters are created once per handle rather than once per call.
+
+A context is not locked.  It and all the handles opened against it
+must only be used from one thread at a time.  Programs which use
+several threads should create a context for each thread.
+
+=over 4
+
+=item hivex_context_new
+
+ hive_context *hivex_context_new (int flags);
+
+Create a new context.  C<flags> must be C<0>.  On error this returns
+NULL and sets errno.
+
+=item hivex_open_ctx
+
+ hive_h *hivex_open_ctx (hive_context *ctx, const char *filename, int flags);
+
+This is the same as C<hivex_open>, except that the handle uses the
+context C<ctx>.  If C<ctx> is NULL this is the same as
+C<hivex_open>.
+
+=item hivex_context_free
+
+ int hivex_context_free (hive_context *ctx);
+
+Free the context.  All the handles opened against it must have been
+closed first, otherwise this returns C<-1> with errno set to
+C<EBUSY>.  Returns C<0> on success.
+
+=back
+
+The C<iconv_opens> statistic (see L</STATISTICS>) counts the
+converters created for a handle, which is C<0> for handles which
+only used converters already in their context.
+
+=head1 STATISTICS
+
+C<hivex_get_stats> returns the following structure.  It is also
+available in the language bindings, where it is returned as a hash
+or an association list of counter names to integers.
+
+ struct hive_stats {
+";
+  List.iter (
+    fun (name, _) -> pr "   uint64_t %s;\n" name
+  ) stats_fields;
+  pr " };
+
+=over 4
+
+";
+  List.iter (
+    fun (name, description) ->
+      pr "=item C<%s>\n\n" name;
+      pr "The %s.\n\n" description
+  ) stats_fields;
+  pr "\
+=back
+
+The statistics are always collected, whether or not
+C<HIVEX_OPEN_DEBUG> was used.  The cost of keeping them is a few
+integer increments.
+
+=head1 STATIC TRACEPOINTS
+
+If hivex was configured with C<--enable-probes> (the default when
+C<E<lt>sys/sdt.hE<gt>> is installed) then the library contains
+static USDT tracepoints in the provider C<hivex>.  When nothing is
+attached they cost a single C<nop> instruction each.  They can be
+listed and used with tools such as C<bpftrace>, C<perf probe> or
+SystemTap, for example:
+
+ bpftrace -e 'usdt:/usr/lib64/libhivex.so.0:hivex:get_children__done
+              { @[arg1] = count(); }'
+
+The tracepoints and their arguments are:
+
+=over 4
+
+=item C<open_scan> (filename, size, pages, blocks, scan_ns)
+
+Fired at the end of the page scan in C<hivex_open>.  C<scan_ns> is
+the time taken in nanoseconds (0 if it cannot be measured).
+
+=item C<get_children__start> (node)
+
+=item C<get_children__done> (node, r)
+
+Reading the subkey lists of C<node>.  C<r> is 0 on success or -1.
+
+=item C<get_values__start> (node)
+
+=item C<get_values__done> (node, r)
+
+Reading the value list of C<node>.  C<r> is 0 on success or -1.
+
+=item C<value_value__start> (value)
+
+=item C<value_value__done> (value, len)
+
+Reading the data of C<value>.  C<len> is the length of the data
+returned, or 0 on error.
+
+=item C<recode__start> (input_encoding, output_encoding, input_len)
+
+=item C<recode__done> (input_len, output_len)
+
+Converting a string between character sets.  C<output_len> is 0 on
+error.
+
+=item C<allocate_page__start> (hint)
+
+=item C<allocate_page__done> (hint, offset)
+
+Extending the hive by a new page, for writable hives.  C<offset> is
+the offset of the new page or 0 on error.
+
+=item C<allocate_block__start> (seg_len)
+
+=item C<allocate_block__done> (seg_len, offset)
+
+Allocating a block, for writable hives.  C<offset> is the offset of
+the new block or 0 on error.
+
+=item C<commit__start> (filename, size)
+
+=item C<commit__done> (size, r)
+
+Writing the hive out in C<hivex_commit>.  C<r> is 0 on success or
+-1.
+
+=back
+
+=head1 C++ API
+
+The header file C<E<lt>hivex.hppE<gt>> is a header-only C++17
+wrapper around the C API.  It provides a C<hivex::Hive> class which
+closes the hive when it goes out of scope, and lightweight
+C<hivex::Node> and C<hivex::Value> handles.  The children and values
+of a node can be iterated over using range-based for loops.
+C<Value::data> returns a read-only view of the value data borrowed
+from the hive (see C<hivex_value_value_ptr> above).
+C<Value::as E<lt>TE<gt>> returns the value decoded as C<T>, which is
+checked at compile time.  Errors are thrown as C<hivex::error>,
+which is a C<std::system_error> holding the errno.
+
+C<hivex::Hive> has a method for each function above, named without
+the C<hivex_> prefix (C<hivex_node_add_child> is C<h.node_add_child>),
+and C<Node> and C<Value> convert to the C handles so they can be
+passed to these methods.  Functions which may find nothing, such as
+C<node_get_child>, return C<std::optional>.  The C-only APIs are
+covered too: C<diff> takes any callable and passes on an exception
+thrown by it, C<search> and C<recover> return vectors, and a
+C<hivex::Context> can be passed to the C<Hive> constructor.
+
+ #include <hivex.hpp>
+
+ hivex::Hive h (\"SOFTWARE\");
+ for (auto node : h.root ().children ())
+   for (auto value : node.values ())
+     if (value.get_type () == hivex::type::REG_DWORD)
+       std::cout << value.key () << \" = \"
+                 << value.as<uint32_t> () << \"\\n\";
+
+=head1 VISITING ALL NODES
+
+The visitor pattern is useful if you want to visit all nodes
+in the tree or all nodes below a certain point in the tree.
+
+First you set up your own C<struct hivex_visitor> with your
+callback functions.
+
+Each of these callback functions should return 0 on success or -1
+on error.  If any callback returns -1, then the entire visit
+terminates immediately.  If you don't need a callback function at
+all, set the function pointer to NULL.
+
+ struct hivex_visitor {
+   int (*node_start) (hive_h *, void *opaque, hive_node_h, const char *name);
+   int (*node_end) (hive_h *, void *opaque, hive_node_h, const char *name);
+   int (*value_string) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, const char *str);
+   int (*value_multiple_strings) (hive_h *, void *opaque, hive_node_h,
+         hive_value_h, hive_type t, size_t len, const char *key, char **argv);
+   int (*value_string_invalid_utf16) (hive_h *, void *opaque, hive_node_h,
+         hive_value_h, hive_type t, size_t len, const char *key,
+         const char *str);
+   int (*value_dword) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, int32_t);
+   int (*value_qword) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, int64_t);
+   int (*value_binary) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, const char *value);
+   int (*value_none) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, const char *value);
+   int (*value_other) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, const char *value);
+   /* If value_any callback is not NULL, then the other value_*
+    * callbacks are not used, and value_any is called on all values.
+    */
+   int (*value_any) (hive_h *, void *opaque, hive_node_h, hive_value_h,
+         hive_type t, size_t len, const char *key, const char *value);
+ };
+
+=over 4
+
+=item hivex_visit
+
+ int hivex_visit (hive_h *h, const struct hivex_visitor *visitor, size_t len, void *opaque, int flags);
+
+Visit all the nodes recursively in the hive C<h>.
+
+C<visitor> should be a C<hivex_visitor> structure with callback
+fields filled in as required (unwanted callbacks can be set to
+NULL).  C<len> must be the length of the 'visitor' struct (you
+should pass C<sizeof (struct hivex_visitor)> for this).
+
+This returns 0 if the whole recursive visit was completed
+successfully.  On error this returns -1.  If one of the callback
+functions returned an error than we don't touch errno.  If the
+error was generated internally then we set errno.
+
+You can skip bad registry entries by setting C<flag> to
+C<HIVEX_VISIT_SKIP_BAD>.  If this flag is not set, then a bad registry
+causes the function to return an error immediately.
+
+This function is robust if the registry contains cycles or
+pointers which are invalid or outside the registry.  It detects
+these cases and returns an error.
+
+=item hivex_visit_node
+
+ int hivex_visit_node (hive_h *h, hive_node_h node, const struct hivex_visitor *visitor, size_t len, void *opaque);
+
+Same as C<hivex_visit> but instead of starting out at the root, this
+starts at C<node>.
+
+=back
+
+=head1 THE STRUCTURE OF THE WINDOWS REGISTRY
+
+Note: To understand the relationship between hives and the common
+Windows Registry keys (like C<HKEY_LOCAL_MACHINE>) please see the
+Wikipedia page on the Windows Registry.
+
+The Windows Registry is split across various binary files, each
+file being known as a \"hive\".  This library only handles a single
+hive file at a time.
+
+Hives are n-ary trees with a single root.  Each node in the tree
+has a name.
+
+Each node in the tree (including non-leaf nodes) may have an
+arbitrary list of (key, value) pairs attached to it.  It may
+be the case that one of these pairs has an empty key.  This
+is referred to as the default key for the node.
+
+The (key, value) pairs are the place where the useful data is
+stored in the registry.  The key is always a string (possibly the
+empty string for the default key).  The value is a typed object
+(eg. string, int32, binary, etc.).
+
+=head2 RELATIONSHIP TO .REG FILES
+
+The hivex C library does not care about or deal with Windows .REG
+files.  Instead we push this complexity up to the Perl
+L<Win::Hivex(3)> library and the Perl programs
+L<hivexregedit(1)> and L<virt-win-reg(1)>.
+Nevertheless it is useful to look at the relationship between the
+Registry and .REG files because they are so common.
+
+A .REG file is a textual representation of the registry, or part of the
+registry.  The actual registry hives that Windows uses are binary
+files.  There are a number of Windows and Linux tools that let you
+generate .REG files, or merge .REG files back into the registry hives.
+Notable amongst them is Microsoft's REGEDIT program (formerly known as
+REGEDT32).
+
+A typical .REG file will contain many sections looking like this:
+
+ [HKEY_LOCAL_MACHINE\\SOFTWARE\\Classes\\Stack]
+ \"@\"=\"Generic Stack\"
+ \"TileInfo\"=\"prop:System.FileCount\"
+ \"TilePath\"=str(2):\"%%systemroot%%\\\\system32\"
+ \"ThumbnailCutoff\"=dword:00000000
+ \"FriendlyTypeName\"=hex(2):40,00,25,00,53,00,79,00,73,00,74,00,65,00,6d,00,52,00,6f,00,\\
+  6f,00,74,00,25,00,5c,00,53,00,79,00,73,00,74,00,65,00,6d,00,\\
+  33,00,32,00,5c,00,73,00,65,00,61,00,72,00,63,00,68,00,66,00,\\
+  6f,00,6c,00,64,00,65,00,72,00,2e,00,64,00,6c,00,6c,00,2c,00,\\
+  2d,00,39,00,30,00,32,00,38,00,00,00,d8
+
+Taking this one piece at a time:
+
+ [HKEY_LOCAL_MACHINE\\SOFTWARE\\Classes\\Stack]
+
+This is the path to this node in the registry tree.  The first part,
+C<HKEY_LOCAL_MACHINE\\SOFTWARE> means that this comes from a hive
+file called C<C:\\WINDOWS\\SYSTEM32\\CONFIG\\SOFTWARE>.
+C<\\Classes\\Stack> is the real path part,
+starting at the root node of the C<SOFTWARE> hive.
+
+Below the node name is a list of zero or more key-value pairs.  Any
+interior or leaf node in the registry may have key-value pairs
+attached.
+
+ \"@\"=\"Generic Stack\"
+
+This is the \"default key\".  In reality (ie. inside the binary hive)
+the key string is the empty string.  In .REG files this is written as
+C<@> but this has no meaning either in the hives themselves or in this
+library.  The value is a string (type 1 - see C<enum hive_type>
+above).
+
+ \"TileInfo\"=\"prop:System.FileCount\"
+
+This is a regular (key, value) pair, with the value being a type 1
+string.  Note that inside the binary file the string is likely to be
+UTF-16LE encoded.  This library converts to and from UTF-8 strings
+transparently in some cases.
+
+ \"TilePath\"=str(2):\"%%systemroot%%\\\\system32\"
+
+The value in this case has type 2 (expanded string) meaning that some
+%%...%% variables get expanded by Windows.  (This library doesn't know
+or care about variable expansion).
+
+ \"ThumbnailCutoff\"=dword:00000000
+
+The value in this case is a dword (type 4).
+
+ \"FriendlyTypeName\"=hex(2):40,00,....
+
+This value is an expanded string (type 2) represented in the .REG file
+as a series of hex bytes.  In this case the string appears to be a
+UTF-16LE string.
+
+=head1 NOTE ON THE USE OF ERRNO
+
+Many functions in this library set errno to indicate errors.  These
+are the values of errno you may encounter (this list is not
+exhaustive):
+
+=over 4
+
+=item ENOTSUP
+
+Corrupt or unsupported Registry file format.
+
+=item HIVEX_NO_KEY
+
+Missing root key.
+
+=item EINVAL
+
+Passed an invalid argument to the function.
+
+=item EFAULT
+
+Followed a Registry pointer which goes outside
+the registry or outside a registry block.
+
+=item ELOOP
+
+Registry contains cycles.
+
+=item ERANGE
+
+Field in the registry out of range.
+
+=item EEXIST
+
+Registry key already exists.
+
+=item EROFS
+
+Tried to write to a registry which is not opened for writing.
+
+=back
+
+=head1 ENVIRONMENT VARIABLES
+
+=over 4
+
+=item HIVEX_DEBUG
+
+Setting HIVEX_DEBUG=1 will enable very verbose messages.  This is
+useful for debugging problems with the library itself.
+
+=back
+
+=head1 SEE ALSO
+
+L<hivex-batch(1)>,
+L<hivex2sqlite(1)>,
+L<hivexdiff(1)>,
+L<hivexget(1)>,
+L<hivexml(1)>,
+L<hivexsh(1)>,
+L<hivextimeline(1)>,
+L<hivexregedit(1)>,
+L<virt-win-reg(1)>,
+L<Win::Hivex(3)>,
+L<guestfs(3)>,
+L<http://libguestfs.org/>,
+L<virt-cat(1)>,
+L<virt-edit(1)>,
+L<http://en.wikipedia.org/wiki/Windows_Registry>.
+
+=head1 AUTHORS
+
+Richard W.M. Jones (C<rjones at redhat dot com>)
+
+=head1 COPYRIGHT
+
+Copyright (C) 2009-2010 Red Hat Inc.
 
 Derived from code by Petter Nordahl-Hagen under a compatible license:
 Copyright (C) 1997-2007 Petter Nordahl-Hagen.
@@ -1479,44 +2413,909 @@ modify it under the terms of the GNU Lesser General Public
 License as published by the Free Software Foundation;
 version 2.1 of the License only.
 
-This library is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-Lesser General Public License for more details.
-"
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+"
+
+(* Generate the linker script which controls the visibility of
+ * symbols in the public ABI and ensures no other symbols get
+ * exported accidentally.
+ *)
+and generate_linker_script () =
+  generate_header HashStyle GPLv2plus;
+
+  let globals = [
+    "hivex_build_search_index";
+    "hivex_build_timestamp_index";
+    "hivex_context_free";
+    "hivex_context_new";
+    "hivex_diff";
+    "hivex_load_node_hashes";
+    "hivex_load_search_index";
+    "hivex_load_timestamp_index";
+    "hivex_memory_usage";
+    "hivex_nodes_modified_between";
+    "hivex_nodes_most_recent";
+    "hivex_open_ctx";
+    "hivex_recover";
+    "hivex_save_node_hashes";
+    "hivex_save_search_index";
+    "hivex_save_timestamp_index";
+    "hivex_search";
+    "hivex_set_memory_limit";
+    "hivex_value_value_ptr";
+    "hivex_visit";
+    "hivex_visit_node"
+  ] in
+
+  let functions =
+    List.map (fun (name, _, _, _) -> "hivex_" ^ name)
+      functions in
+  let globals = List.sort compare (globals @ functions) in
+
+  pr "{\n";
+  pr "    global:\n";
+  List.iter (pr "        %s;\n") globals;
+  pr "\n";
+
+  pr "    local:\n";
+  pr "        *;\n";
+  pr "};\n"
+
+and generate_cxx_header () =
+  generate_header CStyle LGPLv2;
+
+  pr "\
+#ifndef HIVEX_HPP_
+#define HIVEX_HPP_
+
+/* C++ bindings for hivex.  This is a header-only wrapper around the
+ * C API in <hivex.h>, and requires C++17.  See hivex(3).
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus > 201703L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+
+#include <hivex.h>
+
+namespace hivex {
+
+/* Read-only view of bytes borrowed from the hive. */
+#if defined(__cpp_lib_span)
+using bytes = std::span<const char>;
+#else
+class bytes {
+public:
+  constexpr bytes () noexcept : data_ (nullptr), size_ (0) {}
+  constexpr bytes (const char *data, std::size_t size) noexcept
+    : data_ (data), size_ (size) {}
+
+  constexpr const char *data () const noexcept { return data_; }
+  constexpr std::size_t size () const noexcept { return size_; }
+  constexpr bool empty () const noexcept { return size_ == 0; }
+  constexpr const char *begin () const noexcept { return data_; }
+  constexpr const char *end () const noexcept { return data_ + size_; }
+  constexpr const char &operator[] (std::size_t i) const noexcept {
+    return data_[i];
+  }
+
+private:
+  const char *data_;
+  std::size_t size_;
+};
+#endif
+
+/* All errors from the C library are thrown as hivex::error.  what()
+ * is the name of the C function, and code() is the errno.
+ */
+class error : public std::system_error {
+public:
+  error (const char *function, int err)
+    : std::system_error (err, std::generic_category (), function) {}
+};
+
+/* Value types, see hive_type in hivex(3). */
+enum class type : int {
+";
+  List.iter (
+    fun (_, _, new_style, description) ->
+      pr "  REG_%s = hive_t_REG_%s, /* %s */\n"
+        new_style new_style description
+  ) hive_types;
+
+  pr "\
+};
+
+/* Flags for Hive constructor. */
+";
+  List.iter (
+    fun (_, flag, description) ->
+      pr "inline constexpr int OPEN_%s = HIVEX_OPEN_%s; /* %s */\n"
+        flag flag description
+  ) open_flags;
+
+  pr "\
+
+namespace detail {
+
+[[noreturn]] inline void
+throw_error (const char *function)
+{
+  throw error (function, errno);
+}
+
+struct free_deleter {
+  void operator() (void *p) const noexcept { std::free (p); }
+};
+
+struct close_deleter {
+  void operator() (hive_h *h) const noexcept { hivex_close (h); }
+};
+
+struct context_deleter {
+  void operator() (hive_context *ctx) const noexcept {
+    hivex_context_free (ctx);
+  }
+};
+
+/* These free the lists returned by the C library, including the
+ * strings they point to.
+ */
+struct strings_deleter {
+  void operator() (char **p) const noexcept {
+    for (std::size_t i = 0; p[i] != nullptr; ++i)
+      std::free (p[i]);
+    std::free (p);
+  }
+};
+
+struct node_named_deleter {
+  void operator() (hive_node_named *p) const noexcept {
+    for (std::size_t i = 0; p[i].name != nullptr; ++i)
+      std::free (p[i].name);
+    std::free (p);
+  }
+};
+
+struct value_full_deleter {
+  void operator() (hive_value_full *p) const noexcept {
+    for (std::size_t i = 0; p[i].key != nullptr; ++i) {
+      std::free (p[i].key);
+      std::free (p[i].value);
+    }
+    std::free (p);
+  }
+};
+
+struct recovered_deleter {
+  void operator() (hive_recovered *p) const noexcept {
+    for (std::size_t i = 0; p[i].kind != 0; ++i) {
+      std::free (p[i].name);
+      std::free (p[i].value);
+    }
+    std::free (p);
+  }
+};
+
+/* Take ownership of a string returned by the C library. */
+inline std::string
+take_string (char *s, const char *function)
+{
+  if (s == nullptr)
+    throw_error (function);
+  std::unique_ptr<char, free_deleter> p (s);
+  return std::string (s);
+}
+
+/* Take ownership of a list of strings returned by the C library. */
+inline std::vector<std::string>
+take_strings (char **r, const char *function)
+{
+  if (r == nullptr)
+    throw_error (function);
+  std::unique_ptr<char *, strings_deleter> p (r);
+  std::vector<std::string> ret;
+  for (std::size_t i = 0; r[i] != nullptr; ++i)
+    ret.emplace_back (r[i]);
+  return ret;
+}
+
+template <typename T>
+inline constexpr bool dependent_false = false;
+
+} // namespace detail
+
+class Node;
+class Value;
+
+/* A range over a list of nodes or values.  The list of handles is
+ * fetched once when the range is created; iterating over it does not
+ * allocate.
+ */
+template <typename T, typename Handle>
+class range {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = T;
+
+    iterator () noexcept : h_ (nullptr), p_ (nullptr) {}
+    iterator (hive_h *h, const Handle *p) noexcept : h_ (h), p_ (p) {}
+
+    T operator* () const noexcept { return T (h_, *p_); }
+    iterator &operator++ () noexcept { ++p_; return *this; }
+    iterator operator++ (int) noexcept { iterator r = *this; ++p_; return r; }
+    bool operator== (const iterator &o) const noexcept { return p_ == o.p_; }
+    bool operator!= (const iterator &o) const noexcept { return p_ != o.p_; }
+
+  private:
+    hive_h *h_;
+    const Handle *p_;
+  };
+
+  range (hive_h *h, Handle *list) noexcept : h_ (h), list_ (list), size_ (0) {
+    while (list[size_] != 0)
+      ++size_;
+  }
+
+  iterator begin () const noexcept { return iterator (h_, list_.get ()); }
+  iterator end () const noexcept { return iterator (h_, list_.get () + size_); }
+  std::size_t size () const noexcept { return size_; }
+  bool empty () const noexcept { return size_ == 0; }
+  T operator[] (std::size_t i) const noexcept { return T (h_, list_.get ()[i]); }
+
+private:
+  hive_h *h_;
+  std::unique_ptr<Handle, detail::free_deleter> list_;
+  std::size_t size_;
+};
+
+using nodes_range = range<Node, hive_node_h>;
+using values_range = range<Value, hive_value_h>;
+using children_range = nodes_range;
+
+/* A (key, value) pair.  This is a lightweight handle which is only
+ * valid as long as the Hive it came from.
+ */
+class Value {
+public:
+  Value (hive_h *h, hive_value_h value) noexcept : h_ (h), value_ (value) {}
+
+  hive_value_h handle () const noexcept { return value_; }
+  operator hive_value_h () const noexcept { return value_; }
+
+  std::string key () const {
+    return detail::take_string (hivex_value_key (h_, value_),
+                                \"hivex_value_key\");
+  }
+
+  hive_type raw_type () const {
+    hive_type t;
+    std::size_t len;
+    if (hivex_value_type (h_, value_, &t, &len) == -1)
+      detail::throw_error (\"hivex_value_type\");
+    return t;
+  }
+
+  type get_type () const { return static_cast<type> (raw_type ()); }
+
+  std::size_t size () const {
+    hive_type t;
+    std::size_t len;
+    if (hivex_value_type (h_, value_, &t, &len) == -1)
+      detail::throw_error (\"hivex_value_type\");
+    return len;
+  }
+
+  /* Return the data without copying it.  This only works for hives
+   * opened read-only, and for values stored inline or in a single
+   * cell; otherwise it throws an error with code ENOTSUP and you
+   * should use copy() instead.  See hivex_value_value_ptr.
+   */
+  bytes data () const {
+    hive_type t;
+    std::size_t len;
+    const char *r = hivex_value_value_ptr (h_, value_, &t, &len);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_value_value_ptr\");
+    return bytes (r, len);
+  }
+
+  /* Return a copy of the data. */
+  std::vector<char> copy () const {
+    hive_type t;
+    std::size_t len;
+    char *r = hivex_value_value (h_, value_, &t, &len);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_value_value\");
+    std::unique_ptr<char, detail::free_deleter> p (r);
+    return std::vector<char> (r, r + len);
+  }
+
+  /* Return the value decoded as T, which must be one of:
+   *   std::string              (string, expand_string, link)
+   *   std::vector<std::string> (multiple_strings)
+   *   a 32 bit integer type    (dword, dword_be)
+   *   a 64 bit integer type    (qword)
+   *   std::vector<char>        (any type, same as copy())
+   * Using any other type is a compile-time error.  If the value does
+   * not have a matching type, an error is thrown.
+   */
+  template <typename T>
+  T as () const {
+    if constexpr (std::is_same_v<T, std::string>) {
+      return detail::take_string (hivex_value_string (h_, value_),
+                                  \"hivex_value_string\");
+    }
+    else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+      char **r = hivex_value_multiple_strings (h_, value_);
+      if (r == nullptr)
+        detail::throw_error (\"hivex_value_multiple_strings\");
+      std::vector<std::string> ret;
+      for (std::size_t i = 0; r[i] != nullptr; ++i) {
+        ret.emplace_back (r[i]);
+        std::free (r[i]);
+      }
+      std::free (r);
+      return ret;
+    }
+    else if constexpr (std::is_same_v<T, std::vector<char>>) {
+      return copy ();
+    }
+    else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+                       sizeof (T) == 4) {
+      errno = 0;
+      int32_t r = hivex_value_dword (h_, value_);
+      if (r == -1 && errno != 0)
+        detail::throw_error (\"hivex_value_dword\");
+      return static_cast<T> (r);
+    }
+    else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+                       sizeof (T) == 8) {
+      errno = 0;
+      int64_t r = hivex_value_qword (h_, value_);
+      if (r == -1 && errno != 0)
+        detail::throw_error (\"hivex_value_qword\");
+      return static_cast<T> (r);
+    }
+    else {
+      static_assert (detail::dependent_false<T>,
+                     \"hivex::Value::as<T>: T must be std::string, \"
+                     \"std::vector<std::string>, std::vector<char>, \"
+                     \"or a 32 or 64 bit integer type\");
+    }
+  }
+
+  bool operator== (const Value &o) const noexcept { return value_ == o.value_; }
+  bool operator!= (const Value &o) const noexcept { return value_ != o.value_; }
+
+private:
+  hive_h *h_;
+  hive_value_h value_;
+};
+
+/* An entry of the list returned by Hive::node_values_full. */
+struct value_full {
+  std::string key;
+  hive_type t;
+  std::vector<char> value;
+  Value val;
+};
+
+/* A node (registry key).  This is a lightweight handle which is only
+ * valid as long as the Hive it came from.
+ */
+class Node {
+public:
+  Node (hive_h *h, hive_node_h node) noexcept : h_ (h), node_ (node) {}
+
+  hive_node_h handle () const noexcept { return node_; }
+  operator hive_node_h () const noexcept { return node_; }
+
+  std::string name () const {
+    return detail::take_string (hivex_node_name (h_, node_),
+                                \"hivex_node_name\");
+  }
+
+  int64_t timestamp () const {
+    errno = 0;
+    int64_t r = hivex_node_timestamp (h_, node_);
+    if (r == -1 && errno != 0)
+      detail::throw_error (\"hivex_node_timestamp\");
+    return r;
+  }
+
+  Node parent () const {
+    hive_node_h r = hivex_node_parent (h_, node_);
+    if (r == 0)
+      detail::throw_error (\"hivex_node_parent\");
+    return Node (h_, r);
+  }
+
+  std::string path () const {
+    return detail::take_string (hivex_node_path (h_, node_),
+                                \"hivex_node_path\");
+  }
+
+  std::string hash () const {
+    return detail::take_string (hivex_node_hash (h_, node_),
+                                \"hivex_node_hash\");
+  }
+
+  children_range children () const {
+    hive_node_h *r = hivex_node_children (h_, node_);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_node_children\");
+    return children_range (h_, r);
+  }
+
+  /* Return the named child, or nothing if there is no such child. */
+  std::optional<Node> child (const std::string &name) const {
+    errno = 0;
+    hive_node_h r = hivex_node_get_child (h_, node_, name.c_str ());
+    if (r == 0) {
+      if (errno != 0)
+        detail::throw_error (\"hivex_node_get_child\");
+      return std::nullopt;
+    }
+    return Node (h_, r);
+  }
+
+  values_range values () const {
+    hive_value_h *r = hivex_node_values (h_, node_);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_node_values\");
+    return values_range (h_, r);
+  }
+
+  /* Return the named value, or nothing if there is no such value. */
+  std::optional<Value> value (const std::string &key) const {
+    errno = 0;
+    hive_value_h r = hivex_node_get_value (h_, node_, key.c_str ());
+    if (r == 0) {
+      if (errno != 0)
+        detail::throw_error (\"hivex_node_get_value\");
+      return std::nullopt;
+    }
+    return Value (h_, r);
+  }
+
+  bool operator== (const Node &o) const noexcept { return node_ == o.node_; }
+  bool operator!= (const Node &o) const noexcept { return node_ != o.node_; }
+
+private:
+  hive_h *h_;
+  hive_node_h node_;
+};
+
+/* An entry of the list returned by Hive::node_children_named. */
+struct node_named {
+  std::string name;
+  Node node;
+};
+
+/* An entry of the list returned by Hive::search. */
+struct search_match {
+  Node node;
+  Value value;
+};
+
+/* A record returned by Hive::recover.  See hivex_recover in hivex(3)
+ * for the meaning of the fields.  value is only set for values whose
+ * data was recovered.
+ */
+struct recovered {
+  int kind;
+  int flags;
+  std::size_t offset;
+  std::string name;
+  int64_t timestamp;
+  std::size_t parent;
+  hive_type t;
+  std::size_t len;
+  std::optional<std::vector<char>> value;
+};
+
+/* Setup shared between handles, see hivex_open_ctx in hivex(3).  The
+ * context must outlive the Hive objects opened with it.
+ */
+class Context {
+public:
+  Context () : ctx_ (hivex_context_new (0)) {
+    if (!ctx_)
+      detail::throw_error (\"hivex_context_new\");
+  }
+
+  hive_context *get () const noexcept { return ctx_.get (); }
+
+private:
+  std::unique_ptr<hive_context, detail::context_deleter> ctx_;
+};
+
+/* A hive handle.  The hive is closed when this object is destroyed.
+ *
+ * There is a method for each function in hivex(3), with the same
+ * name without the hivex_ prefix.  Node and Value convert to the C
+ * handles, so they can be passed wherever a handle is expected.
+ */
+class Hive {
+public:
+  explicit Hive (const std::string &filename, int flags = 0)
+    : h_ (hivex_open (filename.c_str (), flags)) {
+    if (!h_)
+      detail::throw_error (\"hivex_open\");
+  }
+
+  Hive (const Context &ctx, const std::string &filename, int flags = 0)
+    : h_ (hivex_open_ctx (ctx.get (), filename.c_str (), flags)) {
+    if (!h_)
+      detail::throw_error (\"hivex_open_ctx\");
+  }
+
+  /* Close the hive now, reporting any error.  After this the object
+   * must not be used.
+   */
+  void close () {
+    hive_h *h = h_.release ();
+    if (h != nullptr && hivex_close (h) == -1)
+      detail::throw_error (\"hivex_close\");
+  }
+
+  /* The underlying C handle, for calling the C API directly. */
+  hive_h *get () const noexcept { return h_.get (); }
+";
+
+  (* The wrappers for the functions in the table. *)
+  List.iter (
+    fun (name, (ret, args), shortdesc, _) ->
+      match ret with
+      | RHive | RErrDispose -> () (* open and close are written above *)
+      | _ ->
+          let args = List.filter (function AHive -> false | _ -> true) args in
+          let rec params = function
+            | [] -> []
+            | arg :: rest ->
+                (* Optional arguments at the end can be omitted. *)
+                let last =
+                  List.for_all (function AUnusedFlags -> true | _ -> false)
+                    rest in
+                let param =
+                  match arg with
+                  | AHive | AUnusedFlags -> []
+                  | ANode n -> [sprintf "hive_node_h %s" n]
+                  | AValue n -> [sprintf "hive_value_h %s" n]
+                  | AString n -> [sprintf "const std::string &%s" n]
+                  | AStringNullable n ->
+                      [sprintf "const std::optional<std::string> &%s%s" n
+                         (if last then " = std::nullopt" else "")]
+                  | AOpenFlags -> ["int flags"]
+                  | ASetValues -> ["const std::vector<hive_set_value> &values"]
+                  | ASetValue -> ["const hive_set_value &val"] in
+                param @ params rest in
+          let c_params =
+            List.map (function
+                      | AHive -> []
+                      | ANode n | AValue n -> [n]
+                      | AString n -> [n ^ ".c_str ()"]
+                      | AStringNullable n ->
+                          [sprintf "%s ? %s->c_str () : nullptr" n n]
+                      | AOpenFlags -> ["flags"]
+                      | AUnusedFlags -> ["0"]
+                      | ASetValues -> ["values.size ()"; "values.data ()"]
+                      | ASetValue -> ["&val"]) args in
+          let c_params =
+            match ret with
+            | RLenType | RLenTypeVal -> c_params @ [["&t"; "&len"]]
+            | RLenValue -> c_params @ [["&len"]]
+            | RStats -> c_params @ [["&stats"; "sizeof stats"]]
+            | _ -> c_params in
+          let call =
+            sprintf "hivex_%s (%s)" name
+              (String.concat ", " ("h_.get ()" :: List.concat c_params)) in
+          let ret_type =
+            match ret with
+            | RHive | RErrDispose -> assert false
+            | RErr -> "void"
+            | RSize -> "std::size_t"
+            | RNode -> "Node"
+            | RNodeNotFound -> "std::optional<Node>"
+            | RNodeList -> "nodes_range"
+            | RValue -> "std::optional<Value>"
+            | RValueList -> "values_range"
+            | RNodeNamedList -> "std::vector<node_named>"
+            | RValueFullList -> "std::vector<value_full>"
+            | RString -> "std::string"
+            | RStringList -> "std::vector<std::string>"
+            | RLenType -> "std::pair<hive_type, std::size_t>"
+            | RLenValue -> "std::pair<std::size_t, std::size_t>"
+            | RLenTypeVal -> "std::pair<hive_type, std::vector<char>>"
+            | RStats -> "hive_stats"
+            | RInt32 -> "int32_t"
+            | RInt64 -> "int64_t" in
+
+          pr "\n";
+          pr "  /* %s */\n" shortdesc;
+          pr "  %s %s (%s)%s {\n" ret_type name
+            (String.concat ", " (params args))
+            (if List.mem name write_functions then "" else " const");
+          let throw () =
+            pr "      detail::throw_error (\"hivex_%s\");\n" name in
+          (match ret with
+           | RHive | RErrDispose -> assert false
+           | RErr ->
+               pr "    if (%s == -1)\n" call;
+               throw ()
+           | RSize ->
+               pr "    errno = 0;\n";
+               pr "    std::size_t r = %s;\n" call;
+               pr "    if (r == 0 && errno != 0)\n";
+               throw ();
+               pr "    return r;\n"
+           | RNode ->
+               pr "    hive_node_h r = %s;\n" call;
+               pr "    if (r == 0)\n";
+               throw ();
+               pr "    return Node (h_.get (), r);\n"
+           | RNodeNotFound | RValue ->
+               (* Not found is 0 without errno set. *)
+               let t, cls = if ret = RValue then "value", "Value"
+                            else "node", "Node" in
+               pr "    errno = 0;\n";
+               pr "    hive_%s_h r = %s;\n" t call;
+               pr "    if (r == 0) {\n";
+               pr "      if (errno != 0)\n";
+               pr "  "; throw ();
+               pr "      return std::nullopt;\n";
+               pr "    }\n";
+               pr "    return %s (h_.get (), r);\n" cls
+           | RNodeList | RValueList ->
+               let t = if ret = RNodeList then "node" else "value" in
+               pr "    hive_%s_h *r = %s;\n" t call;
+               pr "    if (r == nullptr)\n";
+               throw ();
+               pr "    return %s (h_.get (), r);\n" ret_type
+           | RNodeNamedList ->
+               pr "    hive_node_named *r = %s;\n" call;
+               pr "    if (r == nullptr)\n";
+               throw ();
+               pr "    std::unique_ptr<hive_node_named, detail::node_named_deleter>\n";
+               pr "      p (r);\n";
+               pr "    std::vector<node_named> ret;\n";
+               pr "    for (std::size_t i = 0; r[i].name != nullptr; ++i)\n";
+               pr "      ret.push_back ({ r[i].name, Node (h_.get (), r[i].node) });\n";
+               pr "    return ret;\n"
+           | RValueFullList ->
+               pr "    hive_value_full *r = %s;\n" call;
+               pr "    if (r == nullptr)\n";
+               throw ();
+               pr "    std::unique_ptr<hive_value_full, detail::value_full_deleter>\n";
+               pr "      p (r);\n";
+               pr "    std::vector<value_full> ret;\n";
+               pr "    for (std::size_t i = 0; r[i].key != nullptr; ++i)\n";
+               pr "      ret.push_back ({ r[i].key, r[i].t,\n";
+               pr "                       std::vector<char> (r[i].value,\n";
+               pr "                                          r[i].value + r[i].len),\n";
+               pr "                       Value (h_.get (), r[i].val) });\n";
+               pr "    return ret;\n"
+           | RString ->
+               pr "    return detail::take_string (%s,\n" call;
+               pr "                                \"hivex_%s\");\n" name
+           | RStringList ->
+               pr "    return detail::take_strings (%s,\n" call;
+               pr "                                 \"hivex_%s\");\n" name
+           | RLenType ->
+               pr "    hive_type t;\n";
+               pr "    std::size_t len;\n";
+               pr "    if (%s == -1)\n" call;
+               throw ();
+               pr "    return { t, len };\n"
+           | RLenValue ->
+               pr "    std::size_t len;\n";
+               pr "    errno = 0;\n";
+               pr "    hive_value_h r = %s;\n" call;
+               pr "    if (r == 0 && errno != 0)\n";
+               throw ();
+               pr "    return { r, len };\n"
+           | RLenTypeVal ->
+               pr "    hive_type t;\n";
+               pr "    std::size_t len;\n";
+               pr "    char *r = %s;\n" call;
+               pr "    if (r == nullptr)\n";
+               throw ();
+               pr "    std::unique_ptr<char, detail::free_deleter> p (r);\n";
+               pr "    return { t, std::vector<char> (r, r + len) };\n"
+           | RStats ->
+               pr "    hive_stats stats;\n";
+               pr "    if (%s == -1)\n" call;
+               throw ();
+               pr "    return stats;\n"
+           | RInt32 | RInt64 ->
+               pr "    errno = 0;\n";
+               pr "    %s r = %s;\n" ret_type call;
+               pr "    if (r == -1 && errno != 0)\n";
+               throw ();
+               pr "    return r;\n"
+          );
+          pr "  }\n"
+  ) functions;
+
+  pr "\
+
+  /* The methods below wrap the parts of the API which are specific to
+   * C, see hivex(3).
+   */
+
+  void set_memory_limit (std::size_t limit) {
+    if (hivex_set_memory_limit (h_.get (), limit) == -1)
+      detail::throw_error (\"hivex_set_memory_limit\");
+  }
+
+  std::size_t memory_usage () const noexcept {
+    return hivex_memory_usage (h_.get ());
+  }
+
+  void build_timestamp_index () const {
+    if (hivex_build_timestamp_index (h_.get (), 0) == -1)
+      detail::throw_error (\"hivex_build_timestamp_index\");
+  }
+
+  nodes_range nodes_modified_between (int64_t from, int64_t to) const {
+    hive_node_h *r = hivex_nodes_modified_between (h_.get (), from, to);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_nodes_modified_between\");
+    return nodes_range (h_.get (), r);
+  }
+
+  nodes_range nodes_most_recent (std::size_t n) const {
+    hive_node_h *r = hivex_nodes_most_recent (h_.get (), n);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_nodes_most_recent\");
+    return nodes_range (h_.get (), r);
+  }
+
+  void save_timestamp_index (const std::string &filename) const {
+    if (hivex_save_timestamp_index (h_.get (), filename.c_str ()) == -1)
+      detail::throw_error (\"hivex_save_timestamp_index\");
+  }
+
+  void load_timestamp_index (const std::string &filename) {
+    if (hivex_load_timestamp_index (h_.get (), filename.c_str ()) == -1)
+      detail::throw_error (\"hivex_load_timestamp_index\");
+  }
+
+  /* Compare the tree under node1 in this hive with the tree under
+   * node2 in other, calling
+   *   callback (int change, hive_node_h node1, hive_node_h node2,
+   *             hive_value_h value1, hive_value_h value2)
+   * for each difference.  An exception thrown by the callback stops
+   * the comparison and is passed on to the caller.
+   */
+  template <typename F>
+  void diff (hive_node_h node1, const Hive &other, hive_node_h node2,
+             F &&callback, int flags = 0) const {
+    struct state {
+      F &callback;
+      std::exception_ptr error;
+    } s { callback, nullptr };
+    auto call = [] (hive_h *, hive_h *, void *opaque, int change,
+                    hive_node_h n1, hive_node_h n2,
+                    hive_value_h v1, hive_value_h v2) -> int {
+      state *s = static_cast<state *> (opaque);
+      try {
+        s->callback (change, n1, n2, v1, v2);
+        return 0;
+      }
+      catch (...) {
+        s->error = std::current_exception ();
+        return -1;
+      }
+    };
+    int r = hivex_diff (h_.get (), node1, other.h_.get (), node2,
+                        call, &s, flags);
+    if (s.error)
+      std::rethrow_exception (s.error);
+    if (r == -1)
+      detail::throw_error (\"hivex_diff\");
+  }
+
+  void save_node_hashes (const std::string &filename) const {
+    if (hivex_save_node_hashes (h_.get (), filename.c_str ()) == -1)
+      detail::throw_error (\"hivex_save_node_hashes\");
+  }
+
+  void load_node_hashes (const std::string &filename) {
+    if (hivex_load_node_hashes (h_.get (), filename.c_str ()) == -1)
+      detail::throw_error (\"hivex_load_node_hashes\");
+  }
+
+  void build_search_index () const {
+    if (hivex_build_search_index (h_.get (), 0) == -1)
+      detail::throw_error (\"hivex_build_search_index\");
+  }
+
+  std::vector<search_match> search (const std::string &str,
+                                    int flags = 0) const {
+    hive_search_match *r = hivex_search (h_.get (), str.c_str (), flags);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_search\");
+    std::unique_ptr<hive_search_match, detail::free_deleter> p (r);
+    std::vector<search_match> ret;
+    for (std::size_t i = 0; r[i].node != 0; ++i)
+      ret.push_back ({ Node (h_.get (), r[i].node),
+                       Value (h_.get (), r[i].value) });
+    return ret;
+  }
 
-(* Generate the linker script which controls the visibility of
- * symbols in the public ABI and ensures no other symbols get
- * exported accidentally.
- *)
-and generate_linker_script () =
-  generate_header HashStyle GPLv2plus;
+  void save_search_index (const std::string &filename) const {
+    if (hivex_save_search_index (h_.get (), filename.c_str ()) == -1)
+      detail::throw_error (\"hivex_save_search_index\");
+  }
 
-  let globals = [
-    "hivex_visit";
-    "hivex_visit_node"
-  ] in
+  void load_search_index (const std::string &filename) {
+    if (hivex_load_search_index (h_.get (), filename.c_str ()) == -1)
+      detail::throw_error (\"hivex_load_search_index\");
+  }
 
-  let functions =
-    List.map (fun (name, _, _, _) -> "hivex_" ^ name)
-      functions in
-  let globals = List.sort compare (globals @ functions) in
+  std::vector<recovered> recover (std::size_t from = 0,
+                                  std::size_t to = SIZE_MAX) const {
+    hive_recovered *r = hivex_recover (h_.get (), from, to, 0);
+    if (r == nullptr)
+      detail::throw_error (\"hivex_recover\");
+    std::unique_ptr<hive_recovered, detail::recovered_deleter> p (r);
+    std::vector<recovered> ret;
+    for (std::size_t i = 0; r[i].kind != 0; ++i) {
+      recovered e { r[i].kind, r[i].flags, r[i].offset,
+                    r[i].name ? r[i].name : \"\", r[i].timestamp,
+                    r[i].parent, r[i].t, r[i].len, std::nullopt };
+      if (r[i].value)
+        e.value.emplace (r[i].value, r[i].value + r[i].len);
+      ret.push_back (std::move (e));
+    }
+    return ret;
+  }
 
-  pr "{\n";
-  pr "    global:\n";
-  List.iter (pr "        %s;\n") globals;
-  pr "\n";
+private:
+  std::unique_ptr<hive_h, detail::close_deleter> h_;
+};
 
-  pr "    local:\n";
-  pr "        *;\n";
-  pr "};\n"
+} // namespace hivex
+
+#endif /* HIVEX_HPP_ */
+"
 
 and generate_ocaml_interface () =
   generate_header OCamlStyle LGPLv2plus;
 
   pr "\
 type t
-(** A [hive_h] hive file handle. *)
+(** A [hive_h] hive file handle.
+
+    The OCaml runtime lock is released during calls into the C
+    library, so separate handles may be used from different threads
+    at the same time.  A single handle must not be shared between
+    threads without external locking. *)
 
 type node
 type value
@@ -1654,11 +3453,14 @@ and generate_ocaml_prototype ?(is_external = false) name style =
    | RNodeList -> pr "node array"
    | RValue -> pr "value"
    | RValueList -> pr "value array"
+   | RNodeNamedList -> pr "(string * node) array"
+   | RValueFullList -> pr "(string * hive_type * string) array"
    | RString -> pr "string"
    | RStringList -> pr "string array"
    | RLenType -> pr "hive_type * int"
    | RLenValue -> pr "int * value"
    | RLenTypeVal -> pr "hive_type * string"
+   | RStats -> pr "(string * int64) array"
    | RInt32 -> pr "int32"
    | RInt64 -> pr "int64"
   );
@@ -1674,6 +3476,7 @@ and generate_ocaml_c () =
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
@@ -1717,12 +3520,17 @@ static value Val_hiveh (hive_h *);
 static int HiveOpenFlags_val (value);
 static hive_set_value *HiveSetValue_val (value);
 static hive_set_value *HiveSetValues_val (value);
+static void free_set_values (hive_set_value *, size_t);
+static char *copy_string_val (value);
 static hive_type HiveType_val (value);
 static value Val_hive_type (hive_type);
 static value copy_int_array (size_t *);
 static value copy_type_len (size_t, hive_type);
 static value copy_len_value (size_t, hive_value_h);
 static value copy_type_value (const char *, size_t, hive_type);
+static value copy_node_named_array (hive_node_named *);
+static value copy_value_full_array (hive_value_full *);
+static value copy_stats (const hive_stats *);
 static void raise_error (const char *) Noreturn;
 static void raise_closed (const char *) Noreturn;
 
@@ -1745,6 +3553,7 @@ static void raise_closed (const char *) Noreturn;
         match fst style with
         | RLenType | RLenTypeVal -> c_params @ [["&t"; "&len"]]
         | RLenValue -> c_params @ [["&len"]]
+        | RStats -> c_params @ [["&stats"; "sizeof stats"]]
         | _ -> c_params in
       let c_params = List.concat c_params in
 
@@ -1780,10 +3589,10 @@ static void raise_closed (const char *) Noreturn;
         | AValue n ->
             pr "  hive_value_h %s = Int_val (%sv);\n" n n
         | AString n ->
-            pr "  const char *%s = String_val (%sv);\n" n n
+            pr "  char *%s = copy_string_val (%sv);\n" n n
         | AStringNullable n ->
-            pr "  const char *%s =\n" n;
-            pr "    %sv != Val_int (0) ? String_val (Field (%sv, 0)) : NULL;\n"
+            pr "  char *%s =\n" n;
+            pr "    %sv != Val_int (0) ? copy_string_val (Field (%sv, 0)) : NULL;\n"
               n n
         | AOpenFlags ->
             pr "  int flags = HiveOpenFlags_val (flagsv);\n"
@@ -1796,6 +3605,37 @@ static void raise_closed (const char *) Noreturn;
       ) (snd style);
       pr "\n";
 
+      let free_copies indent =
+        List.iter (
+          function
+          | AHive | ANode _ | AValue _ | AOpenFlags | AUnusedFlags -> ()
+          | AString n | AStringNullable n ->
+              pr "%sfree (%s);\n" indent n
+          | ASetValues ->
+              pr "%sfree_set_values (values, nrvalues);\n" indent
+          | ASetValue ->
+              pr "%sfree_set_values (val, 1);\n" indent
+        ) (snd style) in
+
+      (* If any copy failed, free the others before raising. *)
+      let copy_failed =
+        filter_map (
+          function
+          | AHive | ANode _ | AValue _ | AOpenFlags | AUnusedFlags -> None
+          | AString n -> Some (sprintf "%s == NULL" n)
+          | AStringNullable n ->
+              Some (sprintf "(%sv != Val_int (0) && %s == NULL)" n n)
+          | ASetValues -> Some "values == NULL"
+          | ASetValue -> Some "val == NULL"
+        ) (snd style) in
+      if copy_failed <> [] then (
+        pr "  if (%s) {\n" (String.concat " ||\n      " copy_failed);
+        free_copies "    ";
+        pr "    caml_raise_out_of_memory ();\n";
+        pr "  }\n";
+        pr "\n"
+      );
+
       let error_code =
         match fst style with
         | RErr -> pr "  int r;\n"; "-1"
@@ -1810,6 +3650,8 @@ static void raise_closed (const char *) Noreturn;
         | RNodeList -> pr "  hive_node_h *r;\n"; "NULL"
         | RValue -> pr "  hive_value_h r;\n"; "0"
         | RValueList -> pr "  hive_value_h *r;\n"; "NULL"
+        | RNodeNamedList -> pr "  hive_node_named *r;\n"; "NULL"
+        | RValueFullList -> pr "  hive_value_full *r;\n"; "NULL"
         | RString -> pr "  char *r;\n"; "NULL"
         | RStringList -> pr "  char **r;\n"; "NULL"
         | RLenType ->
@@ -1827,6 +3669,10 @@ static void raise_closed (const char *) Noreturn;
             pr "  size_t len;\n";
             pr "  hive_type t;\n";
             "NULL"
+        | RStats ->
+            pr "  int r;\n";
+            pr "  hive_stats stats;\n";
+            "-1"
         | RInt32 ->
             pr "  errno = 0;\n";
             pr "  int32_t r;\n";
@@ -1836,16 +3682,14 @@ static void raise_closed (const char *) Noreturn;
             pr "  int64_t r;\n";
             "-1 && errno != 0" in
 
-      (* The libguestfs OCaml bindings call enter_blocking_section
-       * here.  However I don't think that is safe, because we are
-       * holding pointers to caml strings during the call, and these
-       * could be moved or freed by other threads.  In any case, there
-       * is very little reason to enter_blocking_section for any hivex
-       * call, so don't do it.  XXX
+      (* All parameters have been copied out of the OCaml heap above,
+       * so it is safe to release the runtime lock during the call.
+       * This lets other OCaml threads run while we open, commit or
+       * walk large hives.
        *)
-      (*pr "  caml_enter_blocking_section ();\n";*)
+      pr "  caml_enter_blocking_section ();\n";
       pr "  r = hivex_%s (%s);\n" name (String.concat ", " c_params);
-      (*pr "  caml_leave_blocking_section ();\n";*)
+      pr "  caml_leave_blocking_section ();\n";
       pr "\n";
 
       (* Dispose of the hive handle (even if hivex_close returns error). *)
@@ -1857,17 +3701,10 @@ static void raise_closed (const char *) Noreturn;
        | _ -> ()
       );
 
-      List.iter (
-        function
-        | AHive | ANode _ | AValue _ | AString _ | AStringNullable _
-        | AOpenFlags | AUnusedFlags -> ()
-        | ASetValues ->
-            pr "  free (values);\n";
-            pr "\n";
-        | ASetValue ->
-            pr "  free (val);\n";
-            pr "\n";
-      ) (snd style);
+      if copy_failed <> [] then (
+        free_copies "  ";
+        pr "\n"
+      );
 
       (* Check for errors. *)
       pr "  if (r == %s)\n" error_code;
@@ -1892,6 +3729,19 @@ static void raise_closed (const char *) Noreturn;
        | RValueList ->
            pr "  rv = copy_int_array (r);\n";
            pr "  free (r);\n"
+       | RNodeNamedList ->
+           pr "  rv = copy_node_named_array (r);\n";
+           pr "  int i;\n";
+           pr "  for (i = 0; r[i].name != NULL; ++i) free (r[i].name);\n";
+           pr "  free (r);\n"
+       | RValueFullList ->
+           pr "  rv = copy_value_full_array (r);\n";
+           pr "  int i;\n";
+           pr "  for (i = 0; r[i].key != NULL; ++i) {\n";
+           pr "    free (r[i].key);\n";
+           pr "    free (r[i].value);\n";
+           pr "  }\n";
+           pr "  free (r);\n"
        | RString ->
            if f_len_exists name then (
              pr "  size_t sz;\n  sz = hivex_%s_len (%s);\n"
@@ -1911,6 +3761,7 @@ static void raise_closed (const char *) Noreturn;
        | RLenTypeVal ->
            pr "  rv = copy_type_value (r, len, t);\n";
            pr "  free (r);\n"
+       | RStats -> pr "  rv = copy_stats (&stats);\n"
        | RInt32 -> pr "  rv = caml_copy_int32 (r);\n"
        | RInt64 -> pr "  rv = caml_copy_int64 (r);\n"
       );
@@ -1937,15 +3788,58 @@ HiveOpenFlags_val (value v)
   return flags;
 }
 
+/* The runtime lock is released while hivex is called, so anything
+ * passed to the C library must be copied out of the OCaml heap first.
+ * The copies are freed by the wrapper after the call returns.
+ *
+ * These functions return NULL (or -1) if they run out of memory,
+ * having freed anything they allocated, instead of raising an
+ * exception.  The
+ * wrapper makes all the copies, then if any failed it frees the others
+ * and raises Out_of_memory, so earlier copies are not leaked.
+ */
+static char *
+copy_string_val (value v)
+{
+  size_t len = caml_string_length (v);
+  char *s = malloc (len + 1);
+
+  if (s == NULL)
+    return NULL;
+  memcpy (s, String_val (v), len + 1);
+  return s;
+}
+
+static int
+copy_set_value (hive_set_value *val, value v)
+{
+  size_t len = caml_string_length (Field (v, 2));
+
+  val->key = copy_string_val (Field (v, 0));
+  if (val->key == NULL)
+    return -1;
+  val->t = HiveType_val (Field (v, 1));
+  val->len = len;
+  val->value = malloc (len > 0 ? len : 1);
+  if (val->value == NULL) {
+    free (val->key);
+    return -1;
+  }
+  memcpy (val->value, String_val (Field (v, 2)), len);
+  return 0;
+}
+
 static hive_set_value *
 HiveSetValue_val (value v)
 {
   hive_set_value *val = malloc (sizeof (hive_set_value));
 
-  val->key = String_val (Field (v, 0));
-  val->t = HiveType_val (Field (v, 1));
-  val->len = caml_string_length (Field (v, 2));
-  val->value = String_val (Field (v, 2));
+  if (val == NULL)
+    return NULL;
+  if (copy_set_value (val, v) == -1) {
+    free (val);
+    return NULL;
+  }
 
   return val;
 }
@@ -1954,21 +3848,37 @@ static hive_set_value *
 HiveSetValues_val (value v)
 {
   size_t nr_values = Wosize_val (v);
-  hive_set_value *values = malloc (nr_values * sizeof (hive_set_value));
+  hive_set_value *values = malloc ((nr_values + 1) * sizeof (hive_set_value));
   size_t i;
-  value v2;
+
+  if (values == NULL)
+    return NULL;
 
   for (i = 0; i < nr_values; ++i) {
-    v2 = Field (v, i);
-    values[i].key = String_val (Field (v2, 0));
-    values[i].t = HiveType_val (Field (v2, 1));
-    values[i].len = caml_string_length (Field (v2, 2));
-    values[i].value = String_val (Field (v2, 2));
+    if (copy_set_value (&values[i], Field (v, i)) == -1) {
+      free_set_values (values, i);
+      return NULL;
+    }
   }
 
   return values;
 }
 
+static void
+free_set_values (hive_set_value *values, size_t nr_values)
+{
+  size_t i;
+
+  if (values == NULL)
+    return;
+
+  for (i = 0; i < nr_values; ++i) {
+    free (values[i].key);
+    free (values[i].value);
+  }
+  free (values);
+}
+
 static hive_type
 HiveType_val (value v)
 {
@@ -2058,6 +3968,81 @@ copy_type_value (const char *r, size_t len, hive_type t)
   CAMLreturn (rv);
 }
 
+static value
+copy_node_named_array (hive_node_named *r)
+{
+  CAMLparam0 ();
+  CAMLlocal3 (v, tv, rv);
+  size_t nr, i;
+
+  for (nr = 0; r[nr].name != NULL; ++nr)
+    ;
+  if (nr == 0)
+    CAMLreturn (Atom (0));
+  else {
+    rv = caml_alloc (nr, 0);
+    for (i = 0; i < nr; ++i) {
+      tv = caml_alloc (2, 0);
+      v = caml_copy_string (r[i].name);
+      Store_field (tv, 0, v);
+      v = Val_int (r[i].node);
+      Store_field (tv, 1, v);
+      Store_field (rv, i, tv);
+    }
+    CAMLreturn (rv);
+  }
+}
+
+static value
+copy_value_full_array (hive_value_full *r)
+{
+  CAMLparam0 ();
+  CAMLlocal3 (v, tv, rv);
+  size_t nr, i;
+
+  for (nr = 0; r[nr].key != NULL; ++nr)
+    ;
+  if (nr == 0)
+    CAMLreturn (Atom (0));
+  else {
+    rv = caml_alloc (nr, 0);
+    for (i = 0; i < nr; ++i) {
+      tv = caml_alloc (3, 0);
+      v = caml_copy_string (r[i].key);
+      Store_field (tv, 0, v);
+      v = Val_hive_type (r[i].t);
+      Store_field (tv, 1, v);
+      v = caml_alloc_string (r[i].len);
+      memcpy (String_val (v), r[i].value, r[i].len);
+      Store_field (tv, 2, v);
+      Store_field (rv, i, tv);
+    }
+    CAMLreturn (rv);
+  }
+}
+
+";
+  generate_c_stats_table ();
+  pr "\
+static value
+copy_stats (const hive_stats *stats)
+{
+  CAMLparam0 ();
+  CAMLlocal3 (v, tv, rv);
+  size_t i;
+
+  rv = caml_alloc (nr_stats_fields, 0);
+  for (i = 0; i < nr_stats_fields; ++i) {
+    tv = caml_alloc (2, 0);
+    v = caml_copy_string (stats_fields[i].name);
+    Store_field (tv, 0, v);
+    v = caml_copy_int64 (stats_field (stats, i));
+    Store_field (tv, 1, v);
+    Store_field (rv, i, tv);
+  }
+  CAMLreturn (rv);
+}
+
 /* Raise exceptions. */
 static void
 raise_error (const char *function)
@@ -2237,6 +4222,10 @@ sub open {
          | RLenTypeVal
          | RInt32
          | RInt64 -> ()
+         | RStats ->
+             pr "\
+This returns a hashref mapping the name of each counter to
+its value.\n\n"
          | RSize ->
              pr "\
 This returns a size.\n\n"
@@ -2255,6 +4244,14 @@ This returns a value handle.\n\n"
          | RValueList ->
              pr "\
 This returns a list of value handles.\n\n"
+         | RNodeNamedList ->
+             pr "\
+This returns a list of arrayrefs, each containing the name
+and the node handle of one child.\n\n"
+         | RValueFullList ->
+             pr "\
+This returns a list of hashrefs containing C<key>, C<t> (type)
+and C<value>, in the same format as C<node_set_values>.\n\n"
         );
 
         if List.mem ASetValues (snd style) then
@@ -2269,6 +4266,45 @@ values stored at C<node> by passing C<@values = []>.\n\n"
   ) functions;
 
   pr "\
+=item node_to_native
+
+ $tree = $h->node_to_native ($node [, $depth [, $decode]])
+
+Return the subtree starting at C<node> as nested Perl data
+structures.  The whole subtree is read in a single call, which is
+much faster than calling the other methods for each node and value.
+
+Each node is returned as a hashref containing C<name>, C<values>
+and C<children>.  C<values> is an arrayref of hashrefs containing
+C<key>, C<t> (type) and C<value>, in the same format as
+C<node_set_values>.  C<children> is an arrayref of nodes.
+
+C<depth> limits the number of levels of children returned.  Nodes at
+the limit have no C<children> element.  The default, C<-1>, means no
+limit.
+
+If C<decode> is true (the default) then strings, multiple strings,
+dwords and qwords are decoded into Perl strings, arrayrefs of strings
+and integers.  Other values, and values which cannot be decoded, are
+returned as raw bytes.
+
+=item node_children_sorted
+
+ @children = $h->node_children_sorted ($node)
+
+Return the children of C<node> sorted by name.  Each child is returned
+as an arrayref containing the name and the node handle.
+
+The names are fetched and sorted in a single call, which is much
+faster than calling C<node_name> on each child and sorting in Perl.
+
+=item node_values_sorted
+
+ @values = $h->node_values_sorted ($node)
+
+Return the values attached to C<node> sorted by key.  Each value is
+returned as an arrayref containing the key, the type and the raw data.
+
 =cut
 
 1;
@@ -2305,11 +4341,14 @@ and generate_perl_prototype name style =
    | RNodeList -> pr "@nodes = "
    | RValue -> pr "$value = "
    | RValueList -> pr "@values = "
+   | RNodeNamedList -> pr "@children = "
+   | RValueFullList -> pr "@values = "
    | RString -> pr "$string = "
    | RStringList -> pr "@strings = "
    | RLenType -> pr "($type, $len) = "
    | RLenValue -> pr "($len, $value) = "
    | RLenTypeVal -> pr "($type, $data) = "
+   | RStats -> pr "$stats = "
    | RInt32 -> pr "$int32 = "
    | RInt64 -> pr "$int64 = "
   );
@@ -2347,6 +4386,7 @@ and generate_perl_xs () =
 #include \"perl.h\"
 #include \"XSUB.h\"
 
+#include <stddef.h>
 #include <string.h>
 #include <hivex.h>
 #include <inttypes.h>
@@ -2368,7 +4408,6 @@ my_newSVll(long long val) {
 #endif
 }
 
-#if 0
 static SV *
 my_newSVull(unsigned long long val) {
 #ifdef USE_64_BIT_ALL
@@ -2380,7 +4419,10 @@ my_newSVull(unsigned long long val) {
   return newSVpv(buf, len);
 #endif
 }
-#endif
+
+";
+  generate_c_stats_table ();
+  pr "\
 
 #if 0
 /* http://www.perlmonks.org/?node_id=680842 */
@@ -2496,6 +4538,206 @@ unpack_set_value (SV *sv)
   return ret;
 }
 
+/* Used by node_to_native to detect cycles when walking a subtree. */
+struct native_path {
+  hive_node_h node;
+  const struct native_path *parent;
+};
+
+/* Decode a value according to its type.  Returns NULL if the value
+ * cannot be decoded, in which case the caller uses the raw bytes.
+ */
+static SV *
+native_decode_value (hive_h *h, hive_value_h value, hive_type t)
+{
+  switch (t) {
+  case hive_t_string:
+  case hive_t_expand_string:
+  case hive_t_link: {
+    char *str = hivex_value_string (h, value);
+    SV *sv;
+    if (str == NULL)
+      return NULL;
+    sv = newSVpvn_utf8 (str, strlen (str), 1);
+    free (str);
+    return sv;
+  }
+
+  case hive_t_multiple_strings: {
+    char **strs = hivex_value_multiple_strings (h, value);
+    AV *av;
+    size_t i;
+    if (strs == NULL)
+      return NULL;
+    av = newAV ();
+    for (i = 0; strs[i] != NULL; ++i) {
+      av_push (av, newSVpvn_utf8 (strs[i], strlen (strs[i]), 1));
+      free (strs[i]);
+    }
+    free (strs);
+    return newRV_noinc ((SV *) av);
+  }
+
+  case hive_t_dword:
+  case hive_t_dword_be: {
+    int32_t i32;
+    errno = 0;
+    i32 = hivex_value_dword (h, value);
+    if (i32 == -1 && errno != 0)
+      return NULL;
+    return newSViv (i32);
+  }
+
+  case hive_t_qword: {
+    int64_t i64;
+    errno = 0;
+    i64 = hivex_value_qword (h, value);
+    if (i64 == -1 && errno != 0)
+      return NULL;
+    return my_newSVll (i64);
+  }
+
+  default:
+    return NULL;
+  }
+}
+
+static SV *
+native_value (hive_h *h, hive_value_h value, int decode)
+{
+  HV *hv;
+  SV *sv = NULL;
+  char *key, *data;
+  hive_type t;
+  size_t len;
+
+  key = hivex_value_key (h, value);
+  if (key == NULL)
+    return NULL;
+  if (hivex_value_type (h, value, &t, &len) == -1) {
+    free (key);
+    return NULL;
+  }
+
+  if (decode)
+    sv = native_decode_value (h, value, t);
+  if (sv == NULL) {
+    data = hivex_value_value (h, value, &t, &len);
+    if (data == NULL) {
+      free (key);
+      return NULL;
+    }
+    sv = newSVpvn (data, len);
+    free (data);
+  }
+
+  hv = newHV ();
+  (void) hv_store (hv, \"key\", 3, newSVpvn_utf8 (key, strlen (key), 1), 0);
+  (void) hv_store (hv, \"t\", 1, newSViv (t), 0);
+  (void) hv_store (hv, \"value\", 5, sv, 0);
+  free (key);
+
+  return newRV_noinc ((SV *) hv);
+}
+
+/* Build a hashref for the subtree starting at node.  depth is the
+ * number of levels of children to include, or < 0 for no limit.
+ * On error this returns NULL and sets errno.
+ */
+static SV *
+native_node (hive_h *h, hive_node_h node, int depth, int decode,
+             const struct native_path *parent)
+{
+  struct native_path path = { node, parent };
+  const struct native_path *p;
+  hive_node_h *children;
+  hive_value_h *values;
+  HV *hv;
+  AV *av;
+  SV *sv;
+  char *name;
+  size_t i;
+  int err;
+
+  for (p = parent; p != NULL; p = p->parent) {
+    if (p->node == node) {
+      errno = ELOOP;
+      return NULL;
+    }
+  }
+
+  hv = newHV ();
+
+  name = hivex_node_name (h, node);
+  if (name == NULL)
+    goto error;
+  (void) hv_store (hv, \"name\", 4, newSVpvn_utf8 (name, strlen (name), 1), 0);
+  free (name);
+
+  values = hivex_node_values (h, node);
+  if (values == NULL)
+    goto error;
+  av = newAV ();
+  (void) hv_store (hv, \"values\", 6, newRV_noinc ((SV *) av), 0);
+  for (i = 0; values[i] != 0; ++i) {
+    sv = native_value (h, values[i], decode);
+    if (sv == NULL) {
+      free (values);
+      goto error;
+    }
+    av_push (av, sv);
+  }
+  free (values);
+
+  if (depth == 0)
+    return newRV_noinc ((SV *) hv);
+
+  children = hivex_node_children (h, node);
+  if (children == NULL)
+    goto error;
+  av = newAV ();
+  (void) hv_store (hv, \"children\", 8, newRV_noinc ((SV *) av), 0);
+  for (i = 0; children[i] != 0; ++i) {
+    sv = native_node (h, children[i], depth > 0 ? depth - 1 : depth,
+                      decode, &path);
+    if (sv == NULL) {
+      free (children);
+      goto error;
+    }
+    av_push (av, sv);
+  }
+  free (children);
+
+  return newRV_noinc ((SV *) hv);
+
+ error:
+  err = errno;
+  SvREFCNT_dec ((SV *) hv);
+  errno = err;
+  return NULL;
+}
+
+/* Used to return children and values sorted by name.  The names are
+ * UTF-8, so strcmp sorts them in the same order as Perl's cmp.
+ */
+static int
+compare_node_named (const void *av, const void *bv)
+{
+  const hive_node_named *a = av;
+  const hive_node_named *b = bv;
+
+  return strcmp (a->name, b->name);
+}
+
+static int
+compare_value_full (const void *av, const void *bv)
+{
+  const hive_value_full *a = av;
+  const hive_value_full *b = bv;
+
+  return strcmp (a->key, b->key);
+}
+
 MODULE = Win::Hivex  PACKAGE = Win::Hivex
 
 PROTOTYPES: ENABLE
@@ -2518,6 +4760,67 @@ DESTROY (h)
       if (hivex_close (h) == -1)
         croak (\"hivex_close: %%s\", strerror (errno));
 
+SV *
+node_to_native (h, node, depth = -1, decode = 1)
+      hive_h *h;
+      int node;
+      int depth;
+      int decode;
+   CODE:
+      RETVAL = native_node (h, node, depth, decode, NULL);
+      if (RETVAL == NULL)
+        croak (\"%%s: %%s\", \"node_to_native\", strerror (errno));
+ OUTPUT:
+      RETVAL
+
+void
+node_children_sorted (h, node)
+      hive_h *h;
+      int node;
+PREINIT:
+      hive_node_named *r;
+      int i, n;
+ PPCODE:
+      r = hivex_node_children_named (h, node);
+      if (r == NULL)
+        croak (\"%%s: %%s\", \"node_children_sorted\", strerror (errno));
+      for (n = 0; r[n].name != NULL; ++n) /**/;
+      qsort (r, n, sizeof (hive_node_named), compare_node_named);
+      EXTEND (SP, n);
+      for (i = 0; i < n; ++i) {
+        AV *av = newAV ();
+        av_push (av, newSVpvn_utf8 (r[i].name, strlen (r[i].name), 1));
+        av_push (av, newSViv (r[i].node));
+        PUSHs (sv_2mortal (newRV_noinc ((SV *) av)));
+        free (r[i].name);
+      }
+      free (r);
+
+void
+node_values_sorted (h, node)
+      hive_h *h;
+      int node;
+PREINIT:
+      hive_value_full *r;
+      int i, n;
+ PPCODE:
+      r = hivex_node_values_full (h, node);
+      if (r == NULL)
+        croak (\"%%s: %%s\", \"node_values_sorted\", strerror (errno));
+      for (n = 0; r[n].key != NULL; ++n) /**/;
+      qsort (r, n, sizeof (hive_value_full), compare_value_full);
+      EXTEND (SP, n);
+      for (i = 0; i < n; ++i) {
+        AV *av = newAV ();
+        av_push (av, newSVpvn_utf8 (r[i].key, strlen (r[i].key), 1));
+        av_push (av, newSViv (r[i].t));
+        av_push (av, newSVpvn (r[i].value, r[i].len));
+        PUSHs (sv_2mortal (newRV_noinc ((SV *) av)));
+        free (r[i].key);
+        free (r[i].value);
+      }
+      free (r);
+
 ";
 
   List.iter (
@@ -2535,10 +4838,13 @@ DESTROY (h)
          | RString -> pr "SV *\n"
          | RNodeList
          | RValueList
+         | RNodeNamedList
+         | RValueFullList
          | RStringList
          | RLenType
          | RLenValue
          | RLenTypeVal -> pr "void\n"
+         | RStats -> pr "SV *\n"
          | RInt32 -> pr "SV *\n"
          | RInt64 -> pr "SV *\n"
         );
@@ -2642,29 +4948,68 @@ DESTROY (h)
              pr " OUTPUT:\n";
              pr "      RETVAL\n"
 
-         | RString ->
+         | RString ->
+             pr "PREINIT:\n";
+             pr "      char *r;\n";
+             pr "   CODE:\n";
+             pr "      r = hivex_%s (%s);\n"
+               name (String.concat ", " c_params);
+             free_args ();
+             pr "      if (r == NULL)\n";
+             pr "        croak (\"%%s: %%s\", \"%s\", strerror (errno));\n"
+               name;
+             if f_len_exists name then
+               pr "      RETVAL = newSVpvn_utf8 (r, hivex_%s_len (%s), 1);\n"
+                 name (String.concat ", " c_params)
+             else
+               pr "      RETVAL = newSVpv (r, 0);\n";
+             pr "      free (r);\n";
+             pr " OUTPUT:\n";
+             pr "      RETVAL\n"
+
+         | RNodeList
+         | RValueList ->
+             pr "PREINIT:\n";
+             pr "      size_t *r;\n";
+             pr "      int i, n;\n";
+             pr " PPCODE:\n";
+             pr "      r = hivex_%s (%s);\n"
+               name (String.concat ", " c_params);
+             free_args ();
+             pr "      if (r == NULL)\n";
+             pr "        croak (\"%%s: %%s\", \"%s\", strerror (errno));\n"
+               name;
+             pr "      for (n = 0; r[n] != 0; ++n) /**/;\n";
+             pr "      EXTEND (SP, n);\n";
+             pr "      for (i = 0; i < n; ++i)\n";
+             pr "        PUSHs (sv_2mortal (newSViv (r[i])));\n";
+             pr "      free (r);\n";
+
+         | RNodeNamedList ->
              pr "PREINIT:\n";
-             pr "      char *r;\n";
-             pr "   CODE:\n";
+             pr "      hive_node_named *r;\n";
+             pr "      int i, n;\n";
+             pr " PPCODE:\n";
              pr "      r = hivex_%s (%s);\n"
                name (String.concat ", " c_params);
              free_args ();
              pr "      if (r == NULL)\n";
              pr "        croak (\"%%s: %%s\", \"%s\", strerror (errno));\n"
                name;
-             if f_len_exists name then
-               pr "      RETVAL = newSVpvn_utf8 (r, hivex_%s_len (%s), 1);\n"
-                 name (String.concat ", " c_params)
-             else
-               pr "      RETVAL = newSVpv (r, 0);\n";
+             pr "      for (n = 0; r[n].name != NULL; ++n) /**/;\n";
+             pr "      EXTEND (SP, n);\n";
+             pr "      for (i = 0; i < n; ++i) {\n";
+             pr "        AV *av = newAV ();\n";
+             pr "        av_push (av, newSVpvn_utf8 (r[i].name, strlen (r[i].name), 1));\n";
+             pr "        av_push (av, newSViv (r[i].node));\n";
+             pr "        PUSHs (sv_2mortal (newRV_noinc ((SV *) av)));\n";
+             pr "        free (r[i].name);\n";
+             pr "      }\n";
              pr "      free (r);\n";
-             pr " OUTPUT:\n";
-             pr "      RETVAL\n"
 
-         | RNodeList
-         | RValueList ->
+         | RValueFullList ->
              pr "PREINIT:\n";
-             pr "      size_t *r;\n";
+             pr "      hive_value_full *r;\n";
              pr "      int i, n;\n";
              pr " PPCODE:\n";
              pr "      r = hivex_%s (%s);\n"
@@ -2673,10 +5018,17 @@ DESTROY (h)
              pr "      if (r == NULL)\n";
              pr "        croak (\"%%s: %%s\", \"%s\", strerror (errno));\n"
                name;
-             pr "      for (n = 0; r[n] != 0; ++n) /**/;\n";
+             pr "      for (n = 0; r[n].key != NULL; ++n) /**/;\n";
              pr "      EXTEND (SP, n);\n";
-             pr "      for (i = 0; i < n; ++i)\n";
-             pr "        PUSHs (sv_2mortal (newSViv (r[i])));\n";
+             pr "      for (i = 0; i < n; ++i) {\n";
+             pr "        HV *hv = newHV ();\n";
+             pr "        (void) hv_store (hv, \"key\", 3, newSVpvn_utf8 (r[i].key, strlen (r[i].key), 1), 0);\n";
+             pr "        (void) hv_store (hv, \"t\", 1, newSViv (r[i].t), 0);\n";
+             pr "        (void) hv_store (hv, \"value\", 5, newSVpvn (r[i].value, r[i].len), 0);\n";
+             pr "        PUSHs (sv_2mortal (newRV_noinc ((SV *) hv)));\n";
+             pr "        free (r[i].key);\n";
+             pr "        free (r[i].value);\n";
+             pr "      }\n";
              pr "      free (r);\n";
 
          | RStringList ->
@@ -2776,6 +5128,28 @@ DESTROY (h)
              pr "      RETVAL = my_newSVll (r);\n";
              pr " OUTPUT:\n";
              pr "      RETVAL\n"
+
+         | RStats ->
+             pr "PREINIT:\n";
+             pr "      int r;\n";
+             pr "      hive_stats stats;\n";
+             pr "      HV *hv;\n";
+             pr "      size_t i;\n";
+             pr "   CODE:\n";
+             pr "      r = hivex_%s (%s, &stats, sizeof stats);\n"
+               name (String.concat ", " c_params);
+             free_args ();
+             pr "      if (r == -1)\n";
+             pr "        croak (\"%%s: %%s\", \"%s\", strerror (errno));\n"
+               name;
+             pr "      hv = newHV ();\n";
+             pr "      for (i = 0; i < nr_stats_fields; ++i)\n";
+             pr "        (void) hv_store (hv, stats_fields[i].name,\n";
+             pr "                         strlen (stats_fields[i].name),\n";
+             pr "                         my_newSVull (stats_field (&stats, i)), 0);\n";
+             pr "      RETVAL = newRV_noinc ((SV *) hv);\n";
+             pr " OUTPUT:\n";
+             pr "      RETVAL\n"
         );
         pr "\n"
       )
@@ -2798,6 +5172,7 @@ typedef int Py_ssize_t;
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include \"hivex.h\"
@@ -2833,14 +5208,16 @@ put_handle (hive_h *h)
 #endif
 }
 
-/* This returns pointers into the Python objects, which should
- * not be freed.
+/* This returns copies of the key and value, so that the C library
+ * can use them after the GIL has been released.  The caller must
+ * free them using free_value.
  */
 static int
 get_value (PyObject *v, hive_set_value *ret)
 {
   PyObject *obj;
   PyObject *bytes;
+  const char *key;
 
   if (!PyDict_Check (v)) {
     PyErr_SetString (PyExc_TypeError, \"expected dictionary type for value\");
@@ -2859,13 +5236,21 @@ get_value (PyObject *v, hive_set_value *ret)
       PyErr_SetString (PyExc_ValueError, \"failed to decode 'key'\");
       return -1;
     }
-    ret->key = PyBytes_AS_STRING (bytes);
+    key = PyBytes_AS_STRING (bytes);
   } else if (PyBytes_Check (obj)) {
-    ret->key = PyBytes_AS_STRING (obj);
+    bytes = obj;
+    Py_INCREF (bytes);
+    key = PyBytes_AS_STRING (bytes);
   } else {
     PyErr_SetString (PyExc_TypeError, \"expected bytes type for 'key'\");
     return -1;
   }
+  ret->key = strdup (key);
+  Py_DECREF (bytes);
+  if (ret->key == NULL) {
+    PyErr_NoMemory ();
+    return -1;
+  }
 
   obj = PyDict_GetItemString (v, \"t\");
   if (!obj) {
@@ -2875,12 +5260,14 @@ get_value (PyObject *v, hive_set_value *ret)
   ret->t = PyLong_AsLong (obj);
   if (PyErr_Occurred ()) {
     PyErr_SetString (PyExc_TypeError, \"expected int type for 't'\");
+    free (ret->key);
     return -1;
   }
 
   obj = PyDict_GetItemString (v, \"value\");
   if (!obj) {
     PyErr_SetString (PyExc_KeyError, \"no 'value' element in dictionary\");
+    free (ret->key);
     return -1;
   }
   /* Support bytes only. As the registry can use multiple character sets, reject
@@ -2889,123 +5276,718 @@ get_value (PyObject *v, hive_set_value *ret)
    * in Python 2 (but not u'x') but that in Python 3, only b'x' is valid. */
   if (PyBytes_Check (obj)) {
     ret->len = PyBytes_GET_SIZE (obj);
-    ret->value = PyBytes_AS_STRING (obj);
+    ret->value = malloc (ret->len > 0 ? ret->len : 1);
+    if (ret->value == NULL) {
+      PyErr_NoMemory ();
+      free (ret->key);
+      return -1;
+    }
+    memcpy (ret->value, PyBytes_AS_STRING (obj), ret->len);
   } else {
     PyErr_SetString (PyExc_TypeError, \"expected bytes type for 'value'\");
+    free (ret->key);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void
+free_value (hive_set_value *val)
+{
+  free (val->key);
+  free (val->value);
+}
+
+typedef struct py_set_values {
+  size_t nr_values;
+  hive_set_value *values;
+} py_set_values;
+
+static void free_values (py_set_values *values);
+
+static int
+get_values (PyObject *v, py_set_values *ret)
+{
+  Py_ssize_t slen;
+  size_t len, i;
+
+  if (!PyList_Check (v)) {
+    PyErr_SetString (PyExc_RuntimeError, \"expecting a list parameter\");
+    return -1;
+  }
+
+  slen = PyList_Size (v);
+  if (slen < 0) {
+    PyErr_SetString (PyExc_RuntimeError, \"get_string_list: PyList_Size failure\");
     return -1;
   }
+  len = (size_t) slen;
+  ret->nr_values = len;
+  ret->values = malloc (len * sizeof (hive_set_value));
+  if (!ret->values) {
+    PyErr_NoMemory ();
+    return -1;
+  }
+
+  for (i = 0; i < len; ++i) {
+    if (get_value (PyList_GetItem (v, i), &(ret->values[i])) == -1) {
+      ret->nr_values = i;
+      free_values (ret);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void
+free_values (py_set_values *values)
+{
+  size_t i;
+
+  for (i = 0; i < values->nr_values; ++i)
+    free_value (&values->values[i]);
+  free (values->values);
+}
+
+static PyObject *
+put_string_list (char * const * const argv)
+{
+  PyObject *list;
+  size_t argc, i;
+
+  for (argc = 0; argv[argc] != NULL; ++argc)
+    ;
+
+  list = PyList_New (argc);
+  for (i = 0; i < argc; ++i) {
+    PyList_SetItem (list, i, PyUnicode_DecodeUTF8 (argv[i], strlen (argv[i]), NULL));
+  }
+
+  return list;
+}
+
+static void
+free_strings (char **argv)
+{
+  size_t argc;
+
+  for (argc = 0; argv[argc] != NULL; ++argc)
+    free (argv[argc]);
+  free (argv);
+}
+
+/* Since hive_node_t is the same as hive_value_t this also works for values. */
+static PyObject *
+put_node_list (hive_node_h *nodes)
+{
+  PyObject *list;
+  size_t argc, i;
+
+  for (argc = 0; nodes[argc] != 0; ++argc)
+    ;
+
+  list = PyList_New (argc);
+  for (i = 0; i < argc; ++i)
+    PyList_SetItem (list, i, PyLong_FromLongLong ((long) nodes[i]));
+
+  return list;
+}
+
+static PyObject *
+put_len_type (size_t len, hive_type t)
+{
+  PyObject *r = PyTuple_New (2);
+  PyTuple_SetItem (r, 0, PyLong_FromLong ((long) t));
+  PyTuple_SetItem (r, 1, PyLong_FromLongLong ((long) len));
+  return r;
+}
+
+static PyObject *
+put_len_val (size_t len, hive_value_h value)
+{
+  PyObject *r = PyTuple_New (2);
+  PyTuple_SetItem (r, 0, PyLong_FromLongLong ((long) len));
+  PyTuple_SetItem (r, 1, PyLong_FromLongLong ((long) value));
+  return r;
+}
+
+static PyObject *
+put_val_type (char *val, size_t len, hive_type t)
+{
+  PyObject *r = PyTuple_New (2);
+  PyTuple_SetItem (r, 0, PyLong_FromLong ((long) t));
+  PyTuple_SetItem (r, 1, PyBytes_FromStringAndSize (val, len));
+  return r;
+}
+
+static PyObject *
+put_node_named_list (hive_node_named *children)
+{
+  PyObject *list, *item;
+  size_t argc, i;
+
+  for (argc = 0; children[argc].name != NULL; ++argc)
+    ;
+
+  list = PyList_New (argc);
+  for (i = 0; i < argc; ++i) {
+    item = PyTuple_New (2);
+    PyTuple_SetItem (item, 0,
+                     PyUnicode_DecodeUTF8 (children[i].name,
+                                           strlen (children[i].name), NULL));
+    PyTuple_SetItem (item, 1, PyLong_FromLongLong ((long long) children[i].node));
+    PyList_SetItem (list, i, item);
+  }
+
+  return list;
+}
+
+static void
+free_node_named_list (hive_node_named *children)
+{
+  size_t i;
+
+  for (i = 0; children[i].name != NULL; ++i)
+    free (children[i].name);
+  free (children);
+}
+
+static PyObject *
+put_value_full_list (hive_value_full *values)
+{
+  PyObject *list, *item;
+  size_t argc, i;
+
+  for (argc = 0; values[argc].key != NULL; ++argc)
+    ;
+
+  list = PyList_New (argc);
+  for (i = 0; i < argc; ++i) {
+    item = PyTuple_New (3);
+    PyTuple_SetItem (item, 0,
+                     PyUnicode_DecodeUTF8 (values[i].key,
+                                           strlen (values[i].key), NULL));
+    PyTuple_SetItem (item, 1, PyLong_FromLong ((long) values[i].t));
+    PyTuple_SetItem (item, 2,
+                     PyBytes_FromStringAndSize (values[i].value,
+                                                values[i].len));
+    PyList_SetItem (list, i, item);
+  }
+
+  return list;
+}
+
+static void
+free_value_full_list (hive_value_full *values)
+{
+  size_t i;
+
+  for (i = 0; values[i].key != NULL; ++i) {
+    free (values[i].key);
+    free (values[i].value);
+  }
+  free (values);
+}
+
+";
+  generate_c_stats_table ();
+  pr "\
+static PyObject *
+put_stats (const hive_stats *stats)
+{
+  PyObject *dict, *v;
+  size_t i;
+
+  dict = PyDict_New ();
+  for (i = 0; i < nr_stats_fields; ++i) {
+    v = PyLong_FromUnsignedLongLong (stats_field (stats, i));
+    PyDict_SetItemString (dict, stats_fields[i].name, v);
+    Py_DECREF (v);
+  }
+
+  return dict;
+}
+
+/* Used to detect cycles when walking a subtree. */
+struct native_path {
+  hive_node_h node;
+  const struct native_path *parent;
+};
+
+/* Decode a value according to its type.  Returns NULL if the value
+ * cannot be decoded, in which case the caller clears any Python
+ * exception and uses the raw bytes instead.
+ */
+static PyObject *
+decode_native_value (hive_h *h, hive_value_h value, hive_type t)
+{
+  PyObject *r;
+
+  switch (t) {
+  case hive_t_string:
+  case hive_t_expand_string:
+  case hive_t_link: {
+    char *str = hivex_value_string (h, value);
+    if (str == NULL)
+      return NULL;
+    r = PyUnicode_DecodeUTF8 (str, strlen (str), NULL);
+    free (str);
+    if (r == NULL)
+      PyErr_Clear ();
+    return r;
+  }
+
+  case hive_t_multiple_strings: {
+    char **strs = hivex_value_multiple_strings (h, value);
+    if (strs == NULL)
+      return NULL;
+    r = put_string_list (strs);
+    free_strings (strs);
+    return r;
+  }
+
+  case hive_t_dword:
+  case hive_t_dword_be: {
+    int32_t i32;
+    errno = 0;
+    i32 = hivex_value_dword (h, value);
+    if (i32 == -1 && errno != 0)
+      return NULL;
+    return PyLong_FromLong ((long) i32);
+  }
+
+  case hive_t_qword: {
+    int64_t i64;
+    errno = 0;
+    i64 = hivex_value_qword (h, value);
+    if (i64 == -1 && errno != 0)
+      return NULL;
+    return PyLong_FromLongLong (i64);
+  }
+
+  default:
+    return NULL;
+  }
+}
+
+static PyObject *
+put_native_value (hive_h *h, hive_value_h value, int decode)
+{
+  PyObject *r, *py_t, *py_key = NULL, *py_value = NULL;
+  char *key, *data;
+  hive_type t;
+  size_t len;
+
+  key = hivex_value_key (h, value);
+  if (key == NULL)
+    goto hivex_error;
+  py_key = PyUnicode_DecodeUTF8 (key, strlen (key), NULL);
+  free (key);
+  if (py_key == NULL)
+    return NULL;
+
+  if (hivex_value_type (h, value, &t, &len) == -1)
+    goto hivex_error;
+
+  if (decode)
+    py_value = decode_native_value (h, value, t);
+  if (py_value == NULL) {
+    PyErr_Clear ();
+    data = hivex_value_value (h, value, &t, &len);
+    if (data == NULL)
+      goto hivex_error;
+    py_value = PyBytes_FromStringAndSize (data, len);
+    free (data);
+    if (py_value == NULL)
+      goto error;
+  }
+
+  py_t = PyLong_FromLong ((long) t);
+  if (py_t == NULL)
+    goto error;
+  r = PyDict_New ();
+  if (r == NULL) {
+    Py_DECREF (py_t);
+    goto error;
+  }
+  if (PyDict_SetItemString (r, \"key\", py_key) == -1 ||
+      PyDict_SetItemString (r, \"t\", py_t) == -1 ||
+      PyDict_SetItemString (r, \"value\", py_value) == -1) {
+    Py_DECREF (py_t);
+    Py_DECREF (r);
+    goto error;
+  }
+  Py_DECREF (py_key);
+  Py_DECREF (py_t);
+  Py_DECREF (py_value);
+  return r;
+
+ hivex_error:
+  PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+ error:
+  Py_XDECREF (py_key);
+  Py_XDECREF (py_value);
+  return NULL;
+}
+
+/* Build a dict for the subtree starting at node.  depth is the
+ * number of levels of children to include, or < 0 for no limit.
+ */
+static PyObject *
+put_native_node (hive_h *h, hive_node_h node, int depth, int decode,
+                 const struct native_path *parent)
+{
+  struct native_path path = { node, parent };
+  const struct native_path *p;
+  PyObject *r, *list, *item;
+  hive_node_h *children;
+  hive_value_h *values;
+  char *name;
+  size_t i;
+  int ret;
+
+  for (p = parent; p != NULL; p = p->parent) {
+    if (p->node == node) {
+      PyErr_SetString (PyExc_RuntimeError, strerror (ELOOP));
+      return NULL;
+    }
+  }
+
+  r = PyDict_New ();
+  if (r == NULL)
+    return NULL;
+
+  name = hivex_node_name (h, node);
+  if (name == NULL)
+    goto hivex_error;
+  item = PyUnicode_DecodeUTF8 (name, strlen (name), NULL);
+  free (name);
+  if (item == NULL)
+    goto error;
+  ret = PyDict_SetItemString (r, \"name\", item);
+  Py_DECREF (item);
+  if (ret == -1)
+    goto error;
+
+  values = hivex_node_values (h, node);
+  if (values == NULL)
+    goto hivex_error;
+  list = PyList_New (0);
+  if (list == NULL || PyDict_SetItemString (r, \"values\", list) == -1) {
+    Py_XDECREF (list);
+    free (values);
+    goto error;
+  }
+  Py_DECREF (list);
+  for (i = 0; values[i] != 0; ++i) {
+    item = put_native_value (h, values[i], decode);
+    if (item == NULL || PyList_Append (list, item) == -1) {
+      Py_XDECREF (item);
+      free (values);
+      goto error;
+    }
+    Py_DECREF (item);
+  }
+  free (values);
+
+  if (depth == 0)
+    return r;
+
+  children = hivex_node_children (h, node);
+  if (children == NULL)
+    goto hivex_error;
+  list = PyList_New (0);
+  if (list == NULL || PyDict_SetItemString (r, \"children\", list) == -1) {
+    Py_XDECREF (list);
+    free (children);
+    goto error;
+  }
+  Py_DECREF (list);
+  for (i = 0; children[i] != 0; ++i) {
+    item = put_native_node (h, children[i], depth > 0 ? depth - 1 : depth,
+                            decode, &path);
+    if (item == NULL || PyList_Append (list, item) == -1) {
+      Py_XDECREF (item);
+      free (children);
+      goto error;
+    }
+    Py_DECREF (item);
+  }
+  free (children);
 
-  return 0;
+  return r;
+
+ hivex_error:
+  PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+ error:
+  Py_DECREF (r);
+  return NULL;
 }
 
-typedef struct py_set_values {
-  size_t nr_values;
-  hive_set_value *values;
-} py_set_values;
+static PyObject *
+py_hivex_node_to_native (PyObject *self, PyObject *args)
+{
+  PyObject *py_h;
+  hive_h *h;
+  long node;
+  int depth, decode;
+
+  if (!PyArg_ParseTuple (args, (char *) \"Olii:hivex_node_to_native\",
+                         &py_h, &node, &depth, &decode))
+    return NULL;
+  h = get_handle (py_h);
+
+  return put_native_node (h, node, depth, decode, NULL);
+}
+
+#if PY_MAJOR_VERSION >= 3
+/* A read-only buffer over value data stored in the hive.  It holds a
+ * reference to the Python Hivex object, so the hive cannot be closed
+ * while any memoryview of the data exists.
+ */
+typedef struct {
+  PyObject_HEAD
+  PyObject *owner;
+  const char *data;
+  Py_ssize_t len;
+} value_view_object;
 
 static int
-get_values (PyObject *v, py_set_values *ret)
+value_view_getbuffer (PyObject *self, Py_buffer *view, int flags)
 {
-  Py_ssize_t slen;
-  size_t len, i;
+  value_view_object *v = (value_view_object *) self;
 
-  if (!PyList_Check (v)) {
-    PyErr_SetString (PyExc_RuntimeError, \"expecting a list parameter\");
-    return -1;
-  }
+  return PyBuffer_FillInfo (view, self, (void *) v->data, v->len, 1, flags);
+}
 
-  slen = PyList_Size (v);
-  if (slen < 0) {
-    PyErr_SetString (PyExc_RuntimeError, \"get_string_list: PyList_Size failure\");
-    return -1;
+static void
+value_view_dealloc (PyObject *self)
+{
+  value_view_object *v = (value_view_object *) self;
+
+  Py_XDECREF (v->owner);
+  PyObject_Del (self);
+}
+
+static PyBufferProcs value_view_as_buffer = {
+  value_view_getbuffer,         /* bf_getbuffer */
+  NULL,                         /* bf_releasebuffer */
+};
+
+static PyTypeObject value_view_type = {
+  PyVarObject_HEAD_INIT (NULL, 0)
+  .tp_name = \"libhivexmod.value_view\",
+  .tp_basicsize = sizeof (value_view_object),
+  .tp_dealloc = value_view_dealloc,
+  .tp_as_buffer = &value_view_as_buffer,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+};
+#endif
+
+/* Return (type, memoryview) for a value.  Where possible the
+ * memoryview refers directly to the data in the hive, otherwise it
+ * falls back to a copy of the data.
+ */
+static PyObject *
+py_hivex_value_memoryview (PyObject *self, PyObject *args)
+{
+  PyObject *py_owner;
+  PyObject *py_h;
+  PyObject *py_data;
+  PyObject *py_view;
+  PyObject *py_r;
+  hive_h *h;
+  long val;
+  hive_type t;
+  size_t len;
+
+  if (!PyArg_ParseTuple (args, (char *) \"OOl:hivex_value_memoryview\",
+                         &py_owner, &py_h, &val))
+    return NULL;
+  h = get_handle (py_h);
+
+#if PY_MAJOR_VERSION >= 3
+  const char *r = hivex_value_value_ptr (h, val, &t, &len);
+  if (r != NULL) {
+    value_view_object *v = PyObject_New (value_view_object, &value_view_type);
+    if (v == NULL)
+      return NULL;
+    Py_INCREF (py_owner);
+    v->owner = py_owner;
+    v->data = r;
+    v->len = len;
+    py_data = (PyObject *) v;
   }
-  len = (size_t) slen;
-  ret->nr_values = len;
-  ret->values = malloc (len * sizeof (hive_set_value));
-  if (!ret->values) {
-    PyErr_NoMemory ();
-    return -1;
+  else if (errno != ENOTSUP) {
+    PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+    return NULL;
   }
-
-  for (i = 0; i < len; ++i) {
-    if (get_value (PyList_GetItem (v, i), &(ret->values[i])) == -1) {
-      free (ret->values);
-      return -1;
+  else
+#endif
+  {
+    char *copy = hivex_value_value (h, val, &t, &len);
+    if (copy == NULL) {
+      PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+      return NULL;
     }
+    py_data = PyBytes_FromStringAndSize (copy, len);
+    free (copy);
+    if (py_data == NULL)
+      return NULL;
   }
 
-  return 0;
+  py_view = PyMemoryView_FromObject (py_data);
+  Py_DECREF (py_data);
+  if (py_view == NULL)
+    return NULL;
+
+  py_r = PyTuple_New (2);
+  PyTuple_SetItem (py_r, 0, PyLong_FromLong ((long) t));
+  PyTuple_SetItem (py_r, 1, py_view);
+  return py_r;
 }
 
+/* An iterator over an array of node or value handles, used by the
+ * lazy object model in hivex/__init__.py.  The handles are only
+ * converted to Python integers as they are returned.  The iterator
+ * holds a reference to the Python Hivex object, so the hive cannot
+ * be closed while the iterator exists.
+ */
+typedef struct {
+  PyObject_HEAD
+  PyObject *owner;
+  size_t *handles;
+  size_t i;
+} handle_iter_object;
+
 static PyObject *
-put_string_list (char * const * const argv)
+handle_iter_next (PyObject *self)
 {
-  PyObject *list;
-  size_t argc, i;
-
-  for (argc = 0; argv[argc] != NULL; ++argc)
-    ;
-
-  list = PyList_New (argc);
-  for (i = 0; i < argc; ++i) {
-    PyList_SetItem (list, i, PyUnicode_DecodeUTF8 (argv[i], strlen (argv[i]), NULL));
-  }
+  handle_iter_object *it = (handle_iter_object *) self;
 
-  return list;
+  if (it->handles[it->i] == 0)
+    return NULL;                /* StopIteration */
+  return PyLong_FromLongLong ((long long) it->handles[it->i++]);
 }
 
 static void
-free_strings (char **argv)
+handle_iter_dealloc (PyObject *self)
 {
-  size_t argc;
+  handle_iter_object *it = (handle_iter_object *) self;
 
-  for (argc = 0; argv[argc] != NULL; ++argc)
-    free (argv[argc]);
-  free (argv);
+  Py_XDECREF (it->owner);
+  free (it->handles);
+  PyObject_Del (self);
 }
 
-/* Since hive_node_t is the same as hive_value_t this also works for values. */
+static PyTypeObject handle_iter_type = {
+  PyVarObject_HEAD_INIT (NULL, 0)
+  .tp_name = \"libhivexmod.handle_iter\",
+  .tp_basicsize = sizeof (handle_iter_object),
+  .tp_dealloc = handle_iter_dealloc,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_iter = PyObject_SelfIter,
+  .tp_iternext = handle_iter_next,
+};
+
 static PyObject *
-put_node_list (hive_node_h *nodes)
+put_handle_iter (PyObject *py_owner, size_t *handles)
 {
-  PyObject *list;
-  size_t argc, i;
-
-  for (argc = 0; nodes[argc] != 0; ++argc)
-    ;
+  handle_iter_object *it;
 
-  list = PyList_New (argc);
-  for (i = 0; i < argc; ++i)
-    PyList_SetItem (list, i, PyLong_FromLongLong ((long) nodes[i]));
-
-  return list;
+  it = PyObject_New (handle_iter_object, &handle_iter_type);
+  if (it == NULL) {
+    free (handles);
+    return NULL;
+  }
+  Py_INCREF (py_owner);
+  it->owner = py_owner;
+  it->handles = handles;
+  it->i = 0;
+  return (PyObject *) it;
 }
 
 static PyObject *
-put_len_type (size_t len, hive_type t)
+py_hivex_node_children_iter (PyObject *self, PyObject *args)
 {
-  PyObject *r = PyTuple_New (2);
-  PyTuple_SetItem (r, 0, PyLong_FromLong ((long) t));
-  PyTuple_SetItem (r, 1, PyLong_FromLongLong ((long) len));
-  return r;
+  PyObject *py_owner;
+  PyObject *py_h;
+  hive_h *h;
+  long node;
+  hive_node_h *r;
+
+  if (!PyArg_ParseTuple (args, (char *) \"OOl:hivex_node_children_iter\",
+                         &py_owner, &py_h, &node))
+    return NULL;
+  h = get_handle (py_h);
+
+  Py_BEGIN_ALLOW_THREADS
+  r = hivex_node_children (h, node);
+  Py_END_ALLOW_THREADS
+  if (r == NULL) {
+    PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+    return NULL;
+  }
+
+  return put_handle_iter (py_owner, r);
 }
 
 static PyObject *
-put_len_val (size_t len, hive_value_h value)
+py_hivex_node_values_iter (PyObject *self, PyObject *args)
 {
-  PyObject *r = PyTuple_New (2);
-  PyTuple_SetItem (r, 0, PyLong_FromLongLong ((long) len));
-  PyTuple_SetItem (r, 1, PyLong_FromLongLong ((long) value));
-  return r;
+  PyObject *py_owner;
+  PyObject *py_h;
+  hive_h *h;
+  long node;
+  hive_value_h *r;
+
+  if (!PyArg_ParseTuple (args, (char *) \"OOl:hivex_node_values_iter\",
+                         &py_owner, &py_h, &node))
+    return NULL;
+  h = get_handle (py_h);
+
+  Py_BEGIN_ALLOW_THREADS
+  r = hivex_node_values (h, node);
+  Py_END_ALLOW_THREADS
+  if (r == NULL) {
+    PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+    return NULL;
+  }
+
+  return put_handle_iter (py_owner, r);
 }
 
+/* Like node_get_value, but returns None if the key is not found. */
 static PyObject *
-put_val_type (char *val, size_t len, hive_type t)
+py_hivex_node_find_value (PyObject *self, PyObject *args)
 {
-  PyObject *r = PyTuple_New (2);
-  PyTuple_SetItem (r, 0, PyLong_FromLong ((long) t));
-  PyTuple_SetItem (r, 1, PyBytes_FromStringAndSize (val, len));
-  return r;
+  PyObject *py_h;
+  hive_h *h;
+  long node;
+  char *key;
+  hive_value_h r;
+
+  if (!PyArg_ParseTuple (args, (char *) \"Ols:hivex_node_find_value\",
+                         &py_h, &node, &key))
+    return NULL;
+  h = get_handle (py_h);
+
+  Py_BEGIN_ALLOW_THREADS
+  errno = 0;
+  r = hivex_node_get_value (h, node, key);
+  Py_END_ALLOW_THREADS
+  if (r == 0 && errno != 0) {
+    PyErr_SetString (PyExc_RuntimeError, strerror (errno));
+    return NULL;
+  }
+
+  if (r == 0) {
+    Py_INCREF (Py_None);
+    return Py_None;
+  }
+  return PyLong_FromLongLong (r);
 }
 
 ";
@@ -3032,6 +6014,8 @@ put_val_type (char *val, size_t len, hive_type t)
         | RNodeList -> pr "  hive_node_h *r;\n"; "NULL"
         | RValue -> pr "  hive_value_h r;\n"; "0"
         | RValueList -> pr "  hive_value_h *r;\n"; "NULL"
+        | RNodeNamedList -> pr "  hive_node_named *r;\n"; "NULL"
+        | RValueFullList -> pr "  hive_value_full *r;\n"; "NULL"
         | RString -> pr "  char *r;\n"; "NULL"
         | RStringList -> pr "  char **r;\n"; "NULL"
         | RLenType ->
@@ -3049,6 +6033,10 @@ put_val_type (char *val, size_t len, hive_type t)
             pr "  size_t len;\n";
             pr "  hive_type t;\n";
             "NULL"
+        | RStats ->
+            pr "  int r;\n";
+            pr "  hive_stats stats;\n";
+            "-1"
         | RInt32 ->
             pr "  errno = 0;\n";
             pr "  int32_t r;\n";
@@ -3069,6 +6057,7 @@ put_val_type (char *val, size_t len, hive_type t)
         match fst style with
         | RLenType | RLenTypeVal -> c_params @ ["&t"; "&len"]
         | RLenValue -> c_params @ ["&len"]
+        | RStats -> c_params @ ["&stats"; "sizeof stats"]
         | _ -> c_params in
 
       List.iter (
@@ -3159,8 +6148,13 @@ put_val_type (char *val, size_t len, hive_type t)
             pr "    return NULL;\n"
       ) (snd style);
 
-      (* Call the C function. *)
+      (* Call the C function.  String parameters point into objects
+       * owned by the args tuple, and set values have been copied by
+       * get_value, so it is safe to release the GIL here.
+       *)
+      pr "  Py_BEGIN_ALLOW_THREADS\n";
       pr "  r = hivex_%s (%s);\n" name (String.concat ", " c_params);
+      pr "  Py_END_ALLOW_THREADS\n";
 
       (* Free up arguments. *)
       List.iter (
@@ -3169,8 +6163,9 @@ put_val_type (char *val, size_t len, hive_type t)
         | AString _ | AStringNullable _
         | AOpenFlags | AUnusedFlags -> ()
         | ASetValues ->
-            pr "  free (values.values);\n"
-        | ASetValue -> ()
+            pr "  free_values (&values);\n"
+        | ASetValue ->
+            pr "  free_value (&val);\n"
       ) (snd style);
 
       (* Check for errors from C library. *)
@@ -3203,6 +6198,12 @@ put_val_type (char *val, size_t len, hive_type t)
        | RValueList ->
            pr "  py_r = put_node_list (r);\n";
            pr "  free (r);\n"
+       | RNodeNamedList ->
+           pr "  py_r = put_node_named_list (r);\n";
+           pr "  free_node_named_list (r);\n"
+       | RValueFullList ->
+           pr "  py_r = put_value_full_list (r);\n";
+           pr "  free_value_full_list (r);\n"
        | RValue ->
            pr "  py_r = PyLong_FromLongLong (r);\n"
        | RString ->
@@ -3224,6 +6225,8 @@ put_val_type (char *val, size_t len, hive_type t)
        | RLenTypeVal ->
            pr "  py_r = put_val_type (r, len, t);\n";
            pr "  free (r);\n"
+       | RStats ->
+           pr "  py_r = put_stats (&stats);\n"
        | RInt32 ->
            pr "  py_r = PyLong_FromLong ((long) r);\n"
        | RInt64 ->
@@ -3241,6 +6244,11 @@ put_val_type (char *val, size_t len, hive_type t)
       pr "  { (char *) \"%s\", py_hivex_%s, METH_VARARGS, NULL },\n"
         name name
   ) functions;
+  pr "  { (char *) \"value_memoryview\", py_hivex_value_memoryview, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"node_to_native\", py_hivex_node_to_native, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"node_children_iter\", py_hivex_node_children_iter, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"node_values_iter\", py_hivex_node_values_iter, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"node_find_value\", py_hivex_node_find_value, METH_VARARGS, NULL },\n";
   pr "  { NULL, NULL, 0, NULL }\n";
   pr "};\n";
   pr "\n";
@@ -3266,7 +6274,12 @@ moduleinit (void)
 {
   PyObject *m;
 
+  if (PyType_Ready (&handle_iter_type) < 0)
+    return NULL;
+
 #if PY_MAJOR_VERSION >= 3
+  if (PyType_Ready (&value_view_type) < 0)
+    return NULL;
   m = PyModule_Create (&moduledef);
 #else
   m = Py_InitModule ((char *) \"libhivexmod\", methods);
@@ -3370,7 +6383,241 @@ class Hivex(object):
         pr ")\n";
         pr "\n"
       )
-  ) functions
+  ) functions;
+
+  pr "\
+    def value_memoryview (self, val):
+        \"\"\"return data type and a read-only memoryview of the data of a value
+
+        This is like value_value, but where possible the memoryview
+        refers directly to the data in the hive instead of a copy.
+        The hive is kept open while the memoryview exists.\"\"\"
+        return libhivexmod.value_memoryview (self, self._o, val)
+
+    def node_to_native (self, node, depth = -1, decode = True):
+        \"\"\"return the subtree at node as nested dicts
+
+        Each node is returned as a dict with keys 'name', 'values'
+        (a list of dicts with keys 'key', 't' and 'value', as used by
+        node_set_values) and 'children' (a list of nodes).  depth
+        limits the number of levels of children returned; nodes at
+        the limit have no 'children' key.  A negative depth means
+        no limit.
+
+        If decode is true then strings, multiple strings, dwords and
+        qwords are converted to Python str, list and int.  Other
+        values, and values which cannot be decoded, are returned as
+        bytes.\"\"\"
+        return libhivexmod.node_to_native (self._o, node, depth,
+                                           1 if decode else 0)
+
+class Hive(object):
+    \"\"\"A lazy object model of a hive
+
+    import hivex
+    hive = hivex.Hive (filename)
+    for key in hive.root.walk ():
+        if \"Name\" in key.values:
+            print (key.name, key.values[\"Name\"].string ())
+
+    Keys and values are represented by Key and Value objects which
+    hold only the node or value handle.  Names, children and data are
+    fetched from the hive when they are used, and children and values
+    are iterated over without building Python lists.
+
+    The underlying Hivex handle is available as the 'h' attribute.
+    The same arguments as Hivex are accepted.\"\"\"
+
+    def __init__ (self, filename, verbose = False, debug = False,
+                  write = False):
+        self.h = Hivex (filename, verbose = verbose, debug = debug,
+                        write = write)
+
+    @property
+    def root (self):
+        \"\"\"the root key of the hive\"\"\"
+        return Key (self.h, self.h.root ())
+
+class Key(object):
+    \"\"\"A key (node) in a hive
+
+    Iterating over a key returns its subkeys.  key[name] returns the
+    named subkey (matched case insensitively), or raises KeyError.
+    key.values is a mapping of the values attached to the key.\"\"\"
+
+    __slots__ = (\"_h\", \"node\", \"_name\")
+
+    def __init__ (self, h, node):
+        self._h = h
+        self.node = node
+        self._name = None
+
+    def __eq__ (self, other):
+        return isinstance (other, Key) and self.node == other.node
+
+    def __ne__ (self, other):
+        return not self.__eq__ (other)
+
+    def __hash__ (self):
+        return hash (self.node)
+
+    def __repr__ (self):
+        return \"<hivex.Key \" + repr (self.name) + \">\"
+
+    @property
+    def name (self):
+        \"\"\"the name of the key\"\"\"
+        if self._name is None:
+            self._name = self._h.node_name (self.node)
+        return self._name
+
+    @property
+    def parent (self):
+        \"\"\"the parent key\"\"\"
+        return Key (self._h, self._h.node_parent (self.node))
+
+    @property
+    def path (self):
+        \"\"\"the full path of the key from the root\"\"\"
+        return self._h.node_path (self.node)
+
+    @property
+    def timestamp (self):
+        \"\"\"the modification time of the key as a Windows filetime\"\"\"
+        return self._h.node_timestamp (self.node)
+
+    @property
+    def values (self):
+        \"\"\"the values attached to the key\"\"\"
+        return Values (self._h, self.node)
+
+    def __iter__ (self):
+        h = self._h
+        for node in libhivexmod.node_children_iter (h, h._o, self.node):
+            yield Key (h, node)
+
+    def __getitem__ (self, name):
+        node = self._h.node_get_child (self.node, name)
+        if node is None:
+            raise KeyError (name)
+        return Key (self._h, node)
+
+    def __contains__ (self, name):
+        return self._h.node_get_child (self.node, name) is not None
+
+    def get (self, name, default = None):
+        \"\"\"return the named subkey, or default if it does not exist\"\"\"
+        node = self._h.node_get_child (self.node, name)
+        if node is None:
+            return default
+        return Key (self._h, node)
+
+    def walk (self):
+        \"\"\"iterate over this key and all keys below it, depth first
+
+        Only the keys on the path from this key to the current key
+        are held in memory, so this can be used on very large hives.\"\"\"
+        h = self._h
+        yield self
+        stack = [libhivexmod.node_children_iter (h, h._o, self.node)]
+        while stack:
+            for node in stack[-1]:
+                yield Key (h, node)
+                stack.append (libhivexmod.node_children_iter (h, h._o, node))
+                break
+            else:
+                stack.pop ()
+
+class Values(object):
+    \"\"\"The values attached to a key
+
+    Iterating over this returns Value objects.  values[key] returns
+    the named value (matched case insensitively), or raises KeyError.
+    The default value has the key \"\".\"\"\"
+
+    __slots__ = (\"_h\", \"node\")
+
+    def __init__ (self, h, node):
+        self._h = h
+        self.node = node
+
+    def __iter__ (self):
+        h = self._h
+        for val in libhivexmod.node_values_iter (h, h._o, self.node):
+            yield Value (h, val)
+
+    def __getitem__ (self, key):
+        val = libhivexmod.node_find_value (self._h._o, self.node, key)
+        if val is None:
+            raise KeyError (key)
+        return Value (self._h, val)
+
+    def __contains__ (self, key):
+        return libhivexmod.node_find_value (self._h._o, self.node,
+                                            key) is not None
+
+    def get (self, key, default = None):
+        \"\"\"return the named value, or default if it does not exist\"\"\"
+        val = libhivexmod.node_find_value (self._h._o, self.node, key)
+        if val is None:
+            return default
+        return Value (self._h, val)
+
+class Value(object):
+    \"\"\"A value attached to a key
+
+    The key, type and data are read from the hive when they are
+    used.\"\"\"
+
+    __slots__ = (\"_h\", \"value\")
+
+    def __init__ (self, h, value):
+        self._h = h
+        self.value = value
+
+    def __eq__ (self, other):
+        return isinstance (other, Value) and self.value == other.value
+
+    def __ne__ (self, other):
+        return not self.__eq__ (other)
+
+    def __hash__ (self):
+        return hash (self.value)
+
+    def __repr__ (self):
+        return \"<hivex.Value \" + repr (self.key) + \">\"
+
+    @property
+    def key (self):
+        \"\"\"the key (name) of the value\"\"\"
+        return self._h.value_key (self.value)
+
+    @property
+    def type (self):
+        \"\"\"the type of the value\"\"\"
+        return self._h.value_type (self.value)[0]
+
+    @property
+    def data (self):
+        \"\"\"the data of the value as bytes\"\"\"
+        return self._h.value_value (self.value)[1]
+
+    def string (self):
+        \"\"\"return the value as a string\"\"\"
+        return self._h.value_string (self.value)
+
+    def multiple_strings (self):
+        \"\"\"return the value as a list of strings\"\"\"
+        return self._h.value_multiple_strings (self.value)
+
+    def dword (self):
+        \"\"\"return the value as a DWORD\"\"\"
+        return self._h.value_dword (self.value)
+
+    def qword (self):
+        \"\"\"return the value as a QWORD\"\"\"
+        return self._h.value_qword (self.value)
+"
 
 and generate_python_hive_types_py () =
   generate_header HashStyle LGPLv2plus;
@@ -3396,6 +6643,10 @@ and generate_ruby_c () =
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#include <string.h>
+#include <errno.h>
 
 #include <ruby.h>
 #ifdef HAVE_RUBY_ENCODING_H
@@ -3406,6 +6657,10 @@ and generate_ruby_c () =
 
 #include \"extconf.h\"
 
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+#include <ruby/thread.h>
+#endif
+
 /* For Ruby < 1.9 */
 #ifndef RARRAY_LEN
 #define RARRAY_LEN(r) (RARRAY((r))->len)
@@ -3464,10 +6719,326 @@ get_values (VALUE valuesv, size_t *nr_values)
   return ret;
 }
 
+static VALUE
+native_str (const char *str)
+{
+  VALUE rv = rb_str_new2 (str);
+#ifdef HAVE_RUBY_ENCODING_H
+  rb_enc_associate (rv, rb_utf8_encoding ());
+#endif
+  return rv;
+}
+
+";
+  generate_c_stats_table ();
+  pr "\
+/* Used by node_to_native to detect cycles when walking a subtree. */
+struct native_path {
+  hive_node_h node;
+  const struct native_path *parent;
+};
+
+/* Decode a value according to its type.  Returns Qundef if the value
+ * cannot be decoded, in which case the caller uses the raw bytes.
+ */
+static VALUE
+native_decode_value (hive_h *h, hive_value_h value, hive_type t)
+{
+  VALUE rv;
+
+  switch (t) {
+  case hive_t_string:
+  case hive_t_expand_string:
+  case hive_t_link: {
+    char *str = hivex_value_string (h, value);
+    if (str == NULL)
+      return Qundef;
+    rv = native_str (str);
+    free (str);
+    return rv;
+  }
+
+  case hive_t_multiple_strings: {
+    char **strs = hivex_value_multiple_strings (h, value);
+    size_t i;
+    if (strs == NULL)
+      return Qundef;
+    rv = rb_ary_new ();
+    for (i = 0; strs[i] != NULL; ++i) {
+      rb_ary_push (rv, native_str (strs[i]));
+      free (strs[i]);
+    }
+    free (strs);
+    return rv;
+  }
+
+  case hive_t_dword:
+  case hive_t_dword_be: {
+    int32_t i32;
+    errno = 0;
+    i32 = hivex_value_dword (h, value);
+    if (i32 == -1 && errno != 0)
+      return Qundef;
+    return INT2NUM (i32);
+  }
+
+  case hive_t_qword: {
+    int64_t i64;
+    errno = 0;
+    i64 = hivex_value_qword (h, value);
+    if (i64 == -1 && errno != 0)
+      return Qundef;
+    return LL2NUM (i64);
+  }
+
+  default:
+    return Qundef;
+  }
+}
+
+static VALUE
+native_value (hive_h *h, hive_value_h value, int decode)
+{
+  VALUE rv, datav = Qundef;
+  char *key, *data;
+  hive_type t;
+  size_t len;
+
+  key = hivex_value_key (h, value);
+  if (key == NULL)
+    rb_raise (e_Error, \"%%s\", strerror (errno));
+  rv = rb_hash_new ();
+  rb_hash_aset (rv, ID2SYM (rb_intern (\"key\")), native_str (key));
+  free (key);
+
+  if (hivex_value_type (h, value, &t, &len) == -1)
+    rb_raise (e_Error, \"%%s\", strerror (errno));
+  if (decode)
+    datav = native_decode_value (h, value, t);
+  if (datav == Qundef) {
+    data = hivex_value_value (h, value, &t, &len);
+    if (data == NULL)
+      rb_raise (e_Error, \"%%s\", strerror (errno));
+    datav = rb_str_new (data, len);
+    free (data);
+  }
+
+  rb_hash_aset (rv, ID2SYM (rb_intern (\"type\")), INT2NUM (t));
+  rb_hash_aset (rv, ID2SYM (rb_intern (\"value\")), datav);
+  return rv;
+}
+
+static VALUE native_node (hive_h *h, hive_node_h node, int depth, int decode, const struct native_path *parent);
+
+/* Converting the values or children of a node may raise an exception
+ * (including from the recursive call), so the conversion runs under
+ * rb_ensure, which frees the list returned by hivex.
+ */
+struct native_list {
+  hive_h *h;
+  size_t *list;
+  int depth, decode;
+  const struct native_path *path;
+};
+
+static VALUE
+native_values_body (VALUE argv)
+{
+  struct native_list *args = (struct native_list *) argv;
+  VALUE listv = rb_ary_new ();
+  size_t i;
+
+  for (i = 0; args->list[i] != 0; ++i)
+    rb_ary_push (listv, native_value (args->h, args->list[i], args->decode));
+  return listv;
+}
+
+static VALUE
+native_children_body (VALUE argv)
+{
+  struct native_list *args = (struct native_list *) argv;
+  VALUE listv = rb_ary_new ();
+  size_t i;
+
+  for (i = 0; args->list[i] != 0; ++i)
+    rb_ary_push (listv,
+                 native_node (args->h, args->list[i], args->depth,
+                              args->decode, args->path));
+  return listv;
+}
+
+static VALUE
+native_list_free (VALUE argv)
+{
+  struct native_list *args = (struct native_list *) argv;
+
+  free (args->list);
+  return Qnil;
+}
+
+/* Build a hash for the subtree starting at node.  depth is the
+ * number of levels of children to include, or < 0 for no limit.
+ */
+static VALUE
+native_node (hive_h *h, hive_node_h node, int depth, int decode,
+             const struct native_path *parent)
+{
+  struct native_path path = { node, parent };
+  struct native_list args = { h, NULL, depth > 0 ? depth - 1 : depth,
+                              decode, &path };
+  const struct native_path *p;
+  VALUE rv, listv;
+  char *name;
+
+  for (p = parent; p != NULL; p = p->parent) {
+    if (p->node == node)
+      rb_raise (e_Error, \"%%s\", strerror (ELOOP));
+  }
+
+  rv = rb_hash_new ();
+
+  name = hivex_node_name (h, node);
+  if (name == NULL)
+    rb_raise (e_Error, \"%%s\", strerror (errno));
+  rb_hash_aset (rv, ID2SYM (rb_intern (\"name\")), native_str (name));
+  free (name);
+
+  args.list = hivex_node_values (h, node);
+  if (args.list == NULL)
+    rb_raise (e_Error, \"%%s\", strerror (errno));
+  listv = rb_ensure (native_values_body, (VALUE) &args,
+                     native_list_free, (VALUE) &args);
+  rb_hash_aset (rv, ID2SYM (rb_intern (\"values\")), listv);
+
+  if (depth == 0)
+    return rv;
+
+  args.list = hivex_node_children (h, node);
+  if (args.list == NULL)
+    rb_raise (e_Error, \"%%s\", strerror (errno));
+  listv = rb_ensure (native_children_body, (VALUE) &args,
+                     native_list_free, (VALUE) &args);
+  rb_hash_aset (rv, ID2SYM (rb_intern (\"children\")), listv);
+
+  return rv;
+}
+
+/*
+ * call-seq:
+ *   h.node_to_native(node [, depth [, decode]]) -> hash
+ *
+ * return the subtree at node as nested hashes
+ *
+ * Each node is returned as a hash containing +:name+, +:values+
+ * (an array of hashes containing +:key+, +:type+ and +:value+, as
+ * used by node_set_values) and +:children+ (an array of nodes).
+ * +depth+ limits the number of levels of children returned; nodes
+ * at the limit have no +:children+ element.  The default, -1, means
+ * no limit.
+ *
+ * If +decode+ is true (the default) then strings, multiple strings,
+ * dwords and qwords are decoded into Ruby strings, arrays and
+ * integers.  Other values, and values which cannot be decoded, are
+ * returned as raw bytes.
+ */
+static VALUE
+ruby_hivex_node_to_native (int argc, VALUE *argv, VALUE hv)
+{
+  VALUE nodev, depthv, decodev;
+  hive_h *h;
+
+  rb_scan_args (argc, argv, \"12\", &nodev, &depthv, &decodev);
+
+  Data_Get_Struct (hv, hive_h, h);
+  if (!h)
+    rb_raise (rb_eArgError, \"%%s: used handle after closing it\",
+              \"node_to_native\");
+
+  return native_node (h, NUM2ULL (nodev),
+                      NIL_P (depthv) ? -1 : NUM2INT (depthv),
+                      NIL_P (decodev) ? 1 : RTEST (decodev),
+                      NULL);
+}
+
 ";
 
   List.iter (
     fun (name, (ret, args), shortdesc, longdesc) ->
+      let without_gvl = List.mem name ruby_without_gvl in
+
+      let ret_type =
+        match ret with
+        | RErr | RErrDispose | RLenType | RStats -> "int"
+        | RHive -> "hive_h *"
+        | RSize -> "size_t"
+        | RNode | RNodeNotFound -> "hive_node_h"
+        | RNodeList -> "hive_node_h *"
+        | RValue | RLenValue -> "hive_value_h"
+        | RValueList -> "hive_value_h *"
+        | RNodeNamedList -> "hive_node_named *"
+        | RValueFullList -> "hive_value_full *"
+        | RString | RLenTypeVal -> "char *"
+        | RStringList -> "char **"
+        | RInt32 -> "int32_t"
+        | RInt64 -> "int64_t" in
+
+      (* For calls which release the GVL, generate a structure holding
+       * copies of the parameters and a function which runs the call
+       * without touching any Ruby objects.
+       *)
+      if without_gvl then (
+        pr "#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL\n";
+        pr "struct ruby_hivex_%s_args {\n" name;
+        List.iter (
+          function
+          | AHive -> pr "  hive_h *h;\n"
+          | ANode n -> pr "  hive_node_h %s;\n" n
+          | AValue n -> pr "  hive_value_h %s;\n" n
+          | AString n | AStringNullable n -> pr "  char *%s;\n" n
+          | AOpenFlags -> pr "  int flags;\n"
+          | AUnusedFlags -> ()
+          | ASetValues | ASetValue ->
+              failwithf "%s: ruby_without_gvl function takes set values" name
+        ) args;
+        (match ret with
+         | RLenType | RLenTypeVal ->
+             pr "  size_t len;\n";
+             pr "  hive_type t;\n"
+         | RLenValue -> pr "  size_t len;\n"
+         | _ -> ()
+        );
+        pr "  %s%sr;\n" ret_type
+          (if ret_type.[String.length ret_type - 1] = '*' then "" else " ");
+        pr "  int err;\n";
+        pr "};\n";
+        pr "\n";
+
+        let c_params =
+          filter_map (
+            function
+            | AUnusedFlags -> Some "0"
+            | arg -> Some ("args->" ^ name_of_argt arg)
+          ) args in
+        let c_params =
+          match ret with
+          | RLenType | RLenTypeVal -> c_params @ ["&args->t"; "&args->len"]
+          | RLenValue -> c_params @ ["&args->len"]
+          | _ -> c_params in
+
+        pr "static void *\n";
+        pr "ruby_hivex_%s_without_gvl (void *argsv)\n" name;
+        pr "{\n";
+        pr "  struct ruby_hivex_%s_args *args = argsv;\n" name;
+        pr "\n";
+        pr "  errno = 0;\n";
+        pr "  args->r = hivex_%s (%s);\n" name (String.concat ", " c_params);
+        pr "  args->err = errno;\n";
+        pr "  return NULL;\n";
+        pr "}\n";
+        pr "#endif\n";
+        pr "\n"
+      );
+
       let () =
         (* Generate rdoc. *)
         let doc = replace_str longdesc "C<hivex_" "C<h." in
@@ -3494,11 +7065,13 @@ get_values (VALUE valuesv, size_t *nr_values)
           | RNodeList -> "list"
           | RValue -> "integer"
           | RValueList -> "list"
+          | RNodeNamedList | RValueFullList -> "list"
           | RString -> "string"
           | RStringList -> "list"
           | RLenType -> "hash"
           | RLenValue -> "integer"
           | RLenTypeVal -> "hash"
+          | RStats -> "hash"
           | RInt32 -> "integer"
           | RInt64 -> "integer" in
 
@@ -3589,6 +7162,8 @@ get_values (VALUE valuesv, size_t *nr_values)
         | RNodeList -> pr "  hive_node_h *r;\n"; "NULL"
         | RValue -> pr "  hive_value_h r;\n"; "0"
         | RValueList -> pr "  hive_value_h *r;\n"; "NULL"
+        | RNodeNamedList -> pr "  hive_node_named *r;\n"; "NULL"
+        | RValueFullList -> pr "  hive_value_full *r;\n"; "NULL"
         | RString -> pr "  char *r;\n"; "NULL"
         | RStringList -> pr "  char **r;\n"; "NULL"
         | RLenType ->
@@ -3606,6 +7181,10 @@ get_values (VALUE valuesv, size_t *nr_values)
             pr "  size_t len;\n";
             pr "  hive_type t;\n";
             "NULL"
+        | RStats ->
+            pr "  int r;\n";
+            pr "  hive_stats stats;\n";
+            "-1"
         | RInt32 ->
             pr "  errno = 0;\n";
             pr "  int32_t r;\n";
@@ -3626,12 +7205,57 @@ get_values (VALUE valuesv, size_t *nr_values)
         match ret with
         | RLenType | RLenTypeVal -> c_params @ [["&t"; "&len"]]
         | RLenValue -> c_params @ [["&len"]]
+        | RStats -> c_params @ [["&stats"; "sizeof stats"]]
         | _ -> c_params in
       let c_params = List.concat c_params in
 
+      if without_gvl then (
+        pr "#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL\n";
+        pr "  struct ruby_hivex_%s_args args;\n" name;
+        List.iter (
+          function
+          | AHive -> pr "  args.h = h;\n"
+          | ANode n | AValue n -> pr "  args.%s = %s;\n" n n
+          | AString n ->
+              pr "  args.%s = strdup (%s);\n" n n;
+              pr "  if (args.%s == NULL)\n" n;
+              pr "    rb_raise (rb_eNoMemError, \"%%s: out of memory\", \"%s\");\n"
+                name
+          | AStringNullable n ->
+              pr "  args.%s = NULL;\n" n;
+              pr "  if (%s != NULL) {\n" n;
+              pr "    args.%s = strdup (%s);\n" n n;
+              pr "    if (args.%s == NULL)\n" n;
+              pr "      rb_raise (rb_eNoMemError, \"%%s: out of memory\", \"%s\");\n"
+                name;
+              pr "  }\n"
+          | AOpenFlags -> pr "  args.flags = flags;\n"
+          | AUnusedFlags | ASetValues | ASetValue -> ()
+        ) args;
+        pr "  rb_thread_call_without_gvl (ruby_hivex_%s_without_gvl, &args,\n"
+          name;
+        pr "                             NULL, NULL);\n";
+        List.iter (
+          function
+          | AString n | AStringNullable n -> pr "  free (args.%s);\n" n
+          | _ -> ()
+        ) args;
+        pr "  r = args.r;\n";
+        (match ret with
+         | RLenType | RLenTypeVal ->
+             pr "  len = args.len;\n";
+             pr "  t = args.t;\n"
+         | RLenValue -> pr "  len = args.len;\n"
+         | _ -> ()
+        );
+        pr "  errno = args.err;\n";
+        pr "#else\n"
+      );
       pr "  r = hivex_%s (%s" name (List.hd c_params);
       List.iter (pr ", %s") (List.tl c_params);
       pr ");\n";
+      if without_gvl then
+        pr "#endif\n";
       pr "\n";
 
       (* Dispose of the hive handle (even if hivex_close returns error). *)
@@ -3688,6 +7312,34 @@ get_values (VALUE valuesv, size_t *nr_values)
         pr "    rb_ary_push (rv, ULL2NUM (r[i]));\n";
         pr "  free (r);\n";
         pr "  return rv;\n"
+      | RNodeNamedList ->
+        pr "  size_t i, len = 0;\n";
+        pr "  for (i = 0; r[i].name != NULL; ++i) len++;\n";
+        pr "  VALUE rv = rb_ary_new2 (len);\n";
+        pr "  for (i = 0; r[i].name != NULL; ++i) {\n";
+        pr "    VALUE hv = rb_hash_new ();\n";
+        pr "    rb_hash_aset (hv, ID2SYM (rb_intern (\"name\")), native_str (r[i].name));\n";
+        pr "    rb_hash_aset (hv, ID2SYM (rb_intern (\"node\")), ULL2NUM (r[i].node));\n";
+        pr "    rb_ary_push (rv, hv);\n";
+        pr "    free (r[i].name);\n";
+        pr "  }\n";
+        pr "  free (r);\n";
+        pr "  return rv;\n"
+      | RValueFullList ->
+        pr "  size_t i, len = 0;\n";
+        pr "  for (i = 0; r[i].key != NULL; ++i) len++;\n";
+        pr "  VALUE rv = rb_ary_new2 (len);\n";
+        pr "  for (i = 0; r[i].key != NULL; ++i) {\n";
+        pr "    VALUE hv = rb_hash_new ();\n";
+        pr "    rb_hash_aset (hv, ID2SYM (rb_intern (\"key\")), native_str (r[i].key));\n";
+        pr "    rb_hash_aset (hv, ID2SYM (rb_intern (\"type\")), INT2NUM (r[i].t));\n";
+        pr "    rb_hash_aset (hv, ID2SYM (rb_intern (\"value\")), rb_str_new (r[i].value, r[i].len));\n";
+        pr "    rb_ary_push (rv, hv);\n";
+        pr "    free (r[i].key);\n";
+        pr "    free (r[i].value);\n";
+        pr "  }\n";
+        pr "  free (r);\n";
+        pr "  return rv;\n"
       | RString ->
         if f_len_exists name then (
           pr "  size_t sz = hivex_%s_len (%s);\n" name (String.concat ", " c_params);
@@ -3726,6 +7378,13 @@ get_values (VALUE valuesv, size_t *nr_values)
         pr "  rb_hash_aset (rv, ID2SYM (rb_intern (\"value\")), rb_str_new (r, len));\n";
         pr "  free (r);\n";
         pr "  return rv;\n"
+      | RStats ->
+        pr "  VALUE rv = rb_hash_new ();\n";
+        pr "  size_t i;\n";
+        pr "  for (i = 0; i < nr_stats_fields; ++i)\n";
+        pr "    rb_hash_aset (rv, ID2SYM (rb_intern (stats_fields[i].name)),\n";
+        pr "                  ULL2NUM (stats_field (&stats, i)));\n";
+        pr "  return rv;\n"
       );
 
       pr "}\n";
@@ -3766,6 +7425,8 @@ void Init__hivex ()
         pr "  rb_define_module_function (m_hivex, \"%s\",\n" name;
         pr "                             ruby_hivex_%s, %d);\n" name nr_args
   ) functions;
+  pr "  rb_define_method (c_hivex, \"node_to_native\",\n";
+  pr "                    ruby_hivex_node_to_native, -1);\n";
 
   pr "}\n"
 
@@ -3822,6 +7483,7 @@ Run it from the top source directory using the command
   check_functions ();
 
   output_to "lib/hivex.h" generate_c_header;
+  output_to "lib/hivex.hpp" generate_cxx_header;
   output_to "lib/hivex.pod" generate_c_pod;
 
   output_to "lib/hivex.syms" generate_linker_script;
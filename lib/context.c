@@ -0,0 +1,190 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Contexts hold setup which can be shared by many handles (see
+ * hivex_open_ctx).  Every handle has one: handles opened with
+ * hivex_open get a private context which is freed when the handle
+ * is closed.
+ *
+ * The context keeps:
+ *
+ * - The iconv descriptors used by _hivex_recode.  These are opened
+ *   the first time each conversion is needed, and afterwards only
+ *   reset, instead of being opened and closed on every call.
+ *
+ * - One spare validity bitmap.  When a handle is closed its bitmap
+ *   is kept here, and the next handle opened on the context which
+ *   needs a bitmap no larger reuses it, avoiding a large allocation
+ *   and the page faults of touching fresh memory.
+ *
+ * A context is not locked.  Like a handle, it must only be used by
+ * one thread at a time, and that includes all the handles using it.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <iconv.h>
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+/* Only a few conversions are used (see utf16.c), so this never
+ * fills up in practice.
+ */
+#define NR_ICONV 8
+
+struct hive_context {
+  size_t nr_handles;            /* Handles open on this context. */
+
+  struct {
+    const char *to, *from;      /* Static strings from the callers. */
+    iconv_t ic;
+  } iconv[NR_ICONV];
+  size_t nr_iconv;
+
+  char *bitmap;                 /* Spare bitmap, or NULL. */
+  size_t bitmap_size;
+};
+
+hive_context *
+hivex_context_new (int flags)
+{
+  hive_context *ctx;
+
+  if (flags != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  ctx = calloc (1, sizeof *ctx);
+  return ctx;
+}
+
+int
+hivex_context_free (hive_context *ctx)
+{
+  size_t i;
+
+  if (ctx->nr_handles > 0) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  for (i = 0; i < ctx->nr_iconv; ++i)
+    iconv_close (ctx->iconv[i].ic);
+  free (ctx->bitmap);
+  free (ctx);
+  return 0;
+}
+
+/* Return an iconv descriptor in the initial shift state.  It belongs
+ * to the context and must not be closed by the caller.
+ */
+iconv_t
+_hivex_context_iconv (hive_h *h, const char *to, const char *from)
+{
+  hive_context *ctx = h->ctx;
+  iconv_t ic;
+  size_t i;
+
+  for (i = 0; i < ctx->nr_iconv; ++i) {
+    if (STREQ (ctx->iconv[i].to, to) && STREQ (ctx->iconv[i].from, from)) {
+      ic = ctx->iconv[i].ic;
+      iconv (ic, NULL, NULL, NULL, NULL);
+      return ic;
+    }
+  }
+
+  ic = iconv_open (to, from);
+  if (ic == (iconv_t) -1)
+    return ic;
+  STATS_INC (iconv_opens);
+
+  if (ctx->nr_iconv == NR_ICONV) {
+    /* Full, so replace the last one. */
+    ctx->nr_iconv--;
+    iconv_close (ctx->iconv[ctx->nr_iconv].ic);
+  }
+  ctx->iconv[ctx->nr_iconv].to = to;
+  ctx->iconv[ctx->nr_iconv].from = from;
+  ctx->iconv[ctx->nr_iconv].ic = ic;
+  ctx->nr_iconv++;
+  return ic;
+}
+
+/* Allocate a zeroed bitmap of 'size' bytes for the handle, charged
+ * to the handle, reusing the spare bitmap if it is large enough.
+ */
+char *
+_hivex_context_get_bitmap (hive_h *h, size_t size)
+{
+  hive_context *ctx = h->ctx;
+  char *bitmap;
+
+  if (ctx->bitmap == NULL || ctx->bitmap_size < size)
+    return _hivex_calloc (h, size, 1);
+
+  if (_hivex_charge (h, size) == -1)
+    return NULL;
+  bitmap = ctx->bitmap;
+  ctx->bitmap = NULL;
+  memset (bitmap, 0, size);
+  return bitmap;
+}
+
+/* Give the handle's bitmap back to the context when the handle is
+ * closed.  The larger of this and the current spare is kept.
+ */
+void
+_hivex_context_put_bitmap (hive_h *h, char *bitmap, size_t size)
+{
+  hive_context *ctx = h->ctx;
+
+  if (bitmap == NULL)
+    return;
+
+  if (ctx->bitmap_size > size) {
+    free (bitmap);
+    return;
+  }
+  free (ctx->bitmap);
+  ctx->bitmap = bitmap;
+  ctx->bitmap_size = size;
+}
+
+void
+_hivex_context_attach (hive_h *h, hive_context *ctx)
+{
+  h->ctx = ctx;
+  ctx->nr_handles++;
+}
+
+void
+_hivex_context_detach (hive_h *h)
+{
+  hive_context *ctx = h->ctx;
+
+  if (ctx == NULL)
+    return;
+  ctx->nr_handles--;
+  h->ctx = NULL;
+  if (h->own_ctx)
+    hivex_context_free (ctx);
+}
@@ -0,0 +1,334 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Structural diff between two trees of keys.
+ *
+ * The subkeys and values of each pair of matching keys are sorted by
+ * name and merged.  Names are compared as the raw code units stored
+ * in the hive (Latin-1 bytes or UTF-16LE units) with ASCII case
+ * folding, which is how Windows orders subkey lists, so nothing is
+ * converted to UTF-8.  So a rename which only changes the case of
+ * ASCII letters is not reported, and one which only changes the case
+ * of other letters is reported as a delete and an add (see hivex(3)).
+ * Value data is compared as raw bytes.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+struct diff_state {
+  hive_h *h1, *h2;
+  char *unvisited1, *unvisited2;
+  hivex_diff_callback callback;
+  void *opaque;
+  int flags;
+};
+
+static inline unsigned
+name_unit (const struct raw_name *n, size_t i)
+{
+  unsigned c = _hivex_name_unit (n, i);
+
+  return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+static int
+compare_names (const void *av, const void *bv)
+{
+  const struct raw_name *a = av, *b = bv;
+  size_t i;
+
+  for (i = 0; i < a->len && i < b->len; ++i) {
+    unsigned ca = name_unit (a, i), cb = name_unit (b, i);
+    if (ca != cb)
+      return ca < cb ? -1 : 1;
+  }
+  return a->len < b->len ? -1 : a->len > b->len;
+}
+
+static void
+free_names (hive_h *h, struct raw_name *names, size_t nr)
+{
+  _hivex_free (h, names, (nr > 0 ? nr : 1) * sizeof (struct raw_name));
+}
+
+/* Get the raw names of a 0-terminated list of nk or vk records,
+ * sorted.  The array is charged to the handle.
+ */
+static struct raw_name *
+get_names (hive_h *h, size_t *offsets, int is_nk, size_t *nr_ret)
+{
+  struct raw_name *names;
+  size_t nr, i;
+
+  for (nr = 0; offsets[nr] != 0; ++nr)
+    ;
+
+  names = _hivex_malloc (h, (nr > 0 ? nr : 1) * sizeof (struct raw_name));
+  if (names == NULL)
+    return NULL;
+
+  for (i = 0; i < nr; ++i) {
+    if (_hivex_get_raw_name (h, offsets[i], is_nk, &names[i]) == -1) {
+      free_names (h, names, nr);
+      return NULL;
+    }
+  }
+
+  qsort (names, nr, sizeof (struct raw_name), compare_names);
+  *nr_ret = nr;
+  return names;
+}
+
+static int
+values_equal (hive_h *h1, hive_value_h v1, hive_h *h2, hive_value_h v2)
+{
+  const char *d1, *d2;
+  char *copy1, *copy2 = NULL;
+  hive_type t1, t2;
+  size_t len1, len2;
+  int r = -1;
+
+  d1 = _hivex_value_data (h1, v1, &t1, &len1, &copy1);
+  if (d1 == NULL)
+    return -1;
+  d2 = _hivex_value_data (h2, v2, &t2, &len2, &copy2);
+  if (d2 == NULL)
+    goto out;
+
+  r = t1 == t2 && len1 == len2 && memcmp (d1, d2, len1) == 0;
+
+ out:
+  free (copy1);
+  free (copy2);
+  return r;
+}
+
+static int
+report (struct diff_state *state, int change,
+        hive_node_h node1, hive_node_h node2,
+        hive_value_h value1, hive_value_h value2)
+{
+  return state->callback (state->h1, state->h2, state->opaque, change,
+                          node1, node2, value1, value2);
+}
+
+static int
+diff_values (struct diff_state *state, hive_node_h node1, hive_node_h node2)
+{
+  hive_value_h *values1 = NULL, *values2 = NULL;
+  struct raw_name *names1 = NULL, *names2 = NULL;
+  size_t nr1 = 0, nr2 = 0, i, j;
+  int ret = -1;
+
+  if (state->flags & HIVEX_DIFF_TRUST_TIMESTAMPS) {
+    struct ntreg_nk_record *nk1 =
+      (struct ntreg_nk_record *) ((char *) state->h1->addr + node1);
+    struct ntreg_nk_record *nk2 =
+      (struct ntreg_nk_record *) ((char *) state->h2->addr + node2);
+    if (nk1->timestamp != 0 && nk1->timestamp == nk2->timestamp)
+      return 0;
+  }
+
+  if (_hivex_get_values (state->h1, node1, &values1, NULL) == -1 ||
+      _hivex_get_values (state->h2, node2, &values2, NULL) == -1)
+    goto out;
+  names1 = get_names (state->h1, values1, 0, &nr1);
+  if (names1 == NULL)
+    goto out;
+  names2 = get_names (state->h2, values2, 0, &nr2);
+  if (names2 == NULL)
+    goto out;
+
+  for (i = j = 0; i < nr1 || j < nr2; ) {
+    int cmp;
+
+    if (i == nr1)
+      cmp = 1;
+    else if (j == nr2)
+      cmp = -1;
+    else
+      cmp = compare_names (&names1[i], &names2[j]);
+
+    if (cmp < 0) {
+      if (report (state, hivex_diff_value_deleted,
+                  node1, node2, names1[i].offset, 0) == -1)
+        goto out;
+      i++;
+    }
+    else if (cmp > 0) {
+      if (report (state, hivex_diff_value_added,
+                  node1, node2, 0, names2[j].offset) == -1)
+        goto out;
+      j++;
+    }
+    else {
+      int eq = values_equal (state->h1, names1[i].offset,
+                             state->h2, names2[j].offset);
+      if (eq == -1)
+        goto out;
+      if (!eq && report (state, hivex_diff_value_changed, node1, node2,
+                         names1[i].offset, names2[j].offset) == -1)
+        goto out;
+      i++;
+      j++;
+    }
+  }
+
+  ret = 0;
+ out:
+  if (names1)
+    free_names (state->h1, names1, nr1);
+  if (names2)
+    free_names (state->h2, names2, nr2);
+  free (values1);
+  free (values2);
+  return ret;
+}
+
+static int
+diff_nodes (struct diff_state *state, hive_node_h node1, hive_node_h node2)
+{
+  hive_h *h = state->h1;        /* for SET_ERRNO */
+  hive_node_h *children1 = NULL, *children2 = NULL;
+  struct raw_name *names1 = NULL, *names2 = NULL;
+  size_t nr1 = 0, nr2 = 0, i, j;
+  int ret = -1;
+
+  /* Comparing a tree with itself. */
+  if (state->h1 == state->h2 && node1 == node2)
+    return 0;
+
+  if (!BITMAP_TST (state->unvisited1, node1) ||
+      !BITMAP_TST (state->unvisited2, node2)) {
+    SET_ERRNO (ELOOP, "contains cycle: visited node 0x%zx/0x%zx already",
+               node1, node2);
+    return -1;
+  }
+  BITMAP_CLR (state->unvisited1, node1);
+  BITMAP_CLR (state->unvisited2, node2);
+
+  if (diff_values (state, node1, node2) == -1)
+    return -1;
+
+  if (_hivex_get_children (state->h1, node1, &children1, NULL, 0) == -1 ||
+      _hivex_get_children (state->h2, node2, &children2, NULL, 0) == -1)
+    goto out;
+  names1 = get_names (state->h1, children1, 1, &nr1);
+  if (names1 == NULL)
+    goto out;
+  names2 = get_names (state->h2, children2, 1, &nr2);
+  if (names2 == NULL)
+    goto out;
+
+  for (i = j = 0; i < nr1 || j < nr2; ) {
+    int cmp;
+
+    if (i == nr1)
+      cmp = 1;
+    else if (j == nr2)
+      cmp = -1;
+    else
+      cmp = compare_names (&names1[i], &names2[j]);
+
+    if (cmp < 0) {
+      if (report (state, hivex_diff_node_deleted,
+                  names1[i].offset, 0, 0, 0) == -1)
+        goto out;
+      i++;
+    }
+    else if (cmp > 0) {
+      if (report (state, hivex_diff_node_added,
+                  0, names2[j].offset, 0, 0) == -1)
+        goto out;
+      j++;
+    }
+    else {
+      if (diff_nodes (state, names1[i].offset, names2[j].offset) == -1)
+        goto out;
+      i++;
+      j++;
+    }
+  }
+
+  ret = 0;
+ out:
+  if (names1)
+    free_names (state->h1, names1, nr1);
+  if (names2)
+    free_names (state->h2, names2, nr2);
+  free (children1);
+  free (children2);
+  return ret;
+}
+
+int
+hivex_diff (hive_h *h1, hive_node_h node1, hive_h *h2, hive_node_h node2,
+            hivex_diff_callback callback, void *opaque, int flags)
+{
+  hive_h *h = h1;               /* for SET_ERRNO */
+  struct diff_state state;
+  size_t unvisited1_size = 1 + h1->size / 32;
+  size_t unvisited2_size = 1 + h2->size / 32;
+  int r = -1;
+
+  if (!IS_VALID_BLOCK (h1, node1) || !block_id_eq (h1, node1, "nk") ||
+      !IS_VALID_BLOCK (h2, node2) || !block_id_eq (h2, node2, "nk")) {
+    SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
+    return -1;
+  }
+  if (flags & ~HIVEX_DIFF_TRUST_TIMESTAMPS) {
+    SET_ERRNO (EINVAL, "unknown flags 0x%x", flags);
+    return -1;
+  }
+
+  state.h1 = h1;
+  state.h2 = h2;
+  state.callback = callback;
+  state.opaque = opaque;
+  state.flags = flags;
+  state.unvisited2 = NULL;
+
+  /* As in hivex_visit, these record the keys not yet visited, so we
+   * don't loop if either hive contains cycles.
+   */
+  state.unvisited1 = _hivex_malloc (h1, unvisited1_size);
+  if (state.unvisited1 == NULL)
+    return -1;
+  memcpy (state.unvisited1, h1->bitmap, unvisited1_size);
+  state.unvisited2 = _hivex_malloc (h2, unvisited2_size);
+  if (state.unvisited2 == NULL)
+    goto out;
+  memcpy (state.unvisited2, h2->bitmap, unvisited2_size);
+
+  r = diff_nodes (&state, node1, node2);
+
+ out:;
+  int err = errno;
+  _hivex_free (h1, state.unvisited1, unvisited1_size);
+  if (state.unvisited2)
+    _hivex_free (h2, state.unvisited2, unvisited2_size);
+  errno = err;
+  return r;
+}
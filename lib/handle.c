@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 
 #ifdef HAVE_MMAP
 #include <sys/mman.h>
@@ -60,10 +61,29 @@ header_checksum (const hive_h *h)
   return sum;
 }
 
+/* Monotonic time in nanoseconds, or 0 if there is no suitable clock. */
+static uint64_t
+now_ns (void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+  return 0;
+}
+
 #define HIVEX_OPEN_MSGLVL_MASK (HIVEX_OPEN_VERBOSE|HIVEX_OPEN_DEBUG)
 
 hive_h *
 hivex_open (const char *filename, int flags)
+{
+  return hivex_open_ctx (NULL, filename, flags);
+}
+
+hive_h *
+hivex_open_ctx (hive_context *ctx, const char *filename, int flags)
 {
   hive_h *h = NULL;
 
@@ -73,6 +93,17 @@ hivex_open (const char *filename, int flags)
   h = calloc (1, sizeof *h);
   if (h == NULL)
     goto error;
+  STATS_INC (allocations);
+  h->memory_usage = sizeof *h;
+
+  /* Without a shared context, the handle gets its own. */
+  if (ctx == NULL) {
+    ctx = hivex_context_new (0);
+    if (ctx == NULL)
+      goto error;
+    h->own_ctx = 1;
+  }
+  _hivex_context_attach (h, ctx);
 
   h->msglvl = flags & HIVEX_OPEN_MSGLVL_MASK;
 
@@ -83,7 +114,7 @@ hivex_open (const char *filename, int flags)
   DEBUG (2, "created handle %p", h);
 
   h->writable = !!(flags & HIVEX_OPEN_WRITE);
-  h->filename = strdup (filename);
+  h->filename = _hivex_strdup (h, filename);
   if (h->filename == NULL)
     goto error;
 
@@ -118,7 +149,7 @@ hivex_open (const char *filename, int flags)
 
     DEBUG (2, "mapped file at %p", h->addr);
   } else {
-    h->addr = malloc (h->size);
+    h->addr = _hivex_malloc (h, h->size);
     if (h->addr == NULL)
       goto error;
 
@@ -152,7 +183,7 @@ hivex_open (const char *filename, int flags)
     goto error;
   }
 
-  h->bitmap = calloc (1 + h->size / 32, 1);
+  h->bitmap = _hivex_context_get_bitmap (h, 1 + h->size / 32);
   if (h->bitmap == NULL)
     goto error;
 
@@ -167,7 +198,7 @@ hivex_open (const char *filename, int flags)
   h->last_modified = le64toh ((int64_t) h->hdr->last_modified);
 
   if (h->msglvl >= 2) {
-    char *name = _hivex_windows_utf16_to_utf8 (h->hdr->name, 64);
+    char *name = _hivex_windows_utf16_to_utf8 (h, h->hdr->name, 64);
 
     fprintf (stderr,
              "hivex_open: header fields:\n"
@@ -208,6 +239,7 @@ hivex_open (const char *filename, int flags)
   size_t smallest_block = SIZE_MAX, largest_block = 0, blocks_bytes = 0;
   size_t used_blocks = 0;     /* Total number of used blocks found. */
   size_t used_size = 0;       /* Total size (bytes) of used blocks. */
+  uint64_t scan_start = now_ns ();
 
   /* Read the pages and blocks.  The aim here is to be robust against
    * corrupt or malicious registries.  So we make sure the loops
@@ -323,6 +355,20 @@ hivex_open (const char *filename, int flags)
     goto error;
   }
 
+  h->stats.open_scan_ns = now_ns () - scan_start;
+  h->stats.pages = pages;
+  h->stats.smallest_page = smallest_page;
+  h->stats.largest_page = largest_page;
+  h->stats.blocks = blocks;
+  h->stats.smallest_block = smallest_block;
+  h->stats.largest_block = largest_block;
+  h->stats.blocks_bytes = blocks_bytes;
+  h->stats.used_blocks = used_blocks;
+  h->stats.used_bytes = used_size;
+
+  PROBE5 (open_scan, filename, h->size, pages, blocks,
+          h->stats.open_scan_ns);
+
   DEBUG (1, "successfully read Windows Registry hive file:\n"
          "  pages:          %zu [sml: %zu, lge: %zu]\n"
          "  blocks:         %zu [sml: %zu, avg: %zu, lge: %zu]\n"
@@ -337,7 +383,10 @@ hivex_open (const char *filename, int flags)
  error:;
   int err = errno;
   if (h) {
-    free (h->bitmap);
+    if (h->ctx)
+      _hivex_context_put_bitmap (h, h->bitmap, 1 + h->size / 32);
+    else
+      free (h->bitmap);
     if (h->addr && h->size && h->addr != MAP_FAILED) {
       if (!h->writable)
         munmap (h->addr, h->size);
@@ -347,6 +396,7 @@ hivex_open (const char *filename, int flags)
     if (h->fd >= 0)
       close (h->fd);
     free (h->filename);
+    _hivex_context_detach (h);
     free (h);
   }
   errno = err;
@@ -360,7 +410,8 @@ hivex_close (hive_h *h)
 
   DEBUG (1, "hivex_close");
 
-  free (h->bitmap);
+  _hivex_drop_indexes (h);
+  _hivex_context_put_bitmap (h, h->bitmap, 1 + h->size / 32);
   if (!h->writable)
     munmap (h->addr, h->size);
   else
@@ -370,13 +421,28 @@ hivex_close (hive_h *h)
   else
     r = 0;
   free (h->filename);
+  _hivex_context_detach (h);
   free (h);
 
   return r;
 }
 
 int
-hivex_commit (hive_h *h, const char *filename, int flags)
+hivex_get_stats (hive_h *h, hive_stats *stats, size_t len)
+{
+  /* Note that len might be larger *or smaller* than our idea of the
+   * size of the structure, depending on which version of hivex.h the
+   * caller was compiled against.
+   */
+  size_t copysize = len <= sizeof h->stats ? len : sizeof h->stats;
+
+  memset (stats, 0, len);
+  memcpy (stats, &h->stats, copysize);
+  return 0;
+}
+
+static int
+commit (hive_h *h, const char *filename, int flags)
 {
   int fd;
 
@@ -424,5 +490,17 @@ hivex_commit (hive_h *h, const char *filename, int flags)
   if (close (fd) == -1)
     return -1;
 
+  h->dirty = 0;
   return 0;
 }
+
+int
+hivex_commit (hive_h *h, const char *filename, int flags)
+{
+  int r;
+
+  PROBE2 (commit__start, filename ? : h->filename, h->size);
+  r = commit (h, filename, flags);
+  PROBE2 (commit__done, h->size, r);
+  return r;
+}
@@ -22,6 +22,7 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <string.h>
+#include <iconv.h>
 
 #include "byte_conversions.h"
 
@@ -41,6 +42,7 @@ struct hive_h {
   size_t size;
   int msglvl;                   /* 1 = verbose, 2 or 3 = debug */
   int writable;
+  int dirty;                    /* Changed since opened or committed. */
 
   /* Registry file, memory mapped if read-only, or malloc'd if writing. */
   union {
@@ -74,6 +76,39 @@ struct hive_h {
   size_t endblocks;             /* Offset to next block allocation (0
                                    if not allocated anything yet). */
 
+  /* Statistics and counters, see hivex_get_stats. */
+  hive_stats stats;
+
+  /* Shared setup, see context.c.  own_ctx is set if the context was
+   * created by hivex_open for this handle alone.
+   */
+  hive_context *ctx;
+  int own_ctx;
+
+  /* Memory accounting, see memory.c. */
+  size_t memory_usage;          /* Bytes currently charged. */
+  size_t memory_limit;          /* 0 = no limit. */
+
+  /* Offset-to-path reverse index, see path-index.c.  NULL if it has
+   * not been built (or has been invalidated by a write).
+   */
+  struct path_index *path_index;
+
+  /* Last-write timestamp index, see timestamp-index.c.  NULL if it
+   * has not been built or loaded (or has been invalidated by a write).
+   */
+  struct timestamp_index *timestamp_index;
+
+  /* Cached subtree hashes, see node-hash.c.  NULL if none have been
+   * computed or loaded (or they have been invalidated by a write).
+   */
+  struct node_hashes *node_hashes;
+
+  /* Substring search index, see search-index.c.  NULL if it has not
+   * been built or loaded (or has been invalidated by a write).
+   */
+  struct search_index *search_index;
+
 #ifndef HAVE_MMAP
   /* Internal data for mmap replacement */
   void *p_winmap;
@@ -259,11 +294,29 @@ block_len (hive_h *h, size_t blkoff, int *used)
   return (size_t) len;
 }
 
+/* context.c */
+extern iconv_t _hivex_context_iconv (hive_h *h, const char *to, const char *from);
+extern char *_hivex_context_get_bitmap (hive_h *h, size_t size);
+extern void _hivex_context_put_bitmap (hive_h *h, char *bitmap, size_t size);
+extern void _hivex_context_attach (hive_h *h, hive_context *ctx);
+extern void _hivex_context_detach (hive_h *h);
+
 /* node.c */
 #define GET_CHILDREN_NO_CHECK_NK 1
 extern int _hivex_get_children (hive_h *h, hive_node_h node, hive_node_h **children_ret, size_t **blocks_ret, int flags);
 
+/* memory.c */
+extern int _hivex_charge (hive_h *h, size_t bytes);
+extern void _hivex_uncharge (hive_h *h, size_t bytes);
+extern void *_hivex_malloc (hive_h *h, size_t size);
+extern void *_hivex_calloc (hive_h *h, size_t nmemb, size_t size);
+extern void *_hivex_malloc_for_caller (hive_h *h, size_t size);
+extern void *_hivex_realloc (hive_h *h, void *ptr, size_t old_size, size_t new_size);
+extern char *_hivex_strdup (hive_h *h, const char *str);
+extern void _hivex_free (hive_h *h, void *ptr, size_t size);
+
 /* offset-list.c */
+#define OFFSET_LIST_INLINE 32
 typedef struct offset_list offset_list;
 struct offset_list {
   hive_h *h;
@@ -271,6 +324,11 @@ struct offset_list {
   size_t len;
   size_t alloc;
   size_t limit;
+  /* Short lists are stored here (offset_list is usually on the
+   * stack), so that building them does not touch the heap.  The
+   * list is only copied to the heap when it is returned.
+   */
+  size_t inline_offsets[OFFSET_LIST_INLINE];
 };
 extern void _hivex_init_offset_list (hive_h *h, offset_list *list);
 extern int _hivex_grow_offset_list (offset_list *list, size_t alloc);
@@ -281,23 +339,96 @@ extern void _hivex_free_offset_list (offset_list *list);
 extern size_t * _hivex_return_offset_list (offset_list *list);
 extern void _hivex_print_offset_list (offset_list *list, FILE *fp);
 
+/* node-hash.c */
+extern void _hivex_free_node_hashes (hive_h *h);
+
+/* path-index.c */
+extern void _hivex_free_path_index (hive_h *h);
+
+/* search-index.c */
+extern void _hivex_free_search_index (hive_h *h);
+
+/* timestamp-index.c */
+extern void _hivex_free_timestamp_index (hive_h *h);
+
 /* utf16.c */
-extern char * _hivex_recode (const char *input_encoding,
+extern char * _hivex_recode (hive_h *h, const char *input_encoding,
                              const char *input, size_t input_len,
                              const char *output_encoding, size_t *output_len);
-#define _hivex_windows_utf16_to_utf8(_input, _len) \
-  _hivex_recode ("UTF-16LE", _input, _len, "UTF-8", NULL)
-#define _hivex_windows_latin1_to_utf8(_input, _len) \
-  _hivex_recode ("LATIN1", _input, _len, "UTF-8", NULL)
-extern char* _hivex_encode_string(const char *str, size_t *size, int *utf16);
+#define _hivex_windows_utf16_to_utf8(_h, _input, _len) \
+  _hivex_recode (_h, "UTF-16LE", _input, _len, "UTF-8", NULL)
+#define _hivex_windows_latin1_to_utf8(_h, _input, _len) \
+  _hivex_recode (_h, "LATIN1", _input, _len, "UTF-8", NULL)
+extern char* _hivex_encode_string(hive_h *h, const char *str, size_t *size, int *utf16);
 extern size_t _hivex_utf16_string_len_in_bytes_max (const char *str, size_t len);
-extern size_t _hivex_utf8_strlen (const char* str, size_t len, int utf16);
+extern size_t _hivex_utf8_strlen (hive_h *h, const char* str, size_t len, int utf16);
 
 /* util.c */
+
+/* Free the indexes and hashes cached in the handle.  Any change to
+ * the hive invalidates them.
+ */
+extern void _hivex_drop_indexes (hive_h *h);
+
+/* Identifies the state of a hive, for files such as saved indexes
+ * which are only valid for the hive they were built from.  All fields
+ * are little endian.
+ */
+struct hive_identity {
+  uint32_t sequence1;           /* copied from the hive header */
+  uint32_t sequence2;
+  uint32_t csum;
+  int64_t last_modified;
+  uint64_t size;                /* size of the hive */
+  uint64_t rootoffs;
+} __attribute__((__packed__));
+
+extern void _hivex_get_identity (hive_h *h, struct hive_identity *id);
+
+/* Files which store data derived from a hive (saved indexes and
+ * hashes) start with this, followed by fields specific to each kind
+ * of file.  All fields are little endian.  A file is refused if the
+ * identity of the hive it was built from differs.  The identity comes
+ * from the header of the file, so these files cannot be saved from or
+ * loaded into a handle with uncommitted changes.
+ */
+struct sidecar_header {
+  char magic[8];
+  uint32_t version;
+  struct hive_identity id;
+} __attribute__((__packed__));
+
+extern int _hivex_sidecar_create (hive_h *h, const char *filename, const char *magic, uint32_t version, void *hdr, size_t len);
+extern int _hivex_sidecar_open (hive_h *h, const char *filename, const char *magic, uint32_t version, void *hdr, size_t len);
+extern int _hivex_sidecar_read (hive_h *h, int fd, const char *filename, void *buf, size_t len);
+
+/* A key or value name as stored in the hive: either Latin-1 bytes or
+ * UTF-16LE code units.  Use _hivex_name_unit to read code unit i.
+ */
+struct raw_name {
+  const unsigned char *name;
+  size_t len;                   /* in code units */
+  int utf16;
+  size_t offset;                /* of the nk or vk record */
+};
+
+static inline unsigned
+_hivex_name_unit (const struct raw_name *n, size_t i)
+{
+  if (n->utf16)
+    return n->name[2*i] | (n->name[2*i+1] << 8);
+  else
+    return n->name[i];
+}
+
+extern int _hivex_get_raw_name (hive_h *h, size_t offset, int is_nk, struct raw_name *name);
 extern void _hivex_free_strings (char **argv);
+extern void _hivex_free_node_named_list (hive_node_named *list);
+extern void _hivex_free_value_full_list (hive_value_full *list);
 
 /* value.c */
 extern int _hivex_get_values (hive_h *h, hive_node_h node, hive_value_h **values_ret, size_t **blocks_ret);
+extern const char *_hivex_value_data (hive_h *h, hive_value_h value, hive_type *t, size_t *len, char **copy);
 
 #define DEBUG(lvl,fs,...)                                       \
   do {                                                          \
@@ -313,6 +444,30 @@ extern int _hivex_get_values (hive_h *h, hive_node_h node, hive_value_h **values
     errno = errval;                                                     \
   } while (0)
 
+/* Update the counters returned by hivex_get_stats.  These are cheap
+ * enough to be always enabled.
+ */
+#define STATS_INC(field) (h->stats.field++)
+#define STATS_ADD(field,n) (h->stats.field += (n))
+
+/* Static (USDT) tracepoints, see "STATIC TRACEPOINTS" in hivex(3).
+ * When enabled each probe compiles to a single nop plus a note in
+ * the ELF file, so they are left in the hot paths.
+ */
+#ifdef ENABLE_PROBES
+#include <sys/sdt.h>
+#define PROBE1(name,a) DTRACE_PROBE1 (hivex, name, (a))
+#define PROBE2(name,a,b) DTRACE_PROBE2 (hivex, name, (a), (b))
+#define PROBE3(name,a,b,c) DTRACE_PROBE3 (hivex, name, (a), (b), (c))
+#define PROBE5(name,a,b,c,d,e) \
+  DTRACE_PROBE5 (hivex, name, (a), (b), (c), (d), (e))
+#else
+#define PROBE1(name,a) do {} while (0)
+#define PROBE2(name,a,b) do {} while (0)
+#define PROBE3(name,a,b,c) do {} while (0)
+#define PROBE5(name,a,b,c,d,e) do {} while (0)
+#endif
+
 #define CHECK_WRITABLE(retcode)                                         \
   do {                                                                  \
     if (!h->writable) {                                                 \
@@ -0,0 +1,180 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Memory accounting and limits.
+ *
+ * Every allocation made by the library goes through the functions in
+ * this file, which charge it to h->memory_usage.  Memory which the
+ * handle keeps (the handle itself, the bitmap, the copy of the hive
+ * in write mode) stays charged until it is freed.  Memory which is
+ * returned to the caller is charged while it is being built and is
+ * uncharged (with _hivex_uncharge) when it is handed over, since
+ * after that it is the caller's.
+ *
+ * If a limit has been set with hivex_set_memory_limit then any
+ * allocation which would take the usage over the limit fails with
+ * ENOMEM.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+int
+_hivex_charge (hive_h *h, size_t bytes)
+{
+  if (h->memory_limit > 0 &&
+      (bytes > h->memory_limit ||
+       h->memory_usage > h->memory_limit - bytes)) {
+    SET_ERRNO (ENOMEM,
+               "memory limit exceeded (usage %zu + %zu bytes > limit %zu)",
+               h->memory_usage, bytes, h->memory_limit);
+    return -1;
+  }
+
+  h->memory_usage += bytes;
+  return 0;
+}
+
+void
+_hivex_uncharge (hive_h *h, size_t bytes)
+{
+  assert (bytes <= h->memory_usage);
+  h->memory_usage -= bytes;
+}
+
+void *
+_hivex_malloc (hive_h *h, size_t size)
+{
+  void *p;
+
+  if (_hivex_charge (h, size) == -1)
+    return NULL;
+
+  p = malloc (size);
+  STATS_INC (allocations);
+  if (p == NULL)
+    _hivex_uncharge (h, size);
+  return p;
+}
+
+void *
+_hivex_calloc (hive_h *h, size_t nmemb, size_t size)
+{
+  void *p;
+
+  if (size > 0 && nmemb > SIZE_MAX / size) {
+    SET_ERRNO (ENOMEM, "allocation size overflow (%zu * %zu)", nmemb, size);
+    return NULL;
+  }
+
+  if (_hivex_charge (h, nmemb * size) == -1)
+    return NULL;
+
+  p = calloc (nmemb, size);
+  STATS_INC (allocations);
+  if (p == NULL)
+    _hivex_uncharge (h, nmemb * size);
+  return p;
+}
+
+/* Allocate a buffer which is filled and handed straight back to the
+ * caller without any other allocation in between.  It is checked
+ * against the limit, but not kept in the usage since it will be
+ * freed by the caller.
+ */
+void *
+_hivex_malloc_for_caller (hive_h *h, size_t size)
+{
+  void *p = _hivex_malloc (h, size);
+
+  if (p)
+    _hivex_uncharge (h, size);
+  return p;
+}
+
+/* Unlike realloc(3), the caller has to pass the current size of the
+ * allocation so that the difference can be charged.
+ */
+void *
+_hivex_realloc (hive_h *h, void *ptr, size_t old_size, size_t new_size)
+{
+  void *p;
+
+  if (new_size > old_size &&
+      _hivex_charge (h, new_size - old_size) == -1)
+    return NULL;
+
+  p = realloc (ptr, new_size);
+  STATS_INC (allocations);
+  if (p == NULL) {
+    if (new_size > old_size)
+      _hivex_uncharge (h, new_size - old_size);
+    return NULL;
+  }
+
+  if (new_size < old_size)
+    _hivex_uncharge (h, old_size - new_size);
+  return p;
+}
+
+char *
+_hivex_strdup (hive_h *h, const char *str)
+{
+  size_t len = strlen (str) + 1;
+  char *p = _hivex_malloc (h, len);
+
+  if (p)
+    memcpy (p, str, len);
+  return p;
+}
+
+void
+_hivex_free (hive_h *h, void *ptr, size_t size)
+{
+  if (ptr) {
+    _hivex_uncharge (h, size);
+    free (ptr);
+  }
+}
+
+int
+hivex_set_memory_limit (hive_h *h, size_t limit)
+{
+  if (limit > 0 && h->memory_usage > limit) {
+    SET_ERRNO (ENOMEM,
+               "handle is already using more than the limit (%zu > %zu)",
+               h->memory_usage, limit);
+    return -1;
+  }
+
+  h->memory_limit = limit;
+  return 0;
+}
+
+size_t
+hivex_memory_usage (hive_h *h)
+{
+  return h->memory_usage;
+}
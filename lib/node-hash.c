@@ -0,0 +1,463 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Content hashes of subtrees (a Merkle tree over the keys).
+ *
+ * The hash of a key is the SHA-256 of:
+ *
+ *   u32 length of the name in code units, name as UTF-16LE
+ *   u32 number of values, then for each value sorted by name:
+ *     u32 length of the name in code units, name as UTF-16LE
+ *     u32 type, u32 length of the data, data
+ *   u32 number of subkeys, then the hashes of the subkeys, sorted
+ *
+ * All integers are little endian.  Timestamps, class names and
+ * security descriptors are not included, so identical trees in
+ * different hives have the same hash.  Names stored as Latin-1 are
+ * widened to UTF-16LE, which needs no character set conversion.
+ *
+ * Hashes are computed bottom up, and the hash of every key below the
+ * one asked for is kept in a table in the handle, so later calls for
+ * any of them are a lookup.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "full-write.h"
+#include "sha256.h"
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+#define HASH_SIZE SHA256_DIGEST_SIZE
+
+struct node_hash {
+  hive_node_h node;             /* 0 = empty slot */
+  int done;                     /* 0 while the subkeys are being hashed */
+  unsigned char hash[HASH_SIZE];
+};
+
+struct node_hashes {
+  struct node_hash *table;      /* open addressing, size is a power of 2 */
+  size_t size, nr;
+};
+
+/* Format of the saved hashes: the header, followed by nr_entries
+ * entries, one for each key that was hashed, in no particular order.
+ */
+#define NODE_HASHES_MAGIC "hivexMHT"
+#define NODE_HASHES_VERSION 1
+
+struct node_hashes_header {
+  struct sidecar_header common; /* "hivexMHT", version 1 */
+  uint64_t nr_entries;
+} __attribute__((__packed__));
+
+struct node_hashes_entry {
+  uint64_t node;
+  unsigned char hash[HASH_SIZE];
+} __attribute__((__packed__));
+
+void
+_hivex_free_node_hashes (hive_h *h)
+{
+  struct node_hashes *nh = h->node_hashes;
+
+  if (nh) {
+    _hivex_free (h, nh->table, nh->size * sizeof (struct node_hash));
+    _hivex_free (h, nh, sizeof *nh);
+    h->node_hashes = NULL;
+  }
+}
+
+static inline size_t
+slot_of (struct node_hashes *nh, hive_node_h node)
+{
+  /* Blocks are 8 byte aligned, and nearby offsets are common. */
+  return ((node >> 3) * 2654435761U) & (nh->size - 1);
+}
+
+static struct node_hash *
+find_hash (struct node_hashes *nh, hive_node_h node)
+{
+  size_t i;
+
+  if (nh == NULL)
+    return NULL;
+
+  for (i = slot_of (nh, node); nh->table[i].node != 0;
+       i = (i + 1) & (nh->size - 1))
+    if (nh->table[i].node == node)
+      return &nh->table[i];
+  return NULL;
+}
+
+/* Add an entry (which must not already exist) and return it.  This
+ * may move the other entries.
+ */
+static struct node_hash *
+add_hash (hive_h *h, hive_node_h node)
+{
+  struct node_hashes *nh = h->node_hashes;
+  size_t i;
+
+  if (nh == NULL) {
+    nh = _hivex_calloc (h, 1, sizeof *nh);
+    if (nh == NULL)
+      return NULL;
+    h->node_hashes = nh;
+  }
+
+  if (2 * (nh->nr + 1) > nh->size) {
+    struct node_hashes old = *nh;
+    size_t new_size = nh->size ? nh->size * 2 : 1024;
+
+    nh->table = _hivex_calloc (h, new_size, sizeof (struct node_hash));
+    if (nh->table == NULL) {
+      nh->table = old.table;
+      return NULL;
+    }
+    nh->size = new_size;
+    for (i = 0; i < old.size; ++i) {
+      if (old.table[i].node != 0) {
+        size_t j = slot_of (nh, old.table[i].node);
+        while (nh->table[j].node != 0)
+          j = (j + 1) & (nh->size - 1);
+        nh->table[j] = old.table[i];
+      }
+    }
+    _hivex_free (h, old.table, old.size * sizeof (struct node_hash));
+  }
+
+  i = slot_of (nh, node);
+  while (nh->table[i].node != 0)
+    i = (i + 1) & (nh->size - 1);
+  nh->table[i].node = node;
+  nh->table[i].done = 0;
+  nh->nr++;
+  return &nh->table[i];
+}
+
+static void
+hash_u32 (struct sha256_ctx *ctx, uint32_t u)
+{
+  uint32_t le = htole32 (u);
+  sha256_process_bytes (&le, sizeof le, ctx);
+}
+
+static void
+hash_name (struct sha256_ctx *ctx, const struct raw_name *name)
+{
+  hash_u32 (ctx, name->len);
+
+  if (name->utf16)
+    sha256_process_bytes (name->name, name->len * 2, ctx);
+  else {
+    unsigned char buf[256];
+    size_t i, n;
+
+    for (i = 0; i < name->len; i += n) {
+      size_t j;
+
+      n = name->len - i;
+      if (n > sizeof buf / 2)
+        n = sizeof buf / 2;
+      for (j = 0; j < n; ++j) {
+        buf[2*j] = name->name[i+j];
+        buf[2*j+1] = 0;
+      }
+      sha256_process_bytes (buf, n * 2, ctx);
+    }
+  }
+}
+
+static int
+compare_names (const void *av, const void *bv)
+{
+  const struct raw_name *a = av, *b = bv;
+  size_t i;
+
+  for (i = 0; i < a->len && i < b->len; ++i) {
+    unsigned ca = _hivex_name_unit (a, i), cb = _hivex_name_unit (b, i);
+    if (ca != cb)
+      return ca < cb ? -1 : 1;
+  }
+  return a->len < b->len ? -1 : a->len > b->len;
+}
+
+static int
+compare_hashes (const void *a, const void *b)
+{
+  return memcmp (a, b, HASH_SIZE);
+}
+
+static int
+hash_values (hive_h *h, hive_node_h node, struct sha256_ctx *ctx)
+{
+  hive_value_h *values;
+  struct raw_name *names = NULL;
+  size_t nr, i;
+  int ret = -1;
+
+  if (_hivex_get_values (h, node, &values, NULL) == -1)
+    return -1;
+  for (nr = 0; values[nr] != 0; ++nr)
+    ;
+
+  names = _hivex_malloc (h, (nr > 0 ? nr : 1) * sizeof (struct raw_name));
+  if (names == NULL)
+    goto out;
+  for (i = 0; i < nr; ++i)
+    if (_hivex_get_raw_name (h, values[i], 0, &names[i]) == -1)
+      goto out;
+  qsort (names, nr, sizeof (struct raw_name), compare_names);
+
+  hash_u32 (ctx, nr);
+  for (i = 0; i < nr; ++i) {
+    const char *data;
+    char *copy;
+    hive_type t;
+    size_t len;
+
+    data = _hivex_value_data (h, names[i].offset, &t, &len, &copy);
+    if (data == NULL)
+      goto out;
+    hash_name (ctx, &names[i]);
+    hash_u32 (ctx, t);
+    hash_u32 (ctx, len);
+    sha256_process_bytes (data, len, ctx);
+    free (copy);
+  }
+
+  ret = 0;
+ out:
+  if (names)
+    _hivex_free (h, names, (nr > 0 ? nr : 1) * sizeof (struct raw_name));
+  free (values);
+  return ret;
+}
+
+static int
+hash_node (hive_h *h, hive_node_h node, unsigned char *hash_ret)
+{
+  struct node_hash *e;
+  struct sha256_ctx ctx;
+  struct raw_name name;
+  hive_node_h *children = NULL;
+  unsigned char *child_hashes = NULL;
+  size_t nr = 0, i;
+  int ret = -1;
+
+  e = find_hash (h->node_hashes, node);
+  if (e) {
+    if (!e->done) {
+      SET_ERRNO (ELOOP, "contains cycle: key 0x%zx is its own subkey", node);
+      return -1;
+    }
+    memcpy (hash_ret, e->hash, HASH_SIZE);
+    return 0;
+  }
+  if (add_hash (h, node) == NULL)
+    return -1;
+
+  if (_hivex_get_raw_name (h, node, 1, &name) == -1)
+    return -1;
+  sha256_init_ctx (&ctx);
+  hash_name (&ctx, &name);
+
+  if (hash_values (h, node, &ctx) == -1)
+    return -1;
+
+  if (_hivex_get_children (h, node, &children, NULL, 0) == -1)
+    return -1;
+  for (nr = 0; children[nr] != 0; ++nr)
+    ;
+  child_hashes = _hivex_malloc (h, (nr > 0 ? nr : 1) * HASH_SIZE);
+  if (child_hashes == NULL)
+    goto out;
+  for (i = 0; i < nr; ++i)
+    if (hash_node (h, children[i], &child_hashes[i * HASH_SIZE]) == -1)
+      goto out;
+  qsort (child_hashes, nr, HASH_SIZE, compare_hashes);
+
+  hash_u32 (&ctx, nr);
+  sha256_process_bytes (child_hashes, nr * HASH_SIZE, &ctx);
+
+  /* The table may have moved while hashing the subkeys. */
+  e = find_hash (h->node_hashes, node);
+  sha256_finish_ctx (&ctx, e->hash);
+  e->done = 1;
+  memcpy (hash_ret, e->hash, HASH_SIZE);
+
+  ret = 0;
+ out:
+  if (child_hashes)
+    _hivex_free (h, child_hashes, (nr > 0 ? nr : 1) * HASH_SIZE);
+  free (children);
+  return ret;
+}
+
+static int
+get_hash (hive_h *h, hive_node_h node, unsigned char *hash)
+{
+  if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk")) {
+    SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
+    return -1;
+  }
+
+  if (hash_node (h, node, hash) == -1) {
+    /* Entries for keys which were being hashed are left incomplete,
+     * so throw the whole table away.
+     */
+    int err = errno;
+    _hivex_free_node_hashes (h);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+char *
+hivex_node_hash (hive_h *h, hive_node_h node)
+{
+  unsigned char hash[HASH_SIZE];
+  char *ret;
+  size_t i;
+
+  if (get_hash (h, node, hash) == -1)
+    return NULL;
+
+  ret = _hivex_malloc_for_caller (h, 2 * HASH_SIZE + 1);
+  if (ret == NULL)
+    return NULL;
+  for (i = 0; i < HASH_SIZE; ++i)
+    sprintf (&ret[2*i], "%02x", hash[i]);
+  return ret;
+}
+
+int
+hivex_save_node_hashes (hive_h *h, const char *filename)
+{
+  unsigned char hash[HASH_SIZE];
+  struct node_hashes *nh;
+  struct node_hashes_header hdr;
+  struct node_hashes_entry buf[128];
+  size_t i, n;
+  int fd, err;
+
+  /* Hash the whole tree, so that every reachable key is saved. */
+  if (get_hash (h, h->rootoffs, hash) == -1)
+    return -1;
+  nh = h->node_hashes;
+
+  hdr.nr_entries = htole64 (nh->nr);
+  fd = _hivex_sidecar_create (h, filename, NODE_HASHES_MAGIC,
+                              NODE_HASHES_VERSION, &hdr, sizeof hdr);
+  if (fd == -1)
+    return -1;
+
+  for (i = n = 0; i < nh->size; ++i) {
+    if (nh->table[i].node == 0)
+      continue;
+    buf[n].node = htole64 (nh->table[i].node);
+    memcpy (buf[n].hash, nh->table[i].hash, HASH_SIZE);
+    if (++n == sizeof buf / sizeof buf[0]) {
+      if (full_write (fd, buf, sizeof buf) != sizeof buf)
+        goto error;
+      n = 0;
+    }
+  }
+  if (n > 0 && full_write (fd, buf, n * sizeof buf[0]) != n * sizeof buf[0])
+    goto error;
+
+  if (close (fd) == -1)
+    return -1;
+  return 0;
+
+ error:
+  err = errno;
+  close (fd);
+  errno = err;
+  return -1;
+}
+
+int
+hivex_load_node_hashes (hive_h *h, const char *filename)
+{
+  struct node_hashes_header hdr;
+  struct node_hashes_entry buf[128];
+  uint64_t nr;
+  size_t i, n;
+  int fd, err;
+
+  fd = _hivex_sidecar_open (h, filename, NODE_HASHES_MAGIC,
+                            NODE_HASHES_VERSION, &hdr, sizeof hdr);
+  if (fd == -1)
+    return -1;
+
+  nr = le64toh (hdr.nr_entries);
+  /* Every key is at least 0x50 bytes. */
+  if (nr > h->size / 0x50) {
+    SET_ERRNO (EINVAL, "%s: too many entries (%" PRIu64 ")", filename, nr);
+    goto error;
+  }
+
+  _hivex_free_node_hashes (h);
+
+  for (i = 0; i < nr; i += n) {
+    size_t j;
+
+    n = nr - i;
+    if (n > sizeof buf / sizeof buf[0])
+      n = sizeof buf / sizeof buf[0];
+    if (_hivex_sidecar_read (h, fd, filename,
+                             buf, n * sizeof buf[0]) == -1)
+      goto error;
+    for (j = 0; j < n; ++j) {
+      hive_node_h node = le64toh (buf[j].node);
+      struct node_hash *e;
+
+      if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk") ||
+          find_hash (h->node_hashes, node) != NULL) {
+        SET_ERRNO (EINVAL, "%s: entry %zu is invalid", filename, i+j);
+        goto error;
+      }
+      e = add_hash (h, node);
+      if (e == NULL)
+        goto error;
+      memcpy (e->hash, buf[j].hash, HASH_SIZE);
+      e->done = 1;
+    }
+  }
+
+  close (fd);
+  return 0;
+
+ error:
+  err = errno;
+  close (fd);
+  _hivex_free_node_hashes (h);
+  errno = err;
+  return -1;
+}
@@ -90,9 +90,9 @@ hivex_node_name (hive_h *h, hive_node_h node)
   }
   size_t flags = le16toh (nk->flags);
   if (flags & 0x20) {
-    return _hivex_windows_latin1_to_utf8 (nk->name, len);
+    return _hivex_windows_latin1_to_utf8 (h, nk->name, len);
   } else {
-    return _hivex_windows_utf16_to_utf8 (nk->name, len);
+    return _hivex_windows_utf16_to_utf8 (h, nk->name, len);
   }
 }
 
@@ -116,7 +116,8 @@ hivex_node_name_len (hive_h *h, hive_node_h node)
     return 0;
   }
 
-  return _hivex_utf8_strlen (nk->name, len, ! (le16toh (nk->flags) & 0x20));
+  return _hivex_utf8_strlen (h, nk->name, len,
+                             ! (le16toh (nk->flags) & 0x20));
 }
 
 
@@ -220,6 +221,9 @@ static int check_child_is_nk_block (hive_h *h, hive_node_h child, int flags);
  * The list of intermediate nodes (a mix of lf/lh/ri/li blocks) is
  * returned in 'blocks_ret'.
  *
+ * Either 'children_ret' or 'blocks_ret' may be NULL if the caller
+ * does not need that list, in which case it is not allocated.
+ *
  * ----------------------------------------
  *
  * The format of the intermediate blocks is not documented, but
@@ -278,11 +282,13 @@ static int check_child_is_nk_block (hive_h *h, hive_node_h child, int flags);
  * |   offset[2] ------>
  * +-------------+
  */
-int
-_hivex_get_children (hive_h *h, hive_node_h node,
-                     hive_node_h **children_ret, size_t **blocks_ret,
-                     int flags)
+static int
+get_children (hive_h *h, hive_node_h node,
+              hive_node_h **children_ret, size_t **blocks_ret,
+              int flags)
 {
+  STATS_INC (children_lists);
+
   if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk")) {
     SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
     return -1;
@@ -297,6 +303,11 @@ _hivex_get_children (hive_h *h, hive_node_h node,
   _hivex_init_offset_list (h, &children);
   _hivex_init_offset_list (h, &blocks);
 
+  if (children_ret)
+    *children_ret = NULL;
+  if (blocks_ret)
+    *blocks_ret = NULL;
+
   /* Deal with the common "no subkeys" case quickly. */
   if (nr_subkeys_in_nk == 0)
     goto out;
@@ -361,18 +372,44 @@ _hivex_get_children (hive_h *h, hive_node_h node,
   }
 #endif
 
-  *children_ret = _hivex_return_offset_list (&children);
-  *blocks_ret = _hivex_return_offset_list (&blocks);
-  if (!*children_ret || !*blocks_ret)
-    goto error;
+  /* Only copy out the lists that the caller asked for. */
+  if (children_ret) {
+    *children_ret = _hivex_return_offset_list (&children);
+    if (*children_ret == NULL)
+      goto error;
+  }
+  if (blocks_ret) {
+    *blocks_ret = _hivex_return_offset_list (&blocks);
+    if (*blocks_ret == NULL)
+      goto error;
+  }
+  _hivex_free_offset_list (&children);
+  _hivex_free_offset_list (&blocks);
   return 0;
 
  error:
   _hivex_free_offset_list (&children);
   _hivex_free_offset_list (&blocks);
+  if (children_ret) {
+    free (*children_ret);
+    *children_ret = NULL;
+  }
   return -1;
 }
 
+int
+_hivex_get_children (hive_h *h, hive_node_h node,
+                     hive_node_h **children_ret, size_t **blocks_ret,
+                     int flags)
+{
+  int r;
+
+  PROBE1 (get_children__start, node);
+  r = get_children (h, node, children_ret, blocks_ret, flags);
+  PROBE2 (get_children__done, node, r);
+  return r;
+}
+
 static int
 _get_children (hive_h *h, hive_node_h blkoff,
                offset_list *children, offset_list *blocks,
@@ -504,15 +541,52 @@ hive_node_h *
 hivex_node_children (hive_h *h, hive_node_h node)
 {
   hive_node_h *children;
-  size_t *blocks;
 
-  if (_hivex_get_children (h, node, &children, &blocks, 0) == -1)
+  if (_hivex_get_children (h, node, &children, NULL, 0) == -1)
     return NULL;
 
-  free (blocks);
   return children;
 }
 
+hive_node_named *
+hivex_node_children_named (hive_h *h, hive_node_h node)
+{
+  hive_node_h *children;
+  hive_node_named *ret;
+  size_t i, nr_children;
+
+  children = hivex_node_children (h, node);
+  if (children == NULL)
+    return NULL;
+
+  for (nr_children = 0; children[nr_children] != 0; ++nr_children)
+    ;
+
+  ret = _hivex_calloc (h, nr_children + 1, sizeof (hive_node_named));
+  if (ret == NULL) {
+    free (children);
+    return NULL;
+  }
+
+  for (i = 0; i < nr_children; ++i) {
+    ret[i].name = hivex_node_name (h, children[i]);
+    if (ret[i].name == NULL) {
+      int err = errno;
+      _hivex_uncharge (h, (nr_children + 1) * sizeof (hive_node_named));
+      _hivex_free_node_named_list (ret);
+      free (children);
+      errno = err;
+      return NULL;
+    }
+    ret[i].node = children[i];
+  }
+
+  free (children);
+  /* The list now belongs to the caller. */
+  _hivex_uncharge (h, (nr_children + 1) * sizeof (hive_node_named));
+  return ret;
+}
+
 /* Very inefficient, but at least having a separate API call
  * allows us to make it more efficient in future.
  */
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -34,8 +35,8 @@ _hivex_init_offset_list (hive_h *h, offset_list *list)
 {
   list->h = h;
   list->len = 0;
-  list->alloc = 0;
-  list->offsets = NULL;
+  list->alloc = OFFSET_LIST_INLINE;
+  list->offsets = list->inline_offsets;
   list->limit = SIZE_MAX;
 }
 
@@ -44,9 +45,23 @@ int
 _hivex_grow_offset_list (offset_list *list, size_t alloc)
 {
   assert (alloc >= list->len);
-  size_t *p = realloc (list->offsets, alloc * sizeof (size_t));
-  if (p == NULL)
-    return -1;
+  size_t *p;
+
+  if (list->offsets == list->inline_offsets) {
+    if (alloc <= OFFSET_LIST_INLINE)
+      return 0;
+    p = _hivex_malloc (list->h, alloc * sizeof (size_t));
+    if (p == NULL)
+      return -1;
+    memcpy (p, list->offsets, list->len * sizeof (size_t));
+  }
+  else {
+    p = _hivex_realloc (list->h, list->offsets,
+                        list->alloc * sizeof (size_t),
+                        alloc * sizeof (size_t));
+    if (p == NULL)
+      return -1;
+  }
   list->offsets = p;
   list->alloc = alloc;
   return 0;
@@ -56,7 +71,7 @@ static int
 add_to_offset_list (offset_list *list, size_t offset)
 {
   if (list->len >= list->alloc) {
-    if (_hivex_grow_offset_list (list, list->alloc ? list->alloc * 2 : 4) == -1)
+    if (_hivex_grow_offset_list (list, list->alloc * 2) == -1)
       return -1;
   }
   list->offsets[list->len] = offset;
@@ -95,15 +110,39 @@ _hivex_set_offset_list_limit (offset_list *list, size_t limit)
 void
 _hivex_free_offset_list (offset_list *list)
 {
-  free (list->offsets);
+  if (list->offsets != list->inline_offsets)
+    _hivex_free (list->h, list->offsets, list->alloc * sizeof (size_t));
 }
 
+/* Return the 0-terminated list to the caller, who must free it.  The
+ * list is left empty, so it is still safe to call
+ * _hivex_free_offset_list on it afterwards.
+ */
 size_t *
 _hivex_return_offset_list (offset_list *list)
 {
-  if (add_to_offset_list (list, 0) == -1)
-    return NULL;
-  return list->offsets;         /* caller frees */
+  size_t *ret;
+
+  if (list->offsets == list->inline_offsets) {
+    ret = _hivex_malloc_for_caller (list->h,
+                                    (list->len + 1) * sizeof (size_t));
+    if (ret == NULL)
+      return NULL;
+    memcpy (ret, list->offsets, list->len * sizeof (size_t));
+    ret[list->len] = 0;
+  }
+  else {
+    if (add_to_offset_list (list, 0) == -1)
+      return NULL;
+    ret = list->offsets;
+    /* The list now belongs to the caller. */
+    _hivex_uncharge (list->h, list->alloc * sizeof (size_t));
+  }
+
+  list->offsets = list->inline_offsets;
+  list->len = 0;
+  list->alloc = OFFSET_LIST_INLINE;
+  return ret;
 }
 
 void
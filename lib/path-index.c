@@ -0,0 +1,564 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Offset-to-path reverse index.
+ *
+ * The index is built by a single breadth-first walk from the root
+ * key.  Every nk-record reached is given a slot in 'nodes' (in the
+ * order they were reached) holding its offset, the slot of its
+ * parent and an interned name.  Every cell owned by a key -- the
+ * nk-record itself, its classname, subkey list blocks, value list,
+ * vk-records and data cells (including the parts of db-records) --
+ * is recorded in 'cells', which is then sorted by offset.
+ *
+ * So finding the key which owns a cell is a binary search, and the
+ * path of a key is found by following parent slots, without decoding
+ * any names.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+#define NO_PARENT UINT32_MAX
+
+struct index_node {
+  hive_node_h offset;
+  uint32_t parent;              /* slot of parent, or NO_PARENT for root */
+  uint32_t name;                /* interned name */
+};
+
+struct index_cell {
+  size_t offset;
+  uint32_t node;                /* slot of the owning key */
+};
+
+struct path_index {
+  struct index_node *nodes;
+  size_t nr_nodes, nodes_alloc;
+
+  struct index_cell *cells;
+  size_t nr_cells, cells_alloc;
+
+  /* Interned names.  'names' holds the NUL-terminated UTF-8 strings
+   * back to back, and 'name_offs[id]' is the start of name 'id'.
+   * 'hash' is an open addressing table of name ids + 1 (0 = empty),
+   * only needed while building.
+   */
+  char *names;
+  size_t names_len, names_alloc;
+  size_t *name_offs;
+  size_t nr_names, name_offs_alloc;
+  uint32_t *hash;
+  size_t hash_size;
+};
+
+/* Grow an array charged to the handle so it can hold at least one
+ * more element.
+ */
+static int
+grow (hive_h *h, void **array, size_t *alloc, size_t nr, size_t size)
+{
+  size_t new_alloc;
+  void *p;
+
+  if (nr < *alloc)
+    return 0;
+
+  new_alloc = *alloc ? *alloc * 2 : 64;
+  p = _hivex_realloc (h, *array, *alloc * size, new_alloc * size);
+  if (p == NULL)
+    return -1;
+  *array = p;
+  *alloc = new_alloc;
+  return 0;
+}
+
+static uint32_t
+hash_name (const char *name)
+{
+  uint32_t hash = 2166136261U;  /* FNV-1a */
+
+  for (; *name; ++name) {
+    hash ^= (unsigned char) *name;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static int
+rehash (hive_h *h, struct path_index *idx)
+{
+  size_t new_size = idx->hash_size ? idx->hash_size * 2 : 1024;
+  uint32_t *new_hash;
+  size_t i, j;
+
+  new_hash = _hivex_calloc (h, new_size, sizeof (uint32_t));
+  if (new_hash == NULL)
+    return -1;
+
+  for (i = 0; i < idx->nr_names; ++i) {
+    j = hash_name (idx->names + idx->name_offs[i]) & (new_size - 1);
+    while (new_hash[j] != 0)
+      j = (j + 1) & (new_size - 1);
+    new_hash[j] = i + 1;
+  }
+
+  _hivex_free (h, idx->hash, idx->hash_size * sizeof (uint32_t));
+  idx->hash = new_hash;
+  idx->hash_size = new_size;
+  return 0;
+}
+
+/* Return the id of 'name', adding it if it has not been seen before.
+ * Returns -1 on error.
+ */
+static int64_t
+intern (hive_h *h, struct path_index *idx, const char *name)
+{
+  size_t len = strlen (name) + 1;
+  size_t j;
+  uint32_t id;
+
+  if (2 * (idx->nr_names + 1) > idx->hash_size && rehash (h, idx) == -1)
+    return -1;
+
+  j = hash_name (name) & (idx->hash_size - 1);
+  while (idx->hash[j] != 0) {
+    id = idx->hash[j] - 1;
+    if (STREQ (idx->names + idx->name_offs[id], name))
+      return id;
+    j = (j + 1) & (idx->hash_size - 1);
+  }
+
+  if (grow (h, (void **) &idx->name_offs, &idx->name_offs_alloc,
+            idx->nr_names, sizeof (size_t)) == -1)
+    return -1;
+  while (idx->names_len + len > idx->names_alloc) {
+    size_t new_alloc = idx->names_alloc ? idx->names_alloc * 2 : 4096;
+    char *p = _hivex_realloc (h, idx->names, idx->names_alloc, new_alloc);
+    if (p == NULL)
+      return -1;
+    idx->names = p;
+    idx->names_alloc = new_alloc;
+  }
+
+  id = idx->nr_names++;
+  idx->name_offs[id] = idx->names_len;
+  memcpy (idx->names + idx->names_len, name, len);
+  idx->names_len += len;
+  idx->hash[j] = id + 1;
+  return id;
+}
+
+static int
+add_cell (hive_h *h, struct path_index *idx, size_t offset, uint32_t node)
+{
+  if (!IS_VALID_BLOCK (h, offset))
+    return 0;
+
+  if (grow (h, (void **) &idx->cells, &idx->cells_alloc,
+            idx->nr_cells, sizeof (struct index_cell)) == -1)
+    return -1;
+  idx->cells[idx->nr_cells].offset = offset;
+  idx->cells[idx->nr_cells].node = node;
+  idx->nr_cells++;
+  return 0;
+}
+
+static int
+add_cells (hive_h *h, struct path_index *idx, size_t *offsets, uint32_t node)
+{
+  size_t i;
+
+  for (i = 0; offsets[i] != 0; ++i)
+    if (add_cell (h, idx, offsets[i], node) == -1)
+      return -1;
+  return 0;
+}
+
+/* Add the data cells of a value: the data cell itself, or for large
+ * values the db-record, its block list and the data sub-blocks.
+ */
+static int
+add_data_cells (hive_h *h, struct path_index *idx, hive_value_h value,
+                uint32_t node)
+{
+  struct ntreg_vk_record *vk =
+    (struct ntreg_vk_record *) ((char *) h->addr + value);
+  size_t data_len = le32toh (vk->data_len);
+  size_t data_offset, blocklist_offset, nr_blocks, i;
+
+  if (data_len & 0x80000000)    /* inline */
+    return 0;
+
+  data_offset = le32toh (vk->data_offset) + 0x1000;
+  if (!IS_VALID_BLOCK (h, data_offset))
+    return 0;
+  if (add_cell (h, idx, data_offset, node) == -1)
+    return -1;
+
+  if (data_len <= block_len (h, data_offset, NULL) - 4 ||
+      !block_id_eq (h, data_offset, "db"))
+    return 0;
+
+  struct ntreg_db_record *db =
+    (struct ntreg_db_record *) ((char *) h->addr + data_offset);
+  blocklist_offset = le32toh (db->blocklist_offset) + 0x1000;
+  if (!IS_VALID_BLOCK (h, blocklist_offset))
+    return 0;
+  if (add_cell (h, idx, blocklist_offset, node) == -1)
+    return -1;
+
+  struct ntreg_value_list *bl =
+    (struct ntreg_value_list *) ((char *) h->addr + blocklist_offset);
+  nr_blocks = le16toh (db->nr_blocks);
+  if (4 + nr_blocks * 4 > block_len (h, blocklist_offset, NULL))
+    nr_blocks = (block_len (h, blocklist_offset, NULL) - 4) / 4;
+  for (i = 0; i < nr_blocks; ++i)
+    if (add_cell (h, idx, le32toh (bl->offset[i]) + 0x1000, node) == -1)
+      return -1;
+  return 0;
+}
+
+/* Index one key: its name and all the cells it owns, and queue its
+ * children.  Keys or values which cannot be read are skipped, so
+ * that as much as possible of a damaged hive is indexed.
+ */
+static int
+index_node (hive_h *h, struct path_index *idx, char *unvisited,
+            uint32_t slot)
+{
+  hive_node_h node = idx->nodes[slot].offset;
+  struct ntreg_nk_record *nk =
+    (struct ntreg_nk_record *) ((char *) h->addr + node);
+  hive_node_h *children = NULL;
+  hive_value_h *values = NULL;
+  size_t *blocks = NULL;
+  char *name;
+  int64_t id;
+  size_t i;
+  int ret = -1;
+
+  name = hivex_node_name (h, node);
+  id = intern (h, idx, name ? name : "");
+  free (name);
+  if (id == -1)
+    return -1;
+  idx->nodes[slot].name = id;
+
+  if (add_cell (h, idx, node, slot) == -1)
+    return -1;
+  if (le16toh (nk->classname_len) > 0 &&
+      add_cell (h, idx, le32toh (nk->classname) + 0x1000, slot) == -1)
+    return -1;
+
+  if (_hivex_get_children (h, node, &children, &blocks, 0) == 0) {
+    if (add_cells (h, idx, blocks, slot) == -1)
+      goto out;
+    for (i = 0; children[i] != 0; ++i) {
+      if (!BITMAP_TST (unvisited, children[i]))
+        continue;
+      BITMAP_CLR (unvisited, children[i]);
+      if (idx->nr_nodes >= NO_PARENT) {
+        SET_ERRNO (ERANGE, "too many keys to index");
+        goto out;
+      }
+      if (grow (h, (void **) &idx->nodes, &idx->nodes_alloc,
+                idx->nr_nodes, sizeof (struct index_node)) == -1)
+        goto out;
+      idx->nodes[idx->nr_nodes].offset = children[i];
+      idx->nodes[idx->nr_nodes].parent = slot;
+      idx->nodes[idx->nr_nodes].name = 0;
+      idx->nr_nodes++;
+    }
+    free (children);
+    free (blocks);
+    children = NULL;
+    blocks = NULL;
+  }
+
+  if (_hivex_get_values (h, node, &values, &blocks) == 0) {
+    if (add_cells (h, idx, blocks, slot) == -1)
+      goto out;
+    for (i = 0; values[i] != 0; ++i) {
+      if (add_cell (h, idx, values[i], slot) == -1 ||
+          add_data_cells (h, idx, values[i], slot) == -1)
+        goto out;
+    }
+  }
+
+  ret = 0;
+ out:
+  free (children);
+  free (values);
+  free (blocks);
+  return ret;
+}
+
+static int
+compare_cells (const void *av, const void *bv)
+{
+  const struct index_cell *a = av, *b = bv;
+
+  if (a->offset != b->offset)
+    return a->offset < b->offset ? -1 : 1;
+  /* A cell shared by several keys belongs to the first one reached. */
+  return a->node < b->node ? -1 : a->node > b->node;
+}
+
+void
+_hivex_free_path_index (hive_h *h)
+{
+  struct path_index *idx = h->path_index;
+
+  if (idx == NULL)
+    return;
+
+  _hivex_free (h, idx->nodes, idx->nodes_alloc * sizeof (struct index_node));
+  _hivex_free (h, idx->cells, idx->cells_alloc * sizeof (struct index_cell));
+  _hivex_free (h, idx->names, idx->names_alloc);
+  _hivex_free (h, idx->name_offs, idx->name_offs_alloc * sizeof (size_t));
+  _hivex_free (h, idx->hash, idx->hash_size * sizeof (uint32_t));
+  _hivex_free (h, idx, sizeof *idx);
+  h->path_index = NULL;
+}
+
+int
+hivex_build_path_index (hive_h *h, int flags)
+{
+  struct path_index *idx;
+  size_t unvisited_size, i, j;
+  char *unvisited;
+
+  if (flags != 0) {
+    SET_ERRNO (EINVAL, "flags != 0");
+    return -1;
+  }
+
+  if (h->path_index)
+    return 0;
+
+  idx = _hivex_calloc (h, 1, sizeof *idx);
+  if (idx == NULL)
+    return -1;
+  h->path_index = idx;
+
+  /* Keys reached by more than one path (which only happens in
+   * corrupt hives) are indexed under the first one.
+   */
+  unvisited_size = 1 + h->size / 32;
+  unvisited = _hivex_malloc (h, unvisited_size);
+  if (unvisited == NULL)
+    goto error;
+  memcpy (unvisited, h->bitmap, unvisited_size);
+
+  if (grow (h, (void **) &idx->nodes, &idx->nodes_alloc, 0,
+            sizeof (struct index_node)) == -1)
+    goto error;
+  idx->nodes[0].offset = h->rootoffs;
+  idx->nodes[0].parent = NO_PARENT;
+  idx->nr_nodes = 1;
+  BITMAP_CLR (unvisited, h->rootoffs);
+
+  /* 'nodes' is also the queue of the breadth-first walk. */
+  for (i = 0; i < idx->nr_nodes; ++i) {
+    if (index_node (h, idx, unvisited, i) == -1)
+      goto error;
+  }
+
+  _hivex_free (h, unvisited, unvisited_size);
+  unvisited = NULL;
+
+  qsort (idx->cells, idx->nr_cells, sizeof (struct index_cell),
+         compare_cells);
+  for (i = j = 0; i < idx->nr_cells; ++i) {
+    if (j > 0 && idx->cells[j-1].offset == idx->cells[i].offset)
+      continue;
+    idx->cells[j++] = idx->cells[i];
+  }
+  idx->nr_cells = j;
+
+  /* The hash table is only needed for interning. */
+  _hivex_free (h, idx->hash, idx->hash_size * sizeof (uint32_t));
+  idx->hash = NULL;
+  idx->hash_size = 0;
+
+  DEBUG (2, "path index: %zu keys, %zu cells, %zu distinct names",
+         idx->nr_nodes, idx->nr_cells, idx->nr_names);
+  return 0;
+
+ error:;
+  int err = errno;
+  if (unvisited)
+    _hivex_free (h, unvisited, unvisited_size);
+  _hivex_free_path_index (h);
+  errno = err;
+  return -1;
+}
+
+/* Return the slot of the key owning 'offset', or -1 if it is not in
+ * the index.
+ */
+static int64_t
+find_cell (struct path_index *idx, size_t offset)
+{
+  size_t lo = 0, hi = idx->nr_cells;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (idx->cells[mid].offset == offset)
+      return idx->cells[mid].node;
+    if (idx->cells[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return -1;
+}
+
+hive_node_h
+hivex_cell_owner (hive_h *h, hive_node_h offset)
+{
+  int64_t slot;
+
+  if (hivex_build_path_index (h, 0) == -1)
+    return 0;
+
+  slot = find_cell (h->path_index, offset);
+  if (slot == -1) {
+    SET_ERRNO (ENOENT, "no key owns the cell at 0x%zx", offset);
+    return 0;
+  }
+  return h->path_index->nodes[slot].offset;
+}
+
+/* Build "\A\B\C" from a list of names, deepest first. */
+static char *
+join_path (hive_h *h, const char **names, size_t nr_names)
+{
+  size_t len = 1, i;
+  char *path, *p;
+
+  for (i = 0; i < nr_names; ++i)
+    len += 1 + strlen (names[i]);
+
+  path = _hivex_malloc_for_caller (h, len + 1);
+  if (path == NULL)
+    return NULL;
+
+  p = path;
+  if (nr_names == 0)
+    *p++ = '\\';
+  for (i = nr_names; i > 0; --i) {
+    *p++ = '\\';
+    strcpy (p, names[i-1]);
+    p += strlen (names[i-1]);
+  }
+  *p = '\0';
+  return path;
+}
+
+static char *
+indexed_path (hive_h *h, struct path_index *idx, int64_t slot)
+{
+  const char **names = NULL;
+  size_t nr_names = 0, alloc = 0;
+  char *path;
+
+  /* The root key's own name is not part of the path. */
+  for (; idx->nodes[slot].parent != NO_PARENT;
+       slot = idx->nodes[slot].parent) {
+    if (grow (h, (void **) &names, &alloc, nr_names, sizeof (char *)) == -1)
+      goto error;
+    names[nr_names++] = idx->names + idx->name_offs[idx->nodes[slot].name];
+  }
+
+  path = join_path (h, names, nr_names);
+  _hivex_free (h, names, alloc * sizeof (char *));
+  return path;
+
+ error:
+  _hivex_free (h, names, alloc * sizeof (char *));
+  return NULL;
+}
+
+/* Without the index, follow the parent pointers stored in the hive.
+ * An nk-record is at least 0x50 bytes, so a chain of parents longer
+ * than that allows must contain a loop.
+ */
+static char *
+unindexed_path (hive_h *h, hive_node_h node)
+{
+  char **names = NULL;
+  size_t nr_names = 0, alloc = 0, i;
+  char *path = NULL;
+
+  while (node != h->rootoffs) {
+    if (nr_names > h->size / 0x50) {
+      SET_ERRNO (ELOOP, "parent pointers contain a loop");
+      goto out;
+    }
+    if (grow (h, (void **) &names, &alloc, nr_names, sizeof (char *)) == -1)
+      goto out;
+    names[nr_names] = hivex_node_name (h, node);
+    if (names[nr_names] == NULL)
+      goto out;
+    nr_names++;
+    node = hivex_node_parent (h, node);
+    if (node == 0)
+      goto out;
+  }
+
+  path = join_path (h, (const char **) names, nr_names);
+
+ out:;
+  int err = errno;
+  for (i = 0; i < nr_names; ++i)
+    free (names[i]);
+  _hivex_free (h, names, alloc * sizeof (char *));
+  errno = err;
+  return path;
+}
+
+char *
+hivex_node_path (hive_h *h, hive_node_h node)
+{
+  if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk")) {
+    SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
+    return NULL;
+  }
+
+  if (h->path_index) {
+    int64_t slot = find_cell (h->path_index, node);
+
+    if (slot == -1 || h->path_index->nodes[slot].offset != node) {
+      SET_ERRNO (ENOENT, "key is not reachable from the root key");
+      return NULL;
+    }
+    return indexed_path (h, h->path_index, slot);
+  }
+
+  return unindexed_path (h, node);
+}
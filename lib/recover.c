@@ -0,0 +1,465 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Recovery of deleted records from free space.
+ *
+ * When Windows deletes a key or value it marks the cells as free
+ * (and may merge them with free neighbours) but does not clear them,
+ * so the old records survive until the space is reused.  We find the
+ * free regions of the hive (free cells, and the slack after the last
+ * hbin page), then look at every 8 byte aligned offset in them for
+ * something which parses as a record.  Since anything found is a
+ * guess, each record comes with flags saying how well it fits in
+ * with the rest of the hive.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+struct free_region {
+  size_t start, end;
+  int in_slack;
+};
+
+struct recover_state {
+  struct free_region *regions;
+  size_t nr_regions, alloc_regions;
+  hive_recovered *recs;
+  size_t nr_recs, alloc_recs;
+};
+
+static int
+add_region (hive_h *h, struct recover_state *state,
+            size_t start, size_t end, int in_slack)
+{
+  /* Free cells next to each other are one region. */
+  if (state->nr_regions > 0 &&
+      state->regions[state->nr_regions-1].end == start &&
+      state->regions[state->nr_regions-1].in_slack == in_slack) {
+    state->regions[state->nr_regions-1].end = end;
+    return 0;
+  }
+
+  if (state->nr_regions >= state->alloc_regions) {
+    size_t new_alloc = state->alloc_regions ? state->alloc_regions * 2 : 64;
+    struct free_region *p;
+
+    p = _hivex_realloc (h, state->regions,
+                        state->alloc_regions * sizeof (struct free_region),
+                        new_alloc * sizeof (struct free_region));
+    if (p == NULL)
+      return -1;
+    state->regions = p;
+    state->alloc_regions = new_alloc;
+  }
+
+  state->regions[state->nr_regions].start = start;
+  state->regions[state->nr_regions].end = end;
+  state->regions[state->nr_regions].in_slack = in_slack;
+  state->nr_regions++;
+  return 0;
+}
+
+/* Find the free regions, in order.  hivex_open has already checked
+ * the pages and blocks up to h->endpages.
+ */
+static int
+find_regions (hive_h *h, struct recover_state *state)
+{
+  size_t off, page_size, blkoff, seg_len;
+  struct ntreg_hbin_page *page;
+  int used;
+
+  for (off = 0x1000; off < h->endpages; off += page_size) {
+    page = (struct ntreg_hbin_page *) ((char *) h->addr + off);
+    page_size = le32toh (page->page_size);
+
+    for (blkoff = off + 0x20; blkoff < off + page_size; blkoff += seg_len) {
+      seg_len = block_len (h, blkoff, &used);
+      if (!used && add_region (h, state, blkoff, blkoff + seg_len, 0) == -1)
+        return -1;
+    }
+  }
+
+  if (h->endpages < h->size &&
+      add_region (h, state, h->endpages, h->size, 1) == -1)
+    return -1;
+
+  return 0;
+}
+
+/* Is [start, end) entirely inside one free region? */
+static int
+in_free_region (struct recover_state *state, size_t start, size_t end)
+{
+  size_t lo = 0, hi = state->nr_regions;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (state->regions[mid].end <= start)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < state->nr_regions &&
+    state->regions[lo].start <= start && end <= state->regions[lo].end;
+}
+
+/* Does the offset stored in a record point at a record with this id
+ * (allocated or not)?
+ */
+static int
+points_to (hive_h *h, uint32_t stored, const char *id)
+{
+  size_t off = (size_t) stored + 0x1000;
+
+  return (off & 3) == 0 && off + 6 <= h->size &&
+    memcmp ((char *) h->addr + off + 4, id, 2) == 0;
+}
+
+static hive_recovered *
+add_record (hive_h *h, struct recover_state *state,
+            int kind, size_t offset, int flags)
+{
+  hive_recovered *rec;
+
+  if (state->nr_recs >= state->alloc_recs) {
+    size_t new_alloc = state->alloc_recs ? state->alloc_recs * 2 : 64;
+    hive_recovered *p;
+
+    p = _hivex_realloc (h, state->recs,
+                        state->alloc_recs * sizeof (hive_recovered),
+                        new_alloc * sizeof (hive_recovered));
+    if (p == NULL)
+      return NULL;
+    state->recs = p;
+    state->alloc_recs = new_alloc;
+  }
+
+  rec = &state->recs[state->nr_recs++];
+  memset (rec, 0, sizeof *rec);
+  rec->kind = kind;
+  rec->offset = offset;
+  rec->flags = flags;
+  return rec;
+}
+
+/* Decode a name, or return NULL with errno == 0 if it is not valid
+ * (so this is not really a record).
+ */
+static char *
+recover_name (hive_h *h, const char *name, size_t len, int latin1)
+{
+  char *ret;
+
+  if (latin1)
+    ret = _hivex_windows_latin1_to_utf8 (h, name, len);
+  else if (len & 1) {
+    errno = 0;
+    return NULL;
+  }
+  else
+    ret = _hivex_windows_utf16_to_utf8 (h, name, len);
+
+  if (ret == NULL && errno != ENOMEM)
+    errno = 0;
+  return ret;
+}
+
+/* Each of these tries to parse a record at off, with avail bytes
+ * before the end of the free region.  They return the number of bytes
+ * used by the record, 0 if it does not look like one, or -1 on error.
+ */
+static ssize_t
+recover_nk (hive_h *h, struct recover_state *state,
+            size_t off, size_t avail, int flags)
+{
+  struct ntreg_nk_record *nk =
+    (struct ntreg_nk_record *) ((char *) h->addr + off);
+  size_t header = offsetof (struct ntreg_nk_record, name);
+  size_t len, parent;
+  hive_recovered *rec;
+  char *name;
+
+  if (avail < header)
+    return 0;
+  len = le16toh (nk->name_len);
+  if (len == 0 || header + len > avail)
+    return 0;
+
+  name = recover_name (h, nk->name, len, le16toh (nk->flags) & 0x20);
+  if (name == NULL)
+    return errno ? -1 : 0;
+
+  parent = le32toh (nk->parent) + 0x1000;
+  if (IS_VALID_BLOCK (h, parent) && block_id_eq (h, parent, "nk"))
+    flags |= HIVEX_RECOVERED_PARENT_LIVE;
+
+  rec = add_record (h, state, hivex_recovered_node, off, flags);
+  if (rec == NULL) {
+    free (name);
+    return -1;
+  }
+  rec->name = name;
+  rec->timestamp = le64toh (nk->timestamp);
+  rec->parent = parent;
+  return header + len;
+}
+
+static ssize_t
+recover_vk (hive_h *h, struct recover_state *state,
+            size_t off, size_t avail, int flags)
+{
+  struct ntreg_vk_record *vk =
+    (struct ntreg_vk_record *) ((char *) h->addr + off);
+  size_t header = offsetof (struct ntreg_vk_record, name);
+  size_t len, data_len, data_offset;
+  hive_type t;
+  hive_recovered *rec;
+  char *name, *data = NULL;
+
+  if (avail < header)
+    return 0;
+  len = le16toh (vk->name_len);
+  if (header + len > avail)
+    return 0;
+  t = le32toh (vk->data_type);
+  if (t > hive_t_REG_QWORD)
+    return 0;
+
+  if (len > 0) {
+    name = recover_name (h, vk->name, len, le16toh (vk->flags) & 0x01);
+    if (name == NULL)
+      return errno ? -1 : 0;
+  }
+  else {
+    /* The default value. */
+    name = _hivex_malloc_for_caller (h, 1);
+    if (name == NULL)
+      return -1;
+    name[0] = '\0';
+  }
+
+  /* The data is only returned if it cannot have been overwritten:
+   * it is inline, or the cell is still free.
+   */
+  data_len = le32toh (vk->data_len);
+  if (data_len & 0x80000000) {
+    data_len &= 0x7fffffff;
+    if (data_len <= 4) {
+      data = _hivex_malloc_for_caller (h, data_len + 1);
+      if (data == NULL)
+        goto error;
+      memcpy (data, &vk->data_offset, data_len);
+    }
+  }
+  else {
+    data_offset = le32toh (vk->data_offset) + 0x1000;
+    if (data_len <= h->size && (data_offset & 7) == 0 &&
+        in_free_region (state, data_offset, data_offset + 4 + data_len) &&
+        block_len (h, data_offset, NULL) >= 4 + data_len) {
+      data = _hivex_malloc_for_caller (h, data_len + 1);
+      if (data == NULL)
+        goto error;
+      memcpy (data, (char *) h->addr + data_offset + 4, data_len);
+    }
+  }
+  if (data)
+    flags |= HIVEX_RECOVERED_DATA;
+
+  rec = add_record (h, state, hivex_recovered_value, off, flags);
+  if (rec == NULL)
+    goto error;
+  rec->name = name;
+  rec->t = t;
+  rec->len = data_len;
+  rec->value = data;
+  return header + len;
+
+ error:
+  free (name);
+  free (data);
+  return -1;
+}
+
+static ssize_t
+recover_list (hive_h *h, struct recover_state *state,
+              size_t off, size_t avail, int flags)
+{
+  struct ntreg_lf_record *lf =
+    (struct ntreg_lf_record *) ((char *) h->addr + off);
+  const char *target = "nk";
+  size_t entry_size = 8, nr, i;
+  hive_recovered *rec;
+  int links_valid = 1;
+
+  if (lf->id[1] == 'i') {       /* "li" lists nk, "ri" lists lf/lh/li */
+    entry_size = 4;
+    if (lf->id[0] == 'r')
+      target = NULL;
+  }
+
+  nr = le16toh (lf->nr_keys);
+  if (nr == 0 || 8 + nr * entry_size > avail)
+    return 0;
+
+  for (i = 0; i < nr && links_valid; ++i) {
+    uint32_t stored;
+
+    memcpy (&stored, (char *) lf + 8 + i * entry_size, 4);
+    stored = le32toh (stored);
+    if (target)
+      links_valid = points_to (h, stored, target);
+    else
+      links_valid = points_to (h, stored, "lf") ||
+        points_to (h, stored, "lh") || points_to (h, stored, "li");
+  }
+  if (links_valid)
+    flags |= HIVEX_RECOVERED_LINKS_VALID;
+
+  rec = add_record (h, state, hivex_recovered_subkey_list, off, flags);
+  if (rec == NULL)
+    return -1;
+  rec->len = nr;
+  return 8 + nr * entry_size;
+}
+
+static ssize_t
+recover_db (hive_h *h, struct recover_state *state,
+            size_t off, size_t avail, int flags)
+{
+  struct ntreg_db_record *db =
+    (struct ntreg_db_record *) ((char *) h->addr + off);
+  size_t blocklist;
+  hive_recovered *rec;
+
+  if (avail < sizeof *db || le16toh (db->nr_blocks) == 0)
+    return 0;
+
+  blocklist = le32toh (db->blocklist_offset) + 0x1000;
+  if (blocklist + 4 + 4 * (size_t) le16toh (db->nr_blocks) <= h->size)
+    flags |= HIVEX_RECOVERED_LINKS_VALID;
+
+  rec = add_record (h, state, hivex_recovered_big_data, off, flags);
+  if (rec == NULL)
+    return -1;
+  rec->len = le16toh (db->nr_blocks);
+  return sizeof *db;
+}
+
+static int
+carve_region (hive_h *h, struct recover_state *state,
+              const struct free_region *region, size_t from, size_t to)
+{
+  int flags = region->in_slack ? HIVEX_RECOVERED_IN_SLACK : 0;
+  size_t off;
+  ssize_t r;
+
+  for (off = region->start; off + 8 <= region->end && off < to; ) {
+    const char *id = (char *) h->addr + off + 4;
+    size_t avail = region->end - off;
+
+    r = 0;
+    if (id[0] == 'n' && id[1] == 'k')
+      r = recover_nk (h, state, off, avail, flags);
+    else if (id[0] == 'v' && id[1] == 'k')
+      r = recover_vk (h, state, off, avail, flags);
+    else if ((id[0] == 'l' && (id[1] == 'f' || id[1] == 'h' ||
+                               id[1] == 'i')) ||
+             (id[0] == 'r' && id[1] == 'i'))
+      r = recover_list (h, state, off, avail, flags);
+    else if (id[0] == 'd' && id[1] == 'b')
+      r = recover_db (h, state, off, avail, flags);
+    if (r == -1)
+      return -1;
+
+    /* Records before the start of the range are parsed so that we
+     * skip over them in the same way as when searching the whole
+     * hive, but not returned.
+     */
+    if (r > 0 && off < from) {
+      state->nr_recs--;
+      free (state->recs[state->nr_recs].name);
+      free (state->recs[state->nr_recs].value);
+    }
+
+    /* Records don't overlap, so skip over one if found. */
+    off += r > 0 ? (r + 7) & ~7 : 8;
+  }
+
+  return 0;
+}
+
+hive_recovered *
+hivex_recover (hive_h *h, size_t from, size_t to, int flags)
+{
+  struct recover_state state;
+  hive_recovered *ret = NULL;
+  size_t i;
+
+  if (flags != 0) {
+    SET_ERRNO (EINVAL, "flags != 0");
+    return NULL;
+  }
+
+  memset (&state, 0, sizeof state);
+
+  if (find_regions (h, &state) == -1)
+    goto out;
+
+  for (i = 0; i < state.nr_regions; ++i) {
+    if (state.regions[i].end <= from || state.regions[i].start >= to)
+      continue;
+    if (carve_region (h, &state, &state.regions[i], from, to) == -1)
+      goto out;
+  }
+
+  DEBUG (2, "recovered %zu records from %zu free regions",
+         state.nr_recs, state.nr_regions);
+
+  ret = _hivex_malloc_for_caller (h, (state.nr_recs + 1) *
+                                  sizeof (hive_recovered));
+  if (ret == NULL)
+    goto out;
+  if (state.nr_recs > 0)
+    memcpy (ret, state.recs, state.nr_recs * sizeof (hive_recovered));
+  memset (&ret[state.nr_recs], 0, sizeof (hive_recovered));
+  state.nr_recs = 0;            /* now owned by the caller */
+
+ out:;
+  int err = errno;
+  for (i = 0; i < state.nr_recs; ++i) {
+    free (state.recs[i].name);
+    free (state.recs[i].value);
+  }
+  if (state.recs)
+    _hivex_free (h, state.recs, state.alloc_recs * sizeof (hive_recovered));
+  if (state.regions)
+    _hivex_free (h, state.regions,
+                 state.alloc_regions * sizeof (struct free_region));
+  errno = err;
+  return ret;
+}
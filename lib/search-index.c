@@ -0,0 +1,838 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Substring search index.
+ *
+ * Every value reachable from the root is an entry.  The names of the
+ * values and their string data (REG_SZ, REG_EXPAND_SZ, REG_LINK and
+ * each string of REG_MULTI_SZ), converted to UTF-8 with ASCII letters
+ * folded to lower case, are split into trigrams: every run of 3
+ * bytes.  For each trigram the index holds a sorted list of postings
+ * (entry << 1 | field), where field is 0 for the name and 1 for the
+ * data.
+ *
+ * A query of 3 or more bytes intersects the lists of its trigrams,
+ * which gives a small set of candidates, and then decodes only the
+ * candidates to check that the string really occurs.  Shorter queries
+ * have no trigrams, so every entry is a candidate.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "c-ctype.h"
+#include "full-write.h"
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+#define FIELD_NAME 0
+#define FIELD_DATA 1
+
+struct search_entry {
+  hive_node_h node;
+  hive_value_h value;
+};
+
+struct search_index {
+  struct search_entry *entries;
+  size_t nr_entries, alloc;
+
+  /* Trigrams (3 bytes packed into the low 24 bits) in increasing
+   * order.  The postings of keys[i] are postings[starts[i]] up to
+   * postings[starts[i+1]].
+   */
+  uint32_t *keys;
+  size_t *starts;
+  size_t nr_keys;
+  uint32_t *postings;
+  size_t nr_postings;
+};
+
+/* Format of the saved index: the header is followed by the entries,
+ * then the keys, then the postings.  The postings of each key are
+ * stored as the first posting followed by the differences between
+ * consecutive postings, each as an unsigned LEB128 number.
+ */
+#define SEARCH_INDEX_MAGIC "hivexSRI"
+#define SEARCH_INDEX_VERSION 1
+
+struct search_index_header {
+  struct sidecar_header common; /* "hivexSRI", version 1 */
+  uint64_t nr_entries;
+  uint64_t nr_keys;
+  uint64_t nr_postings;
+  uint64_t postings_bytes;      /* size of the encoded postings */
+} __attribute__((__packed__));
+
+struct search_index_entry {
+  uint64_t node;
+  uint64_t value;
+} __attribute__((__packed__));
+
+struct search_index_key {
+  uint32_t key;
+  uint32_t nr_postings;
+} __attribute__((__packed__));
+
+static void
+free_index (hive_h *h, struct search_index *idx)
+{
+  if (idx) {
+    if (idx->entries)
+      _hivex_free (h, idx->entries,
+                   idx->alloc * sizeof (struct search_entry));
+    if (idx->keys)
+      _hivex_free (h, idx->keys, (idx->nr_keys + 1) * sizeof (uint32_t));
+    if (idx->starts)
+      _hivex_free (h, idx->starts, (idx->nr_keys + 1) * sizeof (size_t));
+    if (idx->postings)
+      _hivex_free (h, idx->postings,
+                   (idx->nr_postings + 1) * sizeof (uint32_t));
+    _hivex_free (h, idx, sizeof *idx);
+  }
+}
+
+void
+_hivex_free_search_index (hive_h *h)
+{
+  free_index (h, h->search_index);
+  h->search_index = NULL;
+}
+
+static inline uint32_t
+trigram (const char *s)
+{
+  return (uint32_t) (unsigned char) c_tolower (s[0]) << 16 |
+    (uint32_t) (unsigned char) c_tolower (s[1]) << 8 |
+    (uint32_t) (unsigned char) c_tolower (s[2]);
+}
+
+/* State while building the index.  pairs holds (trigram << 32 |
+ * posting) for every trigram of every string, and is sorted at the
+ * end to make the lists.
+ */
+struct build_state {
+  struct search_index *idx;
+  uint64_t *pairs;
+  size_t nr_pairs, alloc_pairs;
+};
+
+static int
+add_text (hive_h *h, struct build_state *state, int field, const char *str)
+{
+  uint32_t posting = (state->idx->nr_entries - 1) << 1 | field;
+  size_t len = strlen (str), i;
+
+  if (len < 3)
+    return 0;
+
+  if (state->nr_pairs + len - 2 > state->alloc_pairs) {
+    size_t new_alloc = state->alloc_pairs ? state->alloc_pairs : 4096;
+    uint64_t *p;
+
+    while (state->nr_pairs + len - 2 > new_alloc)
+      new_alloc *= 2;
+    p = _hivex_realloc (h, state->pairs,
+                        state->alloc_pairs * sizeof (uint64_t),
+                        new_alloc * sizeof (uint64_t));
+    if (p == NULL)
+      return -1;
+    state->pairs = p;
+    state->alloc_pairs = new_alloc;
+  }
+
+  for (i = 0; i + 3 <= len; ++i)
+    state->pairs[state->nr_pairs++] =
+      (uint64_t) trigram (&str[i]) << 32 | posting;
+  return 0;
+}
+
+static int
+add_value (hive_h *h, struct build_state *state,
+           hive_node_h node, hive_value_h value, const char *key)
+{
+  struct search_index *idx = state->idx;
+
+  if (idx->nr_entries >= idx->alloc) {
+    size_t new_alloc = idx->alloc ? idx->alloc * 2 : 256;
+    struct search_entry *p;
+
+    p = _hivex_realloc (h, idx->entries,
+                        idx->alloc * sizeof (struct search_entry),
+                        new_alloc * sizeof (struct search_entry));
+    if (p == NULL)
+      return -1;
+    idx->entries = p;
+    idx->alloc = new_alloc;
+  }
+
+  idx->entries[idx->nr_entries].node = node;
+  idx->entries[idx->nr_entries].value = value;
+  idx->nr_entries++;
+
+  return add_text (h, state, FIELD_NAME, key);
+}
+
+static int
+visit_string (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+              hive_type t, size_t len, const char *key, const char *str)
+{
+  if (add_value (h, opaque, node, value, key) == -1)
+    return -1;
+  return add_text (h, opaque, FIELD_DATA, str);
+}
+
+static int
+visit_multiple_strings (hive_h *h, void *opaque,
+                        hive_node_h node, hive_value_h value,
+                        hive_type t, size_t len, const char *key,
+                        char **argv)
+{
+  size_t i;
+
+  if (add_value (h, opaque, node, value, key) == -1)
+    return -1;
+  for (i = 0; argv[i] != NULL; ++i)
+    if (add_text (h, opaque, FIELD_DATA, argv[i]) == -1)
+      return -1;
+  return 0;
+}
+
+/* Values without string data: only the name is indexed. */
+static int
+visit_other (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+             hive_type t, size_t len, const char *key, const char *str)
+{
+  return add_value (h, opaque, node, value, key);
+}
+
+static int
+visit_dword (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+             hive_type t, size_t len, const char *key, int32_t v)
+{
+  return add_value (h, opaque, node, value, key);
+}
+
+static int
+visit_qword (hive_h *h, void *opaque, hive_node_h node, hive_value_h value,
+             hive_type t, size_t len, const char *key, int64_t v)
+{
+  return add_value (h, opaque, node, value, key);
+}
+
+static int
+compare_pairs (const void *av, const void *bv)
+{
+  uint64_t a = *(const uint64_t *) av, b = *(const uint64_t *) bv;
+
+  return a < b ? -1 : a > b;
+}
+
+/* Sort and deduplicate the pairs, and turn them into the lists. */
+static int
+make_lists (hive_h *h, struct build_state *state)
+{
+  struct search_index *idx = state->idx;
+  size_t i, n, k;
+
+  qsort (state->pairs, state->nr_pairs, sizeof (uint64_t), compare_pairs);
+
+  for (i = n = k = 0; i < state->nr_pairs; ++i) {
+    if (i > 0 && state->pairs[i] == state->pairs[i-1])
+      continue;
+    if (n == 0 || state->pairs[i] >> 32 != state->pairs[n-1] >> 32)
+      k++;
+    state->pairs[n++] = state->pairs[i];
+  }
+  state->nr_pairs = n;
+
+  idx->nr_keys = k;
+  idx->nr_postings = n;
+  idx->keys = _hivex_malloc (h, (k + 1) * sizeof (uint32_t));
+  if (idx->keys == NULL)
+    return -1;
+  idx->starts = _hivex_malloc (h, (k + 1) * sizeof (size_t));
+  if (idx->starts == NULL)
+    return -1;
+  idx->postings = _hivex_malloc (h, (n + 1) * sizeof (uint32_t));
+  if (idx->postings == NULL)
+    return -1;
+
+  for (i = k = 0; i < n; ++i) {
+    uint32_t key = state->pairs[i] >> 32;
+
+    if (i == 0 || key != idx->keys[k-1]) {
+      idx->keys[k] = key;
+      idx->starts[k] = i;
+      k++;
+    }
+    idx->postings[i] = (uint32_t) state->pairs[i];
+  }
+  idx->starts[k] = n;
+
+  return 0;
+}
+
+int
+hivex_build_search_index (hive_h *h, int flags)
+{
+  struct build_state state;
+  struct hivex_visitor visitor;
+
+  if (flags != 0) {
+    SET_ERRNO (EINVAL, "flags != 0");
+    return -1;
+  }
+
+  if (h->search_index)
+    return 0;
+
+  memset (&state, 0, sizeof state);
+  state.idx = _hivex_calloc (h, 1, sizeof *state.idx);
+  if (state.idx == NULL)
+    return -1;
+
+  memset (&visitor, 0, sizeof visitor);
+  visitor.value_string = visit_string;
+  visitor.value_multiple_strings = visit_multiple_strings;
+  visitor.value_string_invalid_utf16 = visit_other;
+  visitor.value_dword = visit_dword;
+  visitor.value_qword = visit_qword;
+  visitor.value_binary = visit_other;
+  visitor.value_none = visit_other;
+  visitor.value_other = visit_other;
+
+  /* Values which cannot be read are skipped. */
+  if (hivex_visit (h, &visitor, sizeof visitor, &state,
+                   HIVEX_VISIT_SKIP_BAD) == -1)
+    goto error;
+
+  if (state.idx->nr_entries > UINT32_MAX >> 1) {
+    SET_ERRNO (EFBIG, "too many values to index (%zu)",
+               state.idx->nr_entries);
+    goto error;
+  }
+
+  if (make_lists (h, &state) == -1)
+    goto error;
+  _hivex_free (h, state.pairs, state.alloc_pairs * sizeof (uint64_t));
+
+  DEBUG (2, "search index: %zu values, %zu trigrams, %zu postings",
+         state.idx->nr_entries, state.idx->nr_keys, state.idx->nr_postings);
+  h->search_index = state.idx;
+  return 0;
+
+ error:;
+  int err = errno;
+  if (state.pairs)
+    _hivex_free (h, state.pairs, state.alloc_pairs * sizeof (uint64_t));
+  free_index (h, state.idx);
+  errno = err;
+  return -1;
+}
+
+/* Return the postings of a trigram, or NULL if there are none. */
+static const uint32_t *
+find_postings (struct search_index *idx, uint32_t key, size_t *nr_ret)
+{
+  size_t lo = 0, hi = idx->nr_keys;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (idx->keys[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == idx->nr_keys || idx->keys[lo] != key)
+    return NULL;
+  *nr_ret = idx->starts[lo+1] - idx->starts[lo];
+  return &idx->postings[idx->starts[lo]];
+}
+
+static int
+contains_posting (const uint32_t *postings, size_t nr, uint32_t posting)
+{
+  size_t lo = 0, hi = nr;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (postings[mid] < posting)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < nr && postings[lo] == posting;
+}
+
+/* Does str contain the lower case string needle, ignoring the case
+ * of ASCII letters?
+ */
+static int
+contains (const char *str, const char *needle, size_t needle_len)
+{
+  size_t len = strlen (str), i, j;
+
+  for (i = 0; i + needle_len <= len; ++i) {
+    for (j = 0; j < needle_len; ++j)
+      if (c_tolower (str[i+j]) != needle[j])
+        break;
+    if (j == needle_len)
+      return 1;
+  }
+  return 0;
+}
+
+/* Check a candidate.  Returns 1 if the field contains the needle, 0 if
+ * not or if the value can no longer be decoded, or -1 on error.
+ */
+static int
+check_candidate (hive_h *h, const struct search_entry *e, int field,
+                 const char *needle, size_t needle_len)
+{
+  hive_type t;
+  size_t len, i;
+  char *str, **strs;
+  int r = 0;
+
+  errno = 0;
+  if (field == FIELD_NAME) {
+    str = hivex_value_key (h, e->value);
+    if (str == NULL)
+      return errno == ENOMEM ? -1 : 0;
+    r = contains (str, needle, needle_len);
+    free (str);
+    return r;
+  }
+
+  if (hivex_value_type (h, e->value, &t, &len) == -1)
+    return errno == ENOMEM ? -1 : 0;
+
+  switch (t) {
+  case hive_t_string:
+  case hive_t_expand_string:
+  case hive_t_link:
+    str = hivex_value_string (h, e->value);
+    if (str == NULL)
+      return errno == ENOMEM ? -1 : 0;
+    r = contains (str, needle, needle_len);
+    free (str);
+    return r;
+
+  case hive_t_multiple_strings:
+    strs = hivex_value_multiple_strings (h, e->value);
+    if (strs == NULL)
+      return errno == ENOMEM ? -1 : 0;
+    for (i = 0; strs[i] != NULL; ++i) {
+      if (!r)
+        r = contains (strs[i], needle, needle_len);
+      free (strs[i]);
+    }
+    free (strs);
+    return r;
+
+  default:
+    return 0;
+  }
+}
+
+hive_search_match *
+hivex_search (hive_h *h, const char *str, int flags)
+{
+  struct search_index *idx;
+  char *needle = NULL;
+  size_t needle_len, i, j;
+  const uint32_t **lists = NULL, *candidates;
+  size_t *list_lens = NULL, nr_lists = 0, nr_candidates, shortest = 0;
+  size_t last_found = (size_t) -1;
+  offset_list found;
+  size_t *found_entries = NULL;
+  hive_search_match *ret = NULL;
+
+  if (flags & ~(HIVEX_SEARCH_NAMES|HIVEX_SEARCH_DATA)) {
+    SET_ERRNO (EINVAL, "unknown flags 0x%x", flags);
+    return NULL;
+  }
+  if (flags == 0)
+    flags = HIVEX_SEARCH_NAMES|HIVEX_SEARCH_DATA;
+
+  if (hivex_build_search_index (h, 0) == -1)
+    return NULL;
+  idx = h->search_index;
+
+  needle_len = strlen (str);
+  needle = _hivex_malloc (h, needle_len + 1);
+  if (needle == NULL)
+    return NULL;
+  for (i = 0; i <= needle_len; ++i)
+    needle[i] = c_tolower (str[i]);
+
+  _hivex_init_offset_list (h, &found);
+
+  /* Get the list of postings for each trigram of the query.  The
+   * shortest list is the set of candidates.
+   */
+  if (needle_len >= 3) {
+    nr_lists = needle_len - 2;
+    lists = _hivex_malloc (h, nr_lists * sizeof (uint32_t *));
+    if (lists == NULL)
+      goto out;
+    list_lens = _hivex_malloc (h, nr_lists * sizeof (size_t));
+    if (list_lens == NULL)
+      goto out;
+    for (i = 0; i < nr_lists; ++i) {
+      lists[i] = find_postings (idx, trigram (&needle[i]), &list_lens[i]);
+      if (lists[i] == NULL)
+        goto done;              /* no matches */
+      if (list_lens[i] < list_lens[shortest])
+        shortest = i;
+    }
+    candidates = lists[shortest];
+    nr_candidates = list_lens[shortest];
+  }
+  else {
+    candidates = NULL;
+    nr_candidates = 2 * idx->nr_entries;
+  }
+
+  for (i = 0; i < nr_candidates; ++i) {
+    uint32_t posting = candidates ? candidates[i] : i;
+    size_t entry = posting >> 1;
+    int field = posting & 1;
+    int r;
+
+    if (!(flags & (field == FIELD_NAME ? HIVEX_SEARCH_NAMES
+                                       : HIVEX_SEARCH_DATA)))
+      continue;
+
+    /* Postings are in entry order, so a value which matched on its
+     * name is the last one found.
+     */
+    if (entry == last_found)
+      continue;
+
+    for (j = 0; j < nr_lists; ++j)
+      if (j != shortest && !contains_posting (lists[j], list_lens[j], posting))
+        break;
+    if (j < nr_lists)
+      continue;
+
+    r = check_candidate (h, &idx->entries[entry], field,
+                         needle, needle_len);
+    if (r == -1)
+      goto out;
+    if (r) {
+      /* Entry numbers are stored + 1 because 0 ends the list. */
+      if (_hivex_add_to_offset_list (&found, entry + 1) == -1)
+        goto out;
+      last_found = entry;
+    }
+  }
+
+ done:
+  found_entries = _hivex_return_offset_list (&found);
+  if (found_entries == NULL)
+    goto out;
+  for (i = 0; found_entries[i] != 0; ++i)
+    ;
+  ret = _hivex_malloc_for_caller (h, (i + 1) * sizeof (hive_search_match));
+  if (ret == NULL)
+    goto out;
+  for (i = 0; found_entries[i] != 0; ++i) {
+    ret[i].node = idx->entries[found_entries[i] - 1].node;
+    ret[i].value = idx->entries[found_entries[i] - 1].value;
+  }
+  ret[i].node = 0;
+  ret[i].value = 0;
+
+ out:
+  free (found_entries);
+  _hivex_free_offset_list (&found);
+  if (lists)
+    _hivex_free (h, lists, nr_lists * sizeof (uint32_t *));
+  if (list_lens)
+    _hivex_free (h, list_lens, nr_lists * sizeof (size_t));
+  _hivex_free (h, needle, needle_len + 1);
+  return ret;
+}
+
+static size_t
+encode_number (unsigned char *p, uint32_t n)
+{
+  size_t i = 0;
+
+  while (n >= 0x80) {
+    p[i++] = (n & 0x7f) | 0x80;
+    n >>= 7;
+  }
+  p[i++] = n;
+  return i;
+}
+
+/* Call fn for each encoded list of postings.  If fn is NULL, just
+ * return the total size.
+ */
+static int64_t
+encode_postings (struct search_index *idx,
+                 int (*fn) (int fd, const unsigned char *, size_t), int fd)
+{
+  unsigned char buf[4096];
+  size_t i, j, n = 0;
+  int64_t total = 0;
+
+  for (i = 0; i < idx->nr_keys; ++i) {
+    uint32_t prev = 0;
+
+    for (j = idx->starts[i]; j < idx->starts[i+1]; ++j) {
+      if (n > sizeof buf - 5) {
+        if (fn && fn (fd, buf, n) == -1)
+          return -1;
+        total += n;
+        n = 0;
+      }
+      n += encode_number (&buf[n], idx->postings[j] - prev);
+      prev = idx->postings[j];
+    }
+  }
+  if (n > 0 && fn && fn (fd, buf, n) == -1)
+    return -1;
+  return total + n;
+}
+
+static int
+write_bytes (int fd, const unsigned char *buf, size_t n)
+{
+  return full_write (fd, buf, n) == n ? 0 : -1;
+}
+
+int
+hivex_save_search_index (hive_h *h, const char *filename)
+{
+  struct search_index *idx;
+  struct search_index_header hdr;
+  struct search_index_entry ebuf[256];
+  struct search_index_key kbuf[256];
+  size_t i, j, n;
+  int fd, err;
+
+  if (hivex_build_search_index (h, 0) == -1)
+    return -1;
+  idx = h->search_index;
+
+  hdr.nr_entries = htole64 (idx->nr_entries);
+  hdr.nr_keys = htole64 (idx->nr_keys);
+  hdr.nr_postings = htole64 (idx->nr_postings);
+  hdr.postings_bytes = htole64 (encode_postings (idx, NULL, -1));
+  fd = _hivex_sidecar_create (h, filename, SEARCH_INDEX_MAGIC,
+                              SEARCH_INDEX_VERSION, &hdr, sizeof hdr);
+  if (fd == -1)
+    return -1;
+
+  for (i = 0; i < idx->nr_entries; i += n) {
+    n = idx->nr_entries - i;
+    if (n > sizeof ebuf / sizeof ebuf[0])
+      n = sizeof ebuf / sizeof ebuf[0];
+    for (j = 0; j < n; ++j) {
+      ebuf[j].node = htole64 (idx->entries[i+j].node);
+      ebuf[j].value = htole64 (idx->entries[i+j].value);
+    }
+    if (full_write (fd, ebuf, n * sizeof ebuf[0]) != n * sizeof ebuf[0])
+      goto error;
+  }
+
+  for (i = 0; i < idx->nr_keys; i += n) {
+    n = idx->nr_keys - i;
+    if (n > sizeof kbuf / sizeof kbuf[0])
+      n = sizeof kbuf / sizeof kbuf[0];
+    for (j = 0; j < n; ++j) {
+      kbuf[j].key = htole32 (idx->keys[i+j]);
+      kbuf[j].nr_postings =
+        htole32 (idx->starts[i+j+1] - idx->starts[i+j]);
+    }
+    if (full_write (fd, kbuf, n * sizeof kbuf[0]) != n * sizeof kbuf[0])
+      goto error;
+  }
+
+  if (encode_postings (idx, write_bytes, fd) == -1)
+    goto error;
+
+  if (close (fd) == -1)
+    return -1;
+  return 0;
+
+ error:
+  err = errno;
+  close (fd);
+  errno = err;
+  return -1;
+}
+
+int
+hivex_load_search_index (hive_h *h, const char *filename)
+{
+  struct search_index *idx = NULL;
+  struct search_index_header hdr;
+  struct search_index_entry *entries = NULL;
+  struct search_index_key *keys = NULL;
+  unsigned char *bytes = NULL;
+  uint64_t nr_entries, nr_keys = 0, nr_postings, postings_bytes = 0;
+  struct stat statbuf;
+  size_t i, j, p, k;
+  int fd, err;
+
+  fd = _hivex_sidecar_open (h, filename, SEARCH_INDEX_MAGIC,
+                            SEARCH_INDEX_VERSION, &hdr, sizeof hdr);
+  if (fd == -1)
+    return -1;
+
+  idx = _hivex_calloc (h, 1, sizeof *idx);
+  if (idx == NULL)
+    goto error;
+
+  /* Check the sizes against the file before allocating anything.
+   * Every value is at least 0x18 bytes, every posting is at least 1
+   * byte and every key has at least one posting.
+   */
+  nr_entries = le64toh (hdr.nr_entries);
+  nr_keys = le64toh (hdr.nr_keys);
+  nr_postings = le64toh (hdr.nr_postings);
+  postings_bytes = le64toh (hdr.postings_bytes);
+  if (fstat (fd, &statbuf) == -1)
+    goto error;
+  if (postings_bytes > (uint64_t) statbuf.st_size ||
+      nr_entries > h->size / 0x18 ||
+      nr_postings > postings_bytes || nr_keys > nr_postings ||
+      (uint64_t) statbuf.st_size !=
+      sizeof hdr + nr_entries * sizeof entries[0] +
+      nr_keys * sizeof keys[0] + postings_bytes) {
+    SET_ERRNO (EINVAL, "%s: sizes in header are invalid", filename);
+    goto error;
+  }
+
+  idx->alloc = nr_entries > 0 ? nr_entries : 1;
+  idx->nr_keys = nr_keys;
+  idx->nr_postings = nr_postings;
+  idx->entries = _hivex_malloc (h, idx->alloc * sizeof (struct search_entry));
+  idx->keys = _hivex_malloc (h, (nr_keys + 1) * sizeof (uint32_t));
+  idx->starts = _hivex_malloc (h, (nr_keys + 1) * sizeof (size_t));
+  idx->postings = _hivex_malloc (h, (nr_postings + 1) * sizeof (uint32_t));
+  if (!idx->entries || !idx->keys || !idx->starts || !idx->postings)
+    goto error;
+
+  entries = _hivex_malloc (h, idx->alloc * sizeof entries[0]);
+  if (entries == NULL)
+    goto error;
+  if (_hivex_sidecar_read (h, fd, filename,
+                           entries, nr_entries * sizeof entries[0]) == -1)
+    goto error;
+  for (i = 0; i < nr_entries; ++i) {
+    struct search_entry *e = &idx->entries[i];
+
+    e->node = le64toh (entries[i].node);
+    e->value = le64toh (entries[i].value);
+    /* Don't trust the file: the offsets are returned to callers as
+     * handles.
+     */
+    if (!IS_VALID_BLOCK (h, e->node) || !block_id_eq (h, e->node, "nk") ||
+        !IS_VALID_BLOCK (h, e->value) || !block_id_eq (h, e->value, "vk")) {
+      SET_ERRNO (EINVAL, "%s: entry %zu is invalid", filename, i);
+      goto error;
+    }
+    idx->nr_entries++;
+  }
+
+  keys = _hivex_malloc (h, (nr_keys + 1) * sizeof keys[0]);
+  if (keys == NULL)
+    goto error;
+  if (_hivex_sidecar_read (h, fd, filename,
+                           keys, nr_keys * sizeof keys[0]) == -1)
+    goto error;
+  bytes = _hivex_malloc (h, postings_bytes + 1);
+  if (bytes == NULL)
+    goto error;
+  if (_hivex_sidecar_read (h, fd, filename, bytes, postings_bytes) == -1)
+    goto error;
+
+  /* Decode the postings, checking that keys and postings are in
+   * increasing order (binary search relies on it) and that the
+   * postings refer to entries.
+   */
+  for (k = p = j = 0; k < nr_keys; ++k) {
+    uint32_t key = le32toh (keys[k].key);
+    uint32_t n = le32toh (keys[k].nr_postings), prev = 0;
+
+    if (key >= 1 << 24 || (k > 0 && key <= idx->keys[k-1]) ||
+        n == 0 || n > nr_postings - p)
+      goto invalid;
+    idx->keys[k] = key;
+    idx->starts[k] = p;
+
+    for (i = 0; i < n; ++i, ++p) {
+      uint64_t delta = 0;
+      int shift = 0;
+
+      do {
+        if (j == postings_bytes || shift > 28)
+          goto invalid;
+        delta |= (uint64_t) (bytes[j] & 0x7f) << shift;
+        shift += 7;
+      } while (bytes[j++] & 0x80);
+
+      if ((i > 0 && delta == 0) || prev + delta >= 2 * nr_entries)
+        goto invalid;
+      prev += delta;
+      idx->postings[p] = prev;
+    }
+  }
+  if (p != nr_postings || j != postings_bytes)
+    goto invalid;
+  idx->starts[nr_keys] = p;
+
+  _hivex_free (h, entries, idx->alloc * sizeof entries[0]);
+  _hivex_free (h, keys, (nr_keys + 1) * sizeof keys[0]);
+  _hivex_free (h, bytes, postings_bytes + 1);
+  close (fd);
+
+  _hivex_free_search_index (h);
+  h->search_index = idx;
+  return 0;
+
+ invalid:
+  SET_ERRNO (EINVAL, "%s: postings are invalid", filename);
+ error:
+  err = errno;
+  close (fd);
+  if (entries)
+    _hivex_free (h, entries, idx->alloc * sizeof entries[0]);
+  if (keys)
+    _hivex_free (h, keys, (nr_keys + 1) * sizeof keys[0]);
+  if (bytes)
+    _hivex_free (h, bytes, postings_bytes + 1);
+  free_index (h, idx);
+  errno = err;
+  return -1;
+}
@@ -0,0 +1,145 @@
+/* hivex - test contexts shared between handles.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+/* Read the names of all the keys and values below the root. */
+static void
+read_names (hive_h *h)
+{
+  hive_node_h *children;
+  hive_value_h *values;
+  size_t i, j;
+  char *name;
+
+  children = hivex_node_children (h, hivex_root (h));
+  CHECK (children != NULL);
+  for (i = 0; children[i] != 0; ++i) {
+    name = hivex_node_name (h, children[i]);
+    CHECK (name != NULL);
+    free (name);
+    values = hivex_node_values (h, children[i]);
+    CHECK (values != NULL);
+    for (j = 0; values[j] != 0; ++j) {
+      name = hivex_value_key (h, values[j]);
+      CHECK (name != NULL);
+      free (name);
+    }
+    free (values);
+  }
+  free (children);
+}
+
+static hive_stats
+get_stats (hive_h *h)
+{
+  hive_stats stats;
+
+  CHECK (hivex_get_stats (h, &stats, sizeof stats) == 0);
+  return stats;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096];
+  hive_context *ctx;
+  hive_h *h, *h2;
+  hive_stats stats;
+  size_t usage;
+  char *name;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/special", srcdir);
+
+  errno = 0;
+  CHECK (hivex_context_new (1) == NULL);
+  CHECK (errno == EINVAL);
+
+  /* A handle with a private context only creates each converter once,
+   * however many strings it converts.
+   */
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  usage = hivex_memory_usage (h);
+  read_names (h);
+  read_names (h);
+  stats = get_stats (h);
+  CHECK (stats.recode_calls > stats.iconv_opens);
+  CHECK (stats.iconv_opens >= 1 && stats.iconv_opens <= 2);
+  CHECK (hivex_close (h) == 0);
+
+  ctx = hivex_context_new (0);
+  CHECK (ctx != NULL);
+
+  /* The first handle on the context creates the converters. */
+  h = hivex_open_ctx (ctx, filename, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_memory_usage (h) == usage);
+  read_names (h);
+  CHECK (get_stats (h).iconv_opens >= 1);
+
+  /* The context can't be freed while it is in use. */
+  errno = 0;
+  CHECK (hivex_context_free (ctx) == -1);
+  CHECK (errno == EBUSY);
+
+  /* Handles open at the same time share the converters. */
+  h2 = hivex_open_ctx (ctx, filename, 0);
+  CHECK (h2 != NULL);
+  read_names (h2);
+  CHECK (get_stats (h2).iconv_opens == 0);
+  CHECK (hivex_close (h) == 0);
+
+  /* Later handles reuse the converters and the bitmap, and the
+   * results are the same.
+   */
+  CHECK (hivex_close (h2) == 0);
+  h = hivex_open_ctx (ctx, filename, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_memory_usage (h) == usage);
+  read_names (h);
+  CHECK (get_stats (h).iconv_opens == 0);
+  CHECK (hivex_node_get_child (h, hivex_root (h), "abcd_äöüß") != 0);
+  name = hivex_node_name (h, hivex_node_get_child (h, hivex_root (h),
+                                                   "weird™"));
+  CHECK (name != NULL);
+  CHECK (strcmp (name, "weird™") == 0);
+  free (name);
+  CHECK (hivex_close (h) == 0);
+
+  /* A NULL context is the same as hivex_open. */
+  h = hivex_open_ctx (NULL, filename, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_close (h) == 0);
+
+  CHECK (hivex_context_free (ctx) == 0);
+
+  exit (EXIT_SUCCESS);
+}
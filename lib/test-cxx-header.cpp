@@ -0,0 +1,160 @@
+/* hivex
+ * Copyright (C) 2011 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Check that the C++ header compiles and that the wrapper classes
+ * work against the test images.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hivex.hpp"
+#include "test-util.h"
+
+int
+main ()
+{
+  const char *srcdir = getenv ("srcdir");
+  if (!srcdir)
+    srcdir = ".";
+  std::string images = std::string (srcdir) + "/../images";
+
+  /* Modify the minimal hive in memory and read it back. */
+  {
+    hivex::Hive h (images + "/minimal", hivex::OPEN_WRITE);
+    hivex::Node root = h.root ();
+
+    h.node_add_child (root, "A");
+    hivex::Node b = h.node_add_child (root, "B");
+
+    char dword[4] = { 42, 0, 0, 0 };
+    std::vector<hive_set_value> values = {
+      { (char *) "Dw", hive_t_REG_DWORD, 4, dword }
+    };
+    h.node_set_values (b, values);
+
+    std::vector<std::string> names;
+    for (hivex::Node child : root.children ())
+      names.push_back (child.name ());
+    CHECK (names.size () == 2);
+    CHECK (names[0] == "A");
+    CHECK (names[1] == "B");
+
+    CHECK (!root.child ("C"));
+    CHECK (root.child ("B")->parent () == root);
+
+    auto v = b.value ("Dw");
+    CHECK (v);
+    CHECK (v->get_type () == hivex::type::REG_DWORD);
+    CHECK (v->as<uint32_t> () == 42);
+
+    /* The generated methods take the wrapper objects as handles. */
+    CHECK (h.node_name (b) == "B");
+    CHECK (h.node_path (b) == "\\B");
+    CHECK (h.node_get_value (b, "Dw") == *v);
+    CHECK (!h.node_get_value (b, "Missing"));
+    CHECK (h.value_dword (*v) == 42);
+    CHECK (h.value_key_len (*v) == 2);
+    CHECK (!h.node_get_child (root, "C"));
+    CHECK (h.node_hash (root).size () == 64);
+
+    std::vector<hivex::search_match> matches = h.search ("dw");
+    CHECK (matches.size () == 1);
+    CHECK (matches[0].node == b);
+    CHECK (matches[0].value == *v);
+
+    /* Borrowed data is only available for read-only handles. */
+    bool thrown = false;
+    try {
+      v->data ();
+    }
+    catch (const hivex::error &) {
+      thrown = true;
+    }
+    CHECK (thrown);
+  }
+
+  /* Iterate over the values in the special hive. */
+  {
+    hivex::Hive h (images + "/special");
+    size_t n = 0;
+
+    for (hivex::Node child : h.root ().children ())
+      for (hivex::Value value : child.values ()) {
+        CHECK (value.data ().size () == value.size ());
+        std::vector<char> copy = value.copy ();
+        CHECK (std::equal (copy.begin (), copy.end (),
+                           value.data ().data ()));
+        n++;
+      }
+    CHECK (n > 0);
+  }
+
+  /* Compare two handles on the same hive, sharing a context. */
+  {
+    hivex::Context ctx;
+    hivex::Hive h1 (ctx, images + "/minimal", hivex::OPEN_WRITE);
+    hivex::Hive h2 (ctx, images + "/minimal");
+    h1.node_add_child (h1.root (), "A");
+
+    size_t deleted = 0;
+    h1.diff (h1.root (), h2, h2.root (),
+             [&] (int change, hive_node_h, hive_node_h,
+                  hive_value_h, hive_value_h) {
+               if (change == hivex_diff_node_deleted)
+                 deleted++;
+             });
+    CHECK (deleted == 1);
+
+    /* An exception from the callback reaches the caller. */
+    bool thrown = false;
+    try {
+      h1.diff (h1.root (), h2, h2.root (),
+               [] (int, hive_node_h, hive_node_h,
+                   hive_value_h, hive_value_h) {
+                 throw std::runtime_error ("stop");
+               });
+    }
+    catch (const std::runtime_error &) {
+      thrown = true;
+    }
+    CHECK (thrown);
+
+    CHECK (h2.get_stats ().pages > 0);
+    h2.recover ();
+  }
+
+  /* Opening a missing file throws an error holding errno. */
+  {
+    bool thrown = false;
+    try {
+      hivex::Hive h (images + "/does-not-exist");
+    }
+    catch (const hivex::error &e) {
+      thrown = e.code ().value () == ENOENT;
+    }
+    CHECK (thrown);
+  }
+
+  return 0;
+}
@@ -0,0 +1,142 @@
+/* hivex - test hivex_diff.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+struct counts {
+  size_t changes[6];
+  hive_node_h last_node;
+};
+
+static int
+callback (hive_h *h1, hive_h *h2, void *opaque, int change,
+          hive_node_h node1, hive_node_h node2,
+          hive_value_h value1, hive_value_h value2)
+{
+  struct counts *counts = opaque;
+
+  CHECK (change >= 1 && change <= 5);
+  counts->changes[change]++;
+  counts->last_node = change == hivex_diff_node_deleted ? node1 : node2;
+  return 0;
+}
+
+static int
+stop_callback (hive_h *h1, hive_h *h2, void *opaque, int change,
+               hive_node_h node1, hive_node_h node2,
+               hive_value_h value1, hive_value_h value2)
+{
+  errno = EINTR;
+  return -1;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096];
+  hive_h *h1, *h2;
+  hive_node_h root1, root2, a, b, c;
+  struct counts counts;
+  hive_set_value v1 = { .key = (char *) "v1", .t = hive_t_REG_BINARY,
+                        .len = 3, .value = (char *) "abc" };
+  hive_set_value v2 = { .key = (char *) "V2", .t = hive_t_REG_BINARY,
+                        .len = 3, .value = (char *) "def" };
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/minimal", srcdir);
+
+  h1 = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h1 != NULL);
+  h2 = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h2 != NULL);
+  root1 = hivex_root (h1);
+  root2 = hivex_root (h2);
+
+  /* Identical hives. */
+  memset (&counts, 0, sizeof counts);
+  CHECK (hivex_diff (h1, root1, h2, root2, callback, &counts, 0) == 0);
+  CHECK (counts.changes[hivex_diff_node_added] == 0);
+  CHECK (counts.changes[hivex_diff_value_changed] == 0);
+
+  /* Keys "A" and "B" in both, "C" only in the second.  Key names are
+   * matched ignoring case.
+   */
+  a = hivex_node_add_child (h1, root1, "a");
+  CHECK (a != 0);
+  CHECK (hivex_node_add_child (h1, root1, "B") != 0);
+  CHECK (hivex_node_set_value (h1, a, &v1, 0) == 0);
+  CHECK (hivex_node_set_value (h1, a, &v2, 0) == 0);
+
+  a = hivex_node_add_child (h2, root2, "A");
+  b = hivex_node_add_child (h2, root2, "B");
+  c = hivex_node_add_child (h2, root2, "C");
+  CHECK (a != 0 && b != 0 && c != 0);
+  CHECK (hivex_node_add_child (h2, c, "D") != 0);
+  v1.value = (char *) "xyz";
+  CHECK (hivex_node_set_value (h2, a, &v1, 0) == 0);
+
+  memset (&counts, 0, sizeof counts);
+  CHECK (hivex_diff (h1, root1, h2, root2, callback, &counts, 0) == 0);
+  CHECK (counts.changes[hivex_diff_node_added] == 1);
+  CHECK (counts.changes[hivex_diff_node_deleted] == 0);
+  CHECK (counts.changes[hivex_diff_value_added] == 0);
+  CHECK (counts.changes[hivex_diff_value_deleted] == 1);
+  CHECK (counts.changes[hivex_diff_value_changed] == 1);
+
+  /* The other way round. */
+  memset (&counts, 0, sizeof counts);
+  CHECK (hivex_diff (h2, root2, h1, root1, callback, &counts, 0) == 0);
+  CHECK (counts.changes[hivex_diff_node_deleted] == 1);
+  CHECK (counts.last_node == c);
+  CHECK (counts.changes[hivex_diff_value_added] == 1);
+  CHECK (counts.changes[hivex_diff_value_changed] == 1);
+
+  /* Only ASCII letters are matched ignoring case, so a key whose
+   * name differs only in the case of another letter is reported as
+   * deleted and added.
+   */
+  CHECK (hivex_node_add_child (h1, root1, "\xc3\x84") != 0); /* A umlaut */
+  CHECK (hivex_node_add_child (h2, root2, "\xc3\xa4") != 0); /* a umlaut */
+  memset (&counts, 0, sizeof counts);
+  CHECK (hivex_diff (h1, root1, h2, root2, callback, &counts, 0) == 0);
+  CHECK (counts.changes[hivex_diff_node_added] == 2);
+  CHECK (counts.changes[hivex_diff_node_deleted] == 1);
+
+  /* A callback error stops the comparison. */
+  errno = 0;
+  CHECK (hivex_diff (h1, root1, h2, root2, stop_callback, NULL, 0) == -1);
+  CHECK (errno == EINTR);
+
+  errno = 0;
+  CHECK (hivex_diff (h1, root1, h2, root2, callback, &counts, 0x100) == -1);
+  CHECK (errno == EINVAL);
+
+  CHECK (hivex_close (h1) == 0);
+  CHECK (hivex_close (h2) == 0);
+  return 0;
+}
@@ -0,0 +1,106 @@
+/* hivex - test memory accounting and limits.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+static int
+node_start (hive_h *h, void *opaque, hive_node_h node, const char *name)
+{
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096];
+  hive_h *h;
+  hive_node_h root, node;
+  hive_node_h *children;
+  size_t usage, i, n;
+  char name[32];
+  struct hivex_visitor visitor;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/minimal", srcdir);
+
+  h = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  root = hivex_root (h);
+
+  /* The handle, the bitmap and the copy of the hive are counted. */
+  usage = hivex_memory_usage (h);
+  CHECK (usage > 8192);
+
+  /* A limit below the current usage is refused. */
+  errno = 0;
+  CHECK (hivex_set_memory_limit (h, usage / 2) == -1);
+  CHECK (errno == ENOMEM);
+
+  /* Returned lists are not counted once they have been returned. */
+  children = hivex_node_children (h, root);
+  CHECK (children != NULL);
+  free (children);
+  CHECK (hivex_memory_usage (h) == usage);
+
+  /* With no headroom, anything which allocates fails cleanly. */
+  CHECK (hivex_set_memory_limit (h, usage) == 0);
+  errno = 0;
+  CHECK (hivex_node_children (h, root) == NULL);
+  CHECK (errno == ENOMEM);
+  memset (&visitor, 0, sizeof visitor);
+  visitor.node_start = node_start;
+  errno = 0;
+  CHECK (hivex_visit (h, &visitor, sizeof visitor, NULL, 0) == -1);
+  CHECK (errno == ENOMEM);
+  CHECK (hivex_memory_usage (h) == usage);
+
+  /* Growing the hive is counted and stops at the limit. */
+  CHECK (hivex_set_memory_limit (h, usage + 64 * 1024) == 0);
+  for (i = 0; ; ++i) {
+    snprintf (name, sizeof name, "key%zu", i);
+    node = hivex_node_add_child (h, root, name);
+    if (node == 0)
+      break;
+  }
+  CHECK (errno == ENOMEM);
+  CHECK (i > 0);
+  CHECK (hivex_memory_usage (h) > usage);
+  CHECK (hivex_memory_usage (h) <= usage + 64 * 1024);
+
+  /* The handle is still usable once the limit is lifted. */
+  CHECK (hivex_set_memory_limit (h, 0) == 0);
+  children = hivex_node_children (h, root);
+  CHECK (children != NULL);
+  for (n = 0; children[n] != 0; ++n)
+    ;
+  CHECK (n == i);
+  free (children);
+
+  CHECK (hivex_close (h) == 0);
+  return 0;
+}
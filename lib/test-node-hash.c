@@ -0,0 +1,176 @@
+/* hivex - test subtree hashes.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+static void
+add_key (hive_h *h, const char *name, const char *data)
+{
+  hive_node_h node;
+  hive_set_value value;
+
+  node = hivex_node_add_child (h, hivex_root (h), name);
+  CHECK (node != 0);
+  value.key = (char *) "Data";
+  value.t = hive_t_REG_BINARY;
+  value.len = strlen (data);
+  value.value = (char *) data;
+  CHECK (hivex_node_set_values (h, node, 1, &value, 0) == 0);
+}
+
+static int
+equal_hashes (hive_h *h1, hive_node_h node1, hive_h *h2, hive_node_h node2)
+{
+  char *hash1, *hash2;
+  int r;
+
+  hash1 = hivex_node_hash (h1, node1);
+  CHECK (hash1 != NULL);
+  hash2 = hivex_node_hash (h2, node2);
+  CHECK (hash2 != NULL);
+  r = strcmp (hash1, hash2) == 0;
+  free (hash1);
+  free (hash2);
+  return r;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096], minimal[4096];
+  const char *hashfile = "test-node-hash.dat";
+  hive_h *h, *h2;
+  hive_node_h *children;
+  char *hash, *hash2;
+  size_t i;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/rlenvalue_test_hive",
+            srcdir);
+  snprintf (minimal, sizeof minimal, "%s/../images/minimal", srcdir);
+
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  hash = hivex_node_hash (h, hivex_root (h));
+  CHECK (hash != NULL);
+  CHECK (strlen (hash) == 64);
+  CHECK (strspn (hash, "0123456789abcdef") == 64);
+
+  /* Subkeys were hashed too, and differ from the root. */
+  children = hivex_node_children (h, hivex_root (h));
+  CHECK (children != NULL && children[0] != 0);
+  hash2 = hivex_node_hash (h, children[0]);
+  CHECK (hash2 != NULL);
+  CHECK (strcmp (hash, hash2) != 0);
+  free (hash2);
+
+  errno = 0;
+  CHECK (hivex_node_hash (h, 1) == NULL);
+  CHECK (errno == EINVAL);
+
+  /* Save, and load into a new handle on the same hive. */
+  CHECK (hivex_save_node_hashes (h, hashfile) == 0);
+  CHECK (hivex_close (h) == 0);
+
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_load_node_hashes (h, hashfile) == 0);
+  hash2 = hivex_node_hash (h, hivex_root (h));
+  CHECK (hash2 != NULL);
+  CHECK (strcmp (hash, hash2) == 0);
+  free (hash2);
+  for (i = 0; children[i] != 0; ++i) {
+    h2 = hivex_open (filename, 0);
+    CHECK (h2 != NULL);
+    CHECK (equal_hashes (h, children[i], h2, children[i]));
+    CHECK (hivex_close (h2) == 0);
+  }
+  CHECK (hivex_close (h) == 0);
+  free (children);
+  free (hash);
+
+  /* Hashes saved from another hive are refused. */
+  h = hivex_open (minimal, 0);
+  CHECK (h != NULL);
+  errno = 0;
+  CHECK (hivex_load_node_hashes (h, hashfile) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_close (h) == 0);
+
+  /* So is a truncated file, whatever errno was before the call. */
+  CHECK (truncate (hashfile, 70) == 0);
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  errno = ENOENT;
+  CHECK (hivex_load_node_hashes (h, hashfile) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_close (h) == 0);
+  unlink (hashfile);
+
+  /* Hashes of uncommitted changes are not saved, since they would be
+   * accepted for the unchanged file.
+   */
+  h = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  add_key (h, "New", "hello, world");
+  errno = 0;
+  CHECK (hivex_save_node_hashes (h, hashfile) == -1);
+  CHECK (errno == EBUSY);
+  CHECK (hivex_close (h) == 0);
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  errno = 0;
+  CHECK (hivex_load_node_hashes (h, hashfile) == -1);
+  CHECK (errno == ENOENT);
+  CHECK (hivex_close (h) == 0);
+
+  /* The same keys added in a different order give the same hash. */
+  h = hivex_open (minimal, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  h2 = hivex_open (minimal, HIVEX_OPEN_WRITE);
+  CHECK (h2 != NULL);
+  CHECK (equal_hashes (h, hivex_root (h), h2, hivex_root (h2)));
+  add_key (h, "A", "hello, world");
+  add_key (h, "B", "goodbye");
+  add_key (h2, "B", "goodbye");
+  CHECK (!equal_hashes (h, hivex_root (h), h2, hivex_root (h2)));
+  add_key (h2, "A", "hello, world");
+  CHECK (equal_hashes (h, hivex_root (h), h2, hivex_root (h2)));
+
+  /* Changing data deep in the tree changes the hash of the root. */
+  add_key (h2, "C", "hello, world");
+  add_key (h, "C", "hello, World");
+  CHECK (!equal_hashes (h, hivex_root (h), h2, hivex_root (h2)));
+  CHECK (equal_hashes (h, hivex_node_get_child (h, hivex_root (h), "A"),
+                       h2, hivex_node_get_child (h2, hivex_root (h2), "A")));
+
+  CHECK (hivex_close (h) == 0);
+  CHECK (hivex_close (h2) == 0);
+  return 0;
+}
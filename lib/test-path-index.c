@@ -0,0 +1,110 @@
+/* hivex - test the path index and hivex_cell_owner.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+static int
+path_is (hive_h *h, hive_node_h node, const char *expected)
+{
+  char *path;
+  int r;
+
+  path = hivex_node_path (h, node);
+  CHECK (path != NULL);
+  r = strcmp (path, expected) == 0;
+  free (path);
+  return r;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096];
+  hive_h *h;
+  hive_node_h root, a, b, c, d;
+  hive_value_h *values;
+  hive_set_value value;
+  size_t len;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/minimal", srcdir);
+
+  h = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  root = hivex_root (h);
+  a = hivex_node_add_child (h, root, "A");
+  CHECK (a != 0);
+  b = hivex_node_add_child (h, a, "B");
+  CHECK (b != 0);
+  d = hivex_node_add_child (h, root, "D");
+  CHECK (d != 0);
+  value.key = (char *) "v";
+  value.t = hive_t_REG_BINARY;
+  value.value = (char *) "hello, world";
+  value.len = strlen (value.value);
+  CHECK (hivex_node_set_values (h, b, 1, &value, 0) == 0);
+  CHECK (hivex_node_delete_child (h, d) == 0);
+  values = hivex_node_values (h, b);
+  CHECK (values != NULL && values[0] != 0 && values[1] == 0);
+
+  /* Without the index. */
+  CHECK (path_is (h, root, "\\"));
+  CHECK (path_is (h, b, "\\A\\B"));
+
+  errno = 0;
+  CHECK (hivex_build_path_index (h, 1) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_build_path_index (h, 0) == 0);
+  CHECK (hivex_build_path_index (h, 0) == 0);
+  CHECK (path_is (h, root, "\\"));
+  CHECK (path_is (h, a, "\\A"));
+  CHECK (path_is (h, b, "\\A\\B"));
+
+  /* Every cell of a key belongs to it. */
+  CHECK (hivex_cell_owner (h, root) == root);
+  CHECK (hivex_cell_owner (h, b) == b);
+  CHECK (hivex_cell_owner (h, values[0]) == b);
+  CHECK (hivex_cell_owner (h, hivex_value_data_cell_offset (h, values[0],
+                                                            &len)) == b);
+  CHECK (len >= value.len);
+
+  /* A cell used by a deleted key has no owner. */
+  errno = 0;
+  CHECK (hivex_cell_owner (h, d) == 0);
+  CHECK (errno == ENOENT);
+
+  /* Modifying the hive discards the index, and it is rebuilt. */
+  c = hivex_node_add_child (h, b, "C");
+  CHECK (c != 0);
+  CHECK (path_is (h, c, "\\A\\B\\C"));
+  CHECK (hivex_cell_owner (h, c) == c);
+
+  free (values);
+  CHECK (hivex_close (h) == 0);
+  return 0;
+}
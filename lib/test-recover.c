@@ -0,0 +1,153 @@
+/* hivex - test recovery of deleted keys and values.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+#define HELLO "h\0e\0l\0l\0o\0,\0 \0w\0o\0r\0l\0d\0\0"
+
+static void
+free_recovered (hive_recovered *recs)
+{
+  size_t i;
+
+  for (i = 0; recs[i].kind != 0; ++i) {
+    free (recs[i].name);
+    free (recs[i].value);
+  }
+  free (recs);
+}
+
+static size_t
+count (hive_recovered *recs)
+{
+  size_t n;
+
+  for (n = 0; recs[n].kind != 0; ++n)
+    ;
+  return n;
+}
+
+static const hive_recovered *
+find (hive_recovered *recs, int kind, const char *name)
+{
+  size_t i;
+
+  for (i = 0; recs[i].kind != 0; ++i)
+    if (recs[i].kind == kind && strcmp (recs[i].name, name) == 0)
+      return &recs[i];
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096];
+  hive_h *h;
+  hive_node_h root, a, b;
+  hive_set_value values[2];
+  hive_recovered *recs, *recs1, *recs2;
+  const hive_recovered *rec;
+  size_t mid;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/minimal", srcdir);
+
+  h = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  root = hivex_root (h);
+
+  recs = hivex_recover (h, 0, SIZE_MAX, 0);
+  CHECK (recs != NULL);
+  CHECK (find (recs, hivex_recovered_node, "Deleted") == NULL);
+  free_recovered (recs);
+
+  a = hivex_node_add_child (h, root, "Deleted");
+  CHECK (a != 0);
+  b = hivex_node_add_child (h, a, "Sub");
+  CHECK (b != 0);
+  values[0].key = (char *) "Greeting";
+  values[0].t = hive_t_REG_SZ;
+  values[0].len = sizeof HELLO;
+  values[0].value = (char *) HELLO;
+  values[1].key = (char *) "Count";
+  values[1].t = hive_t_REG_DWORD;
+  values[1].len = 4;
+  values[1].value = (char *) "\x2a\x00\x00\x00";
+  CHECK (hivex_node_set_values (h, b, 2, values, 0) == 0);
+  CHECK (hivex_node_delete_child (h, a) == 0);
+
+  recs = hivex_recover (h, 0, SIZE_MAX, 0);
+  CHECK (recs != NULL);
+
+  rec = find (recs, hivex_recovered_node, "Deleted");
+  CHECK (rec != NULL);
+  CHECK (rec->offset == a);
+  CHECK (rec->parent == root);
+  CHECK (rec->flags & HIVEX_RECOVERED_PARENT_LIVE);
+
+  rec = find (recs, hivex_recovered_node, "Sub");
+  CHECK (rec != NULL);
+  CHECK (rec->offset == b);
+  CHECK (rec->parent == a);
+  CHECK (!(rec->flags & HIVEX_RECOVERED_PARENT_LIVE));
+
+  rec = find (recs, hivex_recovered_value, "Greeting");
+  CHECK (rec != NULL);
+  CHECK (rec->t == hive_t_REG_SZ);
+  CHECK (rec->flags & HIVEX_RECOVERED_DATA);
+  CHECK (rec->len == sizeof HELLO);
+  CHECK (memcmp (rec->value, HELLO, sizeof HELLO) == 0);
+
+  rec = find (recs, hivex_recovered_value, "Count");
+  CHECK (rec != NULL);
+  CHECK (rec->t == hive_t_REG_DWORD);
+  CHECK (rec->flags & HIVEX_RECOVERED_DATA);
+  CHECK (rec->len == 4);
+  CHECK (memcmp (rec->value, "\x2a\x00\x00\x00", 4) == 0);
+
+  /* Splitting the hive into two ranges finds the same records. */
+  mid = recs[count (recs) / 2].offset;
+  recs1 = hivex_recover (h, 0, mid, 0);
+  CHECK (recs1 != NULL);
+  recs2 = hivex_recover (h, mid, SIZE_MAX, 0);
+  CHECK (recs2 != NULL);
+  CHECK (count (recs1) + count (recs2) == count (recs));
+  CHECK (recs1[0].offset == recs[0].offset);
+  CHECK (recs2[0].offset == mid);
+  free_recovered (recs1);
+  free_recovered (recs2);
+  free_recovered (recs);
+
+  errno = 0;
+  CHECK (hivex_recover (h, 0, SIZE_MAX, 1) == NULL);
+  CHECK (errno == EINVAL);
+
+  CHECK (hivex_close (h) == 0);
+  return 0;
+}
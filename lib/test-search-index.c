@@ -0,0 +1,202 @@
+/* hivex - test the substring search index.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+/* Strings as UTF-16LE, with the terminating zero. */
+#define SYSTEM32 "C\0:\0\\\0W\0i\0n\0d\0o\0w\0s\0\\\0S\0y\0s\0t\0e\0m\0003\0002\0\0"
+#define HOSTS "h\0o\0s\0t\0s\0\0\0l\0m\0h\0o\0s\0t\0s\0\0\0\0"
+#define URL "h\0t\0t\0p\0:\0/\0/\0w\0w\0w\0.\0e\0x\0a\0m\0p\0l\0e\0.\0c\0o\0m\0/\0\0"
+
+static size_t
+count (hive_search_match *matches)
+{
+  size_t n;
+
+  for (n = 0; matches[n].node != 0; ++n)
+    ;
+  return n;
+}
+
+/* Search and return the number of matches. */
+static size_t
+search (hive_h *h, const char *str, int flags)
+{
+  hive_search_match *matches;
+  size_t n;
+
+  matches = hivex_search (h, str, flags);
+  CHECK (matches != NULL);
+  n = count (matches);
+  free (matches);
+  return n;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char minimal[4096];
+  const char *hivefile = "test-search-index.hive";
+  const char *indexfile = "test-search-index.idx";
+  hive_h *h, *h2;
+  hive_node_h a, b;
+  hive_set_value values[3];
+  hive_search_match *matches, *matches2;
+  FILE *fp;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (minimal, sizeof minimal, "%s/../images/minimal", srcdir);
+
+  h = hivex_open (minimal, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  a = hivex_node_add_child (h, hivex_root (h), "A");
+  CHECK (a != 0);
+  b = hivex_node_add_child (h, hivex_root (h), "B");
+  CHECK (b != 0);
+
+  values[0].key = (char *) "SystemPath";
+  values[0].t = hive_t_REG_SZ;
+  values[0].len = sizeof SYSTEM32 - 1;
+  values[0].value = (char *) SYSTEM32;
+  values[1].key = (char *) "Hosts";
+  values[1].t = hive_t_REG_MULTI_SZ;
+  values[1].len = sizeof HOSTS - 1;
+  values[1].value = (char *) HOSTS;
+  values[2].key = (char *) "Count";
+  values[2].t = hive_t_REG_DWORD;
+  values[2].len = 4;
+  values[2].value = (char *) "\x01\x00\x00\x00";
+  CHECK (hivex_node_set_values (h, a, 3, values, 0) == 0);
+
+  values[0].key = (char *) "Homepage";
+  values[0].t = hive_t_REG_SZ;
+  values[0].len = sizeof URL - 1;
+  values[0].value = (char *) URL;
+  CHECK (hivex_node_set_values (h, b, 1, values, 0) == 0);
+
+  /* Names and data, ignoring case. */
+  matches = hivex_search (h, "system32", 0);
+  CHECK (matches != NULL);
+  CHECK (count (matches) == 1);
+  CHECK (matches[0].node == a);
+  CHECK (matches[0].value == hivex_node_get_value (h, a, "SystemPath"));
+  free (matches);
+
+  CHECK (search (h, "SYSTEM", 0) == 1);
+  CHECK (search (h, "SYSTEM", HIVEX_SEARCH_NAMES) == 1);
+  CHECK (search (h, "SYSTEM", HIVEX_SEARCH_DATA) == 1);
+  CHECK (search (h, "path", HIVEX_SEARCH_DATA) == 0);
+  CHECK (search (h, "example.com/", 0) == 1);
+  CHECK (search (h, "example.org", 0) == 0);
+
+  /* Each string of a REG_MULTI_SZ is searched, but not across the
+   * boundary between them.
+   */
+  CHECK (search (h, "lmhosts", HIVEX_SEARCH_DATA) == 1);
+  CHECK (search (h, "hosts", 0) == 1);
+  CHECK (search (h, "tslm", 0) == 0);
+
+  /* Short strings don't use the index. */
+  CHECK (search (h, "o", HIVEX_SEARCH_NAMES) == 3);
+  CHECK (search (h, "", 0) == 4);
+
+  errno = 0;
+  CHECK (hivex_search (h, "a", 4) == NULL);
+  CHECK (errno == EINVAL);
+
+  /* Modifying the hive discards the index, and it is rebuilt. */
+  CHECK (hivex_node_delete_child (h, b) == 0);
+  CHECK (search (h, "example", 0) == 0);
+
+  CHECK (hivex_commit (h, hivefile, 0) == 0);
+  CHECK (hivex_close (h) == 0);
+
+  /* Save, and load into a new handle on the same hive. */
+  h = hivex_open (hivefile, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_save_search_index (h, indexfile) == 0);
+  matches = hivex_search (h, "system32", 0);
+  CHECK (matches != NULL);
+
+  h2 = hivex_open (hivefile, 0);
+  CHECK (h2 != NULL);
+  CHECK (hivex_load_search_index (h2, indexfile) == 0);
+  matches2 = hivex_search (h2, "system32", 0);
+  CHECK (matches2 != NULL);
+  CHECK (count (matches) == 1 && count (matches2) == 1);
+  CHECK (memcmp (matches, matches2, 2 * sizeof *matches) == 0);
+  CHECK (search (h2, "hosts", 0) == 1);
+  free (matches);
+  free (matches2);
+  CHECK (hivex_close (h) == 0);
+  CHECK (hivex_close (h2) == 0);
+
+  /* An index built from another hive is refused. */
+  h = hivex_open (minimal, 0);
+  CHECK (h != NULL);
+  errno = 0;
+  CHECK (hivex_load_search_index (h, indexfile) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_close (h) == 0);
+
+  /* So is a truncated file, whatever errno was before the call. */
+  fp = fopen (indexfile, "r+");
+  CHECK (fp != NULL);
+  CHECK (fseek (fp, 0, SEEK_END) == 0);
+  CHECK (ftruncate (fileno (fp), ftell (fp) - 1) == 0);
+  CHECK (fclose (fp) == 0);
+  h = hivex_open (hivefile, 0);
+  CHECK (h != NULL);
+  errno = ENOENT;
+  CHECK (hivex_load_search_index (h, indexfile) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_close (h) == 0);
+
+  /* An index of uncommitted changes is not saved, since it would be
+   * accepted for the unchanged file.
+   */
+  unlink (indexfile);
+  h = hivex_open (hivefile, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  CHECK (hivex_node_add_child (h, hivex_root (h), "New") != 0);
+  errno = 0;
+  CHECK (hivex_save_search_index (h, indexfile) == -1);
+  CHECK (errno == EBUSY);
+  CHECK (hivex_close (h) == 0);
+  h = hivex_open (hivefile, 0);
+  CHECK (h != NULL);
+  errno = 0;
+  CHECK (hivex_load_search_index (h, indexfile) == -1);
+  CHECK (errno == ENOENT);
+  CHECK (hivex_close (h) == 0);
+
+  unlink (indexfile);
+  unlink (hivefile);
+  return 0;
+}
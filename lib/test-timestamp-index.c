@@ -0,0 +1,191 @@
+/* hivex - test the last-write timestamp index.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "hivex.h"
+#include "test-util.h"
+
+static size_t
+count (hive_node_h *nodes)
+{
+  size_t n;
+
+  for (n = 0; nodes[n] != 0; ++n)
+    ;
+  return n;
+}
+
+static int
+node_start (hive_h *h, void *nrp, hive_node_h node, const char *name)
+{
+  (*(size_t *) nrp)++;
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *srcdir = getenv ("srcdir");
+  char filename[4096], other[4096];
+  const char *indexfile = "test-timestamp-index.idx";
+  const char *hivefile = "test-timestamp-index.hive";
+  hive_h *h;
+  hive_node_h *all, *nodes;
+  struct hivex_visitor visitor;
+  size_t nr_keys = 0, i, n;
+  int64_t t, first, last;
+  FILE *fp;
+
+  if (!srcdir)
+    srcdir = ".";
+  snprintf (filename, sizeof filename, "%s/../images/rlenvalue_test_hive",
+            srcdir);
+  snprintf (other, sizeof other, "%s/../images/minimal", srcdir);
+
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+
+  memset (&visitor, 0, sizeof visitor);
+  visitor.node_start = node_start;
+  CHECK (hivex_visit (h, &visitor, sizeof visitor, &nr_keys, 0) == 0);
+  CHECK (nr_keys > 1);
+
+  /* The whole range returns every key, oldest first. */
+  all = hivex_nodes_modified_between (h, INT64_MIN, INT64_MAX);
+  CHECK (all != NULL);
+  CHECK (count (all) == nr_keys);
+  for (i = 1; all[i] != 0; ++i)
+    CHECK (hivex_node_timestamp (h, all[i-1]) <=
+           hivex_node_timestamp (h, all[i]));
+  first = hivex_node_timestamp (h, all[0]);
+  last = hivex_node_timestamp (h, all[nr_keys-1]);
+
+  /* A range covering one timestamp returns exactly the keys with it. */
+  t = hivex_node_timestamp (h, all[nr_keys / 2]);
+  nodes = hivex_nodes_modified_between (h, t, t);
+  CHECK (nodes != NULL);
+  for (i = n = 0; all[i] != 0; ++i)
+    if (hivex_node_timestamp (h, all[i]) == t)
+      n++;
+  CHECK (count (nodes) == n);
+  for (i = 0; nodes[i] != 0; ++i)
+    CHECK (hivex_node_timestamp (h, nodes[i]) == t);
+  free (nodes);
+
+  nodes = hivex_nodes_modified_between (h, last + 1, INT64_MAX);
+  CHECK (nodes != NULL && count (nodes) == 0);
+  free (nodes);
+  nodes = hivex_nodes_modified_between (h, last, first - 1);
+  CHECK (nodes != NULL && count (nodes) == 0);
+  free (nodes);
+
+  /* Most recent, newest first. */
+  nodes = hivex_nodes_most_recent (h, 2);
+  CHECK (nodes != NULL && count (nodes) == 2);
+  CHECK (hivex_node_timestamp (h, nodes[0]) == last);
+  CHECK (hivex_node_timestamp (h, nodes[1]) <= last);
+  free (nodes);
+  nodes = hivex_nodes_most_recent (h, nr_keys + 10);
+  CHECK (nodes != NULL && count (nodes) == nr_keys);
+  free (nodes);
+
+  /* Save, and load into a new handle on the same hive. */
+  CHECK (hivex_save_timestamp_index (h, indexfile) == 0);
+  CHECK (hivex_close (h) == 0);
+
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_load_timestamp_index (h, indexfile) == 0);
+  nodes = hivex_nodes_modified_between (h, INT64_MIN, INT64_MAX);
+  CHECK (nodes != NULL);
+  CHECK (count (nodes) == nr_keys);
+  CHECK (memcmp (nodes, all, nr_keys * sizeof (hive_node_h)) == 0);
+  free (nodes);
+  CHECK (hivex_close (h) == 0);
+
+  /* An index built from another hive is refused. */
+  h = hivex_open (other, 0);
+  CHECK (h != NULL);
+  errno = 0;
+  CHECK (hivex_load_timestamp_index (h, indexfile) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_close (h) == 0);
+
+  /* So is a truncated file, whatever errno was before the call. */
+  fp = fopen (indexfile, "r+");
+  CHECK (fp != NULL);
+  CHECK (ftruncate (fileno (fp), 70) == 0);
+  CHECK (fclose (fp) == 0);
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  errno = ENOENT;
+  CHECK (hivex_load_timestamp_index (h, indexfile) == -1);
+  CHECK (errno == EINVAL);
+  CHECK (hivex_close (h) == 0);
+
+  /* A handle with uncommitted changes does not match the file, so
+   * it can neither save an index nor load one.
+   */
+  unlink (indexfile);
+  h = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  CHECK (hivex_node_add_child (h, hivex_root (h), "New") != 0);
+  errno = 0;
+  CHECK (hivex_save_timestamp_index (h, indexfile) == -1);
+  CHECK (errno == EBUSY);
+  CHECK (hivex_close (h) == 0);
+  h = hivex_open (filename, 0);
+  CHECK (h != NULL);
+  errno = 0;
+  CHECK (hivex_load_timestamp_index (h, indexfile) == -1);
+  CHECK (errno == ENOENT);
+  CHECK (hivex_save_timestamp_index (h, indexfile) == 0);
+  CHECK (hivex_close (h) == 0);
+
+  h = hivex_open (filename, HIVEX_OPEN_WRITE);
+  CHECK (h != NULL);
+  CHECK (hivex_node_add_child (h, hivex_root (h), "New") != 0);
+  errno = 0;
+  CHECK (hivex_load_timestamp_index (h, indexfile) == -1);
+  CHECK (errno == EBUSY);
+
+  /* Once committed, the handle matches the new file again. */
+  CHECK (hivex_commit (h, hivefile, 0) == 0);
+  CHECK (hivex_save_timestamp_index (h, indexfile) == 0);
+  CHECK (hivex_close (h) == 0);
+  h = hivex_open (hivefile, 0);
+  CHECK (h != NULL);
+  CHECK (hivex_load_timestamp_index (h, indexfile) == 0);
+  nodes = hivex_nodes_modified_between (h, INT64_MIN, INT64_MAX);
+  CHECK (nodes != NULL && count (nodes) == nr_keys + 1);
+  free (nodes);
+  CHECK (hivex_close (h) == 0);
+
+  unlink (hivefile);
+  unlink (indexfile);
+  free (all);
+  return 0;
+}
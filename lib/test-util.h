@@ -0,0 +1,35 @@
+/* hivex - helpers shared by the tests in this directory.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef HIVEX_TEST_UTIL_H_
+#define HIVEX_TEST_UTIL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Fail the test, naming the line, if expr is false. */
+#define CHECK(expr)                                                     \
+  do {                                                                  \
+    if (!(expr)) {                                                      \
+      fprintf (stderr, "%s:%d: check failed: %s\n",                     \
+               __FILE__, __LINE__, #expr);                              \
+      exit (EXIT_FAILURE);                                              \
+    }                                                                   \
+  } while (0)
+
+#endif /* HIVEX_TEST_UTIL_H_ */
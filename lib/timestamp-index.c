@@ -0,0 +1,377 @@
+/* hivex - Windows Registry "hive" extraction library.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * See file LICENSE for the full license.
+ */
+
+/* Last-write timestamp index.
+ *
+ * This is an array of (timestamp, nk offset) pairs for every key
+ * reachable from the root, sorted by timestamp and then offset, so
+ * that range and most-recent queries are a binary search.  It can be
+ * saved to a file and loaded again later, so that a program which
+ * builds timelines over many hives only has to walk each hive once.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "full-write.h"
+
+#include "hivex.h"
+#include "hivex-internal.h"
+
+struct timestamp_entry {
+  int64_t timestamp;
+  hive_node_h node;
+};
+
+struct timestamp_index {
+  struct timestamp_entry *entries;
+  size_t nr_entries, alloc;
+};
+
+/* Format of the saved index: the header, followed by nr_entries
+ * entries sorted by timestamp and then offset.
+ */
+#define TIMESTAMP_INDEX_MAGIC "hivexTSI"
+#define TIMESTAMP_INDEX_VERSION 1
+
+struct timestamp_index_header {
+  struct sidecar_header common; /* "hivexTSI", version 1 */
+  uint64_t nr_entries;
+} __attribute__((__packed__));
+
+struct timestamp_index_entry {
+  int64_t timestamp;
+  uint64_t node;
+} __attribute__((__packed__));
+
+static void
+free_index (hive_h *h, struct timestamp_index *idx)
+{
+  if (idx) {
+    _hivex_free (h, idx->entries,
+                 idx->alloc * sizeof (struct timestamp_entry));
+    _hivex_free (h, idx, sizeof *idx);
+  }
+}
+
+void
+_hivex_free_timestamp_index (hive_h *h)
+{
+  free_index (h, h->timestamp_index);
+  h->timestamp_index = NULL;
+}
+
+static int
+add_entry (hive_h *h, struct timestamp_index *idx, hive_node_h node)
+{
+  if (idx->nr_entries >= idx->alloc) {
+    size_t new_alloc = idx->alloc ? idx->alloc * 2 : 256;
+    struct timestamp_entry *p;
+
+    p = _hivex_realloc (h, idx->entries,
+                        idx->alloc * sizeof (struct timestamp_entry),
+                        new_alloc * sizeof (struct timestamp_entry));
+    if (p == NULL)
+      return -1;
+    idx->entries = p;
+    idx->alloc = new_alloc;
+  }
+
+  struct ntreg_nk_record *nk =
+    (struct ntreg_nk_record *) ((char *) h->addr + node);
+  idx->entries[idx->nr_entries].timestamp = le64toh (nk->timestamp);
+  idx->entries[idx->nr_entries].node = node;
+  idx->nr_entries++;
+  return 0;
+}
+
+static int
+compare_entries (const void *av, const void *bv)
+{
+  const struct timestamp_entry *a = av, *b = bv;
+
+  if (a->timestamp != b->timestamp)
+    return a->timestamp < b->timestamp ? -1 : 1;
+  return a->node < b->node ? -1 : a->node > b->node;
+}
+
+int
+hivex_build_timestamp_index (hive_h *h, int flags)
+{
+  struct timestamp_index *idx;
+  size_t unvisited_size, i, j;
+  char *unvisited = NULL;
+  hive_node_h *children;
+
+  if (flags != 0) {
+    SET_ERRNO (EINVAL, "flags != 0");
+    return -1;
+  }
+
+  if (h->timestamp_index)
+    return 0;
+
+  idx = _hivex_calloc (h, 1, sizeof *idx);
+  if (idx == NULL)
+    return -1;
+
+  unvisited_size = 1 + h->size / 32;
+  unvisited = _hivex_malloc (h, unvisited_size);
+  if (unvisited == NULL)
+    goto error;
+  memcpy (unvisited, h->bitmap, unvisited_size);
+
+  /* Breadth first walk from the root, using the entries as the
+   * queue.  Subtrees which cannot be read are skipped.
+   */
+  if (add_entry (h, idx, h->rootoffs) == -1)
+    goto error;
+  BITMAP_CLR (unvisited, h->rootoffs);
+
+  for (i = 0; i < idx->nr_entries; ++i) {
+    if (_hivex_get_children (h, idx->entries[i].node,
+                             &children, NULL, 0) == -1)
+      continue;
+    for (j = 0; children[j] != 0; ++j) {
+      if (!BITMAP_TST (unvisited, children[j]))
+        continue;
+      BITMAP_CLR (unvisited, children[j]);
+      if (add_entry (h, idx, children[j]) == -1) {
+        free (children);
+        goto error;
+      }
+    }
+    free (children);
+  }
+
+  _hivex_free (h, unvisited, unvisited_size);
+
+  qsort (idx->entries, idx->nr_entries, sizeof (struct timestamp_entry),
+         compare_entries);
+
+  DEBUG (2, "timestamp index: %zu keys", idx->nr_entries);
+  h->timestamp_index = idx;
+  return 0;
+
+ error:;
+  int err = errno;
+  if (unvisited)
+    _hivex_free (h, unvisited, unvisited_size);
+  free_index (h, idx);
+  errno = err;
+  return -1;
+}
+
+/* Return the index of the first entry with timestamp >= t. */
+static size_t
+lower_bound (struct timestamp_index *idx, int64_t t)
+{
+  size_t lo = 0, hi = idx->nr_entries;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (idx->entries[mid].timestamp < t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+hive_node_h *
+hivex_nodes_modified_between (hive_h *h, int64_t from, int64_t to)
+{
+  struct timestamp_index *idx;
+  offset_list nodes;
+  hive_node_h *ret = NULL;
+  size_t start, end, i;
+
+  if (hivex_build_timestamp_index (h, 0) == -1)
+    return NULL;
+  idx = h->timestamp_index;
+
+  start = lower_bound (idx, from);
+  end = start;
+  if (to >= from)
+    end = to == INT64_MAX ? idx->nr_entries : lower_bound (idx, to + 1);
+
+  _hivex_init_offset_list (h, &nodes);
+  if (_hivex_grow_offset_list (&nodes, end - start + 1) == -1)
+    goto out;
+  for (i = start; i < end; ++i)
+    if (_hivex_add_to_offset_list (&nodes, idx->entries[i].node) == -1)
+      goto out;
+
+  ret = _hivex_return_offset_list (&nodes);
+
+ out:
+  _hivex_free_offset_list (&nodes);
+  return ret;
+}
+
+hive_node_h *
+hivex_nodes_most_recent (hive_h *h, size_t n)
+{
+  struct timestamp_index *idx;
+  offset_list nodes;
+  hive_node_h *ret = NULL;
+  size_t i;
+
+  if (hivex_build_timestamp_index (h, 0) == -1)
+    return NULL;
+  idx = h->timestamp_index;
+
+  if (n > idx->nr_entries)
+    n = idx->nr_entries;
+
+  _hivex_init_offset_list (h, &nodes);
+  if (_hivex_grow_offset_list (&nodes, n + 1) == -1)
+    goto out;
+  for (i = 0; i < n; ++i) {
+    hive_node_h node = idx->entries[idx->nr_entries - 1 - i].node;
+    if (_hivex_add_to_offset_list (&nodes, node) == -1)
+      goto out;
+  }
+
+  ret = _hivex_return_offset_list (&nodes);
+
+ out:
+  _hivex_free_offset_list (&nodes);
+  return ret;
+}
+
+int
+hivex_save_timestamp_index (hive_h *h, const char *filename)
+{
+  struct timestamp_index *idx;
+  struct timestamp_index_header hdr;
+  struct timestamp_index_entry buf[256];
+  size_t i, n;
+  int fd, err;
+
+  if (hivex_build_timestamp_index (h, 0) == -1)
+    return -1;
+  idx = h->timestamp_index;
+
+  hdr.nr_entries = htole64 (idx->nr_entries);
+  fd = _hivex_sidecar_create (h, filename, TIMESTAMP_INDEX_MAGIC,
+                              TIMESTAMP_INDEX_VERSION, &hdr, sizeof hdr);
+  if (fd == -1)
+    return -1;
+
+  for (i = 0; i < idx->nr_entries; i += n) {
+    size_t j;
+
+    n = idx->nr_entries - i;
+    if (n > sizeof buf / sizeof buf[0])
+      n = sizeof buf / sizeof buf[0];
+    for (j = 0; j < n; ++j) {
+      buf[j].timestamp = htole64 (idx->entries[i+j].timestamp);
+      buf[j].node = htole64 (idx->entries[i+j].node);
+    }
+    if (full_write (fd, buf, n * sizeof buf[0]) != n * sizeof buf[0])
+      goto error;
+  }
+
+  if (close (fd) == -1)
+    return -1;
+  return 0;
+
+ error:
+  err = errno;
+  close (fd);
+  errno = err;
+  return -1;
+}
+
+int
+hivex_load_timestamp_index (hive_h *h, const char *filename)
+{
+  struct timestamp_index *idx = NULL;
+  struct timestamp_index_header hdr;
+  struct timestamp_index_entry buf[256];
+  uint64_t nr;
+  size_t i, n;
+  int fd, err;
+
+  fd = _hivex_sidecar_open (h, filename, TIMESTAMP_INDEX_MAGIC,
+                            TIMESTAMP_INDEX_VERSION, &hdr, sizeof hdr);
+  if (fd == -1)
+    return -1;
+
+  nr = le64toh (hdr.nr_entries);
+  /* Every key is at least 0x50 bytes. */
+  if (nr > h->size / 0x50) {
+    SET_ERRNO (EINVAL, "%s: too many entries (%" PRIu64 ")", filename, nr);
+    goto error;
+  }
+
+  idx = _hivex_calloc (h, 1, sizeof *idx);
+  if (idx == NULL)
+    goto error;
+  idx->entries =
+    _hivex_malloc (h, (nr > 0 ? nr : 1) * sizeof (struct timestamp_entry));
+  if (idx->entries == NULL)
+    goto error;
+  idx->alloc = nr > 0 ? nr : 1;
+
+  for (i = 0; i < nr; i += n) {
+    size_t j;
+
+    n = nr - i;
+    if (n > sizeof buf / sizeof buf[0])
+      n = sizeof buf / sizeof buf[0];
+    if (_hivex_sidecar_read (h, fd, filename,
+                             buf, n * sizeof buf[0]) == -1)
+      goto error;
+    for (j = 0; j < n; ++j) {
+      struct timestamp_entry *e = &idx->entries[i+j];
+
+      e->timestamp = le64toh (buf[j].timestamp);
+      e->node = le64toh (buf[j].node);
+      /* Don't trust the file: the offsets are used by callers as
+       * node handles, and binary search relies on the order.
+       */
+      if (!IS_VALID_BLOCK (h, e->node) || !block_id_eq (h, e->node, "nk") ||
+          (i+j > 0 && compare_entries (e - 1, e) >= 0)) {
+        SET_ERRNO (EINVAL, "%s: entry %zu is invalid", filename, i+j);
+        goto error;
+      }
+    }
+    idx->nr_entries += n;
+  }
+
+  close (fd);
+
+  _hivex_free_timestamp_index (h);
+  h->timestamp_index = idx;
+  return 0;
+
+ error:
+  err = errno;
+  close (fd);
+  free_index (h, idx);
+  errno = err;
+  return -1;
+}
@@ -29,11 +29,15 @@
 #include "hivex.h"
 #include "hivex-internal.h"
 
-char *
-_hivex_recode (const char *input_encoding, const char *input, size_t input_len,
-               const char *output_encoding, size_t *output_len)
+static char *
+recode (hive_h *h,
+        const char *input_encoding, const char *input, size_t input_len,
+        const char *output_encoding, size_t *output_len)
 {
-  iconv_t ic = iconv_open (output_encoding, input_encoding);
+  STATS_INC (recode_calls);
+  STATS_ADD (recode_bytes, input_len);
+
+  iconv_t ic = _hivex_context_iconv (h, output_encoding, input_encoding);
   if (ic == (iconv_t) -1)
     return NULL;
 
@@ -44,13 +48,9 @@ _hivex_recode (const char *input_encoding, const char *input, size_t input_len,
  again:;
   size_t inlen = input_len;
   size_t outlen = outalloc;
-  char *out = malloc (outlen + 1);
-  if (out == NULL) {
-    int err = errno;
-    iconv_close (ic);
-    errno = err;
+  char *out = _hivex_malloc_for_caller (h, outlen + 1);
+  if (out == NULL)
     return NULL;
-  }
   const char *inp = input;
   char *outp = out;
 
@@ -63,16 +63,15 @@ _hivex_recode (const char *input_encoding, const char *input, size_t input_len,
       free (out);
       outalloc *= 2;
       if (outalloc < prev) {
-        iconv_close (ic);
         errno = err;
         return NULL;
       }
+      iconv (ic, NULL, NULL, NULL, NULL);
       goto again;
     }
     else {
       /* Else some conversion failure, eg. EILSEQ, EINVAL. */
       int err = errno;
-      iconv_close (ic);
       free (out);
       errno = err;
       return NULL;
@@ -80,27 +79,42 @@ _hivex_recode (const char *input_encoding, const char *input, size_t input_len,
   }
 
   *outp = '\0';
-  iconv_close (ic);
   if (output_len != NULL)
     *output_len = outp - out;
 
   return out;
 }
 
+char *
+_hivex_recode (hive_h *h,
+               const char *input_encoding, const char *input, size_t input_len,
+               const char *output_encoding, size_t *output_len)
+{
+  char *r;
+  size_t len = 0;
+
+  PROBE3 (recode__start, input_encoding, output_encoding, input_len);
+  r = recode (h, input_encoding, input, input_len, output_encoding, &len);
+  PROBE2 (recode__done, input_len, r ? len : 0);
+  if (r && output_len != NULL)
+    *output_len = len;
+  return r;
+}
+
 /* Encode a given UTF-8 string to Latin1 (preferred) or UTF-16 for
  * storing in the hive file, as needed.
  */
 char*
-_hivex_encode_string(const char *str, size_t *size, int *utf16)
+_hivex_encode_string(hive_h *h, const char *str, size_t *size, int *utf16)
 {
   char* outstr;
   *utf16 = 0;
-  outstr = _hivex_recode ("UTF-8", str, strlen(str),
+  outstr = _hivex_recode (h, "UTF-8", str, strlen(str),
                           "LATIN1", size);
   if (outstr != NULL)
     return outstr;
   *utf16 = 1;
-  outstr = _hivex_recode ("UTF-8", str, strlen(str),
+  outstr = _hivex_recode (h, "UTF-8", str, strlen(str),
                           "UTF-16LE", size);
   return outstr;
 }
@@ -124,11 +138,11 @@ _hivex_utf16_string_len_in_bytes_max (const char *str, size_t len)
 }
 
 size_t
-_hivex_utf8_strlen (const char* str, size_t len, int utf16)
+_hivex_utf8_strlen (hive_h *h, const char* str, size_t len, int utf16)
 {
   const char *encoding = utf16 ? "UTF-16LE" : "LATIN1";
   size_t ret = 0;
-  char *buf = _hivex_recode(encoding, str, len, "UTF-8", &ret);
+  char *buf = _hivex_recode(h, encoding, str, len, "UTF-8", &ret);
   free(buf);
   return ret;
 }
@@ -22,10 +22,24 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "full-read.h"
+#include "full-write.h"
 
 #include "hivex.h"
 #include "hivex-internal.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 void
 _hivex_free_strings (char **argv)
 {
@@ -37,3 +51,211 @@ _hivex_free_strings (char **argv)
     free (argv);
   }
 }
+
+void
+_hivex_free_node_named_list (hive_node_named *list)
+{
+  if (list) {
+    size_t i;
+
+    for (i = 0; list[i].name != NULL; ++i)
+      free (list[i].name);
+    free (list);
+  }
+}
+
+void
+_hivex_free_value_full_list (hive_value_full *list)
+{
+  if (list) {
+    size_t i;
+
+    for (i = 0; list[i].key != NULL; ++i) {
+      free (list[i].key);
+      free (list[i].value);
+    }
+    free (list);
+  }
+}
+
+void
+_hivex_drop_indexes (hive_h *h)
+{
+  _hivex_free_path_index (h);
+  _hivex_free_timestamp_index (h);
+  _hivex_free_node_hashes (h);
+  _hivex_free_search_index (h);
+}
+
+void
+_hivex_get_identity (hive_h *h, struct hive_identity *id)
+{
+  memset (id, 0, sizeof *id);
+  id->sequence1 = h->hdr->sequence1;
+  id->sequence2 = h->hdr->sequence2;
+  id->csum = h->hdr->csum;
+  id->last_modified = h->hdr->last_modified;
+  id->size = htole64 (h->size);
+  id->rootoffs = htole64 (h->rootoffs);
+}
+
+static void
+make_sidecar_header (hive_h *h, struct sidecar_header *hdr,
+                     const char *magic, uint32_t version)
+{
+  memcpy (hdr->magic, magic, sizeof hdr->magic);
+  hdr->version = htole32 (version);
+  _hivex_get_identity (h, &hdr->id);
+}
+
+/* The identity is taken from the header, which does not describe
+ * changes that have not been committed yet.
+ */
+static int
+check_not_dirty (hive_h *h)
+{
+  if (h->dirty) {
+    SET_ERRNO (EBUSY, "the hive has uncommitted changes");
+    return -1;
+  }
+  return 0;
+}
+
+/* Create a file derived from the hive.  hdr (len bytes) starts with
+ * a struct sidecar_header, which is filled in here; the caller fills
+ * in the rest.  The header is written and the file descriptor is
+ * returned, or -1 on error (EBUSY if the hive has uncommitted
+ * changes).
+ */
+int
+_hivex_sidecar_create (hive_h *h, const char *filename,
+                       const char *magic, uint32_t version,
+                       void *hdr, size_t len)
+{
+  int fd, err;
+
+  if (check_not_dirty (h) == -1)
+    return -1;
+
+#ifdef O_CLOEXEC
+  fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC|O_BINARY,
+             0666);
+#else
+  fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_BINARY, 0666);
+#endif
+  if (fd == -1)
+    return -1;
+
+  make_sidecar_header (h, hdr, magic, version);
+  if (full_write (fd, hdr, len) != len) {
+    err = errno;
+    close (fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+/* Open a file created by _hivex_sidecar_create and read its header
+ * (len bytes) into hdr.  Returns the file descriptor, or -1 with
+ * errno set to EINVAL if the file is not of the expected kind and
+ * version, was built from a different hive, or is truncated, or to
+ * EBUSY if the hive has uncommitted changes.
+ */
+int
+_hivex_sidecar_open (hive_h *h, const char *filename,
+                     const char *magic, uint32_t version,
+                     void *hdr, size_t len)
+{
+  struct sidecar_header expected;
+  const struct sidecar_header *got = hdr;
+  int fd, err;
+
+  if (check_not_dirty (h) == -1)
+    return -1;
+
+#ifdef O_CLOEXEC
+  fd = open (filename, O_RDONLY|O_CLOEXEC|O_BINARY);
+#else
+  fd = open (filename, O_RDONLY|O_BINARY);
+#endif
+  if (fd == -1)
+    return -1;
+
+  if (_hivex_sidecar_read (h, fd, filename, hdr, len) == -1)
+    goto error;
+
+  make_sidecar_header (h, &expected, magic, version);
+  if (memcmp (got->magic, expected.magic, sizeof got->magic) != 0 ||
+      got->version != expected.version) {
+    SET_ERRNO (EINVAL, "%s: not a file of type %.8s version %" PRIu32,
+               filename, magic, version);
+    goto error;
+  }
+  if (memcmp (&got->id, &expected.id, sizeof got->id) != 0) {
+    SET_ERRNO (EINVAL, "%s: file was built from a different hive",
+               filename);
+    goto error;
+  }
+  return fd;
+
+ error:
+  err = errno;
+  close (fd);
+  errno = err;
+  return -1;
+}
+
+/* Read len bytes.  A short read is reported as EINVAL.  errno is
+ * cleared first so that a stale value left by an earlier call can
+ * never be reported instead.
+ */
+int
+_hivex_sidecar_read (hive_h *h, int fd, const char *filename,
+                     void *buf, size_t len)
+{
+  errno = 0;
+  if (full_read (fd, buf, len) != len) {
+    if (errno == 0)
+      SET_ERRNO (EINVAL, "%s: file is too short", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/* Get the name of the nk-record (if is_nk) or vk-record at offset
+ * without converting it.  The caller must have checked that offset
+ * is a valid block of the right type.
+ */
+int
+_hivex_get_raw_name (hive_h *h, size_t offset, int is_nk,
+                     struct raw_name *name)
+{
+  size_t header, bytes;
+
+  if (is_nk) {
+    struct ntreg_nk_record *nk =
+      (struct ntreg_nk_record *) ((char *) h->addr + offset);
+    header = offsetof (struct ntreg_nk_record, name);
+    bytes = le16toh (nk->name_len);
+    name->name = (unsigned char *) nk->name;
+    name->utf16 = !(le16toh (nk->flags) & 0x20);
+  }
+  else {
+    struct ntreg_vk_record *vk =
+      (struct ntreg_vk_record *) ((char *) h->addr + offset);
+    header = offsetof (struct ntreg_vk_record, name);
+    bytes = le16toh (vk->name_len);
+    name->name = (unsigned char *) vk->name;
+    name->utf16 = !(le16toh (vk->flags) & 0x01);
+  }
+
+  if (header + bytes > block_len (h, offset, NULL)) {
+    SET_ERRNO (EFAULT, "name is too long (%zu bytes at 0x%zx)",
+               bytes, offset);
+    return -1;
+  }
+  name->len = name->utf16 ? bytes / 2 : bytes;
+  name->offset = offset;
+  return 0;
+}
@@ -33,10 +33,12 @@
 #include "hivex.h"
 #include "hivex-internal.h"
 
-int
-_hivex_get_values (hive_h *h, hive_node_h node,
-                   hive_value_h **values_ret, size_t **blocks_ret)
+static int
+get_values (hive_h *h, hive_node_h node,
+            hive_value_h **values_ret, size_t **blocks_ret)
 {
+  STATS_INC (values_lists);
+
   if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk")) {
     SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
     return -1;
@@ -53,6 +55,11 @@ _hivex_get_values (hive_h *h, hive_node_h node,
   _hivex_init_offset_list (h, &values);
   _hivex_init_offset_list (h, &blocks);
 
+  if (values_ret)
+    *values_ret = NULL;
+  if (blocks_ret)
+    *blocks_ret = NULL;
+
   /* Deal with the common "no values" case quickly. */
   if (nr_values == 0)
     goto ok;
@@ -103,31 +110,98 @@ _hivex_get_values (hive_h *h, hive_node_h node,
   }
 
  ok:
-  *values_ret = _hivex_return_offset_list (&values);
-  *blocks_ret = _hivex_return_offset_list (&blocks);
-  if (!*values_ret || !*blocks_ret)
-    goto error;
+  /* Only copy out the lists that the caller asked for. */
+  if (values_ret) {
+    *values_ret = _hivex_return_offset_list (&values);
+    if (*values_ret == NULL)
+      goto error;
+  }
+  if (blocks_ret) {
+    *blocks_ret = _hivex_return_offset_list (&blocks);
+    if (*blocks_ret == NULL)
+      goto error;
+  }
+  _hivex_free_offset_list (&values);
+  _hivex_free_offset_list (&blocks);
   return 0;
 
  error:
   _hivex_free_offset_list (&values);
   _hivex_free_offset_list (&blocks);
+  if (values_ret) {
+    free (*values_ret);
+    *values_ret = NULL;
+  }
   return -1;
 }
 
+int
+_hivex_get_values (hive_h *h, hive_node_h node,
+                   hive_value_h **values_ret, size_t **blocks_ret)
+{
+  int r;
+
+  PROBE1 (get_values__start, node);
+  r = get_values (h, node, values_ret, blocks_ret);
+  PROBE2 (get_values__done, node, r);
+  return r;
+}
+
 hive_value_h *
 hivex_node_values (hive_h *h, hive_node_h node)
 {
   hive_value_h *values;
-  size_t *blocks;
 
-  if (_hivex_get_values (h, node, &values, &blocks) == -1)
+  if (_hivex_get_values (h, node, &values, NULL) == -1)
     return NULL;
 
-  free (blocks);
   return values;
 }
 
+hive_value_full *
+hivex_node_values_full (hive_h *h, hive_node_h node)
+{
+  hive_value_h *values;
+  hive_value_full *ret;
+  size_t i, nr_values;
+
+  values = hivex_node_values (h, node);
+  if (values == NULL)
+    return NULL;
+
+  for (nr_values = 0; values[nr_values] != 0; ++nr_values)
+    ;
+
+  ret = _hivex_calloc (h, nr_values + 1, sizeof (hive_value_full));
+  if (ret == NULL) {
+    free (values);
+    return NULL;
+  }
+
+  for (i = 0; i < nr_values; ++i) {
+    ret[i].key = hivex_value_key (h, values[i]);
+    if (ret[i].key == NULL)
+      goto error;
+    ret[i].value = hivex_value_value (h, values[i], &ret[i].t, &ret[i].len);
+    if (ret[i].value == NULL)
+      goto error;
+    ret[i].val = values[i];
+  }
+
+  free (values);
+  /* The list now belongs to the caller. */
+  _hivex_uncharge (h, (nr_values + 1) * sizeof (hive_value_full));
+  return ret;
+
+ error:;
+  int err = errno;
+  _hivex_uncharge (h, (nr_values + 1) * sizeof (hive_value_full));
+  _hivex_free_value_full_list (ret);
+  free (values);
+  errno = err;
+  return NULL;
+}
+
 /* Very inefficient, but at least having a separate API call
  * allows us to make it more efficient in future.
  */
@@ -193,7 +267,8 @@ hivex_value_key_len (hive_h *h, hive_value_h value)
     SET_ERRNO (EFAULT, "key length is too long (%zu, %zu)", len, seg_len);
     return 0;
   }
-  return _hivex_utf8_strlen (vk->name, len, ! (le16toh (vk->flags) & 0x01));
+  return _hivex_utf8_strlen (h, vk->name, len,
+                             ! (le16toh (vk->flags) & 0x01));
 }
 
 char *
@@ -216,9 +291,9 @@ hivex_value_key (hive_h *h, hive_value_h value)
     return NULL;
   }
   if (flags & 0x01) {
-    return _hivex_windows_latin1_to_utf8 (vk->name, len);
+    return _hivex_windows_latin1_to_utf8 (h, vk->name, len);
   } else {
-    return _hivex_windows_utf16_to_utf8 (vk->name, len);
+    return _hivex_windows_utf16_to_utf8 (h, vk->name, len);
   }
 }
 
@@ -297,9 +372,9 @@ hivex_value_data_cell_offset (hive_h *h, hive_value_h value, size_t *len)
   return data_offset;
 }
 
-char *
-hivex_value_value (hive_h *h, hive_value_h value,
-                   hive_type *t_rtn, size_t *len_rtn)
+static char *
+value_value (hive_h *h, hive_value_h value,
+             hive_type *t_rtn, size_t *len_rtn)
 {
   if (!IS_VALID_BLOCK (h, value) || !block_id_eq (h, value, "vk")) {
     SET_ERRNO (EINVAL, "invalid block or not an 'vk' block");
@@ -339,7 +414,7 @@ hivex_value_value (hive_h *h, hive_value_h value,
     return NULL;
   }
 
-  char *ret = malloc (len);
+  char *ret = _hivex_malloc_for_caller (h, len);
   if (ret == NULL)
     return NULL;
 
@@ -425,6 +500,103 @@ hivex_value_value (hive_h *h, hive_value_h value,
   }
 }
 
+char *
+hivex_value_value (hive_h *h, hive_value_h value,
+                   hive_type *t_rtn, size_t *len_rtn)
+{
+  char *r;
+
+  PROBE1 (value_value__start, value);
+  r = value_value (h, value, t_rtn, len_rtn);
+  PROBE2 (value_value__done, value, r && len_rtn ? *len_rtn : 0);
+  return r;
+}
+
+const char *
+hivex_value_value_ptr (hive_h *h, hive_value_h value,
+                       hive_type *t_rtn, size_t *len_rtn)
+{
+  if (!IS_VALID_BLOCK (h, value) || !block_id_eq (h, value, "vk")) {
+    SET_ERRNO (EINVAL, "invalid block or not an 'vk' block");
+    return NULL;
+  }
+
+  /* In write mode h->addr can be reallocated by any write operation,
+   * so we cannot hand out pointers into it.
+   */
+  if (h->writable) {
+    SET_ERRNO (ENOTSUP, "cannot borrow value data from a writable hive");
+    return NULL;
+  }
+
+  struct ntreg_vk_record *vk =
+    (struct ntreg_vk_record *) ((char *) h->addr + value);
+
+  hive_type t;
+  size_t len;
+  int is_inline;
+
+  t = le32toh (vk->data_type);
+
+  len = le32toh (vk->data_len);
+  is_inline = !!(len & 0x80000000);
+  len &= 0x7fffffff;
+
+  DEBUG (2, "value=0x%zx, t=%d, len=%zu, inline=%d",
+         value, t, len, is_inline);
+
+  if (is_inline) {
+    if (len > 4) {
+      SET_ERRNO (ENOTSUP, "inline data with declared length (%zx) > 4", len);
+      return NULL;
+    }
+    if (t_rtn)
+      *t_rtn = t;
+    if (len_rtn)
+      *len_rtn = len;
+    return (const char *) &vk->data_offset;
+  }
+
+  size_t data_offset = le32toh (vk->data_offset);
+  data_offset += 0x1000;
+  if (!IS_VALID_BLOCK (h, data_offset)) {
+    SET_ERRNO (EFAULT, "data offset is not a valid block (0x%zx)", data_offset);
+    return NULL;
+  }
+
+  /* Data stored in a db record is split over several cells, so it
+   * can only be returned by copying it (see hivex_value_value).
+   */
+  size_t blen = block_len (h, data_offset, NULL);
+  if (len > blen - 4 /* subtract 4 for block header */) {
+    SET_ERRNO (ENOTSUP, "value data is not stored in a single cell "
+               "(data 0x%zx, data len %zu)", data_offset, len);
+    return NULL;
+  }
+
+  if (t_rtn)
+    *t_rtn = t;
+  if (len_rtn)
+    *len_rtn = len;
+  return (const char *) h->addr + data_offset + 4;
+}
+
+/* Return the data of a value, without copying it if possible.
+ * *copy is set if the caller must free the data.
+ */
+const char *
+_hivex_value_data (hive_h *h, hive_value_h value, hive_type *t, size_t *len,
+                   char **copy)
+{
+  const char *data;
+
+  *copy = NULL;
+  data = hivex_value_value_ptr (h, value, t, len);
+  if (data == NULL && errno == ENOTSUP)
+    data = *copy = hivex_value_value (h, value, t, len);
+  return data;
+}
+
 char *
 hivex_value_string (hive_h *h, hive_value_h value)
 {
@@ -455,7 +627,7 @@ hivex_value_string (hive_h *h, hive_value_h value)
   if (slen < len)
     len = slen;
 
-  char *ret = _hivex_windows_utf16_to_utf8 (data, len);
+  char *ret = _hivex_windows_utf16_to_utf8 (h, data, len);
   free (data);
   if (ret == NULL)
     return NULL;
@@ -501,7 +673,7 @@ hivex_value_multiple_strings (hive_h *h, hive_value_h value)
   }
 
   size_t nr_strings = 0;
-  char **ret = malloc ((1 + nr_strings) * sizeof (char *));
+  char **ret = _hivex_malloc (h, (1 + nr_strings) * sizeof (char *));
   if (ret == NULL) {
     free (data);
     return NULL;
@@ -514,17 +686,20 @@ hivex_value_multiple_strings (hive_h *h, hive_value_h value)
   while (p < data + len) {
     plen = _hivex_utf16_string_len_in_bytes_max (p, data + len - p);
     nr_strings++;
-    char **ret2 = realloc (ret, (1 + nr_strings) * sizeof (char *));
+    char **ret2 = _hivex_realloc (h, ret, nr_strings * sizeof (char *),
+                                  (1 + nr_strings) * sizeof (char *));
     if (ret2 == NULL) {
+      _hivex_uncharge (h, nr_strings * sizeof (char *));
       _hivex_free_strings (ret);
       free (data);
       return NULL;
     }
     ret = ret2;
 
-    ret[nr_strings-1] = _hivex_windows_utf16_to_utf8 (p, plen);
+    ret[nr_strings-1] = _hivex_windows_utf16_to_utf8 (h, p, plen);
     ret[nr_strings] = NULL;
     if (ret[nr_strings-1] == NULL) {
+      _hivex_uncharge (h, (1 + nr_strings) * sizeof (char *));
       _hivex_free_strings (ret);
       free (data);
       return NULL;
@@ -534,6 +709,8 @@ hivex_value_multiple_strings (hive_h *h, hive_value_h value)
   }
 
   free (data);
+  /* The list now belongs to the caller. */
+  _hivex_uncharge (h, (1 + nr_strings) * sizeof (char *));
   return ret;
 }
 
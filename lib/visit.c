@@ -59,13 +59,14 @@ hivex_visit_node (hive_h *h, hive_node_h node,
   /* This bitmap records unvisited nodes, so we don't loop if the
    * registry contains cycles.
    */
-  char *unvisited = malloc (1 + h->size / 32);
+  size_t unvisited_size = 1 + h->size / 32;
+  char *unvisited = _hivex_malloc (h, unvisited_size);
   if (unvisited == NULL)
     return -1;
-  memcpy (unvisited, h->bitmap, 1 + h->size / 32);
+  memcpy (unvisited, h->bitmap, unvisited_size);
 
   int r = hivex__visit_node (h, node, &vtor, unvisited, opaque, flags);
-  free (unvisited);
+  _hivex_free (h, unvisited, unvisited_size);
   return r;
 }
 
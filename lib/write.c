@@ -62,7 +62,7 @@
  * 0   : error (errno set)
  */
 static size_t
-allocate_page (hive_h *h, size_t allocation_hint)
+do_allocate_page (hive_h *h, size_t allocation_hint)
 {
   /* In almost all cases this will be 1. */
   size_t nr_4k_pages =
@@ -84,19 +84,28 @@ allocate_page (hive_h *h, size_t allocation_hint)
   if (extend > 0) {
     size_t oldsize = h->size;
     size_t newsize = h->size + extend;
-    char *newaddr = realloc (h->addr, newsize);
+    char *newaddr = _hivex_realloc (h, h->addr, oldsize, newsize);
     if (newaddr == NULL)
       return 0;
+    /* The old address is no longer valid. */
+    h->addr = newaddr;
 
     size_t oldbitmapsize = 1 + oldsize / 32;
     size_t newbitmapsize = 1 + newsize / 32;
-    char *newbitmap = realloc (h->bitmap, newbitmapsize);
+    char *newbitmap =
+      _hivex_realloc (h, h->bitmap, oldbitmapsize, newbitmapsize);
     if (newbitmap == NULL) {
-      free (newaddr);
+      /* Give back the extra space (so the charge matches h->size).
+       * If even shrinking fails, the larger block is kept.
+       */
+      int err = errno;
+      newaddr = _hivex_realloc (h, h->addr, newsize, oldsize);
+      if (newaddr)
+        h->addr = newaddr;
+      errno = err;
       return 0;
     }
 
-    h->addr = newaddr;
     h->size = newsize;
     h->bitmap = newbitmap;
 
@@ -122,10 +131,24 @@ allocate_page (hive_h *h, size_t allocation_hint)
 
   DEBUG (2, "new page at 0x%zx", offset);
 
+  STATS_INC (allocate_page_calls);
+  STATS_ADD (allocate_page_bytes, nr_4k_pages * 4096);
+
   /* Offset of first usable byte after the header. */
   return offset + sizeof (struct ntreg_hbin_page);
 }
 
+static size_t
+allocate_page (hive_h *h, size_t allocation_hint)
+{
+  size_t r;
+
+  PROBE1 (allocate_page__start, allocation_hint);
+  r = do_allocate_page (h, allocation_hint);
+  PROBE2 (allocate_page__done, allocation_hint, r);
+  return r;
+}
+
 /* Allocate a single block, first allocating an hbin (page) at the end
  * of the current file if necessary.  NB. To keep the implementation
  * simple and more likely to be correct, we do not reuse existing free
@@ -146,7 +169,7 @@ allocate_page (hive_h *h, size_t allocation_hint)
  * 0   : error (errno set)
  */
 static size_t
-allocate_block (hive_h *h, size_t seg_len, const char id[2])
+do_allocate_block (hive_h *h, size_t seg_len, const char id[2])
 {
   CHECK_WRITABLE (0);
 
@@ -195,6 +218,9 @@ allocate_block (hive_h *h, size_t seg_len, const char id[2])
 
   BITMAP_SET (h->bitmap, offset);
 
+  STATS_INC (allocate_block_calls);
+  STATS_ADD (allocate_block_bytes, seg_len);
+
   h->endblocks += seg_len;
 
   /* If there is space after the last block in the last page, then we
@@ -215,6 +241,17 @@ allocate_block (hive_h *h, size_t seg_len, const char id[2])
   return offset;
 }
 
+static size_t
+allocate_block (hive_h *h, size_t seg_len, const char id[2])
+{
+  size_t r;
+
+  PROBE1 (allocate_block__start, seg_len);
+  r = do_allocate_block (h, seg_len, id);
+  PROBE2 (allocate_block__done, seg_len, r);
+  return r;
+}
+
 /* 'offset' must point to a valid, used block.  This function marks
  * the block unused (by updating the seg_len field) and invalidates
  * the bitmap.  It does NOT do this recursively, so to avoid creating
@@ -592,6 +629,10 @@ hivex_node_add_child (hive_h *h, hive_node_h parent, const char *name)
 {
   CHECK_WRITABLE (0);
 
+  /* Any change to the tree invalidates the indexes. */
+  _hivex_drop_indexes (h);
+  h->dirty = 1;
+
   if (!IS_VALID_BLOCK (h, parent) || !block_id_eq (h, parent, "nk")) {
     SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
     return 0;
@@ -610,7 +651,7 @@ hivex_node_add_child (hive_h *h, hive_node_h parent, const char *name)
   size_t recoded_name_len;
   int use_utf16 = 0;
   char *recoded_name =
-    _hivex_encode_string (name, &recoded_name_len, &use_utf16);
+    _hivex_encode_string (h, name, &recoded_name_len, &use_utf16);
   if (recoded_name == NULL) {
     SET_ERRNO (EINVAL, "malformed name");
     return 0;
@@ -676,12 +717,10 @@ hivex_node_add_child (hive_h *h, hive_node_h parent, const char *name)
    * The only other case is the no-subkeys case, where we have to
    * create a brand new lh-record.
    */
-  hive_node_h *unused;
   size_t *blocks;
 
-  if (_hivex_get_children (h, parent, &unused, &blocks, 0) == -1)
+  if (_hivex_get_children (h, parent, NULL, &blocks, 0) == -1)
     return 0;
-  free (unused);
 
   size_t i;
   size_t nr_subkeys_in_parent_nk = le32toh (parent_nk->nr_subkeys);
@@ -800,12 +839,10 @@ delete_node (hive_h *h, void *opaque, hive_node_h node, const char *name)
    * deleted by this point, so tell get_children() not to check for
    * validity of the nk-records.
    */
-  hive_node_h *unused;
   size_t *blocks;
   if (_hivex_get_children (h, node,
-                           &unused, &blocks, GET_CHILDREN_NO_CHECK_NK) == -1)
+                           NULL, &blocks, GET_CHILDREN_NO_CHECK_NK) == -1)
     return -1;
-  free (unused);
 
   /* We don't care what's in these intermediate blocks, so we can just
    * delete them unconditionally.
@@ -851,6 +888,9 @@ hivex_node_delete_child (hive_h *h, hive_node_h node)
 {
   CHECK_WRITABLE (-1);
 
+  _hivex_drop_indexes (h);
+  h->dirty = 1;
+
   if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk")) {
     SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
     return -1;
@@ -876,12 +916,10 @@ hivex_node_delete_child (hive_h *h, hive_node_h node)
    * decrement the overall number of subkeys stored in the parent
    * node.
    */
-  hive_node_h *unused;
   size_t *blocks;
   if (_hivex_get_children (h, parent,
-                           &unused, &blocks, GET_CHILDREN_NO_CHECK_NK)== -1)
+                           NULL, &blocks, GET_CHILDREN_NO_CHECK_NK) == -1)
     return -1;
-  free (unused);
 
   size_t i, j;
   for (i = 0; blocks[i] != 0; ++i) {
@@ -927,6 +965,9 @@ hivex_node_set_values (hive_h *h, hive_node_h node,
 {
   CHECK_WRITABLE (-1);
 
+  _hivex_drop_indexes (h);
+  h->dirty = 1;
+
   if (!IS_VALID_BLOCK (h, node) || !block_id_eq (h, node, "nk")) {
     SET_ERRNO (EINVAL, "invalid block or not an 'nk' block");
     return -1;
@@ -959,8 +1000,8 @@ hivex_node_set_values (hive_h *h, hive_node_h node,
     static const char vk_id[2] = { 'v', 'k' };
     size_t recoded_name_len;
     int use_utf16;
-    char* recoded_name = _hivex_encode_string (values[i].key, &recoded_name_len,
-                                               &use_utf16);
+    char* recoded_name = _hivex_encode_string (h, values[i].key,
+                                               &recoded_name_len, &use_utf16);
     seg_len = sizeof (struct ntreg_vk_record) + recoded_name_len;
     size_t vk_offs = allocate_block (h, seg_len, vk_id);
     if (vk_offs == 0)
@@ -1025,6 +1066,7 @@ hivex_node_set_value (hive_h *h, hive_node_h node,
   int retval = -1;
   hive_value_h *prev_values;
   hive_set_value *new_values;
+  size_t new_values_size;
   size_t nr_values;
   size_t i;
   ssize_t idx_of_val;
@@ -1042,7 +1084,8 @@ hivex_node_set_value (hive_h *h, hive_node_h node,
    * values, plus 1 (for the new key if we're not replacing an
    * existing key).
    */
-  new_values = calloc (nr_values + 1, sizeof (hive_set_value));
+  new_values_size = (nr_values + 1) * sizeof (hive_set_value);
+  new_values = _hivex_calloc (h, nr_values + 1, sizeof (hive_set_value));
   if (new_values == NULL)
     goto out1;
 
@@ -1074,19 +1117,26 @@ hivex_node_set_value (hive_h *h, hive_node_h node,
   if (idx_of_val > -1) {
     free (new_values[idx_of_val].key);
     free (new_values[idx_of_val].value);
+    new_values[idx_of_val].key = NULL;
+    new_values[idx_of_val].value = NULL;
   } else { /* insert it at the end */
     idx_of_val = nr_values;
     nr_values++;
   }
 
-  new_values[idx_of_val].key = strdup (val->key);
-  new_values[idx_of_val].value = malloc (val->len);
+  /* These are freed below along with the copies of the other values,
+   * which are not charged, so they are uncharged straight away.
+   */
+  new_values[idx_of_val].key = _hivex_strdup (h, val->key);
+  if (new_values[idx_of_val].key == NULL)
+    goto out2;
+  _hivex_uncharge (h, strlen (val->key) + 1);
+  new_values[idx_of_val].value = _hivex_malloc (h, val->len);
+  if (new_values[idx_of_val].value == NULL)
+    goto out2;
+  _hivex_uncharge (h, val->len);
   new_values[idx_of_val].len = val->len;
   new_values[idx_of_val].t = val->t;
-
-  if (new_values[idx_of_val].key == NULL ||
-      new_values[idx_of_val].value == NULL)
-    goto out2;
   memcpy (new_values[idx_of_val].value, val->value, val->len);
 
   retval = hivex_node_set_values (h, node, nr_values, new_values, 0);
@@ -1096,7 +1146,7 @@ hivex_node_set_value (hive_h *h, hive_node_h node,
     free (new_values[i].key);
     free (new_values[i].value);
   }
-  free (new_values);
+  _hivex_free (h, new_values, new_values_size);
 
  out1:
   free (prev_values);
@@ -0,0 +1,55 @@
+(* hivex OCaml bindings
+ * Copyright (C) 2009-2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *)
+
+(* Test that separate handles can be used from several threads at
+ * once, now that the runtime lock is released during hivex calls.
+ *)
+
+open Unix
+open Printf
+let (//) = Filename.concat
+let srcdir = try Sys.getenv "srcdir" with Not_found -> "."
+
+let count_nodes () =
+  let h = Hivex.open_file (srcdir // "../images/large") [] in
+  let rec count node =
+    Array.fold_left (fun n child -> n + count child) 1
+      (Hivex.node_children h node)
+  in
+  let n = count (Hivex.root h) in
+  Hivex.close h;
+  n
+
+let () =
+  let expected = count_nodes () in
+  let results = Array.make 4 0 in
+  let threads =
+    Array.init 4 (
+      fun i -> Thread.create (fun () -> results.(i) <- count_nodes ()) ()
+    ) in
+  Array.iter Thread.join threads;
+  Array.iter (
+    fun n ->
+      if n <> expected then
+        failwith (sprintf "thread counted %d nodes, expected %d" n expected)
+  ) results;
+
+  (* Gc.compact is a good way to ensure we don't have
+   * heap corruption or double-freeing.
+   *)
+  Gc.compact ()
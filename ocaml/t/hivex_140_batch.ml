@@ -0,0 +1,54 @@
+(* hivex OCaml bindings
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *)
+
+(* Test node_children_named and node_values_full, which return the
+ * contents of a node in a single call.
+ *)
+
+open Unix
+open Printf
+let (//) = Filename.concat
+let srcdir = try Sys.getenv "srcdir" with Not_found -> "."
+
+let () =
+  let h = Hivex.open_file (srcdir // "../images/minimal") [Hivex.OPEN_WRITE] in
+  let root = Hivex.root h in
+  ignore (Hivex.node_add_child h root "A");
+  let b = Hivex.node_add_child h root "B" in
+
+  let children = Hivex.node_children_named h root in
+  assert (Array.map fst children = [| "A"; "B" |]);
+  assert (snd children.(1) = b);
+  assert (Hivex.node_children_named h b = [| |]);
+
+  Hivex.node_set_values h b [|
+    { Hivex.key = "Key1"; t = Hivex.REG_BINARY; value = "ABC" };
+    { Hivex.key = "Key2"; t = Hivex.REG_EXPAND_SZ; value = "DEF" };
+  |];
+  let values = Hivex.node_values_full h b in
+  assert (values = [| "Key1", Hivex.REG_BINARY, "ABC";
+                      "Key2", Hivex.REG_EXPAND_SZ, "DEF" |]);
+  assert (Hivex.node_values_full h root = [| |]);
+
+  (* Discard the changes. *)
+  Hivex.close h;
+
+  (* Gc.compact is a good way to ensure we don't have
+   * heap corruption or double-freeing.
+   *)
+  Gc.compact ()
@@ -0,0 +1,49 @@
+(* hivex OCaml bindings
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *)
+
+(* Test get_stats. *)
+
+open Unix
+open Printf
+let (//) = Filename.concat
+let srcdir = try Sys.getenv "srcdir" with Not_found -> "."
+
+let () =
+  let h = Hivex.open_file (srcdir // "../images/minimal") [Hivex.OPEN_WRITE] in
+  let stat stats name = List.assoc name (Array.to_list stats) in
+
+  let stats = Hivex.get_stats h in
+  assert (stat stats "pages" >= 1L);
+  assert (stat stats "blocks" >= stat stats "used_blocks");
+  assert (stat stats "allocate_block_calls" = 0L);
+
+  let root = Hivex.root h in
+  ignore (Hivex.node_add_child h root "A");
+  ignore (Hivex.node_children h root);
+
+  let stats2 = Hivex.get_stats h in
+  assert (stat stats2 "allocate_block_calls" > 0L);
+  assert (stat stats2 "children_lists" > stat stats "children_lists");
+
+  (* Discard the changes. *)
+  Hivex.close h;
+
+  (* Gc.compact is a good way to ensure we don't have
+   * heap corruption or double-freeing.
+   *)
+  Gc.compact ()
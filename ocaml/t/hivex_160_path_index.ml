@@ -0,0 +1,52 @@
+(* hivex OCaml bindings
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *)
+
+(* Test node_path, build_path_index and cell_owner. *)
+
+open Unix
+open Printf
+let (//) = Filename.concat
+let srcdir = try Sys.getenv "srcdir" with Not_found -> "."
+
+let () =
+  let h = Hivex.open_file (srcdir // "../images/minimal") [Hivex.OPEN_WRITE] in
+  let root = Hivex.root h in
+  let a = Hivex.node_add_child h root "A" in
+  let b = Hivex.node_add_child h a "B" in
+
+  (* Without the index. *)
+  assert (Hivex.node_path h root = "\\");
+  assert (Hivex.node_path h b = "\\A\\B");
+
+  Hivex.build_path_index h;
+  assert (Hivex.node_path h a = "\\A");
+  assert (Hivex.node_path h b = "\\A\\B");
+  assert (Hivex.cell_owner h b = b);
+
+  (* Modifying the hive discards the index, and it is rebuilt. *)
+  let c = Hivex.node_add_child h b "C" in
+  assert (Hivex.node_path h c = "\\A\\B\\C");
+  assert (Hivex.cell_owner h c = c);
+
+  (* Discard the changes. *)
+  Hivex.close h;
+
+  (* Gc.compact is a good way to ensure we don't have
+   * heap corruption or double-freeing.
+   *)
+  Gc.compact ()
@@ -506,7 +506,6 @@ library C<$node> handle.
 
 sub reg_export_node
 {
-    local $_;
     my $h = shift;
     my $node = shift;
     my $fh = shift;
@@ -514,39 +513,42 @@ sub reg_export_node
 
     confess "reg_export_node: \$node parameter was undef" unless defined $node;
 
-    # Get the canonical path of this node.
+    # Get the canonical path of this node.  The paths of the children
+    # are built up from this as we descend, so we only need to walk
+    # up the tree once.
     my $path = _node_canonical_path ($h, $node);
 
-    # Print the path.
-    print $fh "[";
     my $prefix = $params{prefix};
     if (defined $prefix) {
         chop $prefix if substr ($prefix, -1, 1) eq "\\";
-        print $fh $prefix;
+    } else {
+        $prefix = "";
     }
-    print $fh $path;
-    print $fh "]\n";
 
-    my $unsafe_printable_strings = $params{unsafe_printable_strings};
-
-    # Get the values.
-    my @values = $h->node_values ($node);
+    _reg_export_node ($h, $node, $fh, $prefix, $path,
+                      $params{unsafe_printable_strings});
+}
 
-    foreach (@values) {
-        use bytes;
+sub _reg_export_node
+{
+    local $_;
+    my $h = shift;
+    my $node = shift;
+    my $fh = shift;
+    my $prefix = shift;
+    my $path = shift;
+    my $unsafe_printable_strings = shift;
 
-        my $key = $h->value_key ($_);
-        my ($type, $data) = $h->value_value ($_);
-        $_ = { key => $key, type => $type, data => $data }
-    }
+    # Print the path.
+    print $fh "[", $prefix, $path, "]\n";
 
-    @values = sort { $a->{key} cmp $b->{key} } @values;
+    # Get the values, sorted by key.  Each value is returned as
+    # [key, type, data].
+    my @values = $h->node_values_sorted ($node);
 
     # Print the values.
     foreach (@values) {
-        my $key = $_->{key};
-        my $type = $_->{type};
-        my $data = $_->{data};
+        my ($key, $type, $data) = @$_;
 
         if ($key eq "") {
             print $fh '@='    # default key
@@ -567,15 +569,20 @@ sub reg_export_node
         } else {
             # Encode everything else as hex, see encoding section below.
             printf $fh "hex(%x):", $type;
-            my $hex = join (",", map { sprintf "%02x", ord } split (//, $data));
-            print $fh "$hex\n"
+            print $fh join (",", unpack ("(H2)*", $data)), "\n"
         }
     }
     print $fh "\n";
 
-    my @children = $h->node_children ($node);
-    @children = sort { $h->node_name ($a) cmp $h->node_name ($b) } @children;
-    reg_export_node ($h, $_, $fh, @_) foreach @children;
+    # Get the children, sorted by name.  Each child is returned as
+    # [name, node].
+    my @children = $h->node_children_sorted ($node);
+    $path = "" if $path eq "\\";
+    foreach (@children) {
+        my ($name, $child) = @$_;
+        _reg_export_node ($h, $child, $fh, $prefix, "$path\\$name",
+                          $unsafe_printable_strings);
+    }
 }
 
 # Escape " and \ when printing keys.
@@ -0,0 +1,77 @@
+# hivex Perl bindings -*- perl -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+use strict;
+use warnings;
+
+use Encode qw(from_to);
+use Test::More tests => 12;
+
+use Win::Hivex;
+
+my $srcdir = $ENV{srcdir} || ".";
+
+my $h = Win::Hivex->open ("$srcdir/../images/minimal", write => 1);
+ok ($h);
+
+my $root = $h->root ();
+$h->node_add_child ($root, "A");
+$h->node_add_child ($root, "B");
+my $b = $h->node_get_child ($root, "B");
+$h->node_add_child ($b, "C");
+
+# Encode a string as UTF16-LE.
+sub utf16le
+{
+    my $s = shift;
+    from_to ($s, "ascii", "utf-16le");
+    $s;
+}
+
+$h->node_set_values ($b, [
+    { key => "Str", t => 1, value => utf16le ("Hello\0") },
+    { key => "Dword", t => 4, value => pack ("V", 42) },
+    { key => "Bin", t => 3, value => "\x01\x02\x03" },
+]);
+
+my $tree = $h->node_to_native ($root);
+ok ($tree);
+is (scalar @{$tree->{children}}, 2);
+
+my ($tb) = grep { $_->{name} eq "B" } @{$tree->{children}};
+ok ($tb);
+is (scalar @{$tb->{children}}, 1);
+is ($tb->{children}[0]{name}, "C");
+
+my %values = map { $_->{key} => $_ } @{$tb->{values}};
+is ($values{Str}{value}, "Hello");
+is ($values{Dword}{value}, 42);
+is ($values{Bin}{value}, "\x01\x02\x03");
+
+# Without decoding, values are returned as raw bytes.
+$tree = $h->node_to_native ($b, -1, 0);
+%values = map { $_->{key} => $_ } @{$tree->{values}};
+is ($values{Dword}{value}, pack ("V", 42));
+
+# Depth limits the levels of children returned.
+$tree = $h->node_to_native ($root, 0);
+ok (!exists $tree->{children});
+$tree = $h->node_to_native ($root, 1);
+ok (!exists $tree->{children}[0]{children});
+
+# don't commit because that would overwrite the original file
+# $h->commit ();
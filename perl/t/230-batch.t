@@ -0,0 +1,58 @@
+# hivex Perl bindings -*- perl -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+use strict;
+use warnings;
+use Test::More tests => 9;
+
+use Win::Hivex;
+
+my $srcdir = $ENV{srcdir} || ".";
+
+my $h = Win::Hivex->open ("$srcdir/../images/minimal", write => 1);
+ok ($h);
+
+my $root = $h->root ();
+$h->node_add_child ($root, "A");
+my $b = $h->node_add_child ($root, "B");
+
+my @children = $h->node_children_named ($root);
+is_deeply ([map { $_->[0] } @children], ["A", "B"]);
+ok ($children[1]->[1] == $b);
+my @none = $h->node_children_named ($b);
+is (scalar (@none), 0);
+
+my $values = [
+    { key => "Key1", t => 3, value => "ABC" },
+    { key => "Key2", t => 2, value => "DEF" }
+    ];
+$h->node_set_values ($b, $values);
+
+my @values = $h->node_values_full ($b);
+is (scalar (@values), 2);
+is_deeply (\@values, $values);
+@none = $h->node_values_full ($root);
+is (scalar (@none), 0);
+
+# The values can be passed straight back to node_set_values.
+my $node_a = $h->node_get_child ($root, "A");
+$h->node_set_values ($node_a, \@values);
+ok (1);
+is_deeply ([$h->node_values_full ($node_a)], $values);
+
+# don't commit because that would overwrite the original file
+# $h->commit ();
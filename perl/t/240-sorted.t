@@ -0,0 +1,56 @@
+# hivex Perl bindings -*- perl -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+use strict;
+use warnings;
+use Test::More tests => 5;
+
+use Win::Hivex;
+
+my $srcdir = $ENV{srcdir} || ".";
+
+my $h = Win::Hivex->open ("$srcdir/../images/minimal", write => 1);
+ok ($h);
+
+my $root = $h->root ();
+my $c = $h->node_add_child ($root, "c");
+$h->node_add_child ($root, "B");
+$h->node_add_child ($root, "a");
+
+# The children are sorted by name in the same order as Perl's cmp.
+my @children = $h->node_children_sorted ($root);
+is_deeply ([map { $_->[0] } @children], [sort ("c", "B", "a")]);
+ok ($children[2]->[1] == $c);
+
+$h->node_set_values ($c, [
+    { key => "Zed", t => 3, value => "\x01\x02" },
+    { key => "", t => 1, value => "" },
+    { key => "Abc", t => 4, value => "\x2a\0\0\0" },
+    ]);
+
+my @values = $h->node_values_sorted ($c);
+is_deeply (\@values, [
+    [ "", 1, "" ],
+    [ "Abc", 4, "\x2a\0\0\0" ],
+    [ "Zed", 3, "\x01\x02" ],
+    ]);
+
+@values = $h->node_values_sorted ($root);
+is (scalar (@values), 0);
+
+# don't commit because that would overwrite the original file
+# $h->commit ();
@@ -0,0 +1,43 @@
+# hivex Perl bindings -*- perl -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+use strict;
+use warnings;
+use Test::More tests => 6;
+
+use Win::Hivex;
+
+my $srcdir = $ENV{srcdir} || ".";
+
+my $h = Win::Hivex->open ("$srcdir/../images/minimal", write => 1);
+ok ($h);
+
+my $stats = $h->get_stats ();
+ok ($stats->{pages} >= 1);
+ok ($stats->{blocks} >= $stats->{used_blocks});
+is ($stats->{allocate_block_calls}, 0);
+
+my $root = $h->root ();
+$h->node_add_child ($root, "A");
+my @children = $h->node_children ($root);
+
+my $stats2 = $h->get_stats ();
+ok ($stats2->{allocate_block_calls} > 0);
+ok ($stats2->{children_lists} > $stats->{children_lists});
+
+# don't commit because that would overwrite the original file
+# $h->commit ();
@@ -0,0 +1,52 @@
+# hivex Perl bindings -*- perl -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+use strict;
+use warnings;
+use Test::More tests => 10;
+
+use Win::Hivex;
+
+my $srcdir = $ENV{srcdir} || ".";
+
+my $h = Win::Hivex->open ("$srcdir/../images/minimal", write => 1);
+ok ($h);
+
+my $root = $h->root ();
+my $na = $h->node_add_child ($root, "A");
+my $nb = $h->node_add_child ($na, "B");
+$h->node_set_value ($nb, { key => "v", t => 1, value => "hello, world\0" });
+my ($v) = $h->node_values ($nb);
+
+# Without the index.
+is ($h->node_path ($root), "\\");
+is ($h->node_path ($nb), "\\A\\B");
+
+$h->build_path_index ();
+is ($h->node_path ($na), "\\A");
+is ($h->node_path ($nb), "\\A\\B");
+is ($h->cell_owner ($nb), $nb);
+is ($h->cell_owner ($v), $nb);
+my ($len, $off) = $h->value_data_cell_offset ($v);
+is ($h->cell_owner ($off), $nb);
+
+# Modifying the hive discards the index, and it is rebuilt.
+my $nc = $h->node_add_child ($nb, "C");
+is ($h->node_path ($nc), "\\A\\B\\C");
+is ($h->cell_owner ($nc), $nc);
+
+# don't commit because that would overwrite the original file
+# $h->commit ();
@@ -0,0 +1,59 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+# Test that separate handles can be used from several threads at
+# once, now that the GIL is released during hivex calls.
+
+import os
+import threading
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+def count_nodes (results, i):
+    h = hivex.Hivex ("%s/../images/large" % srcdir)
+    def count (node):
+        return 1 + sum ([count (c) for c in h.node_children (node)])
+    results[i] = count (h.root ())
+
+expected = [None]
+count_nodes (expected, 0)
+
+results = [None] * 4
+threads = [threading.Thread (target = count_nodes, args = (results, i))
+           for i in range (len (results))]
+for t in threads:
+    t.start ()
+for t in threads:
+    t.join ()
+
+for r in results:
+    assert r == expected[0]
+
+# Set values are copied before the GIL is released, so a value built
+# from a temporary object must still be written correctly.
+h = hivex.Hivex ("%s/../images/minimal" % srcdir, write = True)
+root = h.root ()
+h.node_add_child (root, "B")
+B = h.node_get_child (root, "B")
+h.node_set_values (B, [ { "key": "Key%d" % i, "t": 3,
+                          "value": ("V%d" % i).encode ("ascii") }
+                        for i in range (10) ])
+val = h.node_get_value (B, "Key7")
+assert h.value_value (val) == (3, b"V7")
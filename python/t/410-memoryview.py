@@ -0,0 +1,57 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+# Read-only hive: data should be borrowed from the hive.
+h = hivex.Hivex ("%s/../images/large" % srcdir)
+nodes = [h.root ()]
+nr_values = 0
+first = None
+while nodes:
+    node = nodes.pop ()
+    for v in h.node_values (node):
+        t, data = h.value_value (v)
+        t2, view = h.value_memoryview (v)
+        assert t == t2
+        assert view.readonly
+        assert view.tobytes () == data
+        nr_values += 1
+        if first is None:
+            first = v
+    nodes.extend (h.node_children (node))
+assert nr_values > 0
+
+# The view must keep the hive alive after the last reference to it
+# has gone.
+data = h.value_value (first)[1]
+view = h.value_memoryview (first)[1]
+del h
+assert view.tobytes () == data
+
+# Writable hive: falls back to a copy.
+h = hivex.Hivex ("%s/../images/minimal" % srcdir, write = True)
+root = h.root ()
+h.node_set_value (root, { "key": "A", "t": 3, "value": b"ABCDEFGH" })
+t, view = h.value_memoryview (h.node_get_value (root, "A"))
+assert t == 3
+assert view.tobytes () == b"ABCDEFGH"
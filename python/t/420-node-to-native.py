@@ -0,0 +1,64 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import struct
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+h = hivex.Hivex ("%s/../images/minimal" % srcdir,
+                 write = True)
+assert h
+
+root = h.root ()
+h.node_add_child (root, "A")
+h.node_add_child (root, "B")
+B = h.node_get_child (root, "B")
+h.node_add_child (B, "C")
+
+h.node_set_values (B, [
+    { "key": "Str", "t": 1, "value": "Hello\0".encode ("utf-16le") },
+    { "key": "Dword", "t": 4, "value": struct.pack ("<I", 42) },
+    { "key": "Bin", "t": 3, "value": b"\1\2\3" },
+])
+
+tree = h.node_to_native (root)
+assert len (tree["children"]) == 2
+tb = [c for c in tree["children"] if c["name"] == "B"][0]
+assert [c["name"] for c in tb["children"]] == ["C"]
+
+values = dict ((v["key"], v) for v in tb["values"])
+assert values["Str"]["t"] == 1
+assert values["Str"]["value"] == "Hello"
+assert values["Dword"]["value"] == 42
+assert values["Bin"]["value"] == b"\1\2\3"
+
+# Without decoding, values are returned as raw bytes which can be
+# passed straight back to node_set_values.
+tree = h.node_to_native (B, decode = False)
+values = dict ((v["key"], v) for v in tree["values"])
+assert values["Dword"]["value"] == struct.pack ("<I", 42)
+h.node_set_values (h.node_get_child (root, "A"), tree["values"])
+
+# Depth limits the levels of children returned.
+tree = h.node_to_native (root, 0)
+assert "children" not in tree
+tree = h.node_to_native (root, 1)
+assert "children" not in tree["children"][0]
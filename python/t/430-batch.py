@@ -0,0 +1,50 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import struct
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+h = hivex.Hivex ("%s/../images/minimal" % srcdir,
+                 write = True)
+assert h
+
+root = h.root ()
+h.node_add_child (root, "A")
+h.node_add_child (root, "B")
+B = h.node_get_child (root, "B")
+
+children = h.node_children_named (root)
+assert [name for (name, node) in children] == ["A", "B"]
+assert children[1][1] == B
+assert h.node_children_named (B) == []
+
+h.node_set_values (B, [
+    { "key": "Dword", "t": 4, "value": struct.pack ("<I", 42) },
+    { "key": "Bin", "t": 3, "value": b"\1\2\3" },
+])
+
+values = h.node_values_full (B)
+assert len (values) == 2
+values = dict ((key, (t, data)) for (key, t, data) in values)
+assert values["Dword"] == (4, struct.pack ("<I", 42))
+assert values["Bin"] == (3, b"\1\2\3")
+assert h.node_values_full (root) == []
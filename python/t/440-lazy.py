@@ -0,0 +1,68 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import struct
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+hive = hivex.Hive ("%s/../images/minimal" % srcdir,
+                   write = True)
+assert hive
+
+h = hive.h
+root = h.root ()
+A = h.node_add_child (root, "A")
+B = h.node_add_child (root, "B")
+C = h.node_add_child (B, "C")
+h.node_set_values (C, [
+    { "key": "Name", "t": 1, "value": "Hello\0".encode ("utf-16le") },
+    { "key": "Dword", "t": 4, "value": struct.pack ("<I", 42) },
+])
+
+assert hive.root.node == root
+assert [key.name for key in hive.root] == ["A", "B"]
+assert [key.name for key in hive.root.walk ()] == \
+    [hive.root.name, "A", "B", "C"]
+
+key = hive.root["b"]["C"]
+assert key.node == C
+assert key.parent.node == B
+assert "C" in hive.root["B"]
+assert "D" not in hive.root["B"]
+assert hive.root.get ("D") is None
+try:
+    hive.root["D"]
+    assert False
+except KeyError:
+    pass
+
+assert sorted (value.key for value in key.values) == ["Dword", "Name"]
+assert key.values["name"].string () == "Hello"
+assert key.values["Dword"].dword () == 42
+assert key.values["Dword"].type == 4
+assert key.values["Dword"].data == struct.pack ("<I", 42)
+assert "Other" not in key.values
+assert key.values.get ("Other") is None
+try:
+    key.values["Other"]
+    assert False
+except KeyError:
+    pass
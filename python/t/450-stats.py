@@ -0,0 +1,40 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+h = hivex.Hivex ("%s/../images/minimal" % srcdir,
+                 write = True)
+assert h
+
+stats = h.get_stats ()
+assert stats["pages"] >= 1
+assert stats["blocks"] >= stats["used_blocks"]
+assert stats["allocate_block_calls"] == 0
+
+root = h.root ()
+h.node_add_child (root, "A")
+h.node_children (root)
+
+stats2 = h.get_stats ()
+assert stats2["allocate_block_calls"] > 0
+assert stats2["children_lists"] > stats["children_lists"]
@@ -0,0 +1,49 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+h = hivex.Hivex ("%s/../images/minimal" % srcdir,
+                 write = True)
+assert h
+
+root = h.root ()
+A = h.node_add_child (root, "A")
+B = h.node_add_child (A, "B")
+h.node_set_value (B, { "key": "v", "t": 3, "value": b"hello, world" })
+v = h.node_values (B)[0]
+
+# Without the index.
+assert h.node_path (root) == "\\"
+assert h.node_path (B) == "\\A\\B"
+
+h.build_path_index ()
+assert h.node_path (A) == "\\A"
+assert h.node_path (B) == "\\A\\B"
+assert h.cell_owner (B) == B
+assert h.cell_owner (v) == B
+assert h.cell_owner (h.value_data_cell_offset (v)[1]) == B
+
+# Modifying the hive discards the index, and it is rebuilt.
+C = h.node_add_child (B, "C")
+assert h.node_path (C) == "\\A\\B\\C"
+assert h.cell_owner (C) == C
@@ -0,0 +1,51 @@
+# hivex Python bindings
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+import os
+import hivex
+
+srcdir = os.environ["srcdir"]
+if not srcdir:
+    srcdir = "."
+
+h1 = hivex.Hivex ("%s/../images/minimal" % srcdir,
+                  write = True)
+assert h1
+h2 = hivex.Hivex ("%s/../images/minimal" % srcdir,
+                  write = True)
+assert h2
+
+root_hash = h1.node_hash (h1.root ())
+assert len (hash) == 64
+assert root_hash == h2.node_hash (h2.root ())
+
+# The same subtree added to both copies, subkeys in a different order.
+for h, names in ((h1, ["A", "B"]), (h2, ["B", "A"])):
+    for name in names:
+        node = h.node_add_child (h.root (), name)
+        h.node_set_value (node, { "key": "v", "t": 3,
+                                  "value": ("value of " + name).encode () })
+assert h1.node_hash (h1.root ()) == h2.node_hash (h2.root ())
+assert h1.node_hash (h1.root ()) != root_hash
+
+# A change to one value changes the hash of the root but not the
+# hash of the other subkey.
+h2.node_set_value (h2.node_get_child (h2.root (), "B"),
+                   { "key": "v", "t": 3, "value": b"changed" })
+assert h1.node_hash (h1.root ()) != h2.node_hash (h2.root ())
+assert h1.node_hash (h1.node_get_child (h1.root (), "A")) == \
+    h2.node_hash (h2.node_get_child (h2.root (), "A"))
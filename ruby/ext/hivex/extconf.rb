@@ -29,5 +29,9 @@ unless have_library("hivex", "hivex_open", "hivex.h")
   raise "hivex library not found"
 end
 
+# Used to release the GVL during long-running hivex calls (Ruby >= 2.0).
+have_header("ruby/thread.h")
+have_func("rb_thread_call_without_gvl", "ruby/thread.h")
+
 create_header
 create_makefile(extension_name)
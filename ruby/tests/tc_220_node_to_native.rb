@@ -0,0 +1,56 @@
+# hivex Ruby bindings -*- ruby -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+require File::join(File::dirname(__FILE__), 'test_helper')
+
+class TestNodeToNative < MiniTest::Unit::TestCase
+  def test_node_to_native
+    h = Hivex::open("../images/minimal", {:write => 1})
+    refute_nil (h)
+
+    root = h.root()
+    h.node_add_child(root, "A")
+    h.node_add_child(root, "B")
+    b = h.node_get_child(root, "B")
+    h.node_add_child(b, "C")
+
+    values = [
+              { :key => "Dword", :type => 4, :value => [42].pack("V") },
+              { :key => "Bin", :type => 3, :value => "\x01\x02\x03" }
+             ]
+    h.node_set_values(b, values)
+
+    tree = h.node_to_native(root)
+    assert_equal(2, tree[:children].length)
+    tb = tree[:children].find { |c| c[:name] == "B" }
+    refute_nil (tb)
+    assert_equal(["C"], tb[:children].map { |c| c[:name] })
+
+    vals = Hash[tb[:values].map { |v| [v[:key], v] }]
+    assert_equal(42, vals["Dword"][:value])
+    assert_equal("\x01\x02\x03", vals["Bin"][:value])
+
+    # Without decoding, values are returned as raw bytes.
+    tree = h.node_to_native(b, -1, false)
+    vals = Hash[tree[:values].map { |v| [v[:key], v] }]
+    assert_equal([42].pack("V"), vals["Dword"][:value])
+
+    # Depth limits the levels of children returned.
+    tree = h.node_to_native(root, 0)
+    assert (!tree.has_key?(:children))
+  end
+end
@@ -0,0 +1,43 @@
+# hivex Ruby bindings -*- ruby -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+require File::join(File::dirname(__FILE__), 'test_helper')
+
+class TestBatch < MiniTest::Unit::TestCase
+  def test_batch
+    h = Hivex::open("../images/minimal", {:write => 1})
+    refute_nil (h)
+
+    root = h.root()
+    h.node_add_child(root, "A")
+    b = h.node_add_child(root, "B")
+
+    children = h.node_children_named(root)
+    assert_equal(["A", "B"], children.map { |c| c[:name] })
+    assert_equal(b, children[1][:node])
+    assert_equal([], h.node_children_named(b))
+
+    values = [
+              { :key => "Key1", :type => 3, :value => "ABC" },
+              { :key => "Key2", :type => 2, :value => "DEF" }
+             ]
+    h.node_set_values(b, values)
+
+    assert_equal(values, h.node_values_full(b))
+    assert_equal([], h.node_values_full(root))
+  end
+end
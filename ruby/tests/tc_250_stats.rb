@@ -0,0 +1,38 @@
+# hivex Ruby bindings -*- ruby -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+require File::join(File::dirname(__FILE__), 'test_helper')
+
+class TestStats < MiniTest::Unit::TestCase
+  def test_stats
+    h = Hivex::open("../images/minimal", {:write => 1})
+    refute_nil (h)
+
+    stats = h.get_stats()
+    assert(stats[:pages] >= 1)
+    assert(stats[:blocks] >= stats[:used_blocks])
+    assert_equal(0, stats[:allocate_block_calls])
+
+    root = h.root()
+    h.node_add_child(root, "A")
+    h.node_children(root)
+
+    stats2 = h.get_stats()
+    assert(stats2[:allocate_block_calls] > 0)
+    assert(stats2[:children_lists] > stats[:children_lists])
+  end
+end
@@ -0,0 +1,46 @@
+# hivex Ruby bindings -*- ruby -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+require File::join(File::dirname(__FILE__), 'test_helper')
+
+class TestPathIndex < MiniTest::Unit::TestCase
+  def test_path_index
+    h = Hivex::open("../images/minimal", {:write => 1})
+    refute_nil (h)
+
+    root = h.root()
+    a = h.node_add_child(root, "A")
+    b = h.node_add_child(a, "B")
+    h.node_set_value(b, { :key => "v", :type => 3, :value => "hello, world" })
+    v = h.node_values(b)[0]
+
+    # Without the index.
+    assert_equal("\\", h.node_path(root))
+    assert_equal("\\A\\B", h.node_path(b))
+
+    h.build_path_index()
+    assert_equal("\\A", h.node_path(a))
+    assert_equal("\\A\\B", h.node_path(b))
+    assert_equal(b, h.cell_owner(b))
+    assert_equal(b, h.cell_owner(v))
+
+    # Modifying the hive discards the index, and it is rebuilt.
+    c = h.node_add_child(b, "C")
+    assert_equal("\\A\\B\\C", h.node_path(c))
+    assert_equal(c, h.cell_owner(c))
+  end
+end
@@ -0,0 +1,39 @@
+# hivex Ruby bindings -*- ruby -*-
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+require File::join(File::dirname(__FILE__), 'test_helper')
+
+class TestThreads < MiniTest::Unit::TestCase
+  def count_nodes(h, node)
+    h.node_children(node).inject(1) { |n, child| n + count_nodes(h, child) }
+  end
+
+  def walk_large
+    h = Hivex::open("../images/large", {})
+    n = count_nodes(h, h.root())
+    h.close()
+    n
+  end
+
+  # Separate handles may be used from several threads at once, since
+  # the long-running calls release the GVL.
+  def test_threads
+    expected = walk_large()
+    threads = (1..4).map { Thread.new { walk_large() } }
+    threads.each { |t| assert_equal(expected, t.value) }
+  end
+end
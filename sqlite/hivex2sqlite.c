@@ -0,0 +1,368 @@
+/* hivex2sqlite - Load a Windows Registry "hive" file into SQLite.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <locale.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBINTL_H
+#include <libintl.h>
+#endif
+
+#include <getopt.h>
+
+#include <sqlite3.h>
+
+#include "hivex.h"
+#include "byte_conversions.h"
+
+#ifdef HAVE_GETTEXT
+#include "gettext.h"
+#define _(str) dgettext(PACKAGE, (str))
+//#define N_(str) dgettext(PACKAGE, (str))
+#else
+#define _(str) str
+//#define N_(str) str
+#endif
+
+/* The tables are created without indexes, so that inserting is fast,
+ * and the indexes are created after all the rows are loaded.  Keys
+ * are identified by their offsets in the hive.  Values are not,
+ * because several keys can share one value record, so key_values has
+ * its own row id and the offset is stored beside it.
+ */
+static const char create_tables[] =
+  "CREATE TABLE keys ("
+  " id INTEGER PRIMARY KEY,"
+  " name TEXT NOT NULL,"
+  " last_write INTEGER);"
+  "CREATE TABLE subkeys ("
+  " parent INTEGER NOT NULL,"
+  " child INTEGER NOT NULL);"
+  "CREATE TABLE key_values ("
+  " id INTEGER PRIMARY KEY,"
+  " offset INTEGER NOT NULL,"
+  " key INTEGER NOT NULL,"
+  " name TEXT NOT NULL,"
+  " type INTEGER NOT NULL,"
+  " data BLOB,"
+  " string TEXT,"
+  " number INTEGER);";
+
+static const char create_indexes[] =
+  "CREATE INDEX subkeys_parent ON subkeys (parent);"
+  "CREATE INDEX subkeys_child ON subkeys (child);"
+  "CREATE INDEX key_values_key ON key_values (key);"
+  "CREATE INDEX key_values_offset ON key_values (offset);";
+
+struct load {
+  hive_h *h;
+  sqlite3 *db;
+  const char *dbfile;
+  int visit_flags;
+  sqlite3_stmt *insert_key;
+  sqlite3_stmt *insert_subkey;
+  sqlite3_stmt *insert_value;
+  size_t batch;                 /* Rows per transaction. */
+  size_t rows;                  /* Rows in the current transaction. */
+  int remove_on_error;          /* Delete dbfile if the load fails. */
+};
+
+static int node_start (hive_h *, void *, hive_node_h, const char *name);
+
+static struct hivex_visitor visitor = {
+  .node_start = node_start,
+};
+
+/* A partly loaded database is no use to anyone, so remove it. */
+static void
+load_failed (struct load *load)
+{
+  if (load->remove_on_error)
+    unlink (load->dbfile);
+  exit (EXIT_FAILURE);
+}
+
+static void
+sqlite_error (struct load *load)
+{
+  fprintf (stderr, "hivex2sqlite: %s: %s\n",
+           load->dbfile, sqlite3_errmsg (load->db));
+  load_failed (load);
+}
+
+static void
+exec (struct load *load, const char *sql)
+{
+  if (sqlite3_exec (load->db, sql, NULL, NULL, NULL) != SQLITE_OK)
+    sqlite_error (load);
+}
+
+static sqlite3_stmt *
+prepare (struct load *load, const char *sql)
+{
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2 (load->db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    sqlite_error (load);
+  return stmt;
+}
+
+static void
+step (struct load *load, sqlite3_stmt *stmt)
+{
+  if (sqlite3_step (stmt) != SQLITE_DONE)
+    sqlite_error (load);
+  sqlite3_reset (stmt);
+  sqlite3_clear_bindings (stmt);
+
+  if (++load->rows >= load->batch) {
+    exec (load, "COMMIT; BEGIN");
+    load->rows = 0;
+  }
+}
+
+static void
+usage (void)
+{
+  fprintf (stderr, _("hivex2sqlite [-dk] [-b rows] hivefile database\n"));
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+#ifdef HAVE_BINDTEXTDOMAIN
+  bindtextdomain (PACKAGE, LOCALEBASEDIR);
+  textdomain (PACKAGE);
+#endif
+
+  int c;
+  int open_flags = 0;
+  struct load load = { .batch = 100000 };
+  struct stat statbuf;
+
+  while ((c = getopt (argc, argv, "b:dk")) != EOF) {
+    switch (c) {
+    case 'b': {
+      long n = atol (optarg);
+      if (n < 1) {
+        fprintf (stderr, _("hivex2sqlite: -b must be at least 1\n"));
+        usage ();
+      }
+      load.batch = n;
+      break;
+    }
+    case 'd':
+      open_flags |= HIVEX_OPEN_DEBUG;
+      break;
+    case 'k':
+      load.visit_flags |= HIVEX_VISIT_SKIP_BAD;
+      break;
+    default:
+      usage ();
+    }
+  }
+
+  if (optind + 2 != argc) {
+    fprintf (stderr, _("hivex2sqlite: expecting a hive file and a database\n"));
+    usage ();
+  }
+  load.dbfile = argv[optind+1];
+
+  load.h = hivex_open (argv[optind], open_flags);
+  if (load.h == NULL) {
+    fprintf (stderr, "hivex_open: %s: %m\n", argv[optind]);
+    exit (EXIT_FAILURE);
+  }
+
+  /* Only remove the database on failure if it is created here (or
+   * was an empty file), never one which already held data.
+   */
+  if (stat (load.dbfile, &statbuf) == -1)
+    load.remove_on_error = errno == ENOENT;
+  else
+    load.remove_on_error = statbuf.st_size == 0;
+
+  if (sqlite3_open (load.dbfile, &load.db) != SQLITE_OK)
+    sqlite_error (&load);
+
+  /* A database left by a crash part way through would be incomplete
+   * anyway, so there is no need for the journal.
+   */
+  exec (&load, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF");
+  exec (&load, create_tables);
+
+  load.insert_key =
+    prepare (&load, "INSERT INTO keys VALUES (?, ?, ?)");
+  load.insert_subkey =
+    prepare (&load, "INSERT INTO subkeys VALUES (?, ?)");
+  load.insert_value =
+    prepare (&load, "INSERT INTO key_values"
+             " (offset, key, name, type, data, string, number)"
+             " VALUES (?, ?, ?, ?, ?, ?, ?)");
+
+  exec (&load, "BEGIN");
+  if (hivex_visit (load.h, &visitor, sizeof visitor, &load,
+                   load.visit_flags) == -1) {
+    fprintf (stderr, "hivex2sqlite: %s: %m\n", argv[optind]);
+    load_failed (&load);
+  }
+  exec (&load, "COMMIT");
+
+  sqlite3_finalize (load.insert_key);
+  sqlite3_finalize (load.insert_subkey);
+  sqlite3_finalize (load.insert_value);
+
+  exec (&load, create_indexes);
+  exec (&load, "ANALYZE");
+
+  if (sqlite3_close (load.db) != SQLITE_OK)
+    sqlite_error (&load);
+
+  if (hivex_close (load.h) == -1) {
+    perror ("hivex_close");
+    exit (EXIT_FAILURE);
+  }
+
+  exit (EXIT_SUCCESS);
+}
+
+static int
+insert_value (struct load *load, hive_node_h node, hive_value_h value)
+{
+  hive_h *h = load->h;
+  sqlite3_stmt *stmt = load->insert_value;
+  char *key, *str;
+  char *copy = NULL;
+  const char *data;
+  hive_type t;
+  size_t len;
+  uint32_t u32;
+  uint64_t u64;
+
+  key = hivex_value_key (h, value);
+  if (key == NULL)
+    return -1;
+
+  /* Most values can be read from the hive without copying them. */
+  data = hivex_value_value_ptr (h, value, &t, &len);
+  if (data == NULL && errno == ENOTSUP)
+    data = copy = hivex_value_value (h, value, &t, &len);
+  if (data == NULL) {
+    free (key);
+    return -1;
+  }
+
+  sqlite3_bind_int64 (stmt, 1, value);
+  sqlite3_bind_int64 (stmt, 2, node);
+  sqlite3_bind_text (stmt, 3, key, -1, free);
+  sqlite3_bind_int (stmt, 4, t);
+  sqlite3_bind_blob (stmt, 5, data, len, SQLITE_STATIC);
+
+  /* Also store strings and numbers in a form that SQL can use. */
+  switch (t) {
+  case hive_t_REG_SZ:
+  case hive_t_REG_EXPAND_SZ:
+  case hive_t_REG_LINK:
+    str = hivex_value_string (h, value);
+    if (str != NULL)
+      sqlite3_bind_text (stmt, 6, str, -1, free);
+    break;
+
+  case hive_t_REG_DWORD:
+    if (len == 4) {
+      memcpy (&u32, data, 4);
+      sqlite3_bind_int64 (stmt, 7, (int32_t) le32toh (u32));
+    }
+    break;
+
+  case hive_t_REG_DWORD_BIG_ENDIAN:
+    if (len == 4) {
+      memcpy (&u32, data, 4);
+      sqlite3_bind_int64 (stmt, 7, (int32_t) be32toh (u32));
+    }
+    break;
+
+  case hive_t_REG_QWORD:
+    if (len == 8) {
+      memcpy (&u64, data, 8);
+      sqlite3_bind_int64 (stmt, 7, (int64_t) le64toh (u64));
+    }
+    break;
+
+  default: ;
+  }
+
+  step (load, stmt);
+  free (copy);
+  return 0;
+}
+
+/* Each key adds a row for itself, a row for each of its subkeys and
+ * a row for each of its values.  hivex_visit then visits the subkeys.
+ */
+static int
+node_start (hive_h *h, void *opaque, hive_node_h node, const char *name)
+{
+  struct load *load = opaque;
+  int skip_bad = load->visit_flags & HIVEX_VISIT_SKIP_BAD;
+  hive_node_h *children;
+  hive_value_h *values;
+  int64_t timestamp;
+  size_t i;
+
+  sqlite3_bind_int64 (load->insert_key, 1, node);
+  sqlite3_bind_text (load->insert_key, 2, name, -1, SQLITE_STATIC);
+  errno = 0;
+  timestamp = hivex_node_timestamp (h, node);
+  if (timestamp != -1 || errno == 0)
+    sqlite3_bind_int64 (load->insert_key, 3, timestamp);
+  step (load, load->insert_key);
+
+  children = hivex_node_children (h, node);
+  if (children == NULL)
+    return skip_bad ? 0 : -1;
+  for (i = 0; children[i] != 0; ++i) {
+    sqlite3_bind_int64 (load->insert_subkey, 1, node);
+    sqlite3_bind_int64 (load->insert_subkey, 2, children[i]);
+    step (load, load->insert_subkey);
+  }
+  free (children);
+
+  values = hivex_node_values (h, node);
+  if (values == NULL)
+    return skip_bad ? 0 : -1;
+  for (i = 0; values[i] != 0; ++i) {
+    if (insert_value (load, node, values[i]) == -1 && !skip_bad) {
+      free (values);
+      return -1;
+    }
+  }
+  free (values);
+
+  return 0;
+}
@@ -0,0 +1,252 @@
+/* hivextimeline - List the keys of Windows Registry "hive" files by time.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <locale.h>
+
+#ifdef HAVE_FORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_LIBINTL_H
+#include <libintl.h>
+#endif
+
+#include <getopt.h>
+
+#include "hivex.h"
+#include "timeline-common.h"
+
+#ifdef HAVE_GETTEXT
+#include "gettext.h"
+#define _(str) dgettext(PACKAGE, (str))
+//#define N_(str) dgettext(PACKAGE, (str))
+#else
+#define _(str) str
+//#define N_(str) str
+#endif
+
+#define STREQ(a,b) (strcmp((a),(b)) == 0)
+
+static enum timeline_format format = TIMELINE_BODYFILE;
+static const char *prefix = "";
+static int open_flags = 0;
+
+static int timeline (const char *filename, int nr_hives, FILE *fp);
+
+static void
+usage (int status)
+{
+  fprintf (stderr, _("hivextimeline [-d] [-f body|tsv] [-j jobs] [-p prefix] hivefile [hivefile ...]\n"));
+  exit (status);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+#ifdef HAVE_BINDTEXTDOMAIN
+  bindtextdomain (PACKAGE, LOCALEBASEDIR);
+  textdomain (PACKAGE);
+#endif
+
+  int c, i, nr_hives;
+  int jobs = 1;
+  int status = EXIT_SUCCESS;
+
+  while ((c = getopt (argc, argv, "df:j:p:")) != EOF) {
+    switch (c) {
+    case 'd':
+      open_flags |= HIVEX_OPEN_DEBUG;
+      break;
+    case 'f':
+      if (STREQ (optarg, "body"))
+        format = TIMELINE_BODYFILE;
+      else if (STREQ (optarg, "tsv"))
+        format = TIMELINE_TSV;
+      else {
+        fprintf (stderr, _("hivextimeline: unknown format: %s\n"), optarg);
+        usage (EXIT_FAILURE);
+      }
+      break;
+    case 'j':
+      jobs = atoi (optarg);
+      if (jobs < 1) {
+        fprintf (stderr, _("hivextimeline: -j must be at least 1\n"));
+        usage (EXIT_FAILURE);
+      }
+      break;
+    case 'p':
+      prefix = optarg;
+      break;
+    default:
+      usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf (stderr, _("hivextimeline: expecting the names of hive files\n"));
+    usage (EXIT_FAILURE);
+  }
+  nr_hives = argc - optind;
+
+  /* As in hivexregedit, the prefix is given without a final backslash. */
+  if (*prefix && prefix[strlen (prefix) - 1] == '\\') {
+    char *p = strdup (prefix);
+    if (p == NULL) {
+      perror ("strdup");
+      exit (EXIT_FAILURE);
+    }
+    p[strlen (p) - 1] = '\0';
+    prefix = p;
+  }
+
+  timeline_print_header (stdout, format);
+
+  if (jobs == 1 || nr_hives == 1) {
+    for (i = optind; i < argc; ++i)
+      if (timeline (argv[i], nr_hives, stdout) == -1)
+        status = EXIT_FAILURE;
+  }
+  else {
+#ifdef HAVE_FORK
+    /* Each hive is processed by a child process, which writes to a
+     * temporary file.  Up to 'jobs' children run at once, and the
+     * output of each is copied to stdout in the order the hives were
+     * given, so the output is the same as without -j.
+     */
+    pid_t *pids = calloc (nr_hives, sizeof (pid_t));
+    FILE **files = calloc (nr_hives, sizeof (FILE *));
+    int next = 0, running = 0;
+
+    if (pids == NULL || files == NULL) {
+      perror ("calloc");
+      exit (EXIT_FAILURE);
+    }
+    fflush (stdout);
+
+    for (i = 0; i < nr_hives; ++i) {
+      char buf[BUFSIZ];
+      size_t n;
+      int wstatus;
+
+      while (next < nr_hives && running < jobs) {
+        files[next] = tmpfile ();
+        if (files[next] == NULL) {
+          perror ("tmpfile");
+          exit (EXIT_FAILURE);
+        }
+        pids[next] = fork ();
+        if (pids[next] == -1) {
+          perror ("fork");
+          exit (EXIT_FAILURE);
+        }
+        if (pids[next] == 0) {
+          int r = timeline (argv[optind+next], nr_hives, files[next]);
+          if (fflush (files[next]) == EOF) {
+            perror ("hivextimeline: temporary file");
+            r = -1;
+          }
+          _exit (r == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+        next++;
+        running++;
+      }
+
+      if (waitpid (pids[i], &wstatus, 0) == -1) {
+        perror ("waitpid");
+        exit (EXIT_FAILURE);
+      }
+      running--;
+      if (!WIFEXITED (wstatus) || WEXITSTATUS (wstatus) != 0)
+        status = EXIT_FAILURE;
+
+      rewind (files[i]);
+      while ((n = fread (buf, 1, sizeof buf, files[i])) > 0)
+        fwrite (buf, 1, n, stdout);
+      fclose (files[i]);
+    }
+
+    free (pids);
+    free (files);
+#else
+    fprintf (stderr, _("hivextimeline: -j is not supported on this platform\n"));
+    exit (EXIT_FAILURE);
+#endif
+  }
+
+  if (fflush (stdout) == EOF) {
+    perror ("stdout");
+    exit (EXIT_FAILURE);
+  }
+
+  exit (status);
+}
+
+/* Print every key in a hive, oldest first.  The timestamp index gives
+ * the keys in order, and the path index makes each path cheap.
+ */
+static int
+timeline (const char *filename, int nr_hives, FILE *fp)
+{
+  hive_h *h;
+  hive_node_h *nodes;
+  size_t i;
+  int r = 0;
+
+  h = hivex_open (filename, open_flags);
+  if (h == NULL) {
+    fprintf (stderr, "hivex_open: %s: %m\n", filename);
+    return -1;
+  }
+
+  if (hivex_build_path_index (h, 0) == -1) {
+    fprintf (stderr, "hivextimeline: %s: %m\n", filename);
+    hivex_close (h);
+    return -1;
+  }
+  nodes = hivex_nodes_modified_between (h, INT64_MIN, INT64_MAX);
+  if (nodes == NULL) {
+    fprintf (stderr, "hivextimeline: %s: %m\n", filename);
+    hivex_close (h);
+    return -1;
+  }
+
+  for (i = 0; nodes[i] != 0; ++i) {
+    if (timeline_print_key (fp, format, h, nodes[i],
+                            nr_hives > 1 ? filename : NULL, prefix) == -1) {
+      /* Carry on with the other keys. */
+      fprintf (stderr, "hivextimeline: %s: key at 0x%zx: %m\n",
+               filename, nodes[i]);
+      r = -1;
+    }
+  }
+
+  free (nodes);
+  hivex_close (h);
+  return r;
+}
@@ -0,0 +1,135 @@
+/* hivex - helpers shared by hivextimeline and hivex-batch.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+
+#include "hivex.h"
+#include "timeline-common.h"
+
+#define STREQ(a,b) (strcmp((a),(b)) == 0)
+
+#define WINDOWS_TICK 10000000LL
+#define SEC_TO_UNIX_EPOCH 11644473600LL
+
+void
+timeline_print_header (FILE *fp, enum timeline_format format)
+{
+  if (format == TIMELINE_TSV)
+    fprintf (fp, "path\tlast_write\tvalues\toffset\n");
+}
+
+/* Print a key name, escaping characters which would break the line
+ * into fields.  '%' is escaped too, so the escaping can be undone.
+ */
+static void
+print_escaped (FILE *fp, enum timeline_format format, const char *str)
+{
+  const unsigned char *p;
+  unsigned char sep = format == TIMELINE_BODYFILE ? '|' : '\t';
+
+  for (p = (const unsigned char *) str; *p; ++p) {
+    if (*p < 0x20 || *p == 0x7f || *p == '%' || *p == sep)
+      fprintf (fp, "%%%02X", *p);
+    else
+      putc (*p, fp);
+  }
+}
+
+static void
+print_path (FILE *fp, enum timeline_format format,
+            const char *filename, const char *prefix, const char *path)
+{
+  if (filename) {
+    print_escaped (fp, format, filename);
+    putc (':', fp);
+  }
+  print_escaped (fp, format, prefix);
+  /* The root is "\" on its own. */
+  if (!*prefix || !STREQ (path, "\\"))
+    print_escaped (fp, format, path);
+}
+
+int
+timeline_print_key (FILE *fp, enum timeline_format format,
+                    hive_h *h, hive_node_h node,
+                    const char *filename, const char *prefix)
+{
+  char *path;
+  int64_t timestamp;
+  hive_value_h *values;
+  size_t nr_values;
+
+  path = hivex_node_path (h, node);
+  if (path == NULL)
+    return -1;
+  errno = 0;
+  timestamp = hivex_node_timestamp (h, node);
+  if (timestamp == -1 && errno != 0) {
+    free (path);
+    return -1;
+  }
+  /* This reads the list of values but doesn't decode them. */
+  values = hivex_node_values (h, node);
+  if (values == NULL) {
+    free (path);
+    return -1;
+  }
+  for (nr_values = 0; values[nr_values] != 0; ++nr_values)
+    ;
+  free (values);
+
+  switch (format) {
+  case TIMELINE_BODYFILE: {
+    /* MD5|name|inode|mode|UID|GID|size|atime|mtime|ctime|crtime */
+    int64_t t = timestamp > 0 ? timestamp / WINDOWS_TICK - SEC_TO_UNIX_EPOCH : 0;
+
+    fprintf (fp, "0|");
+    print_path (fp, format, filename, prefix, path);
+    fprintf (fp, "|%zu|0|0|0|%zu|0|%" PRIi64 "|0|0\n", node, nr_values, t);
+    break;
+  }
+
+  case TIMELINE_TSV: {
+    char timebuf[32] = "";
+    time_t t;
+    struct tm *tm;
+
+    if (timestamp > 0) {
+      t = timestamp / WINDOWS_TICK - SEC_TO_UNIX_EPOCH;
+      tm = gmtime (&t);
+      if (tm == NULL || strftime (timebuf, sizeof timebuf, "%FT%TZ", tm) == 0)
+        timebuf[0] = '\0';
+    }
+
+    print_path (fp, format, filename, prefix, path);
+    fprintf (fp, "\t%s\t%zu\t0x%zx\n", timebuf, nr_values, node);
+    break;
+  }
+  }
+
+  free (path);
+  return 0;
+}
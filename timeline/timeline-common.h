@@ -0,0 +1,40 @@
+/* hivex - helpers shared by hivextimeline and hivex-batch.
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TIMELINE_COMMON_H_
+#define TIMELINE_COMMON_H_
+
+#include <stdio.h>
+
+#include "hivex.h"
+
+enum timeline_format { TIMELINE_BODYFILE, TIMELINE_TSV };
+
+/* Print the header line of the format, if it has one. */
+extern void timeline_print_header (FILE *fp, enum timeline_format format);
+
+/* Print the line for one key.  The path of the key is printed after
+ * "filename:" (if filename is not NULL) and prefix.  Returns -1 with
+ * errno set if the key cannot be read, in which case nothing is
+ * printed.
+ */
+extern int timeline_print_key (FILE *fp, enum timeline_format format,
+                               hive_h *h, hive_node_h node,
+                               const char *filename, const char *prefix);
+
+#endif /* TIMELINE_COMMON_H_ */